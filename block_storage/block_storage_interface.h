@@ -27,12 +27,35 @@ namespace HayaguiKvs
             }
             return WriteInternal(address, buffer);
         }
-        Status ReadBlocks(const LogicalBlockRegion region, BlockBuffers<BlockBuffer> &buffers)
+        // reads the blocks of region into buffers from first_index
+        Status ReadBlocks(const LogicalBlockRegion region, BlockBuffers<BlockBuffer> &buffers, const int first_index = 0)
+        {
+            if (!IsValidRegion(region, buffers, first_index))
+            {
+                return Status::CreateErrorStatus();
+            }
+            return ReadBlocksInternal(region, buffers, first_index);
+        }
+        Status WriteBlocks(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers, const int first_index = 0)
+        {
+            if (!IsValidRegion(region, buffers, first_index))
+            {
+                return Status::CreateErrorStatus();
+            }
+            return WriteBlocksInternal(region, buffers, first_index);
+        }
+        virtual LogicalBlockAddress GetMaxAddress() const = 0;
+
+    protected:
+        virtual Status ReadInternal(const LogicalBlockAddress address, BlockBuffer &buffer) = 0;
+        virtual Status WriteInternal(const LogicalBlockAddress address, const BlockBuffer &buffer) = 0;
+        // backends which can transfer a region at once override these
+        virtual Status ReadBlocksInternal(const LogicalBlockRegion region, BlockBuffers<BlockBuffer> &buffers, const int first_index)
         {
             LogicalBlockAddress address = region.GetStart();
-            for (int i = 0; address.Cmp(region.GetEnd()).IsLowerOrEqual(); i++)
+            for (int i = first_index; address.Cmp(region.GetEnd()).IsLowerOrEqual(); i++)
             {
-                if (!IsValidAddress(address) || ReadInternal(address, *buffers.GetBlockBufferFromIndex(i)).IsError())
+                if (ReadInternal(address, *buffers.GetBlockBufferFromIndex(i)).IsError())
                 {
                     return Status::CreateErrorStatus();
                 }
@@ -40,12 +63,12 @@ namespace HayaguiKvs
             }
             return Status::CreateOkStatus();
         }
-        Status WriteBlocks(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers)
+        virtual Status WriteBlocksInternal(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers, const int first_index)
         {
             LogicalBlockAddress address = region.GetStart();
-            for (int i = 0; address.Cmp(region.GetEnd()).IsLowerOrEqual(); i++)
+            for (int i = first_index; address.Cmp(region.GetEnd()).IsLowerOrEqual(); i++)
             {
-                if (!IsValidAddress(address) || WriteInternal(address, *buffers.GetConstBlockBufferFromIndex(i)).IsError())
+                if (WriteInternal(address, *buffers.GetConstBlockBufferFromIndex(i)).IsError())
                 {
                     return Status::CreateErrorStatus();
                 }
@@ -53,15 +76,15 @@ namespace HayaguiKvs
             }
             return Status::CreateOkStatus();
         }
-        virtual LogicalBlockAddress GetMaxAddress() const = 0;
-
-    protected:
-        virtual Status ReadInternal(const LogicalBlockAddress address, BlockBuffer &buffer) = 0;
-        virtual Status WriteInternal(const LogicalBlockAddress address, const BlockBuffer &buffer) = 0;
         bool IsValidAddress(const LogicalBlockAddress address) const
         {
             return (GetMaxAddress().Cmp(address).IsGreaterOrEqual()) && (LogicalBlockAddress(0).Cmp(address).IsLowerOrEqual());
         }
+        bool IsValidRegion(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers, const int first_index) const
+        {
+            return IsValidAddress(region.GetStart()) && IsValidAddress(region.GetEnd()) &&
+                   first_index >= 0 && first_index + region.GetRegionSize() <= (size_t)buffers.GetCnt();
+        }
 
     private:
         typedef char correct_type;
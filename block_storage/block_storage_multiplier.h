@@ -75,12 +75,24 @@ namespace HayaguiKvs
             {
                 return blockstorage_.Write(region_.GetStart() + address, buffer);
             }
+            virtual Status ReadBlocksInternal(const LogicalBlockRegion region, BlockBuffers<BlockBuffer> &buffers, const int first_index) override
+            {
+                return blockstorage_.ReadBlocks(Translate(region), buffers, first_index);
+            }
+            virtual Status WriteBlocksInternal(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers, const int first_index) override
+            {
+                return blockstorage_.WriteBlocks(Translate(region), buffers, first_index);
+            }
             virtual LogicalBlockAddress GetMaxAddress() const override
             {
                 return LogicalBlockAddress(region_.GetRegionSize() - 1);
             }
 
         private:
+            LogicalBlockRegion Translate(const LogicalBlockRegion region) const
+            {
+                return LogicalBlockRegion(region_.GetStart() + region.GetStart(), region_.GetStart() + region.GetEnd());
+            }
             BlockStorageInterface<BlockBuffer> &blockstorage_;
             const LogicalBlockRegion region_;
         };
@@ -1,5 +1,7 @@
 #pragma once
-#include "block_storage_with_cache.h"
+#include "block_storage_interface.h"
+#include "utils/allocator.h"
+#include <stdlib.h>
 
 namespace HayaguiKvs
 {
@@ -50,6 +52,12 @@ namespace HayaguiKvs
             {
                 return available_ && address_.Cmp(address).IsEqual();
             }
+            // the position of the address in region
+            bool GetIndexIn(const LogicalBlockRegion region, int &index) const
+            {
+                index = address_ - region.GetStart();
+                return available_ && address_.Cmp(region.GetStart()).IsGreaterOrEqual() && address_.Cmp(region.GetEnd()).IsLowerOrEqual();
+            }
 
         private:
             LogicalBlockAddress address_ = LogicalBlockAddress(0);
@@ -101,7 +109,224 @@ namespace HayaguiKvs
             }
             return underlying_blockstorage_.Write(address, buffer);
         }
+        // the cached block is not read from the underlying storage, and the rest of the region is read at once
+        virtual Status ReadBlocksInternal(const LogicalBlockRegion region, BlockBuffers<BlockBuffer> &buffers, const int first_index) override
+        {
+            int cached_index;
+            if (!cache_target_address_.GetIndexIn(region, cached_index))
+            {
+                return underlying_blockstorage_.ReadBlocks(region, buffers, first_index);
+            }
+            const LogicalBlockAddress cached_address = region.GetStart() + LogicalBlockAddress(cached_index);
+            if (cached_index != 0 &&
+                underlying_blockstorage_.ReadBlocks(LogicalBlockRegion(region.GetStart(), LogicalBlockAddress(cached_address.GetRaw() - 1)), buffers, first_index).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (ReadInternal(cached_address, *buffers.GetBlockBufferFromIndex(first_index + cached_index)).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (cached_address.Cmp(region.GetEnd()).IsLower() &&
+                underlying_blockstorage_.ReadBlocks(LogicalBlockRegion(cached_address + LogicalBlockAddress(1), region.GetEnd()), buffers, first_index + cached_index + 1).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Status::CreateOkStatus();
+        }
+        virtual Status WriteBlocksInternal(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers, const int first_index) override
+        {
+            int cached_index;
+            if (cache_target_address_.GetIndexIn(region, cached_index))
+            {
+                cache_.CopyFrom(*buffers.GetConstBlockBufferFromIndex(first_index + cached_index), region.GetStart() + LogicalBlockAddress(cached_index));
+            }
+            return underlying_blockstorage_.WriteBlocks(region, buffers, first_index);
+        }
         CachedAddress cache_target_address_;
         BlockStorageInterface<BlockBuffer> &underlying_blockstorage_;
     };
-}
\ No newline at end of file
+
+    // Keeps a bounded number of recently used blocks.
+    // Writes go through to the underlying storage, so that cached blocks are never dirty.
+    template <class BlockBuffer>
+    class BlockStorageWithLruCache : public BlockStorageInterface<BlockBuffer>
+    {
+    public:
+        BlockStorageWithLruCache() = delete;
+        BlockStorageWithLruCache(BlockStorageInterface<BlockBuffer> &underlying_blockstorage, const int cache_cnt)
+            : underlying_blockstorage_(underlying_blockstorage),
+              cache_cnt_(cache_cnt),
+              bucket_cnt_(GetBucketCnt(cache_cnt)),
+              buffers_(cache_cnt),
+              entries_(reinterpret_cast<Entry *>(MemAllocator::alloc(sizeof(Entry) * cache_cnt))),
+              buckets_(reinterpret_cast<int *>(MemAllocator::alloc(sizeof(int) * bucket_cnt_)))
+        {
+            assert(cache_cnt > 0);
+            for (int i = 0; i < bucket_cnt_; i++)
+            {
+                buckets_[i] = kInvalidIndex;
+            }
+            // all entries are empty and linked in the LRU list
+            for (int i = 0; i < cache_cnt_; i++)
+            {
+                entries_[i].address_ = kInvalidIndex;
+                entries_[i].hash_next_ = kInvalidIndex;
+                entries_[i].prev_ = i - 1;
+                entries_[i].next_ = i + 1 < cache_cnt_ ? i + 1 : kInvalidIndex;
+            }
+            head_ = 0;
+            tail_ = cache_cnt_ - 1;
+        }
+        BlockStorageWithLruCache(const BlockStorageWithLruCache &obj) = delete;
+        BlockStorageWithLruCache &operator=(const BlockStorageWithLruCache &obj) = delete;
+        virtual ~BlockStorageWithLruCache()
+        {
+            MemAllocator::free(reinterpret_cast<char *>(entries_));
+            MemAllocator::free(reinterpret_cast<char *>(buckets_));
+        }
+        virtual Status Open() override
+        {
+            return underlying_blockstorage_.Open();
+        }
+        virtual LogicalBlockAddress GetMaxAddress() const override
+        {
+            return underlying_blockstorage_.GetMaxAddress();
+        }
+
+    private:
+        struct Entry
+        {
+            int address_; // kInvalidIndex if the entry is empty
+            int hash_next_;
+            int prev_;
+            int next_;
+        };
+        virtual Status ReadInternal(const LogicalBlockAddress address, BlockBuffer &buffer) override
+        {
+            const int index = Lookup(address.GetRaw());
+            if (index != kInvalidIndex)
+            {
+                buffer.CopyFrom(*buffers_.GetConstBlockBufferFromIndex(index));
+                MoveToHead(index);
+                return Status::CreateOkStatus();
+            }
+            if (underlying_blockstorage_.Read(address, buffer).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            Store(tail_, address.GetRaw(), buffer);
+            return Status::CreateOkStatus();
+        }
+        virtual Status WriteInternal(const LogicalBlockAddress address, const BlockBuffer &buffer) override
+        {
+            int index = Lookup(address.GetRaw());
+            if (underlying_blockstorage_.Write(address, buffer).IsError())
+            {
+                // the content of the block is unknown
+                if (index != kInvalidIndex)
+                {
+                    Unassign(index);
+                    MoveToTail(index);
+                }
+                return Status::CreateErrorStatus();
+            }
+            Store(index != kInvalidIndex ? index : tail_, address.GetRaw(), buffer);
+            return Status::CreateOkStatus();
+        }
+        void Store(const int index, const int address, const BlockBuffer &buffer)
+        {
+            if (entries_[index].address_ != address)
+            {
+                Unassign(index);
+                Assign(index, address);
+            }
+            buffers_.GetBlockBufferFromIndex(index)->CopyFrom(buffer);
+            MoveToHead(index);
+        }
+        int Lookup(const int address) const
+        {
+            for (int index = buckets_[GetBucket(address)]; index != kInvalidIndex; index = entries_[index].hash_next_)
+            {
+                if (entries_[index].address_ == address)
+                {
+                    return index;
+                }
+            }
+            return kInvalidIndex;
+        }
+        void Assign(const int index, const int address)
+        {
+            int &head = buckets_[GetBucket(address)];
+            entries_[index].address_ = address;
+            entries_[index].hash_next_ = head;
+            head = index;
+        }
+        void Unassign(const int index)
+        {
+            if (entries_[index].address_ == kInvalidIndex)
+            {
+                return;
+            }
+            int *link = &buckets_[GetBucket(entries_[index].address_)];
+            while (*link != index)
+            {
+                link = &entries_[*link].hash_next_;
+            }
+            *link = entries_[index].hash_next_;
+            entries_[index].address_ = kInvalidIndex;
+        }
+        void Unlink(const int index)
+        {
+            Entry &entry = entries_[index];
+            (entry.prev_ != kInvalidIndex ? entries_[entry.prev_].next_ : head_) = entry.next_;
+            (entry.next_ != kInvalidIndex ? entries_[entry.next_].prev_ : tail_) = entry.prev_;
+        }
+        void MoveToHead(const int index)
+        {
+            if (head_ == index)
+            {
+                return;
+            }
+            Unlink(index);
+            entries_[index].prev_ = kInvalidIndex;
+            entries_[index].next_ = head_;
+            entries_[head_].prev_ = index;
+            head_ = index;
+        }
+        void MoveToTail(const int index)
+        {
+            if (tail_ == index)
+            {
+                return;
+            }
+            Unlink(index);
+            entries_[index].next_ = kInvalidIndex;
+            entries_[index].prev_ = tail_;
+            entries_[tail_].next_ = index;
+            tail_ = index;
+        }
+        int GetBucket(const int address) const
+        {
+            return address & (bucket_cnt_ - 1);
+        }
+        static int GetBucketCnt(const int cache_cnt)
+        {
+            int cnt = 1;
+            while (cnt < cache_cnt * 2)
+            {
+                cnt *= 2;
+            }
+            return cnt;
+        }
+        static const int kInvalidIndex = -1;
+        BlockStorageInterface<BlockBuffer> &underlying_blockstorage_;
+        const int cache_cnt_;
+        const int bucket_cnt_;
+        BlockBuffers<BlockBuffer> buffers_;
+        Entry *const entries_;
+        int *const buckets_;
+        int head_; // most recently used
+        int tail_; // least recently used
+    };
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "block_storage_interface.h"
+#include <mutex>
+
+namespace HayaguiKvs
+{
+    // Serializes accesses to a storage which is not thread-safe (e.g. a storage with a cache).
+    // The underlying storage must not be accessed except through this.
+    template <class BlockBuffer>
+    class BlockStorageWithLock : public BlockStorageInterface<BlockBuffer>
+    {
+    public:
+        BlockStorageWithLock() = delete;
+        BlockStorageWithLock(BlockStorageInterface<BlockBuffer> &underlying_blockstorage) : underlying_blockstorage_(underlying_blockstorage)
+        {
+        }
+        BlockStorageWithLock(const BlockStorageWithLock &obj) = delete;
+        BlockStorageWithLock &operator=(const BlockStorageWithLock &obj) = delete;
+        virtual ~BlockStorageWithLock()
+        {
+        }
+        virtual Status Open() override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return underlying_blockstorage_.Open();
+        }
+        virtual LogicalBlockAddress GetMaxAddress() const override
+        {
+            return underlying_blockstorage_.GetMaxAddress();
+        }
+
+    private:
+        virtual Status ReadInternal(const LogicalBlockAddress address, BlockBuffer &buffer) override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return underlying_blockstorage_.Read(address, buffer);
+        }
+        virtual Status WriteInternal(const LogicalBlockAddress address, const BlockBuffer &buffer) override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return underlying_blockstorage_.Write(address, buffer);
+        }
+        virtual Status ReadBlocksInternal(const LogicalBlockRegion region, BlockBuffers<BlockBuffer> &buffers, const int first_index) override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return underlying_blockstorage_.ReadBlocks(region, buffers, first_index);
+        }
+        virtual Status WriteBlocksInternal(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers, const int first_index) override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return underlying_blockstorage_.WriteBlocks(region, buffers, first_index);
+        }
+        BlockStorageInterface<BlockBuffer> &underlying_blockstorage_;
+        std::mutex mtx_;
+    };
+}
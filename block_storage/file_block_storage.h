@@ -4,8 +4,10 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 namespace HayaguiKvs
 {
@@ -66,6 +68,49 @@ namespace HayaguiKvs
             }
             return Status::CreateOkStatus();
         }
+        // a region is transferred by one syscall per kMaxIovCnt blocks
+        virtual Status ReadBlocksInternal(const LogicalBlockRegion region, BlockBuffers<GenericBlockBuffer> &buffers, const int first_index) override
+        {
+            struct iovec iov[kMaxIovCnt];
+            const int block_cnt = region.GetRegionSize();
+            for (int done = 0; done < block_cnt; done += kMaxIovCnt)
+            {
+                const int cnt = block_cnt - done < kMaxIovCnt ? block_cnt - done : kMaxIovCnt;
+                for (int i = 0; i < cnt; i++)
+                {
+                    iov[i].iov_base = buffers.GetBlockBufferFromIndex(first_index + done + i)->GetPtrToTheBuffer();
+                    iov[i].iov_len = BlockBufferInterface::kSize;
+                }
+                if (preadv(fd_, iov, cnt, GetFileOffset(region.GetStart(), done)) != (ssize_t)(cnt * BlockBufferInterface::kSize))
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        virtual Status WriteBlocksInternal(const LogicalBlockRegion region, const BlockBuffers<GenericBlockBuffer> &buffers, const int first_index) override
+        {
+            struct iovec iov[kMaxIovCnt];
+            const int block_cnt = region.GetRegionSize();
+            for (int done = 0; done < block_cnt; done += kMaxIovCnt)
+            {
+                const int cnt = block_cnt - done < kMaxIovCnt ? block_cnt - done : kMaxIovCnt;
+                for (int i = 0; i < cnt; i++)
+                {
+                    iov[i].iov_base = const_cast<uint8_t *>(buffers.GetConstBlockBufferFromIndex(first_index + done + i)->GetConstPtrToTheBuffer());
+                    iov[i].iov_len = BlockBufferInterface::kSize;
+                }
+                if (pwritev(fd_, iov, cnt, GetFileOffset(region.GetStart(), done)) != (ssize_t)(cnt * BlockBufferInterface::kSize))
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        static off_t GetFileOffset(const LogicalBlockAddress start, const int index)
+        {
+            return (off_t)(start.GetRaw() + index) * BlockBufferInterface::kSize;
+        }
         static char *const CopyFname(const char *const fname)
         {
             char *const buf = (char *)malloc(strlen(fname) + 1);
@@ -73,6 +118,11 @@ namespace HayaguiKvs
             return buf;
         }
         static const int kNumBlocks = 4192;
+#ifdef IOV_MAX
+        static const int kMaxIovCnt = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+        static const int kMaxIovCnt = _XOPEN_IOV_MAX;
+#endif
         char *const fname_;
         int fd_ = -1;
     };
@@ -1,5 +1,6 @@
 #pragma once
 #include "block_storage_interface.h"
+#include "utils/allocator.h"
 #include <stdint.h>
 #include <string.h>
 
@@ -8,20 +9,16 @@ namespace HayaguiKvs
     class MemBlockStorage : public BlockStorageInterface<GenericBlockBuffer>
     {
     public:
-        MemBlockStorage()
+        MemBlockStorage() : blocks_(reinterpret_cast<uint8_t *>(MemAllocator::alloc(kNumBlocks * BlockBufferInterface::kSize)))
         {
-            for (int i = 0; i < kNumBlocks; i++)
-            {
-                block_buf_[i] = new MemInternalBlock;
-            }
+            memset(blocks_, 0, kNumBlocks * BlockBufferInterface::kSize);
         }
         virtual ~MemBlockStorage()
         {
-            for (int i = 0; i < kNumBlocks; i++)
-            {
-                delete block_buf_[i];
-            }
+            MemAllocator::free(reinterpret_cast<char *>(blocks_));
         }
+        MemBlockStorage(const MemBlockStorage &obj) = delete;
+        MemBlockStorage &operator=(const MemBlockStorage &obj) = delete;
         virtual Status Open() override
         {
             return Status::CreateOkStatus();
@@ -32,36 +29,42 @@ namespace HayaguiKvs
         }
 
     private:
-        class MemInternalBlock
-        {
-        public:
-            Status Read(GenericBlockBuffer &buffer) const
-            {
-                buffer.CopyFrom(buf_, 0, BlockBufferInterface::kSize);
-                return Status::CreateOkStatus();
-            }
-            Status Write(const GenericBlockBuffer &buffer)
-            {
-                buffer.CopyTo(buf_, 0, BlockBufferInterface::kSize);
-                return Status::CreateOkStatus();
-            }
-
-        private:
-            uint8_t buf_[BlockBufferInterface::kSize];
-        };
         virtual Status ReadInternal(const LogicalBlockAddress address, GenericBlockBuffer &buffer) override
         {
-            return GetBlockFromAddress(address)->Read(buffer);
+            buffer.CopyFrom(GetBlockFromAddress(address), 0, BlockBufferInterface::kSize);
+            return Status::CreateOkStatus();
         }
         virtual Status WriteInternal(const LogicalBlockAddress address, const GenericBlockBuffer &buffer) override
         {
-            return GetBlockFromAddress(address)->Write(buffer);
+            buffer.CopyTo(GetBlockFromAddress(address), 0, BlockBufferInterface::kSize);
+            return Status::CreateOkStatus();
+        }
+        // blocks are contiguous, so a region is copied without virtual calls per block
+        virtual Status ReadBlocksInternal(const LogicalBlockRegion region, BlockBuffers<GenericBlockBuffer> &buffers, const int first_index) override
+        {
+            const uint8_t *block = GetBlockFromAddress(region.GetStart());
+            const int cnt = region.GetRegionSize();
+            for (int i = 0; i < cnt; i++, block += BlockBufferInterface::kSize)
+            {
+                buffers.GetBlockBufferFromIndex(first_index + i)->CopyFrom(block, 0, BlockBufferInterface::kSize);
+            }
+            return Status::CreateOkStatus();
+        }
+        virtual Status WriteBlocksInternal(const LogicalBlockRegion region, const BlockBuffers<GenericBlockBuffer> &buffers, const int first_index) override
+        {
+            uint8_t *block = GetBlockFromAddress(region.GetStart());
+            const int cnt = region.GetRegionSize();
+            for (int i = 0; i < cnt; i++, block += BlockBufferInterface::kSize)
+            {
+                buffers.GetConstBlockBufferFromIndex(first_index + i)->CopyTo(block, 0, BlockBufferInterface::kSize);
+            }
+            return Status::CreateOkStatus();
         }
-        MemInternalBlock *GetBlockFromAddress(const LogicalBlockAddress address)
+        uint8_t *GetBlockFromAddress(const LogicalBlockAddress address)
         {
-            return block_buf_[address.GetRaw()];
+            return blocks_ + (size_t)address.GetRaw() * BlockBufferInterface::kSize;
         }
         static const int kNumBlocks = 4196;
-        MemInternalBlock *block_buf_[kNumBlocks];
+        uint8_t *const blocks_;
     };
-}
\ No newline at end of file
+}
@@ -4,7 +4,10 @@
 #include "char_storage/interface.h"
 #include "utils/slice.h"
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
+#include <chrono>
+#include <vector>
 
 namespace HayaguiKvs
 {
@@ -33,24 +36,21 @@ namespace HayaguiKvs
                 return Status::CreateErrorStatus();
             }
             BlockBufferInterface &buf = buf_;
-            const bool matched = (buf.Memcmp(kSignature, 0, strlen(kSignature)) == 0);
-            if (!matched)
+            if (buf.Memcmp(kSignature, 0, strlen(kSignature)) == 0)
             {
-                len_ = 0;
-
-                BlockBufferInterface &buf = buf_;
-                buf.CopyFrom((const uint8_t *const)kSignature, 0, strlen(kSignature));
-                buf.SetValue<uint64_t>(getOffsetOfSize(), len_);
-                if (storage_.Write(LogicalBlockAddress(0), buf_).IsError())
-                {
-                    buf.SetValue<uint64_t>(getOffsetOfSize(), len_);
-                    return Status::CreateErrorStatus();
-                }
-
-                opened_ = true;
-                return Status::CreateOkStatus();
+                len_ = buf.GetValue<uint64_t>(getOffsetOfSize());
+                start_ = buf.GetValue<uint64_t>(getOffsetOfStart());
+            }
+            else if (buf.Memcmp(kSignatureV1, 0, strlen(kSignatureV1)) == 0)
+            {
+                // V1 has never been trimmed; V2 is written with the next update
+                len_ = buf.GetValue<uint64_t>(getOffsetOfSize());
+                start_ = 0;
+            }
+            else if (Write(0, 0).IsError())
+            {
+                return Status::CreateErrorStatus();
             }
-            len_ = buf.GetValue<uint64_t>(getOffsetOfSize());
             opened_ = true;
             return Status::CreateOkStatus();
         }
@@ -60,15 +60,15 @@ namespace HayaguiKvs
         }
         Status SetLen(size_t len)
         {
-            BlockBufferInterface &buf = buf_;
-            buf.SetValue<uint64_t>(getOffsetOfSize(), len);
-            if (storage_.Write(LogicalBlockAddress(0), buf_).IsError())
-            {
-                buf.SetValue<uint64_t>(getOffsetOfSize(), len);
-                return Status::CreateErrorStatus();
-            }
-            len_ = len;
-            return Status::CreateOkStatus();
+            return Write(len, start_);
+        }
+        size_t GetStart() const
+        {
+            return start_;
+        }
+        Status SetStart(size_t start)
+        {
+            return Write(len_, start);
         }
 
     private:
@@ -80,89 +80,232 @@ namespace HayaguiKvs
         {
             return alignUp8(strlen(kSignature));
         }
+        static const size_t getOffsetOfStart()
+        {
+            return getOffsetOfSize() + sizeof(uint64_t);
+        }
+        // the length and the start are in the same block, so that both are updated at once
+        Status Write(const size_t len, const size_t start)
+        {
+            BlockBufferInterface &buf = buf_;
+            buf.CopyFrom((const uint8_t *const)kSignature, 0, strlen(kSignature));
+            buf.SetValue<uint64_t>(getOffsetOfSize(), len);
+            buf.SetValue<uint64_t>(getOffsetOfStart(), start);
+            if (storage_.Write(LogicalBlockAddress(0), buf_).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            len_ = len;
+            start_ = start;
+            return Status::CreateOkStatus();
+        }
         MultipliedBlockStorage storage_;
         bool opened_ = false;
         BlockBuffer buf_;
         size_t len_;
-        static constexpr const char *const kSignature = "HAYAGUI_APPEND_FILE_V1_";
+        size_t start_;
+        static constexpr const char *const kSignature = "HAYAGUI_APPEND_FILE_V2_";
+        static constexpr const char *const kSignatureV1 = "HAYAGUI_APPEND_FILE_V1_";
     };
 
+    // The data region is used as a ring, so that the storage can be reused after the head of the data is trimmed.
+    // If write_buffer_len is not 0, appended data is kept in memory together with the tail block,
+    // and written back with the metadata by Sync(), when the buffered data exceeds write_buffer_len,
+    // or at an append after flush_interval_ms (0 means no time limit) has passed since the first buffered append.
     template <class BlockBuffer>
     class AppendOnlyCharStorageOverBlockStorage : public AppendOnlyCharStorageInterface
     {
     public:
-        AppendOnlyCharStorageOverBlockStorage(BlockStorageInterface<BlockBuffer> &blockstorage)
+        AppendOnlyCharStorageOverBlockStorage(BlockStorageInterface<BlockBuffer> &blockstorage, const size_t write_buffer_len = 0, const int flush_interval_ms = 0)
             : multiplier_(CreateMultiplier(blockstorage)),
               metadata_manager_(CreateMetaDataManager(multiplier_)),
               data_storage_base_(multiplier_.GetMultipliedBlockStorage(kDataStorageIndex)),
-              data_storage_(data_storage_base_)
+              data_storage_(data_storage_base_),
+              block_cnt_(data_storage_base_.GetMaxAddress().GetRaw() + 1),
+              write_buffer_len_(write_buffer_len),
+              flush_interval_(flush_interval_ms)
         {
         }
+        virtual ~AppendOnlyCharStorageOverBlockStorage()
+        {
+            if (Sync().IsError())
+            {
+                fprintf(stderr, "AppendOnlyCharStorageOverBlockStorage: failed to write back the buffered data\n");
+            }
+        }
         virtual Status Open() override
         {
+            if (opened_)
+            {
+                // the buffered data must not be reloaded
+                return Status::CreateOkStatus();
+            }
             if (metadata_manager_.Open().IsError())
             {
                 return Status::CreateErrorStatus();
             }
-            if (data_storage_.SetCacheAddress(BlockBufferInterface::GetAddressFromOffset(GetLen())).IsError())
+            if (data_storage_.SetCacheAddress(GetPhysicalAddress(BlockBufferInterface::GetAddressFromOffset(metadata_manager_.GetLen()))).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (LoadTail().IsError())
             {
                 return Status::CreateErrorStatus();
             }
+            opened_ = true;
             return Status::CreateOkStatus();
         }
         virtual Status Append(const ValidSlice &slice) override
         {
-            const size_t old_len = GetLen();
+            if (write_buffer_len_ == 0)
+            {
+                return AppendThrough(slice);
+            }
             const size_t len = slice.GetLen();
-            const size_t new_len = old_len + len;
-            const LogicalBlockAddress start = BlockBufferInterface::GetAddressFromOffset(old_len);
-            const LogicalBlockAddress end = BlockBufferInterface::GetAddressFromOffset(new_len - 1);
-            const LogicalBlockRegion region = LogicalBlockRegion(start, end);
-            const int cnt = region.GetRegionSize();
-            BlockBuffers<BlockBuffer> buffers(cnt);
-
-            if (BlockBufferInterface::GetInBufferOffset(old_len) != 0 &&
-                data_storage_.Read(start, *buffers.GetBlockBufferFromIndex(0)).IsError())
+            if (len == 0)
             {
-                return Status::CreateErrorStatus();
+                return Status::CreateOkStatus();
             }
-
-            BlockBufferCopierFromSlice<BlockBuffer> copier(cnt, buffers, slice, BlockBufferInterface::GetInBufferOffset(old_len));
-            copier.Copy();
-
-            if (data_storage_.SetCacheAddress(BlockBufferInterface::GetAddressFromOffset(new_len)).IsError())
+            if (IsFull(GetLen() + len))
             {
                 return Status::CreateErrorStatus();
             }
-
-            if (data_storage_.WriteBlocks(region, buffers).IsError())
+            const size_t tail_len = tail_.size();
+            tail_.resize(tail_len + len);
+            if (slice.CopyToBuffer(tail_.data() + tail_len).IsError())
             {
+                tail_.resize(tail_len);
                 return Status::CreateErrorStatus();
             }
-
-            if (metadata_manager_.SetLen(new_len).IsError())
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (!dirty_)
             {
-                return Status::CreateErrorStatus();
+                dirty_ = true;
+                dirty_since_ = now;
+            }
+            if (tail_.size() >= write_buffer_len_ || (flush_interval_.count() != 0 && now - dirty_since_ >= flush_interval_))
+            {
+                return Sync();
             }
             return Status::CreateOkStatus();
         }
         virtual Status Append(MultipleValidSliceContainerReaderInterface &multiple_slice_container) override
         {
-            return AppendHelper(multiple_slice_container);
+            // slices are coalesced so that both the data blocks and the metadata are written only once.
+            const int len = multiple_slice_container.GetSliceLen();
+            LocalBufferAllocator::Container buf_container = LocalBufferAllocator::Get()->Alloc(len);
+            if (multiple_slice_container.CopyToBuffer(buf_container.GetPtr<char>()).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Append(BufferPtrSlice(buf_container.GetPtr<char>(), len));
         }
         virtual Status Read(const size_t offset, const int len, SliceContainer &container) override
         {
             const size_t file_len = GetLen();
-            if (offset > file_len)
+            if (offset < GetStartOffset() || offset > file_len)
             {
                 return Status::CreateErrorStatus();
             }
             const size_t actual_len = getMin((size_t)len, file_len - offset);
-            return ReadInternal(offset, actual_len, container);
+            if (tail_.empty() || offset + actual_len <= tail_offset_)
+            {
+                return ReadInternal(offset, actual_len, container);
+            }
+            if (offset >= tail_offset_)
+            {
+                container.Set(tail_.data() + (offset - tail_offset_), actual_len);
+                return Status::CreateOkStatus();
+            }
+            // the head is in the blocks, and the rest is in the tail
+            const size_t stored_len = tail_offset_ - offset;
+            if (ReadInternal(offset, stored_len, container).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            char *const buf = MemAllocator::alloc(actual_len);
+            if (container.CopyToBuffer(buf).IsError())
+            {
+                MemAllocator::free(buf);
+                return Status::CreateErrorStatus();
+            }
+            memcpy(buf + stored_len, tail_.data(), actual_len - stored_len);
+            container.Set(buf, actual_len);
+            MemAllocator::free(buf);
+            return Status::CreateOkStatus();
         }
         virtual size_t GetLen() const override
         {
-            return metadata_manager_.GetLen();
+            return write_buffer_len_ == 0 ? metadata_manager_.GetLen() : tail_offset_ + tail_.size();
+        }
+        virtual Status Sync() override
+        {
+            if (!dirty_)
+            {
+                return Status::CreateOkStatus();
+            }
+            const size_t len = GetLen();
+            const LogicalBlockRegion region(BlockBufferInterface::GetAddressFromOffset(tail_offset_), BlockBufferInterface::GetAddressFromOffset(len - 1));
+            const int cnt = region.GetRegionSize();
+            BlockBuffers<BlockBuffer> buffers(cnt);
+            const BufferPtrSlice tail_slice(tail_.data(), tail_.size());
+            BlockBufferCopierFromSlice<BlockBuffer> copier(cnt, buffers, tail_slice, 0);
+            copier.Copy();
+            if (data_storage_.SetCacheAddress(GetPhysicalAddress(BlockBufferInterface::GetAddressFromOffset(len))).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (WriteBlocks(region, buffers).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (metadata_manager_.SetLen(len).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            // only the last partial block is kept, so that it is not read back at the next write
+            const size_t new_tail_offset = len - BlockBufferInterface::GetInBufferOffset(len);
+            tail_.erase(tail_.begin(), tail_.begin() + (new_tail_offset - tail_offset_));
+            tail_offset_ = new_tail_offset;
+            dirty_ = false;
+            return Status::CreateOkStatus();
+        }
+        virtual Status Trim(const size_t offset) override
+        {
+            if (offset < GetStartOffset() || offset > GetLen())
+            {
+                return Status::CreateErrorStatus();
+            }
+            // the start must not exceed the length in the metadata
+            if (Sync().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return metadata_manager_.SetStart(offset);
+        }
+        virtual Status Truncate(const size_t len) override
+        {
+            if (len < GetStartOffset() || len > GetLen())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (Sync().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (data_storage_.SetCacheAddress(GetPhysicalAddress(BlockBufferInterface::GetAddressFromOffset(len))).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (metadata_manager_.SetLen(len).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return LoadTail();
+        }
+        virtual size_t GetStartOffset() const override
+        {
+            return metadata_manager_.GetStart();
         }
 
     private:
@@ -184,6 +327,82 @@ namespace HayaguiKvs
             MultipliedBlockStorage storage = multiplier.GetMultipliedBlockStorage(kMetaDataStorageIndex);
             return MetaDataManagerForAppendOnlyCharStorageOverBlockStorage<BlockBuffer>(std::move(storage));
         }
+        Status AppendThrough(const ValidSlice &slice)
+        {
+            const size_t old_len = GetLen();
+            const size_t len = slice.GetLen();
+            if (len == 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            const size_t new_len = old_len + len;
+            if (IsFull(new_len))
+            {
+                return Status::CreateErrorStatus();
+            }
+            const LogicalBlockAddress start = BlockBufferInterface::GetAddressFromOffset(old_len);
+            const LogicalBlockAddress end = BlockBufferInterface::GetAddressFromOffset(new_len - 1);
+            const LogicalBlockRegion region = LogicalBlockRegion(start, end);
+            const int cnt = region.GetRegionSize();
+            BlockBuffers<BlockBuffer> buffers(cnt);
+
+            if (BlockBufferInterface::GetInBufferOffset(old_len) != 0 &&
+                data_storage_.Read(GetPhysicalAddress(start), *buffers.GetBlockBufferFromIndex(0)).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+
+            BlockBufferCopierFromSlice<BlockBuffer> copier(cnt, buffers, slice, BlockBufferInterface::GetInBufferOffset(old_len));
+            copier.Copy();
+
+            if (data_storage_.SetCacheAddress(GetPhysicalAddress(BlockBufferInterface::GetAddressFromOffset(new_len))).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+
+            if (WriteBlocks(region, buffers).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+
+            if (metadata_manager_.SetLen(new_len).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Status::CreateOkStatus();
+        }
+        // whether the ring can not hold the data up to len
+        bool IsFull(const size_t len) const
+        {
+            const LogicalBlockAddress end = BlockBufferInterface::GetAddressFromOffset(len - 1);
+            return end - BlockBufferInterface::GetAddressFromOffset(GetStartOffset()) >= block_cnt_;
+        }
+        // reads the partial tail block into the write buffer
+        Status LoadTail()
+        {
+            if (write_buffer_len_ == 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            const size_t len = metadata_manager_.GetLen();
+            const size_t in_buffer_offset = BlockBufferInterface::GetInBufferOffset(len);
+            tail_offset_ = len - in_buffer_offset;
+            tail_.clear();
+            dirty_ = false;
+            if (in_buffer_offset == 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            BlockBuffer buffer;
+            if (data_storage_.Read(GetPhysicalAddress(BlockBufferInterface::GetAddressFromOffset(len)), buffer).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            const BlockBufferInterface &buffer_interface = buffer;
+            tail_.resize(in_buffer_offset);
+            buffer_interface.CopyTo(reinterpret_cast<uint8_t *>(tail_.data()), 0, in_buffer_offset);
+            return Status::CreateOkStatus();
+        }
         Status ReadInternal(const size_t offset, const int len, SliceContainer &container)
         {
             const LogicalBlockAddress start = BlockBufferInterface::GetAddressFromOffset(offset);
@@ -191,7 +410,7 @@ namespace HayaguiKvs
             const LogicalBlockRegion region = LogicalBlockRegion(start, end);
             const int cnt = region.GetRegionSize();
             BlockBuffers<BlockBuffer> buffers(cnt);
-            if (data_storage_.ReadBlocks(region, buffers).IsError())
+            if (ReadBlocks(region, buffers).IsError())
             {
                 return Status::CreateErrorStatus();
             }
@@ -202,10 +421,65 @@ namespace HayaguiKvs
 
             return Status::CreateOkStatus();
         }
+        LogicalBlockAddress GetPhysicalAddress(const LogicalBlockAddress address) const
+        {
+            return LogicalBlockAddress(address.GetRaw() % block_cnt_);
+        }
+        // a region wraps around the ring at most once, so it is transferred in up to two physical regions
+        Status ReadBlocks(const LogicalBlockRegion region, BlockBuffers<BlockBuffer> &buffers)
+        {
+            const int first_cnt = GetCntBeforeWrap(region);
+            if (data_storage_.ReadBlocks(GetPhysicalRegion(region.GetStart(), first_cnt), buffers).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            const int rest_cnt = region.GetRegionSize() - first_cnt;
+            if (rest_cnt != 0 && data_storage_.ReadBlocks(GetPhysicalRegion(region.GetStart() + LogicalBlockAddress(first_cnt), rest_cnt), buffers, first_cnt).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Status::CreateOkStatus();
+        }
+        Status WriteBlocks(const LogicalBlockRegion region, const BlockBuffers<BlockBuffer> &buffers)
+        {
+            const int first_cnt = GetCntBeforeWrap(region);
+            if (data_storage_.WriteBlocks(GetPhysicalRegion(region.GetStart(), first_cnt), buffers).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            const int rest_cnt = region.GetRegionSize() - first_cnt;
+            if (rest_cnt != 0 && data_storage_.WriteBlocks(GetPhysicalRegion(region.GetStart() + LogicalBlockAddress(first_cnt), rest_cnt), buffers, first_cnt).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Status::CreateOkStatus();
+        }
+        // the number of blocks from the start of region to the end of the ring or of region
+        int GetCntBeforeWrap(const LogicalBlockRegion region) const
+        {
+            const int cnt_to_end_of_ring = block_cnt_ - GetPhysicalAddress(region.GetStart()).GetRaw();
+            const int region_cnt = region.GetRegionSize();
+            return region_cnt < cnt_to_end_of_ring ? region_cnt : cnt_to_end_of_ring;
+        }
+        LogicalBlockRegion GetPhysicalRegion(const LogicalBlockAddress start, const int cnt) const
+        {
+            const LogicalBlockAddress physical_start = GetPhysicalAddress(start);
+            return LogicalBlockRegion(physical_start, physical_start + LogicalBlockAddress(cnt - 1));
+        }
         BlockStorageMultiplier<BlockBuffer> multiplier_;
         MetaDataManagerForAppendOnlyCharStorageOverBlockStorage<BlockBuffer> metadata_manager_;
         MultipliedBlockStorage data_storage_base_;
         BlockStorageWithOneCache<BlockBuffer> data_storage_;
+        const int block_cnt_;
+        bool opened_ = false;
+        const size_t write_buffer_len_;
+        const std::chrono::milliseconds flush_interval_;
+        // the data from tail_offset_ (aligned to a block) to the end, if buffered
+        std::vector<char> tail_;
+        size_t tail_offset_ = 0;
+        // whether tail_ has data which is not written back
+        bool dirty_ = false;
+        std::chrono::steady_clock::time_point dirty_since_;
         static const int kMetaDataStorageIndex = 0;
         static const int kDataStorageIndex = 1;
     };
@@ -74,6 +74,8 @@ namespace HayaguiKvs
         virtual Status Append(const ValidSlice &slice) = 0;
         virtual Status Append(MultipleValidSliceContainerReaderInterface &multiple_slice_container) = 0;
         virtual size_t GetLen() const = 0;
+        // makes the appended data durable, if the storage buffers it
+        virtual Status Sync() = 0;
 
     protected:
         Status AppendHelper(MultipleValidSliceContainerReaderInterface &multiple_slice_container)
@@ -93,6 +95,11 @@ namespace HayaguiKvs
     {
         virtual Status Open() override = 0;
         virtual size_t GetLen() const override = 0;
+        // drops the data before offset. offsets of the remaining data are not changed.
+        virtual Status Trim(const size_t offset) = 0;
+        // drops the data after len, e.g. a record which is torn by a crash.
+        virtual Status Truncate(const size_t len) = 0;
+        virtual size_t GetStartOffset() const = 0;
     };
 
 }
\ No newline at end of file
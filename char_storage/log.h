@@ -104,9 +104,24 @@ namespace HayaguiKvs
         }
         Status AppendEntries(MultipleValidSliceContainerReaderInterface &entries)
         {
-            LocalBufferAllocator::Container buf_container = LocalBufferAllocator::Get()->Alloc(sizeof(ValidSlice *) * entries.GetLen() * 2);
-            MultipleValidSliceContainer written_slices(buf_container.GetPtr<const ValidSlice *>(), entries.GetLen() * 2);
-            return AppendEntriesSub(written_slices, entries);
+            const int cnt = entries.GetLen();
+            LocalBufferAllocator::Container len_buf_container = LocalBufferAllocator::Get()->Alloc(sizeof(UnsignedInt64ForLogInfoSliceContainer) * cnt);
+            LocalBufferAllocator::Container slices_buf_container = LocalBufferAllocator::Get()->Alloc(sizeof(ValidSlice *) * cnt * 2);
+            UnsignedInt64ForLogInfoSliceContainer *lens = len_buf_container.GetPtr<UnsignedInt64ForLogInfoSliceContainer>();
+            MultipleValidSliceContainer written_slices(slices_buf_container.GetPtr<const ValidSlice *>(), cnt * 2);
+            for (int i = 0; i < cnt; i++)
+            {
+                const ValidSlice *slice = entries.Get();
+                new (&lens[i]) UnsignedInt64ForLogInfoSliceContainer(slice->GetLen());
+                written_slices.Set(&lens[i].GetSlice());
+                written_slices.Set(slice);
+            }
+            Status s = char_storage_.Append(written_slices);
+            for (int i = 0; i < cnt; i++)
+            {
+                lens[i].~UnsignedInt64ForLogInfoSliceContainer();
+            }
+            return s;
         }
         Status AppendEntry(const ValidSlice &obj)
         {
@@ -119,21 +134,6 @@ namespace HayaguiKvs
         }
 
     private:
-        Status AppendEntriesSub(MultipleValidSliceContainer &written_slices, MultipleValidSliceContainerReaderInterface &entries)
-        {
-            const ValidSlice *slice = entries.Get();
-            UnsignedInt64ForLogInfoSliceContainer len(slice->GetLen());
-            written_slices.Set(&len.GetSlice());
-            written_slices.Set(slice);
-            if (written_slices.GetLen() == entries.GetLen() * 2)
-            {
-                return char_storage_.Append(written_slices);
-            }
-            else
-            {
-                return AppendEntriesSub(written_slices, entries);
-            }
-        }
         AppendCharStorageInterface &char_storage_;
     };
 }
\ No newline at end of file
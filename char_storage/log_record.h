@@ -0,0 +1,378 @@
+#pragma once
+#include "char_storage/interface.h"
+#include "char_storage/read_ahead.h"
+#include "utils/crc32c.h"
+#include "utils/slice.h"
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace HayaguiKvs
+{
+    // A record of a put or a delete, framed by one header:
+    //   [type][varint key len][varint value len (put only)][crc32c][key][value]
+    // The crc covers the whole record except itself.
+    // Records of the v1 format (three entries of a signature, a key and a value, each prefixed with a 64bit length)
+    // are still readable. The first byte tells the format, because it is the lowest byte of the length of the signature (= 1) in v1.
+    class LogRecord
+    {
+    public:
+        enum class Type
+        {
+            kPut,
+            kDelete,
+        };
+        enum class ParseResult
+        {
+            kOk,
+            // GetLen() returns the length of the record if the header is available, or 0.
+            kIncomplete,
+            kCorrupted,
+        };
+        static size_t GetPutRecordLen(const int key_len, const int value_len)
+        {
+            return GetPutHeaderLen(key_len, value_len) + key_len + value_len;
+        }
+        // the position of the value in a put record
+        static size_t GetPutValuePos(const int key_len, const int value_len)
+        {
+            return GetPutHeaderLen(key_len, value_len) + key_len;
+        }
+        static size_t GetDeleteRecordLen(const int key_len)
+        {
+            return 1 + GetVarintLen(key_len) + sizeof(uint32_t) + key_len;
+        }
+        // buf must have GetPutRecordLen() bytes
+        static Status EncodePut(char *const buf, const ValidSlice &key, const ValidSlice &value)
+        {
+            char *p = buf;
+            *p++ = kTypePut;
+            p = EncodeVarint(p, key.GetLen());
+            p = EncodeVarint(p, value.GetLen());
+            return EncodeBody(buf, p, key, &value);
+        }
+        // buf must have GetDeleteRecordLen() bytes
+        static Status EncodeDelete(char *const buf, const ValidSlice &key)
+        {
+            char *p = buf;
+            *p++ = kTypeDelete;
+            p = EncodeVarint(p, key.GetLen());
+            return EncodeBody(buf, p, key, nullptr);
+        }
+        // parses the record at the head of buf. the record refers to buf.
+        // without verifies_crc, only the framing is checked (e.g. to find where the records are).
+        static ParseResult Parse(const char *const buf, const size_t len, LogRecord &record, const bool verifies_crc = true)
+        {
+            record.len_ = 0;
+            if (len == 0)
+            {
+                return ParseResult::kIncomplete;
+            }
+            const uint8_t type = buf[0];
+            if (type == kV1SignatureLen)
+            {
+                return ParseV1(buf, len, record);
+            }
+            if (type != kTypePut && type != kTypeDelete)
+            {
+                return ParseResult::kCorrupted;
+            }
+            record.type_ = type == kTypePut ? Type::kPut : Type::kDelete;
+            size_t pos = 1;
+            uint32_t key_len, value_len = 0;
+            ParseResult result = DecodeVarint(buf, len, pos, key_len);
+            if (result == ParseResult::kOk && record.type_ == Type::kPut)
+            {
+                result = DecodeVarint(buf, len, pos, value_len);
+            }
+            if (result != ParseResult::kOk)
+            {
+                return result;
+            }
+            if (len < pos + sizeof(uint32_t))
+            {
+                return ParseResult::kIncomplete;
+            }
+            uint32_t crc;
+            memcpy(&crc, buf + pos, sizeof(uint32_t));
+            const size_t header_len = pos + sizeof(uint32_t);
+            record.len_ = header_len + key_len + value_len;
+            if (key_len > kMaxLen || value_len > kMaxLen)
+            {
+                return ParseResult::kCorrupted;
+            }
+            if (len < record.len_)
+            {
+                return ParseResult::kIncomplete;
+            }
+            if (verifies_crc && Crc32c::Extend(Crc32c::Calc(buf, pos), buf + header_len, key_len + value_len) != crc)
+            {
+                return ParseResult::kCorrupted;
+            }
+            record.key_ = buf + header_len;
+            record.key_len_ = key_len;
+            record.value_ = record.key_ + key_len;
+            record.value_len_ = value_len;
+            record.value_pos_ = header_len + key_len;
+            return ParseResult::kOk;
+        }
+        Type GetType() const
+        {
+            return type_;
+        }
+        BufferPtrSlice GetKey() const
+        {
+            return BufferPtrSlice(key_, key_len_);
+        }
+        const char *GetKeyPtr() const
+        {
+            return key_;
+        }
+        int GetKeyLen() const
+        {
+            return key_len_;
+        }
+        BufferPtrSlice GetValue() const
+        {
+            return BufferPtrSlice(value_, value_len_);
+        }
+        int GetValueLen() const
+        {
+            return value_len_;
+        }
+        // the position of the value in the record
+        size_t GetValuePos() const
+        {
+            return value_pos_;
+        }
+        size_t GetLen() const
+        {
+            return len_;
+        }
+
+    private:
+        static size_t GetPutHeaderLen(const int key_len, const int value_len)
+        {
+            return 1 + GetVarintLen(key_len) + GetVarintLen(value_len) + sizeof(uint32_t);
+        }
+        static int GetVarintLen(uint32_t value)
+        {
+            int len = 1;
+            while (value >= 0x80)
+            {
+                value >>= 7;
+                len++;
+            }
+            return len;
+        }
+        static char *EncodeVarint(char *p, uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                *p++ = static_cast<char>(value | 0x80);
+                value >>= 7;
+            }
+            *p++ = static_cast<char>(value);
+            return p;
+        }
+        static ParseResult DecodeVarint(const char *const buf, const size_t len, size_t &pos, uint32_t &value)
+        {
+            value = 0;
+            for (int shift = 0; shift <= 28; shift += 7)
+            {
+                if (pos == len)
+                {
+                    return ParseResult::kIncomplete;
+                }
+                const uint8_t byte = buf[pos++];
+                value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return ParseResult::kOk;
+                }
+            }
+            return ParseResult::kCorrupted;
+        }
+        // p points the crc
+        static Status EncodeBody(char *const buf, char *const p, const ValidSlice &key, const ValidSlice *const value)
+        {
+            char *const body = p + sizeof(uint32_t);
+            if (key.CopyToBuffer(body).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            int body_len = key.GetLen();
+            if (value != nullptr)
+            {
+                if (value->CopyToBuffer(body + body_len).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                body_len += value->GetLen();
+            }
+            const uint32_t crc = Crc32c::Extend(Crc32c::Calc(buf, p - buf), body, body_len);
+            memcpy(p, &crc, sizeof(uint32_t));
+            return Status::CreateOkStatus();
+        }
+        static ParseResult ParseV1(const char *const buf, const size_t len, LogRecord &record)
+        {
+            size_t pos = 0;
+            uint64_t entry_len;
+            if (!ReadV1Len(buf, len, pos, entry_len))
+            {
+                return ParseResult::kIncomplete;
+            }
+            if (entry_len != kV1SignatureLen)
+            {
+                return ParseResult::kCorrupted;
+            }
+            if (pos == len)
+            {
+                return ParseResult::kIncomplete;
+            }
+            const uint8_t signature = buf[pos++];
+            if (signature != kV1SignaturePut && signature != kV1SignatureDelete)
+            {
+                return ParseResult::kCorrupted;
+            }
+            record.type_ = signature == kV1SignaturePut ? Type::kPut : Type::kDelete;
+            uint64_t key_len, value_len = 0;
+            if (!ReadV1Len(buf, len, pos, key_len))
+            {
+                return ParseResult::kIncomplete;
+            }
+            if (key_len > kMaxLen)
+            {
+                return ParseResult::kCorrupted;
+            }
+            const size_t key_pos = pos;
+            pos += key_len;
+            if (record.type_ == Type::kPut)
+            {
+                if (!ReadV1Len(buf, len, pos, value_len))
+                {
+                    return ParseResult::kIncomplete;
+                }
+                if (value_len > kMaxLen)
+                {
+                    return ParseResult::kCorrupted;
+                }
+            }
+            record.len_ = pos + value_len;
+            if (len < record.len_)
+            {
+                return ParseResult::kIncomplete;
+            }
+            record.key_ = buf + key_pos;
+            record.key_len_ = key_len;
+            record.value_ = buf + pos;
+            record.value_len_ = value_len;
+            record.value_pos_ = pos;
+            return ParseResult::kOk;
+        }
+        static bool ReadV1Len(const char *const buf, const size_t len, size_t &pos, uint64_t &value)
+        {
+            if (len < pos + sizeof(uint64_t))
+            {
+                return false;
+            }
+            memcpy(&value, buf + pos, sizeof(uint64_t));
+            pos += sizeof(uint64_t);
+            return true;
+        }
+
+        Type type_;
+        const char *key_;
+        int key_len_;
+        const char *value_;
+        int value_len_;
+        size_t value_pos_;
+        size_t len_;
+        static const uint8_t kTypePut = 0x80;
+        static const uint8_t kTypeDelete = 0x81;
+        static const uint8_t kV1SignatureLen = 1;
+        static const uint8_t kV1SignaturePut = 0;
+        static const uint8_t kV1SignatureDelete = 1;
+        static const uint32_t kMaxLen = 0x7fffffff;
+    };
+
+    // Reads records sequentially. The log is read in large chunks, rather than per field,
+    // and the following part of the log is prefetched while the records are parsed.
+    class LogRecordReader
+    {
+    public:
+        LogRecordReader(RandomReadCharStorageInterface &char_storage, const size_t offset)
+            : char_storage_(char_storage), read_ahead_storage_(char_storage), buf_offset_(offset)
+        {
+            read_ahead_storage_.SeekTo(offset);
+        }
+        // returns an error at the end of the log, or at a broken record (e.g. torn by a crash).
+        // they are told apart by IsEnd().
+        Status ReadNext(LogRecord &record)
+        {
+            while (true)
+            {
+                switch (LogRecord::Parse(buf_.data() + pos_, buf_.size() - pos_, record))
+                {
+                case LogRecord::ParseResult::kOk:
+                    pos_ += record.GetLen();
+                    return Status::CreateOkStatus();
+                case LogRecord::ParseResult::kCorrupted:
+                    return Status::CreateErrorStatus();
+                case LogRecord::ParseResult::kIncomplete:
+                    if (Fill(record.GetLen()).IsError())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                    break;
+                }
+            }
+        }
+        // the offset of the next record
+        size_t GetOffset() const
+        {
+            return buf_offset_ + pos_;
+        }
+        bool IsEnd() const
+        {
+            return GetOffset() == char_storage_.GetLen();
+        }
+
+    private:
+        // reads at least up to the end of the record of record_len bytes at pos_
+        Status Fill(const size_t record_len)
+        {
+            const size_t read_offset = buf_offset_ + buf_.size();
+            const size_t log_len = char_storage_.GetLen();
+            if (read_offset >= log_len)
+            {
+                return Status::CreateErrorStatus();
+            }
+            buf_.erase(buf_.begin(), buf_.begin() + pos_);
+            buf_offset_ += pos_;
+            pos_ = 0;
+            size_t read_len = record_len > buf_.size() + kReadLen ? record_len - buf_.size() : kReadLen;
+            read_len = read_len < log_len - read_offset ? read_len : log_len - read_offset;
+            SliceContainer container;
+            if (read_ahead_storage_.Read(container, read_len).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            int len;
+            if (container.GetLen(len).IsError() || (size_t)len != read_len)
+            {
+                return Status::CreateErrorStatus();
+            }
+            const size_t buf_len = buf_.size();
+            buf_.resize(buf_len + read_len);
+            return container.CopyToBuffer(buf_.data() + buf_len);
+        }
+
+        RandomReadCharStorageInterface &char_storage_;
+        ReadAheadSequentialReadCharStorage read_ahead_storage_;
+        std::vector<char> buf_;
+        size_t buf_offset_;
+        size_t pos_ = 0;
+        static const size_t kReadLen = 64 * 1024;
+    };
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include "char_storage/interface.h"
+#include "utils/allocator.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace HayaguiKvs
+{
+    // Reads a storage sequentially through two windows. While the current window is consumed,
+    // the next one is read by a background thread, so that reading overlaps with parsing.
+    // The underlying storage must not be used by others until the reader is destructed.
+    // Windows are at least kMinWindowLen bytes, and the background thread reads only whole windows,
+    // so that buffers of its reads (e.g. of VefsCharStorage) do not come from the pool of LocalBufferAllocator.
+    class ReadAheadSequentialReadCharStorage : public SequentialReadCharStorageInterface
+    {
+    public:
+        static const size_t kMinWindowLen = LocalBufferAllocator::kMinUnpooledLen;
+        ReadAheadSequentialReadCharStorage(RandomReadCharStorageInterface &underlying_storage, const size_t window_len = kDefaultWindowLen)
+            : underlying_storage_(underlying_storage), window_len_(window_len < kMinWindowLen ? kMinWindowLen : window_len)
+        {
+        }
+        virtual ~ReadAheadSequentialReadCharStorage()
+        {
+            WaitForPrefetch();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stopping_ = true;
+            }
+            cond_.notify_all();
+            if (prefetch_thread_.joinable())
+            {
+                prefetch_thread_.join();
+            }
+        }
+        ReadAheadSequentialReadCharStorage(const ReadAheadSequentialReadCharStorage &obj) = delete;
+        ReadAheadSequentialReadCharStorage &operator=(const ReadAheadSequentialReadCharStorage &obj) = delete;
+        virtual Status Open() override
+        {
+            return underlying_storage_.Open();
+        }
+        virtual void SeekTo(const size_t offset) override
+        {
+            offset_ = offset;
+        }
+        virtual Status Read(SliceContainer &container, const int len) override
+        {
+            const size_t storage_len = GetLen();
+            if (offset_ > storage_len)
+            {
+                return Status::CreateErrorStatus();
+            }
+            const size_t actual_len = (size_t)len < storage_len - offset_ ? len : storage_len - offset_;
+            if (actual_len == 0)
+            {
+                container.Set(&empty_, 0);
+                return Status::CreateOkStatus();
+            }
+            if (!current_.Contains(offset_) && SwitchWindow().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (current_.Contains(offset_ + actual_len - 1))
+            {
+                container.Set(current_.buf_.data() + (offset_ - current_.offset_), actual_len);
+                offset_ += actual_len;
+                return Status::CreateOkStatus();
+            }
+            // the data lies over windows
+            char *const buf = MemAllocator::alloc(actual_len);
+            size_t copied_len = 0;
+            while (copied_len < actual_len)
+            {
+                if (!current_.Contains(offset_) && SwitchWindow().IsError())
+                {
+                    MemAllocator::free(buf);
+                    return Status::CreateErrorStatus();
+                }
+                const size_t in_window_offset = offset_ - current_.offset_;
+                size_t copy_len = current_.buf_.size() - in_window_offset;
+                copy_len = copy_len < actual_len - copied_len ? copy_len : actual_len - copied_len;
+                memcpy(buf + copied_len, current_.buf_.data() + in_window_offset, copy_len);
+                copied_len += copy_len;
+                offset_ += copy_len;
+            }
+            container.Set(buf, actual_len);
+            MemAllocator::free(buf);
+            return Status::CreateOkStatus();
+        }
+        virtual size_t GetLen() const override
+        {
+            return underlying_storage_.GetLen();
+        }
+
+    private:
+        class Window
+        {
+        public:
+            bool Contains(const size_t offset) const
+            {
+                return offset_ <= offset && offset < offset_ + buf_.size();
+            }
+            void Load(RandomReadCharStorageInterface &storage, const size_t offset, const size_t len)
+            {
+                offset_ = offset;
+                loaded_ = false;
+                buf_.clear();
+                // some storages fail to read over the end
+                const size_t storage_len = storage.GetLen();
+                const size_t actual_len = offset < storage_len && len > storage_len - offset ? storage_len - offset : len;
+                SliceContainer container;
+                if (storage.Read(offset, actual_len, container).IsError())
+                {
+                    return;
+                }
+                int read_len;
+                if (container.GetLen(read_len).IsError())
+                {
+                    return;
+                }
+                buf_.resize(read_len);
+                loaded_ = container.CopyToBuffer(buf_.data()).IsOk();
+            }
+            size_t offset_ = 0;
+            bool loaded_ = false;
+            std::vector<char> buf_;
+        };
+        // makes the window which contains offset_ current, and starts to read the following one
+        Status SwitchWindow()
+        {
+            WaitForPrefetch();
+            std::swap(current_, next_);
+            if (!current_.loaded_ || !current_.Contains(offset_))
+            {
+                // the first read, or SeekTo() out of the windows
+                current_.Load(underlying_storage_, offset_, window_len_);
+            }
+            if (!current_.loaded_ || current_.buf_.empty())
+            {
+                return Status::CreateErrorStatus();
+            }
+            // a window at the end which is shorter than the others is read when it is needed
+            const size_t next_offset = current_.offset_ + current_.buf_.size();
+            if (next_offset + window_len_ <= GetLen())
+            {
+                StartPrefetch(next_offset);
+            }
+            return Status::CreateOkStatus();
+        }
+        // the thread is started at the first prefetch, and waits for the following ones
+        void StartPrefetch(const size_t offset)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                prefetch_offset_ = offset;
+                prefetching_ = true;
+                if (!prefetch_thread_.joinable())
+                {
+                    prefetch_thread_ = std::thread([this]() { Prefetch(); });
+                }
+            }
+            cond_.notify_all();
+        }
+        void Prefetch()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            while (true)
+            {
+                cond_.wait(lock, [this]() { return prefetching_ || stopping_; });
+                if (stopping_)
+                {
+                    return;
+                }
+                const size_t offset = prefetch_offset_;
+                lock.unlock();
+                next_.Load(underlying_storage_, offset, window_len_);
+                lock.lock();
+                prefetching_ = false;
+                cond_.notify_all();
+            }
+        }
+        void WaitForPrefetch()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait(lock, [this]() { return !prefetching_; });
+        }
+
+        RandomReadCharStorageInterface &underlying_storage_;
+        const size_t window_len_;
+        size_t offset_ = 0;
+        Window current_;
+        Window next_;
+        std::thread prefetch_thread_;
+        std::mutex mtx_;
+        std::condition_variable cond_;
+        size_t prefetch_offset_ = 0;
+        bool prefetching_ = false; // next_ is being read
+        bool stopping_ = false;
+        const char empty_ = 0;
+        static const size_t kDefaultWindowLen = 1024 * 1024;
+    };
+}
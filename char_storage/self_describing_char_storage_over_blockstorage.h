@@ -0,0 +1,344 @@
+#pragma once
+#include "block_storage/block_storage_multiplier.h"
+#include "char_storage/interface.h"
+#include "utils/allocator.h"
+#include "utils/crc32c.h"
+#include "utils/slice.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace HayaguiKvs
+{
+    // An append-only storage whose data blocks describe themselves, so that appends do not update the metadata block.
+    // Each data block starts with a header:
+    //   [uint64 sequence number][uint32 valid len][uint32 crc32c of the header and the valid bytes]
+    // The sequence number is the index of the block in the log, which tells blocks written in the previous rounds of the ring.
+    // The metadata block holds the start offset and a hint of the length, which is updated once per kHintIntervalBlockCnt blocks.
+    // On open, the tail is found by scanning from the hint to the first block which is not full.
+    // A write of a block is assumed to be atomic.
+    template <class BlockBuffer>
+    class SelfDescribingAppendOnlyCharStorageOverBlockStorage : public AppendOnlyCharStorageInterface
+    {
+    public:
+        SelfDescribingAppendOnlyCharStorageOverBlockStorage(BlockStorageInterface<BlockBuffer> &blockstorage)
+            : multiplier_(CreateMultiplier(blockstorage)),
+              metadata_storage_(multiplier_.GetMultipliedBlockStorage(kMetaDataStorageIndex)),
+              data_storage_(multiplier_.GetMultipliedBlockStorage(kDataStorageIndex)),
+              block_cnt_(data_storage_.GetMaxAddress().GetRaw() + 1)
+        {
+        }
+        // the number of data bytes in a block
+        static const size_t kPayloadLen = BlockBufferInterface::kSize - 16;
+        virtual Status Open() override
+        {
+            if (opened_)
+            {
+                return Status::CreateOkStatus();
+            }
+            if (metadata_storage_.Open().IsError() || ReadMetaData().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            uint64_t seq = hint_ / kPayloadLen;
+            uint32_t valid_len;
+            while (true)
+            {
+                if (ReadBlock(seq, tail_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                if (!IsSealedBlock(tail_, seq, valid_len))
+                {
+                    valid_len = 0;
+                    break;
+                }
+                if (valid_len < kPayloadLen)
+                {
+                    break;
+                }
+                seq++;
+            }
+            len_ = seq * kPayloadLen + valid_len;
+            if (InvalidateFollowingBlocks(seq).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            opened_ = true;
+            return Status::CreateOkStatus();
+        }
+        virtual Status Append(const ValidSlice &slice) override
+        {
+            const size_t len = slice.GetLen();
+            if (len == 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            const size_t new_len = len_ + len;
+            if ((new_len - 1) / kPayloadLen - start_ / kPayloadLen >= (size_t)block_cnt_)
+            {
+                // the ring is full
+                return Status::CreateErrorStatus();
+            }
+            uint64_t seq = len_ / kPayloadLen;
+            size_t in_block_offset = len_ % kPayloadLen;
+            size_t copied_len = 0;
+            while (copied_len < len)
+            {
+                const size_t copy_len = getMin(kPayloadLen - in_block_offset, len - copied_len);
+                BlockBufferInterface &buf = tail_;
+                buf.CopyFrom(ShrinkedSlice(slice, copied_len, copy_len), kHeaderLen + in_block_offset);
+                SealBlock(tail_, seq, in_block_offset + copy_len);
+                if (WriteBlock(seq, tail_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                copied_len += copy_len;
+                in_block_offset += copy_len;
+                if (in_block_offset == kPayloadLen)
+                {
+                    seq++;
+                    in_block_offset = 0;
+                }
+            }
+            const size_t hint_interval = kPayloadLen * kHintIntervalBlockCnt;
+            const bool hint_outdated = len_ / hint_interval != new_len / hint_interval;
+            len_ = new_len;
+            if (hint_outdated)
+            {
+                hint_ = AlignDown(new_len);
+                return WriteMetaData();
+            }
+            return Status::CreateOkStatus();
+        }
+        virtual Status Append(MultipleValidSliceContainerReaderInterface &multiple_slice_container) override
+        {
+            const int len = multiple_slice_container.GetSliceLen();
+            LocalBufferAllocator::Container buf_container = LocalBufferAllocator::Get()->Alloc(len);
+            if (multiple_slice_container.CopyToBuffer(buf_container.GetPtr<char>()).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Append(BufferPtrSlice(buf_container.GetPtr<char>(), len));
+        }
+        virtual Status Read(const size_t offset, const int len, SliceContainer &container) override
+        {
+            if (offset < start_ || offset > len_)
+            {
+                return Status::CreateErrorStatus();
+            }
+            const size_t actual_len = getMin((size_t)len, len_ - offset);
+            char *const buf = MemAllocator::alloc(actual_len + 1);
+            uint64_t seq = offset / kPayloadLen;
+            size_t in_block_offset = offset % kPayloadLen;
+            size_t copied_len = 0;
+            BlockBuffer block;
+            while (copied_len < actual_len)
+            {
+                // the tail block is kept in memory
+                const bool is_tail = seq == len_ / kPayloadLen;
+                if (!is_tail && ReadBlock(seq, block).IsError())
+                {
+                    MemAllocator::free(buf);
+                    return Status::CreateErrorStatus();
+                }
+                const BlockBufferInterface &src = is_tail ? tail_ : block;
+                const size_t copy_len = getMin(kPayloadLen - in_block_offset, actual_len - copied_len);
+                src.CopyTo(reinterpret_cast<uint8_t *>(buf + copied_len), kHeaderLen + in_block_offset, copy_len);
+                copied_len += copy_len;
+                seq++;
+                in_block_offset = 0;
+            }
+            container.Set(buf, actual_len);
+            MemAllocator::free(buf);
+            return Status::CreateOkStatus();
+        }
+        virtual size_t GetLen() const override
+        {
+            return len_;
+        }
+        virtual Status Sync() override
+        {
+            // every append is written through
+            return Status::CreateOkStatus();
+        }
+        virtual Status Trim(const size_t offset) override
+        {
+            if (offset < start_ || offset > len_)
+            {
+                return Status::CreateErrorStatus();
+            }
+            start_ = offset;
+            // blocks before the start may be overwritten in the next round
+            hint_ = hint_ > AlignDown(offset) ? hint_ : AlignDown(offset);
+            return WriteMetaData();
+        }
+        virtual Status Truncate(const size_t len) override
+        {
+            if (len < start_ || len > len_)
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (len == len_)
+            {
+                return Status::CreateOkStatus();
+            }
+            // the hint must not point the blocks to be invalidated
+            hint_ = hint_ < AlignDown(len) ? hint_ : AlignDown(len);
+            if (WriteMetaData().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            const uint64_t seq = len / kPayloadLen;
+            if (seq != len_ / kPayloadLen && ReadBlock(seq, tail_).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            // when the ring is full and len is at the end of a block, the block of seq is the oldest one, which must be kept
+            if (seq - start_ / kPayloadLen < (uint64_t)block_cnt_)
+            {
+                SealBlock(tail_, seq, len % kPayloadLen);
+                if (WriteBlock(seq, tail_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            len_ = len;
+            return InvalidateFollowingBlocks(seq);
+        }
+        virtual size_t GetStartOffset() const override
+        {
+            return start_;
+        }
+
+    private:
+        using MultipliedBlockStorage = typename BlockStorageMultiplier<BlockBuffer>::MultipliedBlockStorage;
+        static BlockStorageMultiplier<BlockBuffer> CreateMultiplier(BlockStorageInterface<BlockBuffer> &blockstorage)
+        {
+            MultiplyRule rule;
+            int i;
+            Status s1 = rule.AppendRegion(LogicalBlockRegion(LogicalBlockAddress(0), LogicalBlockAddress(0)), i);
+            assert(s1.IsOk());
+            assert(i == kMetaDataStorageIndex);
+            Status s2 = rule.AppendRegion(LogicalBlockRegion(LogicalBlockAddress(1), blockstorage.GetMaxAddress()), i);
+            assert(s2.IsOk());
+            assert(i == kDataStorageIndex);
+            return BlockStorageMultiplier<BlockBuffer>(blockstorage, rule);
+        }
+        static size_t AlignDown(const size_t offset)
+        {
+            return offset - offset % kPayloadLen;
+        }
+        Status ReadMetaData()
+        {
+            BlockBuffer buffer;
+            if (metadata_storage_.Read(LogicalBlockAddress(0), buffer).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            const BlockBufferInterface &buf = buffer;
+            if (buf.Memcmp(kSignature, 0, strlen(kSignature)) != 0)
+            {
+                start_ = 0;
+                hint_ = 0;
+                return WriteMetaData();
+            }
+            start_ = buf.GetValue<uint64_t>(kOffsetOfStart);
+            hint_ = buf.GetValue<uint64_t>(kOffsetOfHint);
+            return Status::CreateOkStatus();
+        }
+        Status WriteMetaData()
+        {
+            BlockBuffer buffer;
+            BlockBufferInterface &buf = buffer;
+            buf.CopyFrom((const uint8_t *const)kSignature, 0, strlen(kSignature));
+            buf.SetValue<uint64_t>(kOffsetOfStart, start_);
+            buf.SetValue<uint64_t>(kOffsetOfHint, hint_);
+            return metadata_storage_.Write(LogicalBlockAddress(0), buffer);
+        }
+        Status ReadBlock(const uint64_t seq, BlockBuffer &buffer)
+        {
+            return data_storage_.Read(LogicalBlockAddress(seq % block_cnt_), buffer);
+        }
+        Status WriteBlock(const uint64_t seq, const BlockBuffer &buffer)
+        {
+            return data_storage_.Write(LogicalBlockAddress(seq % block_cnt_), buffer);
+        }
+        static uint32_t CalcCrc(const BlockBufferInterface &buf, const uint32_t valid_len)
+        {
+            const char *const ptr = reinterpret_cast<const char *>(buf.GetConstPtrToTheBuffer());
+            return Crc32c::Extend(Crc32c::Calc(ptr, kOffsetOfCrc), ptr + kHeaderLen, valid_len);
+        }
+        static void SealBlock(BlockBuffer &buffer, const uint64_t seq, const uint32_t valid_len)
+        {
+            BlockBufferInterface &buf = buffer;
+            buf.SetValue<uint64_t>(kOffsetOfSeq, seq);
+            buf.SetValue<uint32_t>(kOffsetOfValidLen, valid_len);
+            buf.SetValue<uint32_t>(kOffsetOfCrc, CalcCrc(buf, valid_len));
+        }
+        static bool IsSealedBlock(const BlockBuffer &buffer, const uint64_t seq, uint32_t &valid_len)
+        {
+            const BlockBufferInterface &buf = buffer;
+            if (buf.GetValue<uint64_t>(kOffsetOfSeq) != seq)
+            {
+                return false;
+            }
+            valid_len = buf.GetValue<uint32_t>(kOffsetOfValidLen);
+            return valid_len <= kPayloadLen && buf.GetValue<uint32_t>(kOffsetOfCrc) == CalcCrc(buf, valid_len);
+        }
+        // invalidates the blocks after seq which remain from before a crash or a truncation,
+        // so that they are not taken as the tail when the block of seq gets full.
+        // they are invalidated from the last one, so that no gap is left if this is interrupted.
+        Status InvalidateFollowingBlocks(const uint64_t seq)
+        {
+            BlockBuffer buffer;
+            uint64_t end = seq + 1;
+            uint32_t valid_len;
+            while (true)
+            {
+                if (ReadBlock(end, buffer).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                if (!IsSealedBlock(buffer, end, valid_len))
+                {
+                    break;
+                }
+                end++;
+            }
+            BlockBufferInterface &buf = buffer;
+            buf.SetValue<uint64_t>(kOffsetOfSeq, kInvalidSeq);
+            while (end > seq + 1)
+            {
+                end--;
+                if (WriteBlock(end, buffer).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        BlockStorageMultiplier<BlockBuffer> multiplier_;
+        MultipliedBlockStorage metadata_storage_;
+        MultipliedBlockStorage data_storage_;
+        const int block_cnt_;
+        bool opened_ = false;
+        size_t start_ = 0;
+        // the length which is durable, aligned to a block
+        size_t hint_ = 0;
+        size_t len_ = 0;
+        // the block which contains the end of the data
+        BlockBuffer tail_;
+        static const int kMetaDataStorageIndex = 0;
+        static const int kDataStorageIndex = 1;
+        static const size_t kOffsetOfSeq = 0;
+        static const size_t kOffsetOfValidLen = 8;
+        static const size_t kOffsetOfCrc = 12;
+        static const size_t kHeaderLen = BlockBufferInterface::kSize - kPayloadLen;
+        static const size_t kHintIntervalBlockCnt = 256;
+        static const uint64_t kInvalidSeq = UINT64_MAX;
+        static constexpr const char *const kSignature = "HAYAGUI_BLOCK_LOG_V1___";
+        static const size_t kOffsetOfStart = 24;
+        static const size_t kOffsetOfHint = 32;
+    };
+}
@@ -76,6 +76,25 @@ namespace HayaguiKvs
         {
             return vefs_->GetLen(inode_);
         }
+        virtual Status Sync() override
+        {
+            vefs_->SoftSync(inode_);
+            return Status::CreateOkStatus();
+        }
+        virtual Status Trim(const size_t offset) override
+        {
+            // vefs files can not be trimmed
+            return Status::CreateErrorStatus();
+        }
+        virtual Status Truncate(const size_t len) override
+        {
+            // vefs files can not be truncated
+            return Status::CreateErrorStatus();
+        }
+        virtual size_t GetStartOffset() const override
+        {
+            return 0;
+        }
 
     private:
         static char *const CopyFname(const char *const fname)
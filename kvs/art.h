@@ -0,0 +1,969 @@
+#pragma once
+#include "kvs_interface.h"
+#include "utils/allocator.h"
+#include "utils/arena.h"
+#include "utils/contiguous_key.h"
+#include <new>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace HayaguiKvs
+{
+    // Adaptive radix tree (Leis et al., ICDE 2013).
+    // Inner nodes grow from Node4 to Node16, Node48 and Node256 as children are added, and shrink back on deletion.
+    // A common prefix of a node is kept in the node (path compression), and a subtree with a single key is
+    // just a leaf which holds the whole key (lazy expansion). Only the first kStoredPrefixLen bytes of a prefix
+    // are stored; the rest is read from a leaf under the node when needed.
+    // A key which is a prefix of other keys is held by the node where it ends, as terminal_.
+    // Lookups cost O(key length) regardless of the number of entries, and FindNextKey() is a single descent.
+    class ArtKvs final : public Kvs
+    {
+    public:
+        ArtKvs()
+        {
+        }
+        virtual ~ArtKvs() override
+        {
+            ReleaseSubtree(root_);
+        }
+        ArtKvs(const ArtKvs &obj) = delete;
+        ArtKvs &operator=(const ArtKvs &obj) = delete;
+        virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
+        {
+            ContiguousKey ckey(key);
+            Leaf *leaf = Search(ckey);
+            if (leaf == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            container.Set(leaf->GetValue(), leaf->value_len_);
+            return Status::CreateOkStatus();
+        }
+        virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
+        {
+            ContiguousKey ckey(key);
+            return Insert(root_, ckey, 0, value);
+        }
+        virtual Status Delete(WriteOptions options, const ValidSlice &key) override
+        {
+            ContiguousKey ckey(key);
+            return Remove(root_, ckey, 0);
+        }
+        virtual Optional<KvsEntryIterator> GetFirstIterator() override
+        {
+            if (root_ == nullptr)
+            {
+                return Optional<KvsEntryIterator>::CreateInvalidObj();
+            }
+            Leaf *leaf = Minimum(root_);
+            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(BufferPtrSlice(leaf->GetKey(), leaf->key_len_)));
+        }
+        virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
+        {
+            GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
+            new (base) GenericKvsEntryIteratorBase(*this, key);
+            return KvsEntryIterator(base);
+        }
+        virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
+        {
+            ContiguousKey ckey(key);
+            Leaf *leaf = Successor(root_, ckey, 0);
+            if (leaf == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            container.Set(leaf->GetKey(), leaf->key_len_);
+            return Status::CreateOkStatus();
+        }
+        // bytes used by nodes and leaves, including released ones waiting for reuse
+        size_t GetMemoryUsage() const
+        {
+            return arena_.GetMemoryUsage();
+        }
+
+    private:
+        static const uint32_t kStoredPrefixLen = 8;
+        enum NodeType : uint8_t
+        {
+            kNode4,
+            kNode16,
+            kNode48,
+            kNode256,
+        };
+        // key bytes, followed by value bytes
+        struct Leaf
+        {
+            uint32_t key_len_;
+            uint32_t value_len_;
+            uint32_t value_capacity_;
+            char *GetKey()
+            {
+                return reinterpret_cast<char *>(this + 1);
+            }
+            char *GetValue()
+            {
+                return GetKey() + key_len_;
+            }
+            size_t GetSize() const
+            {
+                return sizeof(Leaf) + key_len_ + value_capacity_;
+            }
+            bool DoesMatch(const ContiguousKey &key)
+            {
+                return static_cast<int>(key_len_) == key.GetLen() && memcmp(GetKey(), key.GetPtr(), key_len_) == 0;
+            }
+            // in the same order as ValidSlice::Cmp
+            int CmpKey(const ContiguousKey &key)
+            {
+                const int cmp_len = static_cast<int>(key_len_) < key.GetLen() ? key_len_ : key.GetLen();
+                const int result = memcmp(GetKey(), key.GetPtr(), cmp_len);
+                if (result != 0)
+                {
+                    return result;
+                }
+                return static_cast<int>(key_len_) - key.GetLen();
+            }
+            uint8_t GetByteAt(const uint32_t index)
+            {
+                return static_cast<uint8_t>(GetKey()[index]);
+            }
+        };
+        // children are pointers to either inner nodes or leaves. pointers to leaves are tagged with the lowest bit.
+        struct Node
+        {
+            explicit Node(NodeType type) : type_(type)
+            {
+            }
+            const NodeType type_;
+            uint16_t cnt_ = 0;
+            uint32_t prefix_len_ = 0;
+            uint8_t prefix_[kStoredPrefixLen];
+            Leaf *terminal_ = nullptr;
+        };
+        // keys_ are sorted
+        struct Node4 : public Node
+        {
+            Node4() : Node(kNode4)
+            {
+            }
+            uint8_t keys_[4];
+            Node *children_[4];
+        };
+        // keys_ are sorted
+        struct Node16 : public Node
+        {
+            Node16() : Node(kNode16)
+            {
+            }
+            uint8_t keys_[16];
+            Node *children_[16];
+        };
+        struct Node48 : public Node
+        {
+            Node48() : Node(kNode48)
+            {
+                memset(child_index_, 0, sizeof(child_index_));
+            }
+            // 0 for empty, or the index of children_ plus 1
+            uint8_t child_index_[256];
+            Node *children_[48];
+        };
+        struct Node256 : public Node
+        {
+            Node256() : Node(kNode256)
+            {
+                memset(children_, 0, sizeof(children_));
+            }
+            Node *children_[256];
+        };
+        static bool IsLeaf(const Node *node)
+        {
+            return (reinterpret_cast<uintptr_t>(node) & 1) != 0;
+        }
+        static Leaf *AsLeaf(Node *node)
+        {
+            return reinterpret_cast<Leaf *>(reinterpret_cast<uintptr_t>(node) & ~static_cast<uintptr_t>(1));
+        }
+        static Node *TagLeaf(Leaf *leaf)
+        {
+            return reinterpret_cast<Node *>(reinterpret_cast<uintptr_t>(leaf) | 1);
+        }
+        static uint8_t GetByteAt(const ContiguousKey &key, const uint32_t index)
+        {
+            return static_cast<uint8_t>(key.GetPtr()[index]);
+        }
+        // bitmask of the keys of Node16 which are equal to the byte
+        static uint32_t MatchNode16(const Node16 *node, const uint8_t byte)
+        {
+#ifdef __SSE2__
+            const __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i *>(node->keys_));
+            const uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8(byte)));
+#else
+            uint32_t mask = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                mask |= static_cast<uint32_t>(node->keys_[i] == byte) << i;
+            }
+#endif
+            return mask & ((1U << node->cnt_) - 1);
+        }
+        // bitmask of the keys of Node16 which are lower than the byte
+        static uint32_t MatchLowerNode16(const Node16 *node, const uint8_t byte)
+        {
+#ifdef __SSE2__
+            // bytes are compared as signed integers, so the sign bits are flipped
+            const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+            const __m128i keys = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(node->keys_)), bias);
+            const __m128i target = _mm_xor_si128(_mm_set1_epi8(byte), bias);
+            const uint32_t mask = _mm_movemask_epi8(_mm_cmplt_epi8(keys, target));
+#else
+            uint32_t mask = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                mask |= static_cast<uint32_t>(node->keys_[i] < byte) << i;
+            }
+#endif
+            return mask & ((1U << node->cnt_) - 1);
+        }
+        static Node **FindChild(Node *node, const uint8_t byte)
+        {
+            switch (node->type_)
+            {
+            case kNode4:
+            {
+                Node4 *n = static_cast<Node4 *>(node);
+                for (int i = 0; i < n->cnt_; i++)
+                {
+                    if (n->keys_[i] == byte)
+                    {
+                        return &n->children_[i];
+                    }
+                }
+                return nullptr;
+            }
+            case kNode16:
+            {
+                Node16 *n = static_cast<Node16 *>(node);
+                const uint32_t mask = MatchNode16(n, byte);
+                return mask == 0 ? nullptr : &n->children_[__builtin_ctz(mask)];
+            }
+            case kNode48:
+            {
+                Node48 *n = static_cast<Node48 *>(node);
+                const int index = n->child_index_[byte];
+                return index == 0 ? nullptr : &n->children_[index - 1];
+            }
+            default:
+            {
+                Node256 *n = static_cast<Node256 *>(node);
+                return n->children_[byte] == nullptr ? nullptr : &n->children_[byte];
+            }
+            }
+        }
+        // returns the child with the lowest byte which is equal to or greater than the given one
+        static Node *FindChildFrom(Node *node, const int from)
+        {
+            switch (node->type_)
+            {
+            case kNode4:
+            {
+                Node4 *n = static_cast<Node4 *>(node);
+                for (int i = 0; i < n->cnt_; i++)
+                {
+                    if (n->keys_[i] >= from)
+                    {
+                        return n->children_[i];
+                    }
+                }
+                return nullptr;
+            }
+            case kNode16:
+            {
+                Node16 *n = static_cast<Node16 *>(node);
+                if (from > 0xff)
+                {
+                    return nullptr;
+                }
+                const int index = __builtin_popcount(MatchLowerNode16(n, from));
+                return index == n->cnt_ ? nullptr : n->children_[index];
+            }
+            case kNode48:
+            {
+                Node48 *n = static_cast<Node48 *>(node);
+                for (int i = from; i < 256; i++)
+                {
+                    if (n->child_index_[i] != 0)
+                    {
+                        return n->children_[n->child_index_[i] - 1];
+                    }
+                }
+                return nullptr;
+            }
+            default:
+            {
+                Node256 *n = static_cast<Node256 *>(node);
+                for (int i = from; i < 256; i++)
+                {
+                    if (n->children_[i] != nullptr)
+                    {
+                        return n->children_[i];
+                    }
+                }
+                return nullptr;
+            }
+            }
+        }
+        static Leaf *Minimum(Node *node)
+        {
+            while (!IsLeaf(node))
+            {
+                if (node->terminal_ != nullptr)
+                {
+                    return node->terminal_;
+                }
+                node = FindChildFrom(node, 0);
+            }
+            return AsLeaf(node);
+        }
+        // the byte of the prefix, which is read from a leaf under the node if it is not stored
+        static uint8_t GetPrefixByteAt(Node *node, const uint32_t depth, const uint32_t index, Leaf *&leaf)
+        {
+            if (index < kStoredPrefixLen)
+            {
+                return node->prefix_[index];
+            }
+            if (leaf == nullptr)
+            {
+                leaf = Minimum(node);
+            }
+            return leaf->GetByteAt(depth + index);
+        }
+        // returns the number of bytes of the prefix which match the key from the depth
+        static uint32_t MatchPrefix(Node *node, const ContiguousKey &key, const uint32_t depth)
+        {
+            const uint32_t remaining = key.GetLen() - depth;
+            const uint32_t max = node->prefix_len_ < remaining ? node->prefix_len_ : remaining;
+            Leaf *leaf = nullptr;
+            for (uint32_t i = 0; i < max; i++)
+            {
+                if (GetPrefixByteAt(node, depth, i, leaf) != GetByteAt(key, depth + i))
+                {
+                    return i;
+                }
+            }
+            return max;
+        }
+        // compares the prefix with the key from the depth, in the order of the keys under the node
+        static int CmpPrefix(Node *node, const ContiguousKey &key, const uint32_t depth)
+        {
+            Leaf *leaf = nullptr;
+            for (uint32_t i = 0; i < node->prefix_len_; i++)
+            {
+                if (depth + i >= static_cast<uint32_t>(key.GetLen()))
+                {
+                    // keys under the node are longer than the key
+                    return 1;
+                }
+                const uint8_t byte = GetPrefixByteAt(node, depth, i, leaf);
+                if (byte != GetByteAt(key, depth + i))
+                {
+                    return byte < GetByteAt(key, depth + i) ? -1 : 1;
+                }
+            }
+            return 0;
+        }
+        // stores the prefix of the leaf key from the depth
+        static void SetPrefix(Node *node, Leaf *leaf, const uint32_t depth, const uint32_t len)
+        {
+            node->prefix_len_ = len;
+            memcpy(node->prefix_, leaf->GetKey() + depth, len < kStoredPrefixLen ? len : kStoredPrefixLen);
+        }
+        Leaf *Search(const ContiguousKey &key)
+        {
+            const uint32_t key_len = key.GetLen();
+            Node *node = root_;
+            uint32_t depth = 0;
+            while (node != nullptr)
+            {
+                if (IsLeaf(node))
+                {
+                    Leaf *leaf = AsLeaf(node);
+                    return leaf->DoesMatch(key) ? leaf : nullptr;
+                }
+                // only stored bytes of the prefix are checked; the leaf is compared with the whole key at last.
+                if (node->prefix_len_ != 0)
+                {
+                    if (depth + node->prefix_len_ > key_len)
+                    {
+                        return nullptr;
+                    }
+                    const uint32_t stored_len = node->prefix_len_ < kStoredPrefixLen ? node->prefix_len_ : kStoredPrefixLen;
+                    if (memcmp(node->prefix_, key.GetPtr() + depth, stored_len) != 0)
+                    {
+                        return nullptr;
+                    }
+                    depth += node->prefix_len_;
+                }
+                if (depth == key_len)
+                {
+                    Leaf *leaf = node->terminal_;
+                    return leaf != nullptr && leaf->DoesMatch(key) ? leaf : nullptr;
+                }
+                Node **child = FindChild(node, GetByteAt(key, depth));
+                node = child == nullptr ? nullptr : *child;
+                depth++;
+            }
+            return nullptr;
+        }
+        // returns the leaf with the lowest key which is greater than the key, in the subtree
+        Leaf *Successor(Node *node, const ContiguousKey &key, uint32_t depth)
+        {
+            if (node == nullptr)
+            {
+                return nullptr;
+            }
+            if (IsLeaf(node))
+            {
+                Leaf *leaf = AsLeaf(node);
+                return leaf->CmpKey(key) > 0 ? leaf : nullptr;
+            }
+            const int result = CmpPrefix(node, key, depth);
+            if (result != 0)
+            {
+                return result > 0 ? Minimum(node) : nullptr;
+            }
+            depth += node->prefix_len_;
+            if (depth == static_cast<uint32_t>(key.GetLen()))
+            {
+                // terminal_ is the key itself, and children are greater
+                Node *child = FindChildFrom(node, 0);
+                return child == nullptr ? nullptr : Minimum(child);
+            }
+            const uint8_t byte = GetByteAt(key, depth);
+            Node **child = FindChild(node, byte);
+            if (child != nullptr)
+            {
+                Leaf *leaf = Successor(*child, key, depth + 1);
+                if (leaf != nullptr)
+                {
+                    return leaf;
+                }
+            }
+            Node *next = FindChildFrom(node, byte + 1);
+            return next == nullptr ? nullptr : Minimum(next);
+        }
+        Status Insert(Node *&ref, const ContiguousKey &key, uint32_t depth, const ValidSlice &value)
+        {
+            const uint32_t key_len = key.GetLen();
+            if (ref == nullptr)
+            {
+                return CreateLeaf(key, value, ref);
+            }
+            if (IsLeaf(ref))
+            {
+                Leaf *leaf = AsLeaf(ref);
+                if (leaf->DoesMatch(key))
+                {
+                    return ReplaceValue(leaf, value, ref);
+                }
+                // the leaf is expanded to a node which holds the common part of both keys as its prefix
+                uint32_t common_len = 0;
+                while (depth + common_len < key_len && depth + common_len < leaf->key_len_ &&
+                       GetByteAt(key, depth + common_len) == leaf->GetByteAt(depth + common_len))
+                {
+                    common_len++;
+                }
+                Node *new_leaf;
+                if (CreateLeaf(key, value, new_leaf).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                Node4 *node = CreateNode<Node4>();
+                SetPrefix(node, leaf, depth, common_len);
+                depth += common_len;
+                AddLeafToNewNode(node, leaf, depth);
+                AddLeafToNewNode(node, AsLeaf(new_leaf), depth);
+                ref = node;
+                return Status::CreateOkStatus();
+            }
+            Node *node = ref;
+            if (node->prefix_len_ != 0)
+            {
+                const uint32_t matched_len = MatchPrefix(node, key, depth);
+                if (matched_len < node->prefix_len_)
+                {
+                    return SplitPrefix(ref, key, depth, matched_len, value);
+                }
+                depth += node->prefix_len_;
+            }
+            if (depth == key_len)
+            {
+                if (node->terminal_ != nullptr)
+                {
+                    Node *terminal = TagLeaf(node->terminal_);
+                    Status s = ReplaceValue(node->terminal_, value, terminal);
+                    node->terminal_ = AsLeaf(terminal);
+                    return s;
+                }
+                Node *new_leaf;
+                if (CreateLeaf(key, value, new_leaf).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                node->terminal_ = AsLeaf(new_leaf);
+                return Status::CreateOkStatus();
+            }
+            const uint8_t byte = GetByteAt(key, depth);
+            Node **child = FindChild(node, byte);
+            if (child != nullptr)
+            {
+                return Insert(*child, key, depth + 1, value);
+            }
+            Node *new_leaf;
+            if (CreateLeaf(key, value, new_leaf).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            AddChild(ref, byte, new_leaf);
+            return Status::CreateOkStatus();
+        }
+        // the key diverges from the prefix of the node at matched_len.
+        // a new node takes the matched part, and the node keeps the rest after the diverging byte.
+        Status SplitPrefix(Node *&ref, const ContiguousKey &key, const uint32_t depth, const uint32_t matched_len, const ValidSlice &value)
+        {
+            Node *node = ref;
+            Node *new_leaf;
+            if (CreateLeaf(key, value, new_leaf).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            Leaf *min_leaf = Minimum(node);
+            Node4 *new_node = CreateNode<Node4>();
+            SetPrefix(new_node, min_leaf, depth, matched_len);
+            const uint8_t diverging_byte = min_leaf->GetByteAt(depth + matched_len);
+            SetPrefix(node, min_leaf, depth + matched_len + 1, node->prefix_len_ - matched_len - 1);
+            Node *new_ref = new_node;
+            AddChild(new_ref, diverging_byte, node);
+            assert(new_ref == new_node);
+            AddLeafToNewNode(new_node, AsLeaf(new_leaf), depth + matched_len);
+            ref = new_node;
+            return Status::CreateOkStatus();
+        }
+        // the node has free slots
+        void AddLeafToNewNode(Node4 *node, Leaf *leaf, const uint32_t depth)
+        {
+            if (leaf->key_len_ == depth)
+            {
+                node->terminal_ = leaf;
+                return;
+            }
+            Node *ref = node;
+            AddChild(ref, leaf->GetByteAt(depth), TagLeaf(leaf));
+            assert(ref == node);
+        }
+        Status Remove(Node *&ref, const ContiguousKey &key, uint32_t depth)
+        {
+            const uint32_t key_len = key.GetLen();
+            if (ref == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (IsLeaf(ref))
+            {
+                Leaf *leaf = AsLeaf(ref);
+                if (!leaf->DoesMatch(key))
+                {
+                    return Status::CreateErrorStatus();
+                }
+                ReleaseLeaf(leaf);
+                ref = nullptr;
+                return Status::CreateOkStatus();
+            }
+            Node *node = ref;
+            const uint32_t node_depth = depth;
+            if (node->prefix_len_ != 0)
+            {
+                if (MatchPrefix(node, key, depth) != node->prefix_len_)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                depth += node->prefix_len_;
+            }
+            if (depth == key_len)
+            {
+                if (node->terminal_ == nullptr || !node->terminal_->DoesMatch(key))
+                {
+                    return Status::CreateErrorStatus();
+                }
+                ReleaseLeaf(node->terminal_);
+                node->terminal_ = nullptr;
+                Shrink(ref, node_depth);
+                return Status::CreateOkStatus();
+            }
+            const uint8_t byte = GetByteAt(key, depth);
+            Node **child = FindChild(node, byte);
+            if (child == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (Remove(*child, key, depth + 1).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (*child == nullptr)
+            {
+                RemoveChild(node, byte);
+                Shrink(ref, node_depth);
+            }
+            return Status::CreateOkStatus();
+        }
+        void AddChild(Node *&ref, const uint8_t byte, Node *child)
+        {
+            Node *node = ref;
+            switch (node->type_)
+            {
+            case kNode4:
+            {
+                Node4 *n = static_cast<Node4 *>(node);
+                if (n->cnt_ == 4)
+                {
+                    Node16 *grown = CreateNode<Node16>();
+                    CopyHeader(grown, n);
+                    memcpy(grown->keys_, n->keys_, sizeof(n->keys_));
+                    memcpy(grown->children_, n->children_, sizeof(n->children_));
+                    ReleaseNode(n);
+                    ref = grown;
+                    AddChild(ref, byte, child);
+                    return;
+                }
+                int index = 0;
+                while (index < n->cnt_ && n->keys_[index] < byte)
+                {
+                    index++;
+                }
+                InsertSorted(n->keys_, n->children_, n->cnt_, index, byte, child);
+                n->cnt_++;
+                return;
+            }
+            case kNode16:
+            {
+                Node16 *n = static_cast<Node16 *>(node);
+                if (n->cnt_ == 16)
+                {
+                    Node48 *grown = CreateNode<Node48>();
+                    CopyHeader(grown, n);
+                    for (int i = 0; i < 16; i++)
+                    {
+                        grown->children_[i] = n->children_[i];
+                        grown->child_index_[n->keys_[i]] = i + 1;
+                    }
+                    ReleaseNode(n);
+                    ref = grown;
+                    AddChild(ref, byte, child);
+                    return;
+                }
+                const int index = __builtin_popcount(MatchLowerNode16(n, byte));
+                InsertSorted(n->keys_, n->children_, n->cnt_, index, byte, child);
+                n->cnt_++;
+                return;
+            }
+            case kNode48:
+            {
+                Node48 *n = static_cast<Node48 *>(node);
+                if (n->cnt_ == 48)
+                {
+                    Node256 *grown = CreateNode<Node256>();
+                    CopyHeader(grown, n);
+                    for (int i = 0; i < 256; i++)
+                    {
+                        if (n->child_index_[i] != 0)
+                        {
+                            grown->children_[i] = n->children_[n->child_index_[i] - 1];
+                        }
+                    }
+                    ReleaseNode(n);
+                    ref = grown;
+                    AddChild(ref, byte, child);
+                    return;
+                }
+                // slots of children_ are packed, as RemoveChild() moves the last one to the hole
+                n->children_[n->cnt_] = child;
+                n->child_index_[byte] = n->cnt_ + 1;
+                n->cnt_++;
+                return;
+            }
+            default:
+            {
+                Node256 *n = static_cast<Node256 *>(node);
+                n->children_[byte] = child;
+                n->cnt_++;
+                return;
+            }
+            }
+        }
+        // the child is already released
+        static void RemoveChild(Node *node, const uint8_t byte)
+        {
+            switch (node->type_)
+            {
+            case kNode4:
+            {
+                Node4 *n = static_cast<Node4 *>(node);
+                RemoveSorted(n->keys_, n->children_, n->cnt_, static_cast<int>(FindChild(n, byte) - n->children_));
+                n->cnt_--;
+                return;
+            }
+            case kNode16:
+            {
+                Node16 *n = static_cast<Node16 *>(node);
+                RemoveSorted(n->keys_, n->children_, n->cnt_, static_cast<int>(FindChild(n, byte) - n->children_));
+                n->cnt_--;
+                return;
+            }
+            case kNode48:
+            {
+                Node48 *n = static_cast<Node48 *>(node);
+                const int index = n->child_index_[byte] - 1;
+                const int last = n->cnt_ - 1;
+                if (index != last)
+                {
+                    for (int i = 0; i < 256; i++)
+                    {
+                        if (n->child_index_[i] == last + 1)
+                        {
+                            n->child_index_[i] = index + 1;
+                            break;
+                        }
+                    }
+                    n->children_[index] = n->children_[last];
+                }
+                n->child_index_[byte] = 0;
+                n->cnt_--;
+                return;
+            }
+            default:
+            {
+                Node256 *n = static_cast<Node256 *>(node);
+                n->children_[byte] = nullptr;
+                n->cnt_--;
+                return;
+            }
+            }
+        }
+        // replaces the node with a smaller one, or removes it when it has only one entry
+        void Shrink(Node *&ref, const uint32_t depth)
+        {
+            Node *node = ref;
+            if (node->cnt_ == 0)
+            {
+                // a node always has at least two entries, so the terminal is left
+                assert(node->terminal_ != nullptr);
+                ref = TagLeaf(node->terminal_);
+                ReleaseNode(node);
+                return;
+            }
+            if (node->cnt_ == 1 && node->terminal_ == nullptr)
+            {
+                Node *child = FindChildFrom(node, 0);
+                if (!IsLeaf(child))
+                {
+                    // the prefix of the node, the byte to the child and the prefix of the child are concatenated
+                    SetPrefix(child, Minimum(child), depth, node->prefix_len_ + 1 + child->prefix_len_);
+                }
+                ref = child;
+                ReleaseNode(node);
+                return;
+            }
+            switch (node->type_)
+            {
+            case kNode16:
+            {
+                Node16 *n = static_cast<Node16 *>(node);
+                if (n->cnt_ > 3)
+                {
+                    return;
+                }
+                Node4 *shrunk = CreateNode<Node4>();
+                CopyHeader(shrunk, n);
+                memcpy(shrunk->keys_, n->keys_, n->cnt_);
+                memcpy(shrunk->children_, n->children_, sizeof(Node *) * n->cnt_);
+                ReleaseNode(n);
+                ref = shrunk;
+                return;
+            }
+            case kNode48:
+            {
+                Node48 *n = static_cast<Node48 *>(node);
+                if (n->cnt_ > 12)
+                {
+                    return;
+                }
+                Node16 *shrunk = CreateNode<Node16>();
+                CopyHeader(shrunk, n);
+                int cnt = 0;
+                for (int i = 0; i < 256; i++)
+                {
+                    if (n->child_index_[i] != 0)
+                    {
+                        shrunk->keys_[cnt] = i;
+                        shrunk->children_[cnt] = n->children_[n->child_index_[i] - 1];
+                        cnt++;
+                    }
+                }
+                ReleaseNode(n);
+                ref = shrunk;
+                return;
+            }
+            case kNode256:
+            {
+                Node256 *n = static_cast<Node256 *>(node);
+                if (n->cnt_ > 37)
+                {
+                    return;
+                }
+                Node48 *shrunk = CreateNode<Node48>();
+                CopyHeader(shrunk, n);
+                int cnt = 0;
+                for (int i = 0; i < 256; i++)
+                {
+                    if (n->children_[i] != nullptr)
+                    {
+                        shrunk->children_[cnt] = n->children_[i];
+                        shrunk->child_index_[i] = cnt + 1;
+                        cnt++;
+                    }
+                }
+                ReleaseNode(n);
+                ref = shrunk;
+                return;
+            }
+            default:
+                return;
+            }
+        }
+        template <int N>
+        static void InsertSorted(uint8_t (&keys)[N], Node *(&children)[N], const int cnt, const int index, const uint8_t byte, Node *child)
+        {
+            memmove(keys + index + 1, keys + index, cnt - index);
+            memmove(children + index + 1, children + index, sizeof(Node *) * (cnt - index));
+            keys[index] = byte;
+            children[index] = child;
+        }
+        template <int N>
+        static void RemoveSorted(uint8_t (&keys)[N], Node *(&children)[N], const int cnt, const int index)
+        {
+            memmove(keys + index, keys + index + 1, cnt - index - 1);
+            memmove(children + index, children + index + 1, sizeof(Node *) * (cnt - index - 1));
+        }
+        static void CopyHeader(Node *dst, const Node *src)
+        {
+            dst->cnt_ = src->cnt_;
+            dst->prefix_len_ = src->prefix_len_;
+            memcpy(dst->prefix_, src->prefix_, kStoredPrefixLen);
+            dst->terminal_ = src->terminal_;
+        }
+        template <class T>
+        T *CreateNode()
+        {
+            return new (arena_.Allocate(sizeof(T))) T();
+        }
+        void ReleaseNode(Node *node)
+        {
+            switch (node->type_)
+            {
+            case kNode4:
+                ReleaseNodeBuffer(static_cast<Node4 *>(node));
+                return;
+            case kNode16:
+                ReleaseNodeBuffer(static_cast<Node16 *>(node));
+                return;
+            case kNode48:
+                ReleaseNodeBuffer(static_cast<Node48 *>(node));
+                return;
+            default:
+                ReleaseNodeBuffer(static_cast<Node256 *>(node));
+                return;
+            }
+        }
+        template <class T>
+        void ReleaseNodeBuffer(T *node)
+        {
+            node->~T();
+            arena_.Release(reinterpret_cast<char *>(node), sizeof(T));
+        }
+        // the created leaf is returned as a tagged pointer
+        Status CreateLeaf(const ContiguousKey &key, const ValidSlice &value, Node *&ref)
+        {
+            const uint32_t key_len = key.GetLen();
+            const uint32_t value_len = value.GetLen();
+            Leaf *leaf = reinterpret_cast<Leaf *>(arena_.Allocate(sizeof(Leaf) + key_len + value_len));
+            leaf->key_len_ = key_len;
+            leaf->value_len_ = value_len;
+            leaf->value_capacity_ = value_len;
+            memcpy(leaf->GetKey(), key.GetPtr(), key_len);
+            if (value.CopyToBuffer(leaf->GetValue()).IsError())
+            {
+                ReleaseLeaf(leaf);
+                return Status::CreateErrorStatus();
+            }
+            ref = TagLeaf(leaf);
+            return Status::CreateOkStatus();
+        }
+        // ref is the tagged pointer to the leaf, which is replaced when the value does not fit
+        Status ReplaceValue(Leaf *leaf, const ValidSlice &value, Node *&ref)
+        {
+            const uint32_t value_len = value.GetLen();
+            if (value_len > leaf->value_capacity_)
+            {
+                ContiguousKey key(BufferPtrSlice(leaf->GetKey(), leaf->key_len_));
+                if (CreateLeaf(key, value, ref).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                ReleaseLeaf(leaf);
+                return Status::CreateOkStatus();
+            }
+            if (value.CopyToBuffer(leaf->GetValue()).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            leaf->value_len_ = value_len;
+            return Status::CreateOkStatus();
+        }
+        void ReleaseLeaf(Leaf *leaf)
+        {
+            arena_.Release(reinterpret_cast<char *>(leaf), leaf->GetSize());
+        }
+        void ReleaseSubtree(Node *node)
+        {
+            if (node == nullptr)
+            {
+                return;
+            }
+            if (IsLeaf(node))
+            {
+                ReleaseLeaf(AsLeaf(node));
+                return;
+            }
+            if (node->terminal_ != nullptr)
+            {
+                ReleaseLeaf(node->terminal_);
+            }
+            for (int i = 0; i < 256; i++)
+            {
+                Node **child = FindChild(node, i);
+                if (child != nullptr)
+                {
+                    ReleaseSubtree(*child);
+                }
+            }
+            ReleaseNode(node);
+        }
+        RecyclingArena arena_;
+        Node *root_ = nullptr;
+    };
+}
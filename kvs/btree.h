@@ -0,0 +1,639 @@
+#pragma once
+#include "kvs_interface.h"
+#include "utils/allocator.h"
+#include "utils/arena.h"
+#include "utils/contiguous_key.h"
+#include <new>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+namespace HayaguiKvs
+{
+    // In-memory B+tree.
+    // Nodes keep 8 bytes of each key as a big-endian integer (head) next to the pointer to the key,
+    // so that a search mostly compares integers in a few cache lines, and reads full keys only when heads are equal.
+    // Heads are taken after the prefix shared by the keys of the node, since keys in a node often share their first bytes.
+    // Leaves are linked, so each step of iteration costs O(1) while the tree is not modified.
+    // Leaves are not merged on deletion; a leaf is removed when it becomes empty.
+    class BTreeKvs final : public Kvs
+    {
+    public:
+        BTreeKvs() : root_(CreateLeaf())
+        {
+        }
+        virtual ~BTreeKvs() override
+        {
+            ReleaseNode(root_, height_);
+        }
+        BTreeKvs(const BTreeKvs &obj) = delete;
+        BTreeKvs &operator=(const BTreeKvs &obj) = delete;
+        virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
+        {
+            ContiguousKey ckey(key);
+            const SearchKey skey(ckey);
+            Leaf *leaf = FindLeaf(skey, nullptr);
+            bool found;
+            const int index = CountLower(leaf, leaf->heads_, leaf->records_, skey, found);
+            if (!found)
+            {
+                return Status::CreateErrorStatus();
+            }
+            leaf->records_[index]->PutValueTo(container);
+            return Status::CreateOkStatus();
+        }
+        virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
+        {
+            ContiguousKey ckey(key);
+            const SearchKey skey(ckey);
+            Path path;
+            Leaf *leaf = FindLeaf(skey, &path);
+            bool found;
+            int index = CountLower(leaf, leaf->heads_, leaf->records_, skey, found);
+            if (found)
+            {
+                return ReplaceValue(leaf->records_[index], value);
+            }
+            if (leaf->cnt_ == kLeafCapacity)
+            {
+                Leaf *new_leaf = SplitLeaf(leaf, path);
+                if (index > leaf->cnt_)
+                {
+                    index -= leaf->cnt_;
+                    leaf = new_leaf;
+                }
+            }
+            Record *rec = CreateRecord(ckey.GetPtr(), ckey.GetLen(), &value);
+            if (rec == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            InsertAt(leaf, leaf->heads_, leaf->records_, index, rec);
+            leaf->cnt_++;
+            version_++;
+            return Status::CreateOkStatus();
+        }
+        virtual Status Delete(WriteOptions options, const ValidSlice &key) override
+        {
+            ContiguousKey ckey(key);
+            const SearchKey skey(ckey);
+            Path path;
+            Leaf *leaf = FindLeaf(skey, &path);
+            bool found;
+            const int index = CountLower(leaf, leaf->heads_, leaf->records_, skey, found);
+            if (!found)
+            {
+                return Status::CreateErrorStatus();
+            }
+            ReleaseRecord(leaf->records_[index]);
+            RemoveAt(leaf->heads_, leaf->records_, leaf->cnt_, index);
+            leaf->cnt_--;
+            version_++;
+            if (leaf->cnt_ == 0 && height_ != 0)
+            {
+                RemoveLeaf(leaf, path);
+            }
+            return Status::CreateOkStatus();
+        }
+        virtual Optional<KvsEntryIterator> GetFirstIterator() override
+        {
+            Node *node = root_;
+            for (int level = height_; level > 0; level--)
+            {
+                node = static_cast<Inner *>(node)->children_[0];
+            }
+            Leaf *leaf = static_cast<Leaf *>(node);
+            if (leaf->cnt_ == 0)
+            {
+                // only the root leaf can be empty
+                return Optional<KvsEntryIterator>::CreateInvalidObj();
+            }
+            return Optional<KvsEntryIterator>::CreateValidObj(KvsEntryIterator(IteratorBase::Create(*this, leaf, 0)));
+        }
+        virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
+        {
+            ContiguousKey ckey(key);
+            const SearchKey skey(ckey);
+            Leaf *leaf = FindLeaf(skey, nullptr);
+            bool found;
+            const int index = CountLower(leaf, leaf->heads_, leaf->records_, skey, found);
+            if (found)
+            {
+                return KvsEntryIterator(IteratorBase::Create(*this, leaf, index));
+            }
+            IteratorBase *base = MemAllocator::alloc<IteratorBase>();
+            new (base) IteratorBase(*this, key, nullptr, 0);
+            return KvsEntryIterator(base);
+        }
+        virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
+        {
+            Leaf *leaf;
+            int index;
+            if (FindSubsequentPosition(key, leaf, index).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            leaf->records_[index]->PutKeyTo(container);
+            return Status::CreateOkStatus();
+        }
+
+    private:
+        static const int kLeafCapacity = 16;
+        static const int kInnerCapacity = 16;
+        static const int kMaxHeight = 32;
+        // key bytes, followed by value bytes. separators in inner nodes have no value.
+        struct Record
+        {
+            uint32_t key_len_;
+            uint32_t value_len_;
+            uint32_t value_capacity_;
+            char *GetKey()
+            {
+                return reinterpret_cast<char *>(this + 1);
+            }
+            char *GetValue()
+            {
+                return GetKey() + key_len_;
+            }
+            size_t GetSize() const
+            {
+                return sizeof(Record) + key_len_ + value_capacity_;
+            }
+            void PutKeyTo(SliceContainer &container)
+            {
+                container.Set(GetKey(), key_len_);
+            }
+            void PutValueTo(SliceContainer &container)
+            {
+                container.Set(GetValue(), value_len_);
+            }
+        };
+        struct Node
+        {
+            int cnt_ = 0;
+            // heads are taken from this offset. the keys of the node share the bytes before it.
+            int prefix_len_ = 0;
+        };
+        struct Leaf : public Node
+        {
+            Leaf *prev_ = nullptr;
+            Leaf *next_ = nullptr;
+            uint64_t heads_[kLeafCapacity];
+            Record *records_[kLeafCapacity];
+        };
+        // cnt_ is the number of separators. children_[i] holds keys lower than separators_[i].
+        struct Inner : public Node
+        {
+            uint64_t heads_[kInnerCapacity];
+            Record *separators_[kInnerCapacity];
+            Node *children_[kInnerCapacity + 1];
+        };
+        struct Path
+        {
+            // indexed by depth. positions_[d] is the index of the child taken at inners_[d].
+            Inner *inners_[kMaxHeight];
+            int positions_[kMaxHeight];
+        };
+        struct SearchKey
+        {
+            explicit SearchKey(const ContiguousKey &key) : ptr_(key.GetPtr()), len_(key.GetLen())
+            {
+            }
+            const char *const ptr_;
+            const int len_;
+        };
+        // Iterator which holds the position of the key in a leaf.
+        // The position is discarded once the tree is modified, and the key is searched again as GenericKvsEntryIteratorBase does.
+        class IteratorBase final : public GenericKvsEntryIteratorBase
+        {
+        public:
+            IteratorBase() = delete;
+            IteratorBase(BTreeKvs &kvs, const ValidSlice &key, Leaf *leaf, int index)
+                : GenericKvsEntryIteratorBase(kvs, key), btree_(kvs), leaf_(leaf), index_(index), version_(kvs.version_)
+            {
+            }
+            virtual ~IteratorBase() override
+            {
+            }
+            static IteratorBase *Create(BTreeKvs &kvs, Leaf *leaf, int index)
+            {
+                Record *rec = leaf->records_[index];
+                IteratorBase *base = MemAllocator::alloc<IteratorBase>();
+                new (base) IteratorBase(kvs, BufferPtrSlice(rec->GetKey(), rec->key_len_), leaf, index);
+                return base;
+            }
+            virtual bool hasNext() override
+            {
+                Leaf *leaf;
+                int index;
+                return GetNextPosition(leaf, index).IsOk();
+            }
+            virtual KvsEntryIteratorBaseInterface *GetNext() override
+            {
+                Leaf *leaf;
+                int index;
+                if (GetNextPosition(leaf, index).IsError())
+                {
+                    return nullptr;
+                }
+                return Create(btree_, leaf, index);
+            }
+            virtual Status Get(ReadOptions options, SliceContainer &container) override
+            {
+                if (!IsPositionValid())
+                {
+                    return GenericKvsEntryIteratorBase::Get(options, container);
+                }
+                leaf_->records_[index_]->PutValueTo(container);
+                return Status::CreateOkStatus();
+            }
+            virtual void Destroy() override
+            {
+                this->~IteratorBase();
+                MemAllocator::free(this);
+            }
+
+        private:
+            bool IsPositionValid() const
+            {
+                return leaf_ != nullptr && version_ == btree_.version_;
+            }
+            Status GetNextPosition(Leaf *&leaf, int &index)
+            {
+                if (!IsPositionValid())
+                {
+                    return btree_.FindSubsequentPosition(key_, leaf, index);
+                }
+                leaf = leaf_;
+                index = index_ + 1;
+                return SkipToAvailablePosition(leaf, index);
+            }
+            BTreeKvs &btree_;
+            Leaf *const leaf_;
+            const int index_;
+            const uint64_t version_;
+        };
+        static uint64_t CalcHead(const char *key, const int len)
+        {
+            uint64_t head = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                head <<= 8;
+                if (i < len)
+                {
+                    head |= static_cast<uint8_t>(key[i]);
+                }
+            }
+            return head;
+        }
+        static uint64_t CalcHead(Record *rec, const int prefix_len)
+        {
+            return CalcHead(rec->GetKey() + prefix_len, rec->key_len_ - prefix_len);
+        }
+        // compares the keys after the prefix, which both share.
+        static int CmpKey(Record *rec, const SearchKey &key, const int prefix_len)
+        {
+            const int cmp_len = static_cast<int>(rec->key_len_) < key.len_ ? rec->key_len_ : key.len_;
+            const int result = memcmp(rec->GetKey() + prefix_len, key.ptr_ + prefix_len, cmp_len - prefix_len);
+            if (result != 0)
+            {
+                return result;
+            }
+            return static_cast<int>(rec->key_len_) - key.len_;
+        }
+        // returns the number of entries whose keys are lower than the key.
+        // the prefix of the node is compared once, then heads are counted without branches,
+        // and full keys are compared only for entries with the same head.
+        // heads are zero-padded, so that different heads are ordered as the keys are.
+        static int CountLower(const Node *node, const uint64_t *heads, Record *const *records, const SearchKey &key, bool &found)
+        {
+            const int cnt = node->cnt_;
+            const int prefix_len = node->prefix_len_;
+            found = false;
+            if (cnt == 0)
+            {
+                return 0;
+            }
+            if (prefix_len != 0)
+            {
+                const int result = memcmp(records[0]->GetKey(), key.ptr_, prefix_len < key.len_ ? prefix_len : key.len_);
+                if (result != 0)
+                {
+                    return result < 0 ? cnt : 0;
+                }
+                if (key.len_ < prefix_len)
+                {
+                    // the key is a prefix of all keys of the node
+                    return 0;
+                }
+            }
+            const uint64_t head = CalcHead(key.ptr_ + prefix_len, key.len_ - prefix_len);
+            int pos = 0;
+            for (int i = 0; i < cnt; i++)
+            {
+                pos += heads[i] < head ? 1 : 0;
+            }
+            while (pos < cnt && heads[pos] == head)
+            {
+                const int result = CmpKey(records[pos], key, prefix_len);
+                if (result >= 0)
+                {
+                    found = result == 0;
+                    break;
+                }
+                pos++;
+            }
+            return pos;
+        }
+        // inserts rec before the entry at index. the node has cnt_ entries before the insertion.
+        static void InsertAt(Node *node, uint64_t *heads, Record **records, const int index, Record *rec)
+        {
+            const int cnt = node->cnt_;
+            memmove(heads + index + 1, heads + index, sizeof(uint64_t) * (cnt - index));
+            memmove(records + index + 1, records + index, sizeof(Record *) * (cnt - index));
+            records[index] = rec;
+            if (index == 0 || index == cnt)
+            {
+                // the prefix may be shortened by a new first or last key
+                UpdateHeads(node, heads, records, cnt + 1);
+                return;
+            }
+            // a key between others shares their prefix
+            heads[index] = CalcHead(rec, node->prefix_len_);
+        }
+        // sets the prefix to the one shared by the first and the last keys, which all keys between them share.
+        // heads other than the first and the last ones must be relative to the current prefix.
+        static void UpdateHeads(Node *node, uint64_t *heads, Record *const *records, const int cnt)
+        {
+            if (cnt == 0)
+            {
+                node->prefix_len_ = 0;
+                return;
+            }
+            Record *first = records[0];
+            Record *last = records[cnt - 1];
+            const int max_len = first->key_len_ < last->key_len_ ? first->key_len_ : last->key_len_;
+            int prefix_len = 0;
+            while (prefix_len < max_len && first->GetKey()[prefix_len] == last->GetKey()[prefix_len])
+            {
+                prefix_len++;
+            }
+            const bool changed = prefix_len != node->prefix_len_;
+            node->prefix_len_ = prefix_len;
+            for (int i = 0; i < cnt; i++)
+            {
+                if (changed || i == 0 || i == cnt - 1)
+                {
+                    heads[i] = CalcHead(records[i], prefix_len);
+                }
+            }
+        }
+        static void RemoveAt(uint64_t *heads, Record **records, const int cnt, const int index)
+        {
+            memmove(heads + index, heads + index + 1, sizeof(uint64_t) * (cnt - index - 1));
+            memmove(records + index, records + index + 1, sizeof(Record *) * (cnt - index - 1));
+        }
+        static Status SkipToAvailablePosition(Leaf *&leaf, int &index)
+        {
+            if (index >= leaf->cnt_)
+            {
+                // leaves other than the root are never empty
+                leaf = leaf->next_;
+                index = 0;
+            }
+            return leaf == nullptr ? Status::CreateErrorStatus() : Status::CreateOkStatus();
+        }
+        Leaf *FindLeaf(const SearchKey &key, Path *path)
+        {
+            Node *node = root_;
+            for (int depth = 0; depth < height_; depth++)
+            {
+                Inner *inner = static_cast<Inner *>(node);
+                bool found;
+                int pos = CountLower(inner, inner->heads_, inner->separators_, key, found);
+                if (found)
+                {
+                    pos++;
+                }
+                if (path != nullptr)
+                {
+                    path->inners_[depth] = inner;
+                    path->positions_[depth] = pos;
+                }
+                node = inner->children_[pos];
+            }
+            return static_cast<Leaf *>(node);
+        }
+        // finds the first entry whose key is greater than the given key
+        Status FindSubsequentPosition(const ValidSlice &key, Leaf *&leaf, int &index)
+        {
+            ContiguousKey ckey(key);
+            const SearchKey skey(ckey);
+            leaf = FindLeaf(skey, nullptr);
+            bool found;
+            index = CountLower(leaf, leaf->heads_, leaf->records_, skey, found);
+            if (found)
+            {
+                index++;
+            }
+            return SkipToAvailablePosition(leaf, index);
+        }
+        // moves the upper half of the leaf to a new leaf, and returns the new one
+        Leaf *SplitLeaf(Leaf *leaf, Path &path)
+        {
+            Leaf *new_leaf = CreateLeaf();
+            const int half = leaf->cnt_ / 2;
+            new_leaf->cnt_ = leaf->cnt_ - half;
+            new_leaf->prefix_len_ = leaf->prefix_len_;
+            memcpy(new_leaf->heads_, leaf->heads_ + half, sizeof(uint64_t) * new_leaf->cnt_);
+            memcpy(new_leaf->records_, leaf->records_ + half, sizeof(Record *) * new_leaf->cnt_);
+            leaf->cnt_ = half;
+            // each half may share a longer prefix
+            UpdateHeads(leaf, leaf->heads_, leaf->records_, leaf->cnt_);
+            UpdateHeads(new_leaf, new_leaf->heads_, new_leaf->records_, new_leaf->cnt_);
+            new_leaf->prev_ = leaf;
+            new_leaf->next_ = leaf->next_;
+            if (leaf->next_ != nullptr)
+            {
+                leaf->next_->prev_ = new_leaf;
+            }
+            leaf->next_ = new_leaf;
+            Record *first = new_leaf->records_[0];
+            Record *separator = CreateRecord(first->GetKey(), first->key_len_, nullptr);
+            InsertIntoParent(path, height_ - 1, separator, new_leaf);
+            return new_leaf;
+        }
+        // inserts the separator and the right node next to the child taken at the depth
+        void InsertIntoParent(Path &path, const int depth, Record *separator, Node *right)
+        {
+            if (depth < 0)
+            {
+                Inner *new_root = CreateInner();
+                new_root->cnt_ = 1;
+                new_root->separators_[0] = separator;
+                UpdateHeads(new_root, new_root->heads_, new_root->separators_, 1);
+                new_root->children_[0] = root_;
+                new_root->children_[1] = right;
+                root_ = new_root;
+                height_++;
+                assert(height_ < kMaxHeight);
+                return;
+            }
+            Inner *inner = path.inners_[depth];
+            int pos = path.positions_[depth];
+            if (inner->cnt_ == kInnerCapacity)
+            {
+                // the middle separator moves up, and the children after it move to the new node
+                Inner *new_inner = CreateInner();
+                const int mid = inner->cnt_ / 2;
+                new_inner->cnt_ = inner->cnt_ - mid - 1;
+                new_inner->prefix_len_ = inner->prefix_len_;
+                memcpy(new_inner->heads_, inner->heads_ + mid + 1, sizeof(uint64_t) * new_inner->cnt_);
+                memcpy(new_inner->separators_, inner->separators_ + mid + 1, sizeof(Record *) * new_inner->cnt_);
+                memcpy(new_inner->children_, inner->children_ + mid + 1, sizeof(Node *) * (new_inner->cnt_ + 1));
+                inner->cnt_ = mid;
+                UpdateHeads(inner, inner->heads_, inner->separators_, inner->cnt_);
+                UpdateHeads(new_inner, new_inner->heads_, new_inner->separators_, new_inner->cnt_);
+                InsertIntoParent(path, depth - 1, inner->separators_[mid], new_inner);
+                if (pos > mid)
+                {
+                    pos -= mid + 1;
+                    inner = new_inner;
+                }
+            }
+            InsertAt(inner, inner->heads_, inner->separators_, pos, separator);
+            memmove(inner->children_ + pos + 2, inner->children_ + pos + 1, sizeof(Node *) * (inner->cnt_ - pos));
+            inner->children_[pos + 1] = right;
+            inner->cnt_++;
+        }
+        void RemoveLeaf(Leaf *leaf, Path &path)
+        {
+            if (leaf->prev_ != nullptr)
+            {
+                leaf->prev_->next_ = leaf->next_;
+            }
+            if (leaf->next_ != nullptr)
+            {
+                leaf->next_->prev_ = leaf->prev_;
+            }
+            ReleaseNodeBuffer(leaf);
+            RemoveFromParent(path, height_ - 1);
+            // the root with a single child is replaced by the child
+            while (height_ != 0 && root_->cnt_ == 0)
+            {
+                Inner *old_root = static_cast<Inner *>(root_);
+                root_ = old_root->children_[0];
+                ReleaseNodeBuffer(old_root);
+                height_--;
+            }
+        }
+        // removes the child taken at the depth, which is already released
+        void RemoveFromParent(Path &path, const int depth)
+        {
+            assert(depth >= 0);
+            Inner *inner = path.inners_[depth];
+            const int pos = path.positions_[depth];
+            if (inner->cnt_ == 0)
+            {
+                // the child was the only one
+                assert(depth != 0);
+                ReleaseNodeBuffer(inner);
+                RemoveFromParent(path, depth - 1);
+                return;
+            }
+            // the separator on the left of the child, or on the right for the first child
+            const int separator_index = pos == 0 ? 0 : pos - 1;
+            ReleaseRecord(inner->separators_[separator_index]);
+            RemoveAt(inner->heads_, inner->separators_, inner->cnt_, separator_index);
+            memmove(inner->children_ + pos, inner->children_ + pos + 1, sizeof(Node *) * (inner->cnt_ - pos));
+            inner->cnt_--;
+        }
+        Status ReplaceValue(Record *&rec, const ValidSlice &value)
+        {
+            const uint32_t len = value.GetLen();
+            if (len > rec->value_capacity_)
+            {
+                Record *new_rec = CreateRecord(rec->GetKey(), rec->key_len_, &value);
+                if (new_rec == nullptr)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                ReleaseRecord(rec);
+                rec = new_rec;
+                return Status::CreateOkStatus();
+            }
+            if (value.CopyToBuffer(rec->GetValue()).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            rec->value_len_ = len;
+            return Status::CreateOkStatus();
+        }
+        Record *CreateRecord(const char *key, const uint32_t key_len, const ValidSlice *value)
+        {
+            const uint32_t value_len = value == nullptr ? 0 : value->GetLen();
+            Record *rec = reinterpret_cast<Record *>(arena_.Allocate(sizeof(Record) + key_len + value_len));
+            rec->key_len_ = key_len;
+            rec->value_len_ = value_len;
+            rec->value_capacity_ = value_len;
+            memcpy(rec->GetKey(), key, key_len);
+            if (value != nullptr && value->CopyToBuffer(rec->GetValue()).IsError())
+            {
+                ReleaseRecord(rec);
+                return nullptr;
+            }
+            return rec;
+        }
+        void ReleaseRecord(Record *rec)
+        {
+            arena_.Release(reinterpret_cast<char *>(rec), rec->GetSize());
+        }
+        Leaf *CreateLeaf()
+        {
+            return new (arena_.Allocate(sizeof(Leaf))) Leaf();
+        }
+        Inner *CreateInner()
+        {
+            return new (arena_.Allocate(sizeof(Inner))) Inner();
+        }
+        void ReleaseNodeBuffer(Leaf *leaf)
+        {
+            leaf->~Leaf();
+            arena_.Release(reinterpret_cast<char *>(leaf), sizeof(Leaf));
+        }
+        void ReleaseNodeBuffer(Inner *inner)
+        {
+            inner->~Inner();
+            arena_.Release(reinterpret_cast<char *>(inner), sizeof(Inner));
+        }
+        // releases the subtree including records. height is 0 for leaves.
+        void ReleaseNode(Node *node, const int height)
+        {
+            if (height == 0)
+            {
+                Leaf *leaf = static_cast<Leaf *>(node);
+                for (int i = 0; i < leaf->cnt_; i++)
+                {
+                    ReleaseRecord(leaf->records_[i]);
+                }
+                ReleaseNodeBuffer(leaf);
+                return;
+            }
+            Inner *inner = static_cast<Inner *>(node);
+            for (int i = 0; i <= inner->cnt_; i++)
+            {
+                ReleaseNode(inner->children_[i], height - 1);
+            }
+            for (int i = 0; i < inner->cnt_; i++)
+            {
+                ReleaseRecord(inner->separators_[i]);
+            }
+            ReleaseNodeBuffer(inner);
+        }
+        RecyclingArena arena_;
+        Node *root_;
+        int height_ = 0;
+        // incremented when entries are inserted or removed, which invalidates positions held by iterators
+        uint64_t version_ = 0;
+    };
+}
@@ -1,22 +1,40 @@
 #pragma once
 #include "kvs_interface.h"
 #include "kvs/simple_kvs.h"
-#include "char_storage/log.h"
+#include "char_storage/log_record.h"
 #include "char_storage/interface.h"
-#include "utils/multipleslice_container.h"
+#include "char_storage/read_ahead.h"
+#include "utils/allocator.h"
+#include "utils/hash_function.h"
+#include <stdint.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace HayaguiKvs
 {
     class CharStorageKvs final : public Kvs
     {
     public:
+        enum class ValueMode
+        {
+            // cache_kvs_ holds the values as well as the keys
+            kCached,
+            // cache_kvs_ holds the locations of the values in the log, and values are read from the storage
+            kSeparated,
+        };
         CharStorageKvs() = delete;
-        CharStorageKvs(AppendOnlyCharStorageInterface &char_storage, Kvs &cache_kvs)
+        // with recovery_thread_cnt > 1, the log is replayed by multiple threads,
+        // so cache_kvs must accept concurrent writes to different keys (e.g. ShardedKvs).
+        CharStorageKvs(AppendOnlyCharStorageInterface &char_storage, Kvs &cache_kvs, const ValueMode value_mode = ValueMode::kCached, const int recovery_thread_cnt = 1)
             : char_storage_(char_storage),
-              log_(char_storage_),
-              cache_kvs_(cache_kvs)
+              cache_kvs_(cache_kvs),
+              value_mode_(value_mode),
+              recovery_thread_cnt_(recovery_thread_cnt)
         {
-            if (log_.Open().IsError())
+            if (char_storage_.Open().IsError())
             {
                 abort();
             }
@@ -29,35 +47,74 @@ namespace HayaguiKvs
         }
         virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
         {
-            return cache_kvs_.Get(options, key, container);
+            if (value_mode_ == ValueMode::kCached)
+            {
+                return cache_kvs_.Get(options, key, container);
+            }
+            SliceContainer location_container;
+            if (cache_kvs_.Get(options, key, location_container).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            uint64_t offset;
+            int len;
+            if (ValueLocation::Decode(location_container, offset, len).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return char_storage_.Read(offset, len, container);
         }
         virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
         {
-            const ValidSlice *slices[3];
-            MultipleValidSliceContainer container(slices, 3);
-            Signature::PutSignature signature;
-            container.Set(&signature.GetSlice());
-            container.Set(&key);
-            container.Set(&value);
-            if (log_.AppendEntries(container).IsError())
+            const size_t record_len = LogRecord::GetPutRecordLen(key.GetLen(), value.GetLen());
+            LocalBufferAllocator::Container buf_container = LocalBufferAllocator::Get()->Alloc(record_len);
+            if (LogRecord::EncodePut(buf_container.GetPtr<char>(), key, value).IsError())
             {
                 return Status::CreateErrorStatus();
             }
-            return cache_kvs_.Put(options, key, value);
+            const size_t offset = char_storage_.GetLen();
+            if (AppendToLog(options, buf_container.GetPtr<char>(), record_len).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (value_mode_ == ValueMode::kCached)
+            {
+                return cache_kvs_.Put(options, key, value);
+            }
+            ValueLocation location(offset + LogRecord::GetPutValuePos(key.GetLen(), value.GetLen()), value.GetLen());
+            return cache_kvs_.Put(options, key, location.GetSlice());
         }
         virtual Status Delete(WriteOptions options, const ValidSlice &key) override
         {
-            const ValidSlice *slices[2];
-            MultipleValidSliceContainer container(slices, 2);
-            Signature::DeleteSignature signature;
-            container.Set(&signature.GetSlice());
-            container.Set(&key);
-            if (log_.AppendEntries(container).IsError())
+            const size_t record_len = LogRecord::GetDeleteRecordLen(key.GetLen());
+            LocalBufferAllocator::Container buf_container = LocalBufferAllocator::Get()->Alloc(record_len);
+            if (LogRecord::EncodeDelete(buf_container.GetPtr<char>(), key).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (AppendToLog(options, buf_container.GetPtr<char>(), record_len).IsError())
             {
                 return Status::CreateErrorStatus();
             }
             return cache_kvs_.Delete(options, key);
         }
+        virtual Status Write(WriteOptions options, WriteBatch &batch) override
+        {
+            if (batch.GetCount() == 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            const size_t offset = char_storage_.GetLen();
+            if (AppendBatchToLog(options, batch).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (value_mode_ == ValueMode::kCached)
+            {
+                return cache_kvs_.Write(options, batch);
+            }
+            return WriteLocationsToCache(options, batch, offset);
+        }
         virtual Optional<KvsEntryIterator> GetFirstIterator() override
         {
             Optional<KvsEntryIterator> cache_iter = cache_kvs_.GetFirstIterator();
@@ -81,124 +138,600 @@ namespace HayaguiKvs
             return cache_kvs_.FindNextKey(key, container);
         }
 
+        // Log compaction rewrites the live entries at the tail of the log, and then trims the log before them,
+        // so that the recovery time is proportional to the live data rather than to the write history.
+        // Writes may be issued between the steps, because they are appended after the entries they supersede.
+        Status StartLogCompaction()
+        {
+            if (IsCompactingLog() || IsBroken())
+            {
+                return Status::CreateErrorStatus();
+            }
+            compacting_log_ = true;
+            checkpoint_start_ = char_storage_.GetLen();
+            log_compaction_cursor_.Release();
+            return Status::CreateOkStatus();
+        }
+        // appends at most max_entry_cnt entries to the log at once
+        Status ContinueLogCompaction(const int max_entry_cnt, bool &done)
+        {
+            done = false;
+            if (!IsCompactingLog())
+            {
+                return Status::CreateErrorStatus();
+            }
+            WriteBatch batch;
+            SliceContainer cursor;
+            if (log_compaction_cursor_.IsSliceAvailable())
+            {
+                cursor.Set(log_compaction_cursor_.CreateConstSlice());
+            }
+            while (batch.GetCount() < max_entry_cnt)
+            {
+                SliceContainer key_container, value_container;
+                if (FindNextKeyForLogCompaction(cursor, key_container).IsError())
+                {
+                    break;
+                }
+                ConstSlice key = key_container.CreateConstSlice();
+                if (Get(ReadOptions(), key, value_container).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                batch.Put(key, value_container.CreateConstSlice());
+                cursor.Set(key);
+            }
+            if (batch.GetCount() != 0)
+            {
+                const size_t offset = char_storage_.GetLen();
+                if (AppendBatchToLog(WriteOptions(), batch).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                // the old locations are invalidated by the trim
+                if (value_mode_ == ValueMode::kSeparated && WriteLocationsToCache(WriteOptions(), batch, offset).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                // the cursor is advanced only after the entries are persisted
+                log_compaction_cursor_.Set(cursor.CreateConstSlice());
+            }
+            if (batch.GetCount() == max_entry_cnt)
+            {
+                return Status::CreateOkStatus();
+            }
+            // all live entries have been appended after checkpoint_start_
+            if (char_storage_.Trim(checkpoint_start_).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            compacting_log_ = false;
+            log_compaction_cursor_.Release();
+            done = true;
+            return Status::CreateOkStatus();
+        }
+        Status CompactLog()
+        {
+            if (StartLogCompaction().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            bool done = false;
+            while (!done)
+            {
+                if (ContinueLogCompaction(kLogCompactionBatchSize, done).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        bool IsCompactingLog() const
+        {
+            return compacting_log_;
+        }
+        // Recovery has found a broken record before the end of the log, and stopped there.
+        // The log is left as it is, and updates are rejected so that nothing is appended after the record.
+        bool IsBroken() const
+        {
+            return broken_;
+        }
+        // the length of the log which is read on recovery
+        size_t GetLogLen() const
+        {
+            return char_storage_.GetLen() - char_storage_.GetStartOffset();
+        }
+
     private:
+        Status AppendToLog(WriteOptions options, const char *const buf, const size_t len)
+        {
+            if (broken_)
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (char_storage_.Append(BufferPtrSlice(buf, len)).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (options.sync && char_storage_.Sync().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Status::CreateOkStatus();
+        }
+        Status AppendBatchToLog(WriteOptions options, WriteBatch &batch)
+        {
+            RecordsEncoder len_calculator(nullptr);
+            if (batch.Iterate(len_calculator).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            const size_t len = len_calculator.GetLen();
+            LocalBufferAllocator::Container buf_container = LocalBufferAllocator::Get()->Alloc(len);
+            RecordsEncoder encoder(buf_container.GetPtr<char>());
+            if (batch.Iterate(encoder).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            // all records in the batch are appended to the log at once
+            return AppendToLog(options, buf_container.GetPtr<char>(), len);
+        }
+        // batch has been appended to the log at offset
+        Status WriteLocationsToCache(WriteOptions options, WriteBatch &batch, const size_t offset)
+        {
+            WriteBatch location_batch;
+            LocationsCollector collector(location_batch, offset);
+            if (batch.Iterate(collector).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return cache_kvs_.Write(options, location_batch);
+        }
+        Status FindNextKeyForLogCompaction(SliceContainer &cursor, SliceContainer &key_container)
+        {
+            if (cursor.IsSliceAvailable())
+            {
+                return cache_kvs_.FindNextKey(cursor.CreateConstSlice(), key_container);
+            }
+            Optional<KvsEntryIterator> iter = cache_kvs_.GetFirstIterator();
+            if (!iter.isPresent())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return iter.get().GetKey(key_container);
+        }
+        // A broken record ends the recovery. If it runs to the end of the log (e.g. torn by a crash),
+        // it is truncated so that later records are not appended after it.
+        // Otherwise acknowledged records may follow it, so the log is kept and the kvs becomes broken.
         void RecoverFromStorage()
         {
-            SequentialReadCharStorageOverRandomReadCharStorage seqread_char_storage(char_storage_);
-            LogReader log(seqread_char_storage);
-            if (log.Open().IsError())
+            size_t end;
+            if (recovery_thread_cnt_ > 1)
+            {
+                ParallelRecovery recovery(*this, recovery_thread_cnt_);
+                end = recovery.Run();
+            }
+            else
+            {
+                // the log before the start offset has been superseded by a log compaction
+                LogRecordReader reader(char_storage_, char_storage_.GetStartOffset());
+                LogRecord record;
+                size_t offset = reader.GetOffset();
+                while (reader.ReadNext(record).IsOk())
+                {
+                    ApplyRecord(record, offset);
+                    offset = reader.GetOffset();
+                }
+                end = reader.GetOffset();
+            }
+            if (end == char_storage_.GetLen())
+            {
+                return;
+            }
+            if (!IsTornTail(end))
             {
+                broken_ = true;
                 return;
             }
-            while (true)
+            if (char_storage_.Truncate(end).IsError())
             {
-                uint8_t signature;
-                if (Signature::RetrieveSignature(log, signature).IsError())
+                abort();
+            }
+        }
+        // whether the broken record at offset runs to the end of the log
+        bool IsTornTail(const size_t offset)
+        {
+            const size_t rest_len = char_storage_.GetLen() - offset;
+            std::vector<char> buf;
+            for (size_t len = kTornTailProbeLen;;)
+            {
+                len = len < rest_len ? len : rest_len;
+                SliceContainer container;
+                int read_len;
+                if (char_storage_.Read(offset, len, container).IsError() ||
+                    container.GetLen(read_len).IsError() || (size_t)read_len != len)
                 {
-                    return;
+                    return false;
                 }
-                if (signature == Signature::kSignaturePut)
+                buf.resize(len);
+                if (container.CopyToBuffer(buf.data()).IsError())
                 {
-                    SliceContainer key_container, value_container;
-                    if (RetrievePutItem(log, key_container, value_container).IsError())
-                    {
-                        abort();
-                    }
-                    if (cache_kvs_.Put(WriteOptions(), key_container.CreateConstSlice(), value_container.CreateConstSlice()).IsError())
-                    {
-                        abort();
-                    }
+                    return false;
                 }
-                else if (signature == Signature::kSignatureDelete)
+                LogRecord record;
+                switch (LogRecord::Parse(buf.data(), len, record))
                 {
-                    SliceContainer key_container;
-                    if (RetrieveDeletedItem(log, key_container).IsError())
-                    {
-                        abort();
-                    }
-                    if (cache_kvs_.Delete(WriteOptions(), key_container.CreateConstSlice()).IsError())
+                case LogRecord::ParseResult::kOk:
+                    // the record is intact, and the recovery has stopped for another reason (e.g. a read error)
+                    return false;
+                case LogRecord::ParseResult::kCorrupted:
+                    return record.GetLen() == rest_len;
+                case LogRecord::ParseResult::kIncomplete:
+                    if (len == rest_len || record.GetLen() > rest_len)
                     {
-                        abort();
+                        return true;
                     }
+                    // the header is not complete in the probe, or the record is longer than it
+                    len = record.GetLen() > len ? record.GetLen() : len * 2;
+                    break;
                 }
-                else
+            }
+        }
+        // the record is at offset in the log
+        void ApplyRecord(const LogRecord &record, const size_t offset)
+        {
+            if (record.GetType() == LogRecord::Type::kDelete)
+            {
+                // a delete issued during a log compaction may follow the checkpoint without the put it deletes,
+                // so deleting an absent key is not an error
+                SliceContainer container;
+                if (cache_kvs_.Delete(WriteOptions(), record.GetKey()).IsError() &&
+                    cache_kvs_.Get(ReadOptions(), record.GetKey(), container).IsOk())
                 {
                     abort();
                 }
+                return;
             }
-        }
-        Status RetrievePutItem(LogReader &log, SliceContainer &key_container, SliceContainer &value_container)
-        {
-            if (log.RetrieveNextEntry(key_container).IsError())
+            if (value_mode_ == ValueMode::kCached)
             {
-                return Status::CreateErrorStatus();
+                if (cache_kvs_.Put(WriteOptions(), record.GetKey(), record.GetValue()).IsError())
+                {
+                    abort();
+                }
+                return;
+            }
+            // values are not copied
+            ValueLocation location(offset + record.GetValuePos(), record.GetValueLen());
+            if (cache_kvs_.Put(WriteOptions(), record.GetKey(), location.GetSlice()).IsError())
+            {
+                abort();
             }
-            return log.RetrieveNextEntry(value_container);
-        }
-        Status RetrieveDeletedItem(LogReader &log, SliceContainer &key_container)
-        {
-            return log.RetrieveNextEntry(key_container);
         }
 
         AppendOnlyCharStorageInterface &char_storage_;
-        LogAppender log_;
         Kvs &cache_kvs_;
+        const ValueMode value_mode_;
+        const int recovery_thread_cnt_;
+        bool compacting_log_ = false;
+        bool broken_ = false;
+        size_t checkpoint_start_ = 0;
+        SliceContainer log_compaction_cursor_;
+        static const int kLogCompactionBatchSize = 64;
+        static const size_t kTornTailProbeLen = 64;
 
-        class Signature
+        // encodes a batch into contiguous records. with a null buffer, only the length is calculated.
+        class RecordsEncoder : public WriteBatchHandlerInterface
         {
         public:
-            static Status RetrieveSignature(LogReader &log, uint8_t &signature)
+            RecordsEncoder(char *const buf) : buf_(buf)
+            {
+            }
+            virtual Status Put(const ValidSlice &key, const ValidSlice &value) override
             {
-                SliceContainer signature_container;
-                if (log.RetrieveNextEntry(signature_container).IsError())
+                if (buf_ != nullptr && LogRecord::EncodePut(buf_ + len_, key, value).IsError())
                 {
                     return Status::CreateErrorStatus();
                 }
-                int len;
-                if (signature_container.GetLen(len).IsError())
+                len_ += LogRecord::GetPutRecordLen(key.GetLen(), value.GetLen());
+                return Status::CreateOkStatus();
+            }
+            virtual Status Delete(const ValidSlice &key) override
+            {
+                if (buf_ != nullptr && LogRecord::EncodeDelete(buf_ + len_, key).IsError())
                 {
                     return Status::CreateErrorStatus();
                 }
-                if (len != 1)
+                len_ += LogRecord::GetDeleteRecordLen(key.GetLen());
+                return Status::CreateOkStatus();
+            }
+            size_t GetLen() const
+            {
+                return len_;
+            }
+
+        private:
+            char *const buf_;
+            size_t len_ = 0;
+        };
+
+        // the offset and the length of a value in the log
+        class ValueLocation
+        {
+        public:
+            ValueLocation(const uint64_t offset, const uint32_t len) : slice_(buf_, kSize)
+            {
+                memcpy(buf_, &offset, sizeof(uint64_t));
+                memcpy(buf_ + sizeof(uint64_t), &len, sizeof(uint32_t));
+            }
+            ValidSlice &GetSlice()
+            {
+                return slice_;
+            }
+            static Status Decode(const SliceContainer &container, uint64_t &offset, int &len)
+            {
+                int container_len;
+                if (container.GetLen(container_len).IsError() || container_len != kSize)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                char buf[kSize];
+                if (container.CopyToBuffer(buf).IsError())
                 {
                     return Status::CreateErrorStatus();
                 }
-                return signature_container.CopyToBuffer((char *)&signature);
+                uint32_t len32;
+                memcpy(&offset, buf, sizeof(uint64_t));
+                memcpy(&len32, buf + sizeof(uint64_t), sizeof(uint32_t));
+                len = len32;
+                return Status::CreateOkStatus();
+            }
+
+        private:
+            static const int kSize = sizeof(uint64_t) + sizeof(uint32_t);
+            char buf_[kSize];
+            BufferPtrSlice slice_;
+        };
+
+        // converts a batch appended to the log into the batch of the locations of its values
+        class LocationsCollector : public WriteBatchHandlerInterface
+        {
+        public:
+            LocationsCollector(WriteBatch &batch, const size_t offset)
+                : batch_(batch), offset_(offset)
+            {
+            }
+            virtual Status Put(const ValidSlice &key, const ValidSlice &value) override
+            {
+                ValueLocation location(offset_ + LogRecord::GetPutValuePos(key.GetLen(), value.GetLen()), value.GetLen());
+                batch_.Put(key, location.GetSlice());
+                offset_ += LogRecord::GetPutRecordLen(key.GetLen(), value.GetLen());
+                return Status::CreateOkStatus();
+            }
+            virtual Status Delete(const ValidSlice &key) override
+            {
+                offset_ += LogRecord::GetDeleteRecordLen(key.GetLen());
+                batch_.Delete(key);
+                return Status::CreateOkStatus();
             }
 
-            class DeleteSignature
+        private:
+            WriteBatch &batch_;
+            size_t offset_;
+        };
+
+        // The calling thread reads the log chunk by chunk, and only finds the boundaries of the records.
+        // Worker i decodes the chunks whose index is i modulo the number of workers: it verifies the records
+        // and sorts them into the partitions by the hash of their keys.
+        // Each worker then applies the records of its partition of every chunk in order,
+        // so records of a key are applied in log order by one thread and the last writer wins.
+        class ParallelRecovery
+        {
+        public:
+            ParallelRecovery(CharStorageKvs &kvs, const int thread_cnt)
+                : kvs_(kvs), thread_cnt_(thread_cnt)
             {
-            public:
-                DeleteSignature() : slice_(buf_, 1)
+                for (int i = 0; i < kMaxChunksInFlight; i++)
                 {
-                    buf_[0] = kSignatureDelete;
+                    slots_[i] = nullptr;
                 }
-                ValidSlice &GetSlice()
+            }
+            // returns the end of the valid records
+            size_t Run()
+            {
+                std::vector<std::thread> workers;
+                for (int i = 0; i < thread_cnt_; i++)
                 {
-                    return slice_;
+                    workers.push_back(std::thread([this, i]() { Work(i); }));
                 }
-            private:
-                char buf_[1];
-                BufferPtrSlice slice_;
+                size_t end = ReadChunks();
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    reading_done_ = true;
+                }
+                cond_.notify_all();
+                for (std::thread &worker : workers)
+                {
+                    worker.join();
+                }
+                // chunks after a broken record are left by the workers
+                for (int i = 0; i < kMaxChunksInFlight; i++)
+                {
+                    delete slots_[i];
+                }
+                return broken_end_ < end ? broken_end_ : end;
+            }
+
+        private:
+            struct Chunk
+            {
+                // the offset of buf in the log
+                size_t offset;
+                // whole records, which are not verified until the chunk is decoded
+                std::vector<char> buf;
+                // records of each partition and their positions in buf
+                std::vector<std::vector<LogRecord>> records;
+                std::vector<std::vector<size_t>> positions;
+                bool decoded = false;
+                bool broken = false;
+                int ref_cnt;
             };
-            class PutSignature
+            size_t ReadChunks()
             {
-            public:
-                PutSignature() : slice_(buf_, 1)
+                size_t read_offset = kvs_.char_storage_.GetStartOffset();
+                const size_t len = kvs_.char_storage_.GetLen();
+                // the next chunk is read while the current one is scanned
+                ReadAheadSequentialReadCharStorage read_ahead_storage(kvs_.char_storage_, kChunkSize);
+                read_ahead_storage.SeekTo(read_offset);
+                std::vector<char> buf;
+                size_t buf_offset = read_offset;
+                bool broken = false;
+                while (!broken && read_offset < len)
                 {
-                    buf_[0] = kSignaturePut;
+                    const size_t read_len = len - read_offset < kChunkSize ? len - read_offset : kChunkSize;
+                    if (ReadAppend(read_ahead_storage, read_len, buf).IsError())
+                    {
+                        break;
+                    }
+                    read_offset += read_len;
+                    size_t pos = 0;
+                    LogRecord record;
+                    LogRecord::ParseResult result;
+                    while ((result = LogRecord::Parse(buf.data() + pos, buf.size() - pos, record, false)) == LogRecord::ParseResult::kOk)
+                    {
+                        pos += record.GetLen();
+                    }
+                    broken = result == LogRecord::ParseResult::kCorrupted;
+                    if (pos == 0)
+                    {
+                        // a record lies over the chunk
+                        continue;
+                    }
+                    // the rest is carried over to the next chunk
+                    Chunk *chunk = new Chunk();
+                    chunk->offset = buf_offset;
+                    chunk->buf.assign(buf.begin(), buf.begin() + pos);
+                    buf.erase(buf.begin(), buf.begin() + pos);
+                    buf_offset += pos;
+                    if (!Publish(chunk))
+                    {
+                        break;
+                    }
                 }
-                ValidSlice &GetSlice()
+                return buf_offset;
+            }
+            Status ReadAppend(SequentialReadCharStorageInterface &storage, const size_t len, std::vector<char> &buf)
+            {
+                SliceContainer container;
+                if (storage.Read(container, len).IsError())
                 {
-                    return slice_;
+                    return Status::CreateErrorStatus();
                 }
-            private:
-                char buf_[1];
-                BufferPtrSlice slice_;
-            };
+                int read_len;
+                if (container.GetLen(read_len).IsError() || (size_t)read_len != len)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                const size_t buf_len = buf.size();
+                buf.resize(buf_len + len);
+                return container.CopyToBuffer(buf.data() + buf_len);
+            }
+            // returns false if a broken record has been found, and the chunk is not needed
+            bool Publish(Chunk *chunk)
+            {
+                chunk->ref_cnt = thread_cnt_;
+                std::unique_lock<std::mutex> lock(mutex_);
+                // the slot of the chunk is reused after all workers have applied the previous chunk in it, which bounds the memory
+                Chunk *&slot = slots_[published_cnt_ % kMaxChunksInFlight];
+                cond_.wait(lock, [this, &slot]() { return slot == nullptr || broken_end_ != SIZE_MAX; });
+                if (broken_end_ != SIZE_MAX)
+                {
+                    delete chunk;
+                    return false;
+                }
+                slot = chunk;
+                published_cnt_++;
+                cond_.notify_all();
+                return true;
+            }
+            // verifies the records of the chunk, and sorts them into the partitions
+            void Decode(Chunk *chunk)
+            {
+                chunk->records.resize(thread_cnt_);
+                chunk->positions.resize(thread_cnt_);
+                for (size_t pos = 0; pos < chunk->buf.size();)
+                {
+                    LogRecord record;
+                    if (LogRecord::Parse(chunk->buf.data() + pos, chunk->buf.size() - pos, record) != LogRecord::ParseResult::kOk)
+                    {
+                        chunk->broken = true;
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        broken_end_ = chunk->offset + pos;
+                        return;
+                    }
+                    const int partition = (int)(FastHash::Calc(record.GetKeyPtr(), record.GetKeyLen()) % thread_cnt_);
+                    chunk->records[partition].push_back(record);
+                    chunk->positions[partition].push_back(pos);
+                    pos += record.GetLen();
+                }
+            }
+            void Work(const int partition)
+            {
+                for (size_t i = 0;; i++)
+                {
+                    Chunk *chunk;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        cond_.wait(lock, [this, i]() { return i < published_cnt_ || reading_done_; });
+                        if (i >= published_cnt_)
+                        {
+                            return;
+                        }
+                        chunk = slots_[i % kMaxChunksInFlight];
+                    }
+                    if (i % thread_cnt_ == (size_t)partition)
+                    {
+                        Decode(chunk);
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        chunk->decoded = true;
+                        cond_.notify_all();
+                    }
+                    else
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        cond_.wait(lock, [chunk]() { return chunk->decoded; });
+                    }
+                    const std::vector<LogRecord> &records = chunk->records[partition];
+                    for (size_t j = 0; j < records.size(); j++)
+                    {
+                        kvs_.ApplyRecord(records[j], chunk->offset + chunk->positions[partition][j]);
+                    }
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (chunk->broken)
+                    {
+                        // the following chunks are not applied
+                        cond_.notify_all();
+                        return;
+                    }
+                    if (--chunk->ref_cnt == 0)
+                    {
+                        delete chunk;
+                        slots_[i % kMaxChunksInFlight] = nullptr;
+                        cond_.notify_all();
+                    }
+                }
+            }
 
-            static const uint8_t kSignaturePut = 0;
-            static const uint8_t kSignatureDelete = 1;
+            static const size_t kChunkSize = 1024 * 1024;
+            static const int kMaxChunksInFlight = 4;
+            CharStorageKvs &kvs_;
+            const int thread_cnt_;
+            std::mutex mutex_;
+            std::condition_variable cond_;
+            Chunk *slots_[kMaxChunksInFlight];
+            size_t published_cnt_ = 0;
+            bool reading_done_ = false;
+            // the offset of the first record whose crc does not match
+            size_t broken_end_ = SIZE_MAX;
         };
     };
 }
\ No newline at end of file
@@ -0,0 +1,458 @@
+#pragma once
+#include "kvs_interface.h"
+#include "utils/allocator.h"
+#include "utils/contiguous_key.h"
+#include "utils/epoch.h"
+#include "common/rtc.h"
+#include <atomic>
+#include <new>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+namespace HayaguiKvs
+{
+    // Skiplist which can be accessed by multiple threads without locks, in the style of the LevelDB/RocksDB memtable.
+    // Elements are linked with CAS and are never unlinked, so traversals are wait-free.
+    // Values are immutable records swapped atomically; a deleted value is nullptr.
+    // Replaced or deleted records are reclaimed with EpochManager, and elements are freed when the kvs is destroyed.
+    // Iterators themselves must not be shared among threads.
+    class ConcurrentSkipListKvs final : public Kvs
+    {
+    public:
+        ConcurrentSkipListKvs() : head_(CreateElement(nullptr, 0, kMaxHeight))
+        {
+            // GlobalBufferAllocator is initialized lazily, which is not thread-safe
+            GlobalBufferAllocator::Get();
+        }
+        virtual ~ConcurrentSkipListKvs() override
+        {
+            Element *ele = head_;
+            while (ele != nullptr)
+            {
+                Element *next = ele->GetNext(0);
+                Value *value = ele->value_.load(std::memory_order_relaxed);
+                if (value != nullptr)
+                {
+                    MemAllocator::free(value);
+                }
+                MemAllocator::free(ele);
+                ele = next;
+            }
+        }
+        ConcurrentSkipListKvs(const ConcurrentSkipListKvs &obj) = delete;
+        ConcurrentSkipListKvs &operator=(const ConcurrentSkipListKvs &obj) = delete;
+        virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
+        {
+            ContiguousKey ckey(key);
+            Element *ele = FindGreaterOrEqual(ckey, nullptr);
+            if (ele == nullptr || !ele->IsKeyEqual(ckey))
+            {
+                return Status::CreateErrorStatus();
+            }
+            return ele->PutValueTo(epoch_manager_, container);
+        }
+        virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
+        {
+            ContiguousKey ckey(key);
+            Value *new_value = CreateValue(value);
+            Element *prev[kMaxHeight];
+            Element *next[kMaxHeight];
+            Element *new_ele = nullptr;
+            while (true)
+            {
+                Element *ele = FindSplice(ckey, prev, next);
+                if (ele != nullptr && ele->IsKeyEqual(ckey))
+                {
+                    if (new_ele != nullptr)
+                    {
+                        // another thread has inserted the key. the element was never published.
+                        MemAllocator::free(new_ele);
+                    }
+                    ele->ReplaceValueWith(epoch_manager_, new_value);
+                    return Status::CreateOkStatus();
+                }
+                if (new_ele == nullptr)
+                {
+                    new_ele = CreateElement(&ckey, new_value, GetRandomHeight());
+                    RaiseMaxHeight(new_ele->height_);
+                }
+                new_ele->SetNextWithoutBarrier(0, next[0]);
+                if (prev[0]->CasNext(0, next[0], new_ele))
+                {
+                    break;
+                }
+            }
+            // the element is visible from now on. upper levels are only shortcuts, so they are linked one by one.
+            for (int level = 1; level < new_ele->height_; level++)
+            {
+                while (true)
+                {
+                    new_ele->SetNextWithoutBarrier(level, next[level]);
+                    if (prev[level]->CasNext(level, next[level], new_ele))
+                    {
+                        break;
+                    }
+                    FindSpliceForLevel(ckey, prev[level], level, prev[level], next[level]);
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        virtual Status Delete(WriteOptions options, const ValidSlice &key) override
+        {
+            ContiguousKey ckey(key);
+            Element *ele = FindGreaterOrEqual(ckey, nullptr);
+            if (ele == nullptr || !ele->IsKeyEqual(ckey))
+            {
+                return Status::CreateErrorStatus();
+            }
+            return ele->Delete(epoch_manager_);
+        }
+        virtual Optional<KvsEntryIterator> GetFirstIterator() override
+        {
+            Element *ele = SkipDeletedElements(head_->GetNext(0));
+            if (ele == nullptr)
+            {
+                return Optional<KvsEntryIterator>::CreateInvalidObj();
+            }
+            return Optional<KvsEntryIterator>::CreateValidObj(KvsEntryIterator(IteratorBase::Create(*this, ele)));
+        }
+        virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
+        {
+            ContiguousKey ckey(key);
+            Element *ele = FindGreaterOrEqual(ckey, nullptr);
+            if (ele != nullptr && ele->IsKeyEqual(ckey))
+            {
+                return KvsEntryIterator(IteratorBase::Create(*this, ele));
+            }
+            SeekIteratorBase *base = MemAllocator::alloc<SeekIteratorBase>();
+            new (base) SeekIteratorBase(*this, key);
+            return KvsEntryIterator(base);
+        }
+        virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
+        {
+            Element *ele = FindNextElement(key);
+            if (ele == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            ele->PutKeyTo(container);
+            return Status::CreateOkStatus();
+        }
+
+    private:
+        static const int kMaxHeight = 12;
+        struct Value
+        {
+            EpochManager::Retirable header_;
+            int len_;
+            char *GetPtr()
+            {
+                return reinterpret_cast<char *>(this + 1);
+            }
+        };
+        // the tower of next pointers and the key bytes follow the header
+        class Element
+        {
+        public:
+            std::atomic<Value *> value_;
+            int key_len_;
+            int height_;
+            Element *GetNext(int level)
+            {
+                return GetTower()[level].load(std::memory_order_acquire);
+            }
+            void SetNextWithoutBarrier(int level, Element *ele)
+            {
+                GetTower()[level].store(ele, std::memory_order_relaxed);
+            }
+            bool CasNext(int level, Element *expected, Element *ele)
+            {
+                return GetTower()[level].compare_exchange_strong(expected, ele, std::memory_order_acq_rel);
+            }
+            char *GetKey()
+            {
+                return reinterpret_cast<char *>(GetTower() + height_);
+            }
+            int CmpKey(const ContiguousKey &key)
+            {
+                const int cmp_len = key_len_ < key.GetLen() ? key_len_ : key.GetLen();
+                const int result = memcmp(GetKey(), key.GetPtr(), cmp_len);
+                if (result != 0)
+                {
+                    return result;
+                }
+                return key_len_ - key.GetLen();
+            }
+            bool IsKeyEqual(const ContiguousKey &key)
+            {
+                return key_len_ == key.GetLen() && memcmp(GetKey(), key.GetPtr(), key_len_) == 0;
+            }
+            bool IsValueAvailable()
+            {
+                return value_.load(std::memory_order_acquire) != nullptr;
+            }
+            void PutKeyTo(SliceContainer &container)
+            {
+                container.Set(GetKey(), key_len_);
+            }
+            Status PutValueTo(EpochManager &epoch_manager, SliceContainer &container)
+            {
+                EpochManager::Guard guard(epoch_manager);
+                Value *value = value_.load(std::memory_order_acquire);
+                if (value == nullptr)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                container.Set(value->GetPtr(), value->len_);
+                return Status::CreateOkStatus();
+            }
+            void ReplaceValueWith(EpochManager &epoch_manager, Value *value)
+            {
+                Value *old_value = value_.exchange(value, std::memory_order_acq_rel);
+                if (old_value != nullptr)
+                {
+                    epoch_manager.Retire(&old_value->header_);
+                }
+            }
+            void InitTower()
+            {
+                for (int i = 0; i < height_; i++)
+                {
+                    new (&GetTower()[i]) std::atomic<Element *>(nullptr);
+                }
+            }
+            Status Delete(EpochManager &epoch_manager)
+            {
+                Value *old_value = value_.exchange(nullptr, std::memory_order_acq_rel);
+                if (old_value == nullptr)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                epoch_manager.Retire(&old_value->header_);
+                return Status::CreateOkStatus();
+            }
+
+        private:
+            std::atomic<Element *> *GetTower()
+            {
+                return reinterpret_cast<std::atomic<Element *> *>(this + 1);
+            }
+        };
+        static Element *SkipDeletedElements(Element *ele)
+        {
+            while (ele != nullptr && !ele->IsValueAvailable())
+            {
+                ele = ele->GetNext(0);
+            }
+            return ele;
+        }
+        static Element *CreateElement(const ContiguousKey *key, Value *value, int height)
+        {
+            const int key_len = key == nullptr ? 0 : key->GetLen();
+            Element *ele = reinterpret_cast<Element *>(MemAllocator::alloc(sizeof(Element) + sizeof(std::atomic<Element *>) * height + key_len));
+            ele->value_.store(value, std::memory_order_relaxed);
+            ele->key_len_ = key_len;
+            ele->height_ = height;
+            ele->InitTower();
+            if (key_len != 0)
+            {
+                memcpy(ele->GetKey(), key->GetPtr(), key_len);
+            }
+            return ele;
+        }
+        static Value *CreateValue(const ValidSlice &slice)
+        {
+            Value *value = reinterpret_cast<Value *>(MemAllocator::alloc(sizeof(Value) + slice.GetLen()));
+            value->len_ = slice.GetLen();
+            if (slice.CopyToBuffer(value->GetPtr()).IsError())
+            {
+                abort();
+            }
+            return value;
+        }
+        int GetMaxHeight()
+        {
+            return max_height_.load(std::memory_order_relaxed);
+        }
+        void RaiseMaxHeight(int height)
+        {
+            int max_height = GetMaxHeight();
+            while (height > max_height)
+            {
+                if (max_height_.compare_exchange_weak(max_height, height))
+                {
+                    break;
+                }
+            }
+        }
+        static int GetRandomHeight()
+        {
+            static thread_local uint64_t state = RtcTaker::get() | 1;
+            int height = 1;
+            while (height < kMaxHeight)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                if ((state & 3) != 0)
+                {
+                    break;
+                }
+                height++;
+            }
+            return height;
+        }
+        Element *FindGreaterOrEqual(const ContiguousKey &key, Element **prev)
+        {
+            Element *ele = head_;
+            int level = GetMaxHeight() - 1;
+            while (true)
+            {
+                Element *next = ele->GetNext(level);
+                if (next != nullptr && next->CmpKey(key) < 0)
+                {
+                    ele = next;
+                    continue;
+                }
+                if (prev != nullptr)
+                {
+                    prev[level] = ele;
+                }
+                if (level == 0)
+                {
+                    return next;
+                }
+                level--;
+            }
+        }
+        // fills prev/next of every level, and returns the first element whose key is not less than the given key.
+        Element *FindSplice(const ContiguousKey &key, Element *prev[kMaxHeight], Element *next[kMaxHeight])
+        {
+            Element *ele = head_;
+            for (int level = kMaxHeight - 1; level >= 0; level--)
+            {
+                FindSpliceForLevel(key, ele, level, prev[level], next[level]);
+                ele = prev[level];
+            }
+            return next[0];
+        }
+        static void FindSpliceForLevel(const ContiguousKey &key, Element *before, int level, Element *&prev, Element *&next)
+        {
+            while (true)
+            {
+                Element *ele = before->GetNext(level);
+                if (ele == nullptr || ele->CmpKey(key) >= 0)
+                {
+                    prev = before;
+                    next = ele;
+                    return;
+                }
+                before = ele;
+            }
+        }
+        Element *FindNextElement(const ValidSlice &key)
+        {
+            ContiguousKey ckey(key);
+            Element *ele = FindGreaterOrEqual(ckey, nullptr);
+            if (ele != nullptr && ele->IsKeyEqual(ckey))
+            {
+                ele = ele->GetNext(0);
+            }
+            return SkipDeletedElements(ele);
+        }
+        class IteratorBase final : public KvsEntryIteratorBaseInterface
+        {
+        public:
+            IteratorBase() = delete;
+            IteratorBase(ConcurrentSkipListKvs &kvs, Element *ele) : kvs_(kvs), ele_(ele)
+            {
+            }
+            virtual ~IteratorBase() override
+            {
+            }
+            static IteratorBase *Create(ConcurrentSkipListKvs &kvs, Element *ele)
+            {
+                IteratorBase *base = MemAllocator::alloc<IteratorBase>();
+                new (base) IteratorBase(kvs, ele);
+                return base;
+            }
+            virtual bool hasNext() override
+            {
+                return SkipDeletedElements(ele_->GetNext(0)) != nullptr;
+            }
+            virtual KvsEntryIteratorBaseInterface *GetNext() override
+            {
+                Element *next = SkipDeletedElements(ele_->GetNext(0));
+                if (next == nullptr)
+                {
+                    return nullptr;
+                }
+                return Create(kvs_, next);
+            }
+            virtual Status Get(ReadOptions options, SliceContainer &container) override
+            {
+                return ele_->PutValueTo(kvs_.epoch_manager_, container);
+            }
+            virtual Status Put(WriteOptions options, ValidSlice &value) override
+            {
+                ele_->ReplaceValueWith(kvs_.epoch_manager_, CreateValue(value));
+                return Status::CreateOkStatus();
+            }
+            virtual Status Delete(WriteOptions options) override
+            {
+                return ele_->Delete(kvs_.epoch_manager_);
+            }
+            virtual Status GetKey(SliceContainer &container) override
+            {
+                ele_->PutKeyTo(container);
+                return Status::CreateOkStatus();
+            }
+            virtual void Destroy() override
+            {
+                this->~IteratorBase();
+                MemAllocator::free(this);
+            }
+
+        private:
+            ConcurrentSkipListKvs &kvs_;
+            Element *const ele_;
+        };
+        // Iterator for a key which is not stored. It hands over to IteratorBase after the first step.
+        class SeekIteratorBase final : public GenericKvsEntryIteratorBase
+        {
+        public:
+            SeekIteratorBase() = delete;
+            SeekIteratorBase(ConcurrentSkipListKvs &kvs, const ValidSlice &key) : GenericKvsEntryIteratorBase(kvs, key), skiplist_(kvs)
+            {
+            }
+            virtual ~SeekIteratorBase() override
+            {
+            }
+            virtual bool hasNext() override
+            {
+                return skiplist_.FindNextElement(key_) != nullptr;
+            }
+            virtual KvsEntryIteratorBaseInterface *GetNext() override
+            {
+                Element *next = skiplist_.FindNextElement(key_);
+                if (next == nullptr)
+                {
+                    return nullptr;
+                }
+                return IteratorBase::Create(skiplist_, next);
+            }
+            virtual void Destroy() override
+            {
+                this->~SeekIteratorBase();
+                MemAllocator::free(this);
+            }
+
+        private:
+            ConcurrentSkipListKvs &skiplist_;
+        };
+        EpochManager epoch_manager_;
+        Element *const head_;
+        std::atomic<int> max_height_{1};
+    };
+}
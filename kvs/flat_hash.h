@@ -0,0 +1,373 @@
+#pragma once
+#include "kvs_interface.h"
+#include "utils/allocator.h"
+#include "utils/arena.h"
+#include "utils/contiguous_key.h"
+#include "utils/hash_function.h"
+#include <new>
+#include <string.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace HayaguiKvs
+{
+    // Open-addressing hash table in the style of Swiss tables.
+    // Each slot has a control byte which holds 7 bits of the hash, and 16 control bytes (a group) are compared at once.
+    // Keys and values live in an arena, which is compacted when the table is rehashed.
+    // Entries are not ordered, so FindNextKey() and each step of iteration cost O(n).
+    class FlatHashKvs final : public Kvs
+    {
+    public:
+        FlatHashKvs() : FlatHashKvs(kGroupWidth)
+        {
+        }
+        explicit FlatHashKvs(size_t initial_capacity)
+        {
+            size_t capacity = kGroupWidth;
+            while (capacity < initial_capacity)
+            {
+                capacity *= 2;
+            }
+            AllocateTable(capacity);
+        }
+        virtual ~FlatHashKvs() override
+        {
+            ReleaseTable();
+        }
+        FlatHashKvs(const FlatHashKvs &obj) = delete;
+        FlatHashKvs &operator=(const FlatHashKvs &obj) = delete;
+        virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
+        {
+            ContiguousKey ckey(key);
+            const uint64_t hash = FastHash::Calc(ckey.GetPtr(), ckey.GetLen());
+            const size_t index = FindIndex(ckey, hash);
+            if (index == kNotFound)
+            {
+                return Status::CreateErrorStatus();
+            }
+            Record *rec = slots_[index];
+            container.Set(rec->GetValue(), rec->value_len_);
+            return Status::CreateOkStatus();
+        }
+        virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
+        {
+            ContiguousKey ckey(key);
+            const uint64_t hash = FastHash::Calc(ckey.GetPtr(), ckey.GetLen());
+            const size_t index = FindIndex(ckey, hash);
+            if (index != kNotFound)
+            {
+                Record *rec = slots_[index];
+                if (static_cast<uint32_t>(value.GetLen()) <= rec->value_capacity_)
+                {
+                    if (value.CopyToBuffer(rec->GetValue()).IsError())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                    rec->value_len_ = value.GetLen();
+                    return Status::CreateOkStatus();
+                }
+                garbage_bytes_ += rec->GetSize();
+                slots_[index] = CreateRecord(arena_, hash, ckey.GetPtr(), ckey.GetLen(), value);
+                if (garbage_bytes_ > kMinGarbageBytesToCompact && garbage_bytes_ * 2 > arena_.GetMemoryUsage())
+                {
+                    Rehash(capacity_);
+                }
+                return Status::CreateOkStatus();
+            }
+            PrepareInsert();
+            const size_t insert_index = FindInsertIndex(hash);
+            if (ctrl_[insert_index] == kDeleted)
+            {
+                tombstone_cnt_--;
+            }
+            ctrl_[insert_index] = H2(hash);
+            slots_[insert_index] = CreateRecord(arena_, hash, ckey.GetPtr(), ckey.GetLen(), value);
+            size_++;
+            return Status::CreateOkStatus();
+        }
+        virtual Status Delete(WriteOptions options, const ValidSlice &key) override
+        {
+            ContiguousKey ckey(key);
+            const uint64_t hash = FastHash::Calc(ckey.GetPtr(), ckey.GetLen());
+            const size_t index = FindIndex(ckey, hash);
+            if (index == kNotFound)
+            {
+                return Status::CreateErrorStatus();
+            }
+            garbage_bytes_ += slots_[index]->GetSize();
+            slots_[index] = nullptr;
+            // probing stops at a group which has an empty slot, so no probe sequence passes through such a group,
+            // and the slot can be emptied instead of leaving a tombstone.
+            if (Group::MatchEmpty(ctrl_ + (index & ~(kGroupWidth - 1))) != 0)
+            {
+                ctrl_[index] = kEmpty;
+            }
+            else
+            {
+                ctrl_[index] = kDeleted;
+                tombstone_cnt_++;
+            }
+            size_--;
+            return Status::CreateOkStatus();
+        }
+        virtual Optional<KvsEntryIterator> GetFirstIterator() override
+        {
+            Record *first = nullptr;
+            for (size_t i = 0; i < capacity_; i++)
+            {
+                if (IsFull(ctrl_[i]) && (first == nullptr || CompareKey(slots_[i], first->GetKey(), first->key_len_) < 0))
+                {
+                    first = slots_[i];
+                }
+            }
+            if (first == nullptr)
+            {
+                return Optional<KvsEntryIterator>::CreateInvalidObj();
+            }
+            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(BufferPtrSlice(first->GetKey(), first->key_len_)));
+        }
+        virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
+        {
+            GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
+            new (base) GenericKvsEntryIteratorBase(*this, key);
+            return KvsEntryIterator(base);
+        }
+        virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
+        {
+            ContiguousKey ckey(key);
+            Record *next = nullptr;
+            for (size_t i = 0; i < capacity_; i++)
+            {
+                if (!IsFull(ctrl_[i]) || CompareKey(slots_[i], ckey.GetPtr(), ckey.GetLen()) <= 0)
+                {
+                    continue;
+                }
+                if (next == nullptr || CompareKey(slots_[i], next->GetKey(), next->key_len_) < 0)
+                {
+                    next = slots_[i];
+                }
+            }
+            if (next == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            container.Set(next->GetKey(), next->key_len_);
+            return Status::CreateOkStatus();
+        }
+        size_t GetMemoryUsage() const
+        {
+            return arena_.GetMemoryUsage() + capacity_ * (sizeof(int8_t) + sizeof(Record *));
+        }
+
+    private:
+        // key and value bytes follow the header
+        struct Record
+        {
+            uint64_t hash_;
+            uint32_t key_len_;
+            uint32_t value_len_;
+            uint32_t value_capacity_;
+            uint32_t padding_;
+            char *GetKey()
+            {
+                return reinterpret_cast<char *>(this + 1);
+            }
+            char *GetValue()
+            {
+                return GetKey() + key_len_;
+            }
+            size_t GetSize() const
+            {
+                return sizeof(Record) + key_len_ + value_capacity_;
+            }
+        };
+        // bit i of the returned mask corresponds to ctrl[i]
+        struct Group
+        {
+            static uint32_t Match(const int8_t *ctrl, const int8_t h2)
+            {
+#ifdef __SSE2__
+                const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+                return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+#else
+                uint32_t mask = 0;
+                for (size_t i = 0; i < kGroupWidth; i++)
+                {
+                    mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+                }
+                return mask;
+#endif
+            }
+            static uint32_t MatchEmpty(const int8_t *ctrl)
+            {
+                return Match(ctrl, kEmpty);
+            }
+            static uint32_t MatchEmptyOrDeleted(const int8_t *ctrl)
+            {
+#ifdef __SSE2__
+                // kEmpty and kDeleted are the only negative values
+                const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+                return _mm_movemask_epi8(group);
+#else
+                uint32_t mask = 0;
+                for (size_t i = 0; i < kGroupWidth; i++)
+                {
+                    mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+                }
+                return mask;
+#endif
+            }
+        };
+        static int8_t H2(const uint64_t hash)
+        {
+            return static_cast<int8_t>(hash & 0x7f);
+        }
+        static size_t H1(const uint64_t hash)
+        {
+            return hash >> 7;
+        }
+        static bool IsFull(const int8_t ctrl)
+        {
+            return ctrl >= 0;
+        }
+        static int CompareKey(Record *rec, const char *key, const int len)
+        {
+            const int cmp_len = static_cast<int>(rec->key_len_) < len ? rec->key_len_ : len;
+            const int result = memcmp(rec->GetKey(), key, cmp_len);
+            if (result != 0)
+            {
+                return result;
+            }
+            return static_cast<int>(rec->key_len_) - len;
+        }
+        // groups are probed in triangular order, which visits every group when the number of groups is a power of 2.
+        size_t FindIndex(const ContiguousKey &key, const uint64_t hash) const
+        {
+            const int8_t h2 = H2(hash);
+            const size_t group_mask = capacity_ / kGroupWidth - 1;
+            size_t group = H1(hash) & group_mask;
+            for (size_t i = 0; i <= group_mask; i++)
+            {
+                const int8_t *const ctrl = ctrl_ + group * kGroupWidth;
+                uint32_t match = Group::Match(ctrl, h2);
+                while (match != 0)
+                {
+                    const size_t index = group * kGroupWidth + __builtin_ctz(match);
+                    Record *rec = slots_[index];
+                    if (rec->hash_ == hash && static_cast<int>(rec->key_len_) == key.GetLen() && memcmp(rec->GetKey(), key.GetPtr(), key.GetLen()) == 0)
+                    {
+                        return index;
+                    }
+                    match &= match - 1;
+                }
+                if (Group::MatchEmpty(ctrl) != 0)
+                {
+                    return kNotFound;
+                }
+                group = (group + i + 1) & group_mask;
+            }
+            return kNotFound;
+        }
+        size_t FindInsertIndex(const uint64_t hash) const
+        {
+            const size_t group_mask = capacity_ / kGroupWidth - 1;
+            size_t group = H1(hash) & group_mask;
+            for (size_t i = 0; i <= group_mask; i++)
+            {
+                const uint32_t match = Group::MatchEmptyOrDeleted(ctrl_ + group * kGroupWidth);
+                if (match != 0)
+                {
+                    return group * kGroupWidth + __builtin_ctz(match);
+                }
+                group = (group + i + 1) & group_mask;
+            }
+            // PrepareInsert() ensures that there is a free slot
+            abort();
+        }
+        void PrepareInsert()
+        {
+            if ((size_ + tombstone_cnt_ + 1) * 8 <= capacity_ * 7)
+            {
+                return;
+            }
+            // grows only when live entries occupy more than half of the limit; otherwise tombstones are just cleaned.
+            Rehash((size_ + 1) * 16 > capacity_ * 7 ? capacity_ * 2 : capacity_);
+        }
+        // rebuilds the table, and copies the live records into a new arena to drop garbage.
+        void Rehash(size_t new_capacity)
+        {
+            int8_t *const old_ctrl = ctrl_;
+            Record **const old_slots = slots_;
+            const size_t old_capacity = capacity_;
+            Arena new_arena;
+            AllocateTable(new_capacity);
+            for (size_t i = 0; i < old_capacity; i++)
+            {
+                if (!IsFull(old_ctrl[i]))
+                {
+                    continue;
+                }
+                Record *rec = old_slots[i];
+                const size_t index = FindInsertIndex(rec->hash_);
+                ctrl_[index] = H2(rec->hash_);
+                slots_[index] = CopyRecord(new_arena, rec);
+            }
+            delete[] old_ctrl;
+            delete[] old_slots;
+            arena_.Swap(new_arena);
+            tombstone_cnt_ = 0;
+            garbage_bytes_ = 0;
+        }
+        void AllocateTable(size_t capacity)
+        {
+            capacity_ = capacity;
+            ctrl_ = new int8_t[capacity];
+            slots_ = new Record *[capacity];
+            memset(ctrl_, kEmpty, capacity);
+        }
+        void ReleaseTable()
+        {
+            delete[] ctrl_;
+            delete[] slots_;
+        }
+        static Record *CreateRecord(Arena &arena, const uint64_t hash, const char *key, const int key_len, const ValidSlice &value)
+        {
+            const int value_len = value.GetLen();
+            Record *rec = reinterpret_cast<Record *>(arena.Allocate(sizeof(Record) + key_len + value_len));
+            rec->hash_ = hash;
+            rec->key_len_ = key_len;
+            rec->value_len_ = value_len;
+            rec->value_capacity_ = value_len;
+            memcpy(rec->GetKey(), key, key_len);
+            if (value.CopyToBuffer(rec->GetValue()).IsError())
+            {
+                abort();
+            }
+            return rec;
+        }
+        static Record *CopyRecord(Arena &arena, Record *rec)
+        {
+            Record *new_rec = reinterpret_cast<Record *>(arena.Allocate(sizeof(Record) + rec->key_len_ + rec->value_len_));
+            new_rec->hash_ = rec->hash_;
+            new_rec->key_len_ = rec->key_len_;
+            new_rec->value_len_ = rec->value_len_;
+            new_rec->value_capacity_ = rec->value_len_;
+            memcpy(new_rec->GetKey(), rec->GetKey(), rec->key_len_ + rec->value_len_);
+            return new_rec;
+        }
+        static const size_t kGroupWidth = 16;
+        static const size_t kNotFound = SIZE_MAX;
+        static const int8_t kEmpty = -128;
+        static const int8_t kDeleted = -2;
+        static const size_t kMinGarbageBytesToCompact = 64 * 1024;
+        int8_t *ctrl_;
+        Record **slots_;
+        size_t capacity_;
+        size_t size_ = 0;
+        size_t tombstone_cnt_ = 0;
+        size_t garbage_bytes_ = 0;
+        Arena arena_;
+    };
+}
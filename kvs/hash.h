@@ -1,5 +1,8 @@
 #pragma once
 #include "kvs_interface.h"
+#include "utils/hash_function.h"
+#include <algorithm>
+#include <vector>
 
 namespace HayaguiKvs
 {
@@ -28,96 +31,190 @@ namespace HayaguiKvs
         }
     };
 
+    // hashes the contiguous key bytes with FastHash. keys are copied once with CopyToBuffer().
+    // it is stateless and can be used from multiple threads.
+    class FastHashCalculator final : public HashCalculatorInterface
+    {
+    public:
+        virtual const int CalcHash(const int bucket_size, const ValidSlice &key) override
+        {
+            return static_cast<int>(CalcHash64(key) % static_cast<uint64_t>(bucket_size));
+        }
+        static uint64_t CalcHash64(const ValidSlice &key)
+        {
+            const int len = key.GetLen();
+            if (len <= kStackBufLen)
+            {
+                char buf[kStackBufLen];
+                if (key.CopyToBuffer(buf).IsError())
+                {
+                    abort();
+                }
+                return FastHash::Calc(buf, len);
+            }
+            // LocalBufferAllocator is not used, so that the calculator can be shared among threads (e.g. by ShardedKvs)
+            char *const buf = MemAllocator::alloc(len);
+            if (key.CopyToBuffer(buf).IsError())
+            {
+                abort();
+            }
+            const uint64_t hash = FastHash::Calc(buf, len);
+            MemAllocator::free(buf);
+            return hash;
+        }
+
+    private:
+        static const int kStackBufLen = 64;
+    };
+
+    // Buckets are doubled when the number of entries exceeds max_load_factor * bucket_size.
+    // Resizing is incremental: a few buckets of the old table migrate to the new one on each modification,
+    // and a key lives either in the new table or in a bucket of the old table which has not migrated yet.
+    // The underlying kvs of a bucket is allocated when a key is first written into it.
     class HashKvs final : public Kvs
     {
     public:
         HashKvs() = delete;
-        HashKvs(int bucket_size, KvsAllocatorInterface &underlying_kvs_allocator, HashCalculatorInterface &hash_calcurator)
-            : bucket_size_(bucket_size),
-              buckets_(GenerateBuckets(bucket_size, underlying_kvs_allocator)),
-              hash_calcurator_(hash_calcurator)
+        HashKvs(int bucket_size, KvsAllocatorInterface &underlying_kvs_allocator, HashCalculatorInterface &hash_calcurator, int max_load_factor = kDefaultMaxLoadFactor)
+            : table_(bucket_size),
+              old_table_(),
+              underlying_kvs_allocator_(underlying_kvs_allocator),
+              hash_calcurator_(hash_calcurator),
+              max_load_factor_(max_load_factor)
         {
         }
         ~HashKvs()
         {
-            for (int i = 0; i < bucket_size_; i++)
-            {
-                delete buckets_[i];
-            }
-            delete[] buckets_;
+            table_.Release();
+            old_table_.Release();
+            ReleaseRetiredBuckets();
         }
         HashKvs(const HashKvs &obj) = delete;
         HashKvs &operator=(const HashKvs &obj) = delete;
         virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
         {
-            const int index = hash_calcurator_.CalcHash(bucket_size_, key);
-            return buckets_[index]->Get(options, key, container);
+            Kvs *bucket = table_.buckets_[hash_calcurator_.CalcHash(table_.size_, key)];
+            if (bucket != nullptr && bucket->Get(options, key, container).IsOk())
+            {
+                return Status::CreateOkStatus();
+            }
+            Kvs *old_bucket = GetOldBucket(key);
+            if (old_bucket == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            return old_bucket->Get(options, key, container);
         }
         virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
         {
-            const int index = hash_calcurator_.CalcHash(bucket_size_, key);
-            return buckets_[index]->Put(options, key, value);
+            version_++;
+            StepResizing();
+            return PutInternal(options, key, value);
         }
         virtual Status Delete(WriteOptions options, const ValidSlice &key) override
         {
-            const int index = hash_calcurator_.CalcHash(bucket_size_, key);
-            return buckets_[index]->Delete(options, key);
+            version_++;
+            StepResizing();
+            return DeleteInternal(options, key);
+        }
+        virtual Status MultiGet(ReadOptions options, const ValidSlice *keys[], const int n, SliceContainer containers[]) override
+        {
+            if (n <= 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            if (IsResizing())
+            {
+                // keys may be in either table, so they are looked up one by one until the migration finishes.
+                return Kvs::MultiGet(options, keys, n, containers);
+            }
+            const int bucket_size = table_.size_;
+            Kvs **const buckets = table_.buckets_;
+            // every key is hashed up front and the keys are sorted by bucket, packed as (bucket << 32 | index),
+            // so that each bucket is visited once, in order, while the next one is prefetched.
+            // only the n keys are sorted, so the cost does not depend on the number of buckets.
+            LocalBufferAllocator::Container buf_container = LocalBufferAllocator::Get()->Alloc(sizeof(uint64_t) * n);
+            uint64_t *const order = buf_container.GetPtr<uint64_t>();
+            for (int i = 0; i < n; i++)
+            {
+                order[i] = (static_cast<uint64_t>(hash_calcurator_.CalcHash(bucket_size, *keys[i])) << 32) | static_cast<uint32_t>(i);
+            }
+            std::sort(order, order + n);
+            for (int j = 0; j < n; j++)
+            {
+                const int bucket = static_cast<int>(order[j] >> 32);
+                const int i = static_cast<int>(order[j] & 0xFFFFFFFF);
+                if (j + 1 < n && static_cast<int>(order[j + 1] >> 32) != bucket)
+                {
+                    __builtin_prefetch(buckets[order[j + 1] >> 32]);
+                }
+                containers[i].Release();
+                if (buckets[bucket] == nullptr || buckets[bucket]->Get(options, *keys[i], containers[i]).IsError())
+                {
+                    containers[i].Release();
+                }
+            }
+            return Status::CreateOkStatus();
         }
         virtual Optional<KvsEntryIterator> GetFirstIterator() override
         {
-            LowerSliceContainer key_container;
-            for (int i = 0; i < bucket_size_; i++)
+            const int bucket_id_cnt = GetBucketIdCnt();
+            CursorHeap *heap = CursorHeap::Create(bucket_id_cnt, version_);
+            for (int i = 0; i < bucket_id_cnt; i++)
             {
-                Optional<KvsEntryIterator> optional_bucket_iter = buckets_[i]->GetFirstIterator();
-                if (!optional_bucket_iter.isPresent())
+                Kvs *bucket = GetBucketById(i);
+                if (bucket != nullptr)
                 {
-                    continue;
+                    heap->Push(i, bucket->GetFirstIterator());
                 }
-                SliceContainer iter_key_container;
-                Status s1 = optional_bucket_iter.get().GetKey(iter_key_container);
-                assert(s1.IsOk());
-                key_container.SetIfLower(std::move(iter_key_container));
             }
-            if (!key_container.IsSliceAvailable())
+            if (heap->IsEmpty())
             {
+                CursorHeap::Destroy(heap);
                 return Optional<KvsEntryIterator>::CreateInvalidObj();
             }
-            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(key_container.CreateConstSlice()));
+            int bucket_id;
+            KvsEntryIterator bucket_iter = heap->Pop(bucket_id);
+            return Optional<KvsEntryIterator>::CreateValidObj(KvsEntryIterator(MergeIteratorBase::Create(*this, bucket_id, std::move(bucket_iter), heap)));
         }
         virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
         {
-            GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
-            new (base) GenericKvsEntryIteratorBase(*this, key);
-            return KvsEntryIterator(base);
+            int bucket_id = hash_calcurator_.CalcHash(table_.size_, key);
+            if (IsResizing())
+            {
+                const int old_index = hash_calcurator_.CalcHash(old_table_.size_, key);
+                Kvs *old_bucket = old_table_.buckets_[old_index];
+                SliceContainer container;
+                if (old_bucket != nullptr && old_bucket->Get(ReadOptions(), key, container).IsOk())
+                {
+                    return KvsEntryIterator(MergeIteratorBase::Create(*this, table_.size_ + old_index, old_bucket->GetIterator(key), nullptr));
+                }
+            }
+            return KvsEntryIterator(MergeIteratorBase::Create(*this, bucket_id, table_.GetOrCreateBucket(bucket_id, underlying_kvs_allocator_)->GetIterator(key), nullptr));
         }
         virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
         {
             LowerSliceContainer key_container;
-            for (int i = 0; i < bucket_size_; i++)
+            const int bucket_id_cnt = GetBucketIdCnt();
+            for (int i = 0; i < bucket_id_cnt; i++)
             {
-                Optional<KvsEntryIterator> optional_bucket_iter = buckets_[i]->GetFirstIterator();
-                while (optional_bucket_iter.isPresent())
+                Kvs *bucket = GetBucketById(i);
+                SliceContainer bucket_key_container;
+                if (bucket != nullptr && bucket->FindNextKey(key, bucket_key_container).IsOk())
                 {
-                    SliceContainer iter_key_container;
-                    KvsEntryIterator bucket_iter = optional_bucket_iter.get();
-                    Status s1 = bucket_iter.GetKey(iter_key_container);
-                    assert(s1.IsOk());
-
-                    CmpResult result;
-                    if (iter_key_container.Cmp(key, result).IsError())
-                    {
-                        abort();
-                    }
-                    if (result.IsGreater())
-                    {
-                        key_container.SetIfLower(std::move(iter_key_container));
-                        break;
-                    }
-                    optional_bucket_iter = std::move(bucket_iter.GetNext());
+                    key_container.SetIfLower(std::move(bucket_key_container));
                 }
             }
             return key_container.SetTo(container);
         }
+        int GetBucketSize() const
+        {
+            return table_.size_;
+        }
+        bool IsResizing() const
+        {
+            return old_table_.buckets_ != nullptr;
+        }
 
     private:
         class LowerSliceContainer
@@ -163,17 +260,459 @@ namespace HayaguiKvs
         private:
             SliceContainer container_;
         };
-        static Kvs **GenerateBuckets(int bucket_size, KvsAllocatorInterface &underlying_kvs_allocator)
+        // Holds at most one cursor per bucket, ordered by the key of the cursor.
+        class CursorHeap
+        {
+        public:
+            CursorHeap() = delete;
+            CursorHeap(int bucket_id_cnt, uint64_t version)
+                : cursors_(new Cursor[bucket_id_cnt]), heap_(new int[bucket_id_cnt]), version_(version)
+            {
+            }
+            ~CursorHeap()
+            {
+                delete[] cursors_;
+                delete[] heap_;
+            }
+            CursorHeap(const CursorHeap &obj) = delete;
+            CursorHeap &operator=(const CursorHeap &obj) = delete;
+            static CursorHeap *Create(int bucket_id_cnt, uint64_t version)
+            {
+                CursorHeap *heap = MemAllocator::alloc<CursorHeap>();
+                new (heap) CursorHeap(bucket_id_cnt, version);
+                return heap;
+            }
+            static void Destroy(CursorHeap *heap)
+            {
+                heap->~CursorHeap();
+                MemAllocator::free(heap);
+            }
+            uint64_t GetVersion() const
+            {
+                return version_;
+            }
+            bool IsEmpty() const
+            {
+                return size_ == 0;
+            }
+            void Push(int bucket, Optional<KvsEntryIterator> &&optional_iter)
+            {
+                if (!optional_iter.isPresent())
+                {
+                    return;
+                }
+                cursors_[bucket].Set(optional_iter.get());
+                int i = size_;
+                size_++;
+                while (i > 0)
+                {
+                    const int parent = (i - 1) / 2;
+                    if (!IsLower(bucket, heap_[parent]))
+                    {
+                        break;
+                    }
+                    heap_[i] = heap_[parent];
+                    i = parent;
+                }
+                heap_[i] = bucket;
+            }
+            KvsEntryIterator Pop(int &bucket)
+            {
+                assert(size_ > 0);
+                bucket = heap_[0];
+                size_--;
+                const int last = heap_[size_];
+                int i = 0;
+                while (true)
+                {
+                    int child = i * 2 + 1;
+                    if (child >= size_)
+                    {
+                        break;
+                    }
+                    if (child + 1 < size_ && IsLower(heap_[child + 1], heap_[child]))
+                    {
+                        child++;
+                    }
+                    if (!IsLower(heap_[child], last))
+                    {
+                        break;
+                    }
+                    heap_[i] = heap_[child];
+                    i = child;
+                }
+                heap_[i] = last;
+                return cursors_[bucket].Take();
+            }
+
+        private:
+            class Cursor
+            {
+            public:
+                Cursor() : iter_(nullptr)
+                {
+                }
+                ~Cursor()
+                {
+                    Reset();
+                }
+                void Set(KvsEntryIterator &&iter)
+                {
+                    Reset();
+                    iter_ = new (buf_) KvsEntryIterator(std::move(iter));
+                    Status s1 = iter_->GetKey(key_container_);
+                    assert(s1.IsOk());
+                }
+                KvsEntryIterator Take()
+                {
+                    assert(iter_ != nullptr);
+                    KvsEntryIterator iter(std::move(*iter_));
+                    Reset();
+                    return iter;
+                }
+                const SliceContainer &GetKey() const
+                {
+                    return key_container_;
+                }
+
+            private:
+                void Reset()
+                {
+                    if (iter_ != nullptr)
+                    {
+                        iter_->~KvsEntryIterator();
+                        iter_ = nullptr;
+                    }
+                }
+                KvsEntryIterator *iter_;
+                char buf_[sizeof(KvsEntryIterator)] __attribute__((aligned(8)));
+                SliceContainer key_container_;
+            };
+            bool IsLower(int bucket1, int bucket2) const
+            {
+                CmpResult result;
+                if (cursors_[bucket1].GetKey().Cmp(cursors_[bucket2].GetKey(), result).IsError())
+                {
+                    abort();
+                }
+                return result.IsLower();
+            }
+            Cursor *const cursors_;
+            int *const heap_;
+            int size_ = 0;
+            const uint64_t version_;
+        };
+        // Iterator which merges the iterators of all buckets in the order of keys.
+        // The cursors of the other buckets are handed over to the next iterator, so a scan costs O(log B) per step.
+        // When the kvs is modified, or GetNext() is called twice, the cursors are rebuilt from the current key.
+        // Once the buckets are changed by resizing, the bucket of the iterator is only used to get the current key,
+        // and everything else is looked up by the key.
+        class MergeIteratorBase final : public KvsEntryIteratorBaseInterface
+        {
+        public:
+            MergeIteratorBase() = delete;
+            MergeIteratorBase(HashKvs &kvs, int bucket, KvsEntryIterator &&bucket_iter, CursorHeap *heap)
+                : kvs_(kvs), bucket_(bucket), bucket_iter_(std::move(bucket_iter)), heap_(heap), layout_version_(kvs.layout_version_)
+            {
+                kvs_.iterator_cnt_++;
+            }
+            virtual ~MergeIteratorBase() override
+            {
+                ReleaseHeap();
+                kvs_.iterator_cnt_--;
+            }
+            static MergeIteratorBase *Create(HashKvs &kvs, int bucket, KvsEntryIterator &&bucket_iter, CursorHeap *heap)
+            {
+                MergeIteratorBase *base = MemAllocator::alloc<MergeIteratorBase>();
+                new (base) MergeIteratorBase(kvs, bucket, std::move(bucket_iter), heap);
+                return base;
+            }
+            virtual bool hasNext() override
+            {
+                PrepareHeap();
+                return !heap_->IsEmpty();
+            }
+            virtual KvsEntryIteratorBaseInterface *GetNext() override
+            {
+                PrepareHeap();
+                if (heap_->IsEmpty())
+                {
+                    return nullptr;
+                }
+                int bucket;
+                KvsEntryIterator next_bucket_iter = heap_->Pop(bucket);
+                CursorHeap *heap = heap_;
+                heap_ = nullptr;
+                return Create(kvs_, bucket, std::move(next_bucket_iter), heap);
+            }
+            virtual Status Get(ReadOptions options, SliceContainer &container) override
+            {
+                if (!kvs_.IsResizing() && !IsRelocated())
+                {
+                    return bucket_iter_.Get(options, container);
+                }
+                // the key may have moved to the new table
+                SliceContainer key_container;
+                Status s1 = bucket_iter_.GetKey(key_container);
+                assert(s1.IsOk());
+                return kvs_.Get(options, key_container.CreateConstSlice(), container);
+            }
+            virtual Status Put(WriteOptions options, ValidSlice &value) override
+            {
+                SliceContainer key_container;
+                Status s1 = bucket_iter_.GetKey(key_container);
+                assert(s1.IsOk());
+                return kvs_.PutInternal(options, key_container.CreateConstSlice(), value);
+            }
+            virtual Status Delete(WriteOptions options) override
+            {
+                SliceContainer key_container;
+                Status s1 = bucket_iter_.GetKey(key_container);
+                assert(s1.IsOk());
+                return kvs_.DeleteInternal(options, key_container.CreateConstSlice());
+            }
+            virtual Status GetKey(SliceContainer &container) override
+            {
+                return bucket_iter_.GetKey(container);
+            }
+            virtual void Destroy() override
+            {
+                this->~MergeIteratorBase();
+                MemAllocator::free(this);
+            }
+
+        private:
+            // the bucket of the iterator has migrated, or its id has changed
+            bool IsRelocated() const
+            {
+                return layout_version_ != kvs_.layout_version_;
+            }
+            void PrepareHeap()
+            {
+                if (heap_ != nullptr && heap_->GetVersion() != kvs_.version_)
+                {
+                    ReleaseHeap();
+                }
+                if (heap_ == nullptr)
+                {
+                    const int bucket_id_cnt = kvs_.GetBucketIdCnt();
+                    heap_ = CursorHeap::Create(bucket_id_cnt, kvs_.version_);
+                    // a relocated iterator does not belong to any of the buckets, so all of them are searched
+                    const bool relocated = IsRelocated();
+                    successor_pushed_ = relocated;
+                    SliceContainer key_container;
+                    Status s1 = bucket_iter_.GetKey(key_container);
+                    assert(s1.IsOk());
+                    ConstSlice key = key_container.CreateConstSlice();
+                    for (int i = 0; i < bucket_id_cnt; i++)
+                    {
+                        Kvs *bucket = kvs_.GetBucketById(i);
+                        if ((relocated || i != bucket_) && bucket != nullptr)
+                        {
+                            heap_->Push(i, bucket->GetIterator(key).GetNext());
+                        }
+                    }
+                }
+                if (!successor_pushed_)
+                {
+                    // the successor in the same bucket is pushed lazily, as the iterator may not be advanced at all.
+                    heap_->Push(bucket_, bucket_iter_.GetNext());
+                    successor_pushed_ = true;
+                }
+            }
+            void ReleaseHeap()
+            {
+                if (heap_ != nullptr)
+                {
+                    CursorHeap::Destroy(heap_);
+                    heap_ = nullptr;
+                }
+            }
+            HashKvs &kvs_;
+            const int bucket_;
+            KvsEntryIterator bucket_iter_;
+            CursorHeap *heap_;
+            bool successor_pushed_ = false;
+            const uint64_t layout_version_;
+        };
+        class Table
+        {
+        public:
+            Table() : size_(0), buckets_(nullptr)
+            {
+            }
+            explicit Table(int size) : size_(size), buckets_(new Kvs *[size]())
+            {
+            }
+            Kvs *GetOrCreateBucket(const int index, KvsAllocatorInterface &underlying_kvs_allocator)
+            {
+                if (buckets_[index] == nullptr)
+                {
+                    buckets_[index] = underlying_kvs_allocator.Allocate();
+                }
+                return buckets_[index];
+            }
+            void Release()
+            {
+                if (buckets_ == nullptr)
+                {
+                    return;
+                }
+                for (int i = 0; i < size_; i++)
+                {
+                    delete buckets_[i];
+                }
+                delete[] buckets_;
+                size_ = 0;
+                buckets_ = nullptr;
+            }
+            int size_;
+            Kvs **buckets_; // nullptr until a key is written, and buckets of the old table are set to nullptr once they migrate
+        };
+        // iterators refer buckets by id. ids in [0, table_.size_) are the buckets of the current table,
+        // and the rest are the buckets of the old table.
+        int GetBucketIdCnt() const
+        {
+            return table_.size_ + old_table_.size_;
+        }
+        Kvs *GetBucketById(int id) const
+        {
+            if (id < table_.size_)
+            {
+                return table_.buckets_[id];
+            }
+            return old_table_.buckets_[id - table_.size_];
+        }
+        Kvs *GetOldBucket(const ValidSlice &key)
+        {
+            if (!IsResizing())
+            {
+                return nullptr;
+            }
+            return old_table_.buckets_[hash_calcurator_.CalcHash(old_table_.size_, key)];
+        }
+        // modifications from iterators do not change the set of other keys, so they do not invalidate the cursors.
+        Status PutInternal(WriteOptions options, const ValidSlice &key, const ValidSlice &value)
+        {
+            Kvs *bucket = table_.GetOrCreateBucket(hash_calcurator_.CalcHash(table_.size_, key), underlying_kvs_allocator_);
+            SliceContainer container;
+            bool exists = bucket->Get(ReadOptions(), key, container).IsOk();
+            if (bucket->Put(options, key, value).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (!exists)
+            {
+                Kvs *old_bucket = GetOldBucket(key);
+                exists = old_bucket != nullptr && old_bucket->Delete(options, key).IsOk();
+            }
+            if (!exists)
+            {
+                entry_cnt_++;
+            }
+            return Status::CreateOkStatus();
+        }
+        Status DeleteInternal(WriteOptions options, const ValidSlice &key)
+        {
+            Kvs *bucket = table_.buckets_[hash_calcurator_.CalcHash(table_.size_, key)];
+            if (bucket == nullptr || bucket->Delete(options, key).IsError())
+            {
+                Kvs *old_bucket = GetOldBucket(key);
+                if (old_bucket == nullptr || old_bucket->Delete(options, key).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            entry_cnt_--;
+            return Status::CreateOkStatus();
+        }
+        // iterators may refer migrated buckets, so they are retired rather than deleted until no iterator exists.
+        // the ids of buckets change, and the iterators notice it by layout_version_.
+        void StepResizing()
+        {
+            if (iterator_cnt_ == 0)
+            {
+                ReleaseRetiredBuckets();
+            }
+            if (IsResizing())
+            {
+                for (int i = 0; i < kMigrationBucketsPerStep && IsResizing(); i++)
+                {
+                    MigrateOldBucket();
+                }
+                layout_version_++;
+            }
+            else if (max_load_factor_ > 0 && entry_cnt_ > static_cast<int64_t>(max_load_factor_) * table_.size_)
+            {
+                old_table_ = table_;
+                table_ = Table(old_table_.size_ * 2);
+                migrated_cnt_ = 0;
+                layout_version_++;
+            }
+        }
+        void MigrateOldBucket()
+        {
+            Kvs *old_bucket = old_table_.buckets_[migrated_cnt_];
+            old_table_.buckets_[migrated_cnt_] = nullptr;
+            migrated_cnt_++;
+            if (old_bucket != nullptr)
+            {
+                MoveEntries(*old_bucket);
+                if (iterator_cnt_ == 0)
+                {
+                    delete old_bucket;
+                }
+                else
+                {
+                    retired_buckets_.push_back(old_bucket);
+                }
+            }
+            if (migrated_cnt_ == old_table_.size_)
+            {
+                old_table_.Release();
+            }
+        }
+        void MoveEntries(Kvs &old_bucket)
+        {
+            Optional<KvsEntryIterator> optional_iter = old_bucket.GetFirstIterator();
+            while (optional_iter.isPresent())
+            {
+                KvsEntryIterator iter = optional_iter.get();
+                SliceContainer key_container;
+                SliceContainer value_container;
+                if (iter.GetKey(key_container).IsError() || iter.Get(ReadOptions(), value_container).IsError())
+                {
+                    abort();
+                }
+                ConstSlice key = key_container.CreateConstSlice();
+                Kvs *bucket = table_.GetOrCreateBucket(hash_calcurator_.CalcHash(table_.size_, key), underlying_kvs_allocator_);
+                if (bucket->Put(WriteOptions(), key, value_container.CreateConstSlice()).IsError())
+                {
+                    abort();
+                }
+                optional_iter = iter.GetNext();
+            }
+        }
+        void ReleaseRetiredBuckets()
         {
-            Kvs **buckets = new Kvs *[bucket_size];
-            for (int i = 0; i < bucket_size; i++)
+            for (Kvs *bucket : retired_buckets_)
             {
-                buckets[i] = underlying_kvs_allocator.Allocate();
+                delete bucket;
             }
-            return buckets;
+            retired_buckets_.clear();
         }
-        const int bucket_size_;
-        Kvs **buckets_;
+        static const int kDefaultMaxLoadFactor = 4;
+        static const int kMigrationBucketsPerStep = 2;
+        Table table_;
+        Table old_table_;
+        int migrated_cnt_ = 0;
+        KvsAllocatorInterface &underlying_kvs_allocator_;
         HashCalculatorInterface &hash_calcurator_;
+        const int max_load_factor_;
+        int64_t entry_cnt_ = 0;
+        int iterator_cnt_ = 0;
+        uint64_t version_ = 0;        // incremented on every modification, to invalidate the cursors of iterators
+        uint64_t layout_version_ = 0; // incremented when buckets migrate or their ids change
+        std::vector<Kvs *> retired_buckets_; // migrated buckets which iterators may still refer
     };
 }
\ No newline at end of file
@@ -3,11 +3,15 @@
 #include "utils/slice.h"
 #include "utils/optional.h"
 #include "utils/ptr_container.h"
+#include "kvs/write_batch.h"
 
 namespace HayaguiKvs
 {
     class WriteOptions
     {
+    public:
+        // the write is made durable before returning, even if the storage buffers writes
+        bool sync = false;
     };
 
     class ReadOptions
@@ -111,6 +115,30 @@ namespace HayaguiKvs
         virtual Optional<KvsEntryIterator> GetFirstIterator() = 0;
         virtual KvsEntryIterator GetIterator(const ValidSlice &key) = 0; // warning: retured iterator does not promise the existence of the key.
         virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) = 0;
+        // looks up n keys at once. containers[i] holds the value of keys[i] when it is found,
+        // and is left released otherwise.
+        // Status is not default-constructible, so the per-key result is reported through
+        // SliceContainer::IsSliceAvailable() instead of an array of Status.
+        virtual Status MultiGet(ReadOptions options, const ValidSlice *keys[], const int n, SliceContainer containers[])
+        {
+            for (int i = 0; i < n; i++)
+            {
+                containers[i].Release();
+                if (Get(options, *keys[i], containers[i]).IsError())
+                {
+                    containers[i].Release();
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        // applies the operations in the batch in order.
+        // deleting an absent key does nothing, as when the batch is replayed from a log.
+        // engines which can persist or apply the batch at once should override this.
+        virtual Status Write(WriteOptions options, WriteBatch &batch)
+        {
+            BatchApplier applier(*this, options);
+            return batch.Iterate(applier);
+        }
         Status DeleteAll(WriteOptions options)
         {
             return DeleteIterRecursive(GetFirstIterator(), options);
@@ -123,6 +151,34 @@ namespace HayaguiKvs
         }
 
     private:
+        class BatchApplier : public WriteBatchHandlerInterface
+        {
+        public:
+            BatchApplier(Kvs &kvs, WriteOptions options) : kvs_(kvs), options_(options)
+            {
+            }
+            virtual Status Put(const ValidSlice &key, const ValidSlice &value) override
+            {
+                return kvs_.Put(options_, key, value);
+            }
+            virtual Status Delete(const ValidSlice &key) override
+            {
+                if (kvs_.Delete(options_, key).IsOk())
+                {
+                    return Status::CreateOkStatus();
+                }
+                SliceContainer container;
+                if (kvs_.Get(ReadOptions(), key, container).IsOk())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                return Status::CreateOkStatus();
+            }
+
+        private:
+            Kvs &kvs_;
+            WriteOptions options_;
+        };
         void PrintIterRecursive(Optional<KvsEntryIterator> o_iter)
         {
             if (!o_iter.isPresent())
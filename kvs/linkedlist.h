@@ -30,16 +30,20 @@ namespace HayaguiKvs
         }
         virtual Optional<KvsEntryIterator> GetFirstIterator() override
         {
-            SliceContainer key_container;
-            Status s1 = first_element_.GetNext().GetKey(key_container);
-            if (s1.IsError())
+            Element *ele = first_element_.GetFirstElementFromNext();
+            if (ele == nullptr)
             {
                 return Optional<KvsEntryIterator>::CreateInvalidObj();
             }
-            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(key_container.CreateConstSlice()));
+            return Optional<KvsEntryIterator>::CreateValidObj(KvsEntryIterator(IteratorBase::Create(*this, ele)));
         }
         virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
         {
+            Element *ele;
+            if (first_element_.FindElementFromNext(key, ele).IsOk())
+            {
+                return KvsEntryIterator(IteratorBase::Create(*this, ele));
+            }
             GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
             new (base) GenericKvsEntryIteratorBase(*this, key);
             return KvsEntryIterator(base);
@@ -62,6 +66,7 @@ namespace HayaguiKvs
             ~Element()
             {
                 assert(next_ == nullptr); // to ensure the linked element is referred by others
+                assert(pin_cnt_ == 0);
             }
             bool isKeyEqual(const ValidSlice &key) const
             {
@@ -102,11 +107,41 @@ namespace HayaguiKvs
             {
                 return next_;
             }
+            void ReplaceValueWith(const ValidSlice &value)
+            {
+                ConstSlice new_value = ConstSlice::CreateFromValidSlice(value);
+                value_.~ConstSlice();
+                new (&value_) ConstSlice(std::move(new_value));
+            }
+            // pinned elements are not freed even if they are unlinked from the list
+            void Pin()
+            {
+                pin_cnt_++;
+            }
+            void Unpin()
+            {
+                assert(pin_cnt_ > 0);
+                pin_cnt_--;
+            }
+            bool IsPinned() const
+            {
+                return pin_cnt_ != 0;
+            }
+            void MarkUnlinked()
+            {
+                unlinked_ = true;
+            }
+            bool IsUnlinked() const
+            {
+                return unlinked_;
+            }
 
         private:
             ConstSlice key_;
             ConstSlice value_;
             Element *next_ = nullptr;
+            int pin_cnt_ = 0;
+            bool unlinked_ = false;
         };
         class Container
         {
@@ -142,9 +177,36 @@ namespace HayaguiKvs
             }
             Status FindSubsequentKeyRecursivelyFromNext(const ValidSlice &key, SliceContainer &container)
             {
-                FindNextKeyProcessor processor(key, container);
+                Element *ele;
+                if (FindSubsequentElementFromNext(key, ele).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                ele->PutKeyTo(container);
+                return Status::CreateOkStatus();
+            }
+            Status FindSubsequentElementFromNext(const ValidSlice &key, Element *&ele)
+            {
+                FindNextElementProcessor processor(key, ele);
                 return Walk(processor);
             }
+            Status FindElementFromNext(const ValidSlice &key, Element *&ele)
+            {
+                FindElementProcessor processor(key, ele);
+                return Walk(processor);
+            }
+            Element *GetFirstElementFromNext()
+            {
+                return ele_->GetNext();
+            }
+            static void UnpinElement(Element *ele)
+            {
+                ele->Unpin();
+                if (ele->IsUnlinked() && !ele->IsPinned())
+                {
+                    DeleteElement(ele);
+                }
+            }
             Status GetKey(SliceContainer &container)
             {
                 if (!hasElement())
@@ -216,8 +278,7 @@ namespace HayaguiKvs
                 }
                 virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) override
                 {
-                    prev.DeleteNext();
-                    prev.InsertNext(key_, value_);
+                    prev.GetNext().ele_->ReplaceValueWith(value_);
                     return Status::CreateOkStatus();
                 }
                 virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Container &prev) override
@@ -260,12 +321,12 @@ namespace HayaguiKvs
                 const ValidSlice &key_;
                 SliceContainer &container_;
             };
-            class FindNextKeyProcessor : public ProcessorInterface
+            class FindNextElementProcessor : public ProcessorInterface
             {
             public:
-                FindNextKeyProcessor() = delete;
-                FindNextKeyProcessor(const ValidSlice &key, SliceContainer &container)
-                    : key_(key), container_(container)
+                FindNextElementProcessor() = delete;
+                FindNextElementProcessor(const ValidSlice &key, Element *&ele)
+                    : key_(key), ele_(ele)
                 {
                 }
                 virtual const ValidSlice &GetKey() override
@@ -278,39 +339,89 @@ namespace HayaguiKvs
                 }
                 virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) override
                 {
-                    return prev.GetNext().GetNext().GetKey(container_);
+                    return SetIfAvailable(prev.GetNext().GetNext());
                 }
                 virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Container &prev) override
                 {
-                    return prev.GetNext().GetKey(container_);
+                    return SetIfAvailable(prev.GetNext());
                 }
 
             private:
+                Status SetIfAvailable(Container container)
+                {
+                    if (!container.hasElement())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                    ele_ = container.ele_;
+                    return Status::CreateOkStatus();
+                }
                 const ValidSlice &key_;
-                SliceContainer &container_;
+                Element *&ele_;
             };
-            Status Walk(ProcessorInterface &processor)
+            class FindElementProcessor : public ProcessorInterface
             {
-                Container next = GetNext();
-                if (!next.hasElement())
+            public:
+                FindElementProcessor() = delete;
+                FindElementProcessor(const ValidSlice &key, Element *&ele)
+                    : key_(key), ele_(ele)
+                {
+                }
+                virtual const ValidSlice &GetKey() override
                 {
-                    return processor.ProcessTheCaseOfNoMoreEntries(*this);
+                    return key_;
                 }
-                if (next.ele_->isKeyEqual(processor.GetKey()))
+                virtual Status ProcessTheCaseOfNoMoreEntries(Container &prev) override
                 {
-                    return processor.ProcessTheCaseOfNextEqualsToTheKey(*this);
+                    return Status::CreateErrorStatus();
                 }
-                if (next.ele_->isKeyGreater(processor.GetKey()))
+                virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) override
                 {
-                    return processor.ProcessTheCaseOfNextGreaterThanTheKey(*this);
+                    ele_ = prev.GetNext().ele_;
+                    return Status::CreateOkStatus();
+                }
+                virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Container &prev) override
+                {
+                    return Status::CreateErrorStatus();
+                }
+
+            private:
+                const ValidSlice &key_;
+                Element *&ele_;
+            };
+            Status Walk(ProcessorInterface &processor)
+            {
+                Element *prev_ele = ele_;
+                while (true)
+                {
+                    Container prev(prev_ele);
+                    Container next = prev.GetNext();
+                    if (!next.hasElement())
+                    {
+                        return processor.ProcessTheCaseOfNoMoreEntries(prev);
+                    }
+                    if (next.ele_->isKeyEqual(processor.GetKey()))
+                    {
+                        return processor.ProcessTheCaseOfNextEqualsToTheKey(prev);
+                    }
+                    if (next.ele_->isKeyGreater(processor.GetKey()))
+                    {
+                        return processor.ProcessTheCaseOfNextGreaterThanTheKey(prev);
+                    }
+                    prev_ele = next.ele_;
                 }
-                return next.Walk(processor);
             }
             void DeleteNext()
             {
                 Container next = GetNext();
                 assert(next.hasElement());
                 ele_->RetrieveNextFrom(next.ele_);
+                if (next.ele_->IsPinned())
+                {
+                    // an iterator still refers the element. it will be freed when the iterator is destroyed.
+                    next.ele_->MarkUnlinked();
+                    return;
+                }
                 DeleteElement(next.ele_);
             }
             void InsertNext(const ValidSlice &key, const ValidSlice &value)
@@ -341,6 +452,99 @@ namespace HayaguiKvs
             }*/
             Element *const ele_;
         };
+        // Iterator which pins the element of the key and follows next_ directly.
+        // Once the element is unlinked by Delete(), it falls back to operations by the key, as GenericKvsEntryIteratorBase does.
+        class IteratorBase final : public KvsEntryIteratorBaseInterface
+        {
+        public:
+            IteratorBase() = delete;
+            IteratorBase(LinkedListKvs &kvs, Element *ele) : kvs_(kvs), ele_(ele)
+            {
+                ele_->Pin();
+            }
+            virtual ~IteratorBase() override
+            {
+                Container::UnpinElement(ele_);
+            }
+            static IteratorBase *Create(LinkedListKvs &kvs, Element *ele)
+            {
+                IteratorBase *base = MemAllocator::alloc<IteratorBase>();
+                new (base) IteratorBase(kvs, ele);
+                return base;
+            }
+            virtual bool hasNext() override
+            {
+                Element *next;
+                return GetNextElement(next).IsOk();
+            }
+            virtual KvsEntryIteratorBaseInterface *GetNext() override
+            {
+                Element *next;
+                if (GetNextElement(next).IsError())
+                {
+                    return nullptr;
+                }
+                return Create(kvs_, next);
+            }
+            virtual Status Get(ReadOptions options, SliceContainer &container) override
+            {
+                if (ele_->IsUnlinked())
+                {
+                    SliceContainer key_container;
+                    ele_->PutKeyTo(key_container);
+                    return kvs_.Get(options, key_container.CreateConstSlice(), container);
+                }
+                ele_->PutValueTo(container);
+                return Status::CreateOkStatus();
+            }
+            virtual Status Put(WriteOptions options, ValidSlice &value) override
+            {
+                if (ele_->IsUnlinked())
+                {
+                    SliceContainer key_container;
+                    ele_->PutKeyTo(key_container);
+                    return kvs_.Put(options, key_container.CreateConstSlice(), value);
+                }
+                ele_->ReplaceValueWith(value);
+                return Status::CreateOkStatus();
+            }
+            virtual Status Delete(WriteOptions options) override
+            {
+                // the previous element is needed to unlink, so the list is walked by the key.
+                SliceContainer key_container;
+                ele_->PutKeyTo(key_container);
+                return kvs_.Delete(options, key_container.CreateConstSlice());
+            }
+            virtual Status GetKey(SliceContainer &container) override
+            {
+                ele_->PutKeyTo(container);
+                return Status::CreateOkStatus();
+            }
+            virtual void Destroy() override
+            {
+                this->~IteratorBase();
+                MemAllocator::free(this);
+            }
+
+        private:
+            Status GetNextElement(Element *&next)
+            {
+                if (ele_->IsUnlinked())
+                {
+                    SliceContainer key_container;
+                    ele_->PutKeyTo(key_container);
+                    return kvs_.first_element_.FindSubsequentElementFromNext(key_container.CreateConstSlice(), next);
+                }
+                next = ele_->GetNext();
+                if (next == nullptr)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                return Status::CreateOkStatus();
+            }
+            LinkedListKvs &kvs_;
+            Element *const ele_;
+        };
         Container first_element_ = Container::CreateDummy();
     };
 }
\ No newline at end of file
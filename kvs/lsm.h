@@ -0,0 +1,1377 @@
+#pragma once
+#include "kvs_interface.h"
+#include "block_storage/block_storage_interface.h"
+#include "block_storage/block_storage_multiplier.h"
+#include "block_storage/block_storage_with_lock.h"
+#include "utils/contiguous_key.h"
+#include "utils/hash_function.h"
+#include "utils/bloom_filter.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+
+namespace HayaguiKvs
+{
+    // Immutable sorted run of LsmKvs, stored in contiguous blocks.
+    // The first block is a header, followed by the entries in key order as a byte stream, and then the metadata:
+    // the key and the position of the first entry which starts in each block, the last key, and a bloom filter.
+    // The metadata is kept in memory while the run is open, so that a lookup reads only the blocks around the key.
+    template <class BlockBuffer>
+    class LsmRun
+    {
+    public:
+        static const int kMaxKeyLen = 0xFFFF;
+        static const int kMaxValueLen = 0xFFFE;
+        struct Entry
+        {
+            const char *key_;
+            int key_len_;
+            const char *value_;
+            int value_len_;
+            bool deleted_;
+        };
+        // upper bounds of a set of entries, used to reserve blocks before building a run
+        struct Stats
+        {
+            void Add(const Stats &stats)
+            {
+                entry_cnt_ += stats.entry_cnt_;
+                data_len_ += stats.data_len_;
+                max_key_len_ = max_key_len_ > stats.max_key_len_ ? max_key_len_ : stats.max_key_len_;
+            }
+            void Add(const int key_len, const int value_len)
+            {
+                entry_cnt_++;
+                data_len_ += kEntryHeaderSize + key_len + value_len;
+                max_key_len_ = max_key_len_ > key_len ? max_key_len_ : key_len;
+            }
+            uint32_t entry_cnt_;
+            uint64_t data_len_;
+            int max_key_len_;
+        };
+        static Stats CreateEmptyStats()
+        {
+            return Stats{0, 0, 0};
+        }
+        static uint64_t GetEntryLen(const int key_len, const int value_len)
+        {
+            return kEntryHeaderSize + key_len + value_len;
+        }
+
+        // Reads entries in order from a position of the data area.
+        class Reader
+        {
+        public:
+            Reader(const LsmRun &run, const uint64_t pos) : run_(run), pos_(pos), loaded_block_(-1)
+            {
+            }
+            bool IsEnd() const
+            {
+                return pos_ >= run_.data_len_;
+            }
+            // the entry refers to the buffer of the reader, and is valid until the next call
+            Status ReadEntry(Entry &entry)
+            {
+                uint8_t header[kEntryHeaderSize];
+                if (Read(reinterpret_cast<char *>(header), kEntryHeaderSize).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                const int key_len = header[0] | (header[1] << 8);
+                const int raw_value_len = header[2] | (header[3] << 8);
+                const bool deleted = raw_value_len == kTombstone;
+                const int value_len = deleted ? 0 : raw_value_len;
+                buf_.resize(key_len + value_len + 1);
+                if (Read(buf_.data(), key_len + value_len).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                entry = Entry{buf_.data(), key_len, buf_.data() + key_len, value_len, deleted};
+                return Status::CreateOkStatus();
+            }
+
+        private:
+            Status Read(char *dst, int len)
+            {
+                while (len > 0)
+                {
+                    if (IsEnd())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                    const int64_t block = pos_ / BlockBufferInterface::kSize;
+                    const int offset = pos_ % BlockBufferInterface::kSize;
+                    if (block != loaded_block_)
+                    {
+                        if (run_.storage_.Read(LogicalBlockAddress(run_.start_ + kHeaderBlockCnt + block), block_buf_).IsError())
+                        {
+                            return Status::CreateErrorStatus();
+                        }
+                        loaded_block_ = block;
+                    }
+                    const int n = len < static_cast<int>(BlockBufferInterface::kSize) - offset ? len : BlockBufferInterface::kSize - offset;
+                    block_buf_.CopyTo(reinterpret_cast<uint8_t *>(dst), offset, n);
+                    dst += n;
+                    len -= n;
+                    pos_ += n;
+                }
+                return Status::CreateOkStatus();
+            }
+            const LsmRun &run_;
+            uint64_t pos_;
+            int64_t loaded_block_;
+            BlockBuffer block_buf_;
+            std::vector<char> buf_;
+        };
+
+        // Writes entries given in key order into reserved blocks.
+        class Builder
+        {
+        public:
+            Builder(BlockStorageInterface<BlockBuffer> &storage, const uint32_t start, const uint32_t capacity)
+                : storage_(storage), start_(start), capacity_(capacity), stats_(CreateEmptyStats()), pos_(0), last_indexed_block_(-1), index_cnt_(0)
+            {
+                AppendValue<uint32_t>(index_, 0);
+            }
+            Builder(const Builder &obj) = delete;
+            Builder &operator=(const Builder &obj) = delete;
+            // number of blocks enough for a run of the entries
+            static uint32_t GetMaxBlockCnt(const Stats &stats)
+            {
+                const uint64_t data_block_cnt = DivCeil(stats.data_len_);
+                const uint64_t index_cnt = stats.entry_cnt_ < data_block_cnt ? stats.entry_cnt_ : data_block_cnt;
+                const uint64_t meta_len = sizeof(uint32_t) + index_cnt * (kIndexRecordHeaderSize + stats.max_key_len_) +
+                                          sizeof(uint16_t) + stats.max_key_len_ + GetMaxBloomLen(stats.entry_cnt_);
+                return kHeaderBlockCnt + data_block_cnt + DivCeil(meta_len);
+            }
+            // whether the entry can be added within the reserved blocks
+            bool Fits(const int key_len, const int value_len) const
+            {
+                const uint64_t meta_len = index_.size() + kIndexRecordHeaderSize + key_len +
+                                          sizeof(uint16_t) + key_len + GetMaxBloomLen(stats_.entry_cnt_ + 1);
+                return kHeaderBlockCnt + DivCeil(pos_ + GetEntryLen(key_len, value_len)) + DivCeil(meta_len) <= capacity_;
+            }
+            bool IsEmpty() const
+            {
+                return stats_.entry_cnt_ == 0;
+            }
+            Status Add(const Entry &entry)
+            {
+                assert(entry.key_len_ <= kMaxKeyLen && entry.value_len_ <= kMaxValueLen);
+                const int64_t block = pos_ / BlockBufferInterface::kSize;
+                if (block != last_indexed_block_)
+                {
+                    AppendValue<uint64_t>(index_, pos_);
+                    AppendValue<uint16_t>(index_, entry.key_len_);
+                    index_.insert(index_.end(), entry.key_, entry.key_ + entry.key_len_);
+                    index_cnt_++;
+                    last_indexed_block_ = block;
+                }
+                hashes_.push_back(FastHash::Calc(entry.key_, entry.key_len_));
+                last_key_.assign(entry.key_, entry.key_ + entry.key_len_);
+                stats_.Add(entry.key_len_, entry.value_len_);
+                const int raw_value_len = entry.deleted_ ? kTombstone : entry.value_len_;
+                const uint8_t header[kEntryHeaderSize] = {
+                    static_cast<uint8_t>(entry.key_len_), static_cast<uint8_t>(entry.key_len_ >> 8),
+                    static_cast<uint8_t>(raw_value_len), static_cast<uint8_t>(raw_value_len >> 8)};
+                if (AppendData(header, kEntryHeaderSize).IsError() ||
+                    AppendData(reinterpret_cast<const uint8_t *>(entry.key_), entry.key_len_).IsError() ||
+                    AppendData(reinterpret_cast<const uint8_t *>(entry.value_), entry.value_len_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                return Status::CreateOkStatus();
+            }
+            // returns nullptr on failure
+            LsmRun *Finish()
+            {
+                assert(!IsEmpty());
+                if (pos_ % BlockBufferInterface::kSize != 0 && WriteDataBlock(pos_ / BlockBufferInterface::kSize).IsError())
+                {
+                    return nullptr;
+                }
+                const uint32_t data_block_cnt = DivCeil(pos_);
+                std::vector<char> meta;
+                meta.swap(index_);
+                memcpy(meta.data(), &index_cnt_, sizeof(uint32_t));
+                AppendValue<uint16_t>(meta, last_key_.size());
+                meta.insert(meta.end(), last_key_.begin(), last_key_.end());
+                std::vector<uint8_t> bloom;
+                BloomFilter::Build(hashes_.data(), hashes_.size(), kBloomBitsPerKey, bloom);
+                AppendValue<uint32_t>(meta, bloom.size());
+                meta.insert(meta.end(), bloom.begin(), bloom.end());
+
+                const uint32_t meta_start = kHeaderBlockCnt + data_block_cnt;
+                const uint32_t block_cnt = meta_start + DivCeil(meta.size());
+                if (block_cnt > capacity_)
+                {
+                    return nullptr;
+                }
+                BlockBufferInterface &buf = block_buf_;
+                for (size_t offset = 0; offset < meta.size(); offset += BlockBufferInterface::kSize)
+                {
+                    const size_t len = meta.size() - offset < BlockBufferInterface::kSize ? meta.size() - offset : BlockBufferInterface::kSize;
+                    buf.CopyFrom(reinterpret_cast<const uint8_t *>(meta.data() + offset), 0, len);
+                    if (storage_.Write(LogicalBlockAddress(start_ + meta_start + offset / BlockBufferInterface::kSize), block_buf_).IsError())
+                    {
+                        return nullptr;
+                    }
+                }
+                memset(buf.GetPtrToTheBuffer(), 0, BlockBufferInterface::kSize);
+                buf.SetValue<uint32_t>(kMagicOffset, kMagic);
+                buf.SetValue<uint32_t>(kEntryCntOffset, stats_.entry_cnt_);
+                buf.SetValue<uint64_t>(kDataLenOffset, stats_.data_len_);
+                buf.SetValue<uint32_t>(kMetaLenOffset, meta.size());
+                buf.SetValue<uint32_t>(kMaxKeyLenOffset, stats_.max_key_len_);
+                if (storage_.Write(LogicalBlockAddress(start_), block_buf_).IsError())
+                {
+                    return nullptr;
+                }
+                return Create(storage_, start_, block_cnt, stats_, std::move(meta));
+            }
+
+        private:
+            Status AppendData(const uint8_t *data, const int len)
+            {
+                for (const uint8_t *const end = data + len; data != end;)
+                {
+                    const size_t offset = pos_ % BlockBufferInterface::kSize;
+                    const size_t n = static_cast<size_t>(end - data) < BlockBufferInterface::kSize - offset ? end - data : BlockBufferInterface::kSize - offset;
+                    block_buf_.CopyFrom(data, offset, n);
+                    data += n;
+                    pos_ += n;
+                    if (pos_ % BlockBufferInterface::kSize == 0 && WriteDataBlock(pos_ / BlockBufferInterface::kSize - 1).IsError())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                }
+                return Status::CreateOkStatus();
+            }
+            Status WriteDataBlock(const uint64_t block)
+            {
+                if (kHeaderBlockCnt + block >= capacity_)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                return storage_.Write(LogicalBlockAddress(start_ + kHeaderBlockCnt + block), block_buf_);
+            }
+            BlockStorageInterface<BlockBuffer> &storage_;
+            const uint32_t start_;
+            const uint32_t capacity_;
+            Stats stats_;
+            uint64_t pos_; // in the data area
+            int64_t last_indexed_block_;
+            uint32_t index_cnt_;
+            std::vector<char> index_;
+            std::vector<char> last_key_;
+            std::vector<uint64_t> hashes_;
+            BlockBuffer block_buf_;
+        };
+
+        LsmRun() = delete;
+        LsmRun(const LsmRun &obj) = delete;
+        LsmRun &operator=(const LsmRun &obj) = delete;
+        // returns nullptr on failure
+        static LsmRun *Load(BlockStorageInterface<BlockBuffer> &storage, const uint32_t start, const uint32_t block_cnt)
+        {
+            BlockBuffer block_buf;
+            BlockBufferInterface &buf = block_buf;
+            if (storage.Read(LogicalBlockAddress(start), block_buf).IsError() || buf.GetValue<uint32_t>(kMagicOffset) != kMagic)
+            {
+                return nullptr;
+            }
+            Stats stats = Stats{buf.GetValue<uint32_t>(kEntryCntOffset), buf.GetValue<uint64_t>(kDataLenOffset), static_cast<int>(buf.GetValue<uint32_t>(kMaxKeyLenOffset))};
+            std::vector<char> meta(buf.GetValue<uint32_t>(kMetaLenOffset));
+            const uint32_t meta_start = kHeaderBlockCnt + DivCeil(stats.data_len_);
+            if (meta_start + DivCeil(meta.size()) != block_cnt)
+            {
+                return nullptr;
+            }
+            for (size_t offset = 0; offset < meta.size(); offset += BlockBufferInterface::kSize)
+            {
+                const size_t len = meta.size() - offset < BlockBufferInterface::kSize ? meta.size() - offset : BlockBufferInterface::kSize;
+                if (storage.Read(LogicalBlockAddress(start + meta_start + offset / BlockBufferInterface::kSize), block_buf).IsError())
+                {
+                    return nullptr;
+                }
+                buf.CopyTo(reinterpret_cast<uint8_t *>(meta.data() + offset), 0, len);
+            }
+            return Create(storage, start, block_cnt, stats, std::move(meta));
+        }
+        static void Destroy(LsmRun *run)
+        {
+            run->~LsmRun();
+            MemAllocator::free(run);
+        }
+        uint32_t GetStart() const
+        {
+            return start_;
+        }
+        uint32_t GetBlockCnt() const
+        {
+            return block_cnt_;
+        }
+        const Stats &GetStats() const
+        {
+            return stats_;
+        }
+        int CmpFirstKey(const char *key, const int len) const
+        {
+            return CmpKey(index_[0].key_, index_[0].key_len_, key, len);
+        }
+        int CmpLastKey(const char *key, const int len) const
+        {
+            return CmpKey(last_key_, last_key_len_, key, len);
+        }
+        // whether keys of the run can be in [first, last] of the other run
+        bool Overlaps(const LsmRun &run) const
+        {
+            return CmpFirstKey(run.last_key_, run.last_key_len_) <= 0 && run.CmpFirstKey(last_key_, last_key_len_) <= 0;
+        }
+        const char *GetLastKey(int &len) const
+        {
+            len = last_key_len_;
+            return last_key_;
+        }
+        // found is false if the run does not have the key, and deleted is true if the run has a tombstone of it
+        Status Get(const ContiguousKey &key, const uint64_t hash, SliceContainer &container, bool &found, bool &deleted) const
+        {
+            found = false;
+            if (CmpKey(key.GetPtr(), key.GetLen(), last_key_, last_key_len_) > 0 ||
+                !BloomFilter::MayContain(bloom_, bloom_len_, hash))
+            {
+                return Status::CreateOkStatus();
+            }
+            const int index = FindIndex(key);
+            if (index < 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            Reader reader(*this, index_[index].pos_);
+            while (!reader.IsEnd())
+            {
+                Entry entry;
+                if (reader.ReadEntry(entry).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                const int result = CmpKey(entry.key_, entry.key_len_, key.GetPtr(), key.GetLen());
+                if (result > 0)
+                {
+                    break;
+                }
+                if (result == 0)
+                {
+                    found = true;
+                    deleted = entry.deleted_;
+                    if (!deleted)
+                    {
+                        container.Set(entry.value_, entry.value_len_);
+                    }
+                    break;
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        // finds the lowest key greater than the given one (or equal to it, if inclusive), including tombstones
+        Status FindNextKey(const ContiguousKey &key, const bool inclusive, SliceContainer &container, bool &found) const
+        {
+            found = false;
+            const int last_result = CmpKey(last_key_, last_key_len_, key.GetPtr(), key.GetLen());
+            if (last_result < 0 || (last_result == 0 && !inclusive))
+            {
+                return Status::CreateOkStatus();
+            }
+            const int index = FindIndex(key);
+            Reader reader(*this, index < 0 ? 0 : index_[index].pos_);
+            while (!reader.IsEnd())
+            {
+                Entry entry;
+                if (reader.ReadEntry(entry).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                const int result = CmpKey(entry.key_, entry.key_len_, key.GetPtr(), key.GetLen());
+                if (result > 0 || (result == 0 && inclusive))
+                {
+                    found = true;
+                    container.Set(entry.key_, entry.key_len_);
+                    break;
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        static int CmpKey(const char *key1, const int len1, const char *key2, const int len2)
+        {
+            const int result = memcmp(key1, key2, len1 < len2 ? len1 : len2);
+            return result != 0 ? result : len1 - len2;
+        }
+
+    private:
+        static const int kEntryHeaderSize = 4;
+        static const int kTombstone = 0xFFFF;
+        static const int kBloomBitsPerKey = 10;
+        static const int kIndexRecordHeaderSize = sizeof(uint64_t) + sizeof(uint16_t);
+        static const uint32_t kHeaderBlockCnt = 1;
+        static const uint32_t kMagic = 0x4c534d31;
+        static const int kMagicOffset = 0;
+        static const int kEntryCntOffset = 4;
+        static const int kDataLenOffset = 8;
+        static const int kMetaLenOffset = 16;
+        static const int kMaxKeyLenOffset = 20;
+        struct IndexEntry
+        {
+            uint64_t pos_;
+            const char *key_;
+            int key_len_;
+        };
+
+        LsmRun(BlockStorageInterface<BlockBuffer> &storage, const uint32_t start, const uint32_t block_cnt, const Stats &stats, std::vector<char> &&meta)
+            : storage_(storage), start_(start), block_cnt_(block_cnt), data_len_(stats.data_len_), stats_(stats), meta_(std::move(meta))
+        {
+        }
+        static LsmRun *Create(BlockStorageInterface<BlockBuffer> &storage, const uint32_t start, const uint32_t block_cnt, const Stats &stats, std::vector<char> &&meta)
+        {
+            LsmRun *run = MemAllocator::alloc<LsmRun>();
+            new (run) LsmRun(storage, start, block_cnt, stats, std::move(meta));
+            if (run->ParseMeta().IsError())
+            {
+                Destroy(run);
+                return nullptr;
+            }
+            return run;
+        }
+        Status ParseMeta()
+        {
+            size_t offset = 0;
+            uint32_t index_cnt;
+            if (!ReadValue<uint32_t>(offset, index_cnt) || index_cnt == 0)
+            {
+                return Status::CreateErrorStatus();
+            }
+            index_.resize(index_cnt);
+            for (uint32_t i = 0; i < index_cnt; i++)
+            {
+                uint16_t key_len;
+                if (!ReadValue<uint64_t>(offset, index_[i].pos_) || !ReadValue<uint16_t>(offset, key_len) ||
+                    offset + key_len > meta_.size())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                index_[i].key_ = meta_.data() + offset;
+                index_[i].key_len_ = key_len;
+                offset += key_len;
+            }
+            uint16_t last_key_len;
+            if (!ReadValue<uint16_t>(offset, last_key_len) || offset + last_key_len > meta_.size())
+            {
+                return Status::CreateErrorStatus();
+            }
+            last_key_ = meta_.data() + offset;
+            last_key_len_ = last_key_len;
+            offset += last_key_len;
+            uint32_t bloom_len;
+            if (!ReadValue<uint32_t>(offset, bloom_len) || offset + bloom_len != meta_.size())
+            {
+                return Status::CreateErrorStatus();
+            }
+            bloom_ = reinterpret_cast<const uint8_t *>(meta_.data() + offset);
+            bloom_len_ = bloom_len;
+            return Status::CreateOkStatus();
+        }
+        // index of the last block whose first key is lower than or equal to the given one, or -1
+        int FindIndex(const ContiguousKey &key) const
+        {
+            int low = 0;
+            int high = index_.size();
+            while (low < high)
+            {
+                const int mid = (low + high) / 2;
+                if (CmpKey(index_[mid].key_, index_[mid].key_len_, key.GetPtr(), key.GetLen()) <= 0)
+                {
+                    low = mid + 1;
+                }
+                else
+                {
+                    high = mid;
+                }
+            }
+            return low - 1;
+        }
+        template <class T>
+        bool ReadValue(size_t &offset, T &value) const
+        {
+            if (offset + sizeof(T) > meta_.size())
+            {
+                return false;
+            }
+            memcpy(&value, meta_.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+        template <class T>
+        static void AppendValue(std::vector<char> &buf, const T value)
+        {
+            const char *ptr = reinterpret_cast<const char *>(&value);
+            buf.insert(buf.end(), ptr, ptr + sizeof(T));
+        }
+        static uint64_t GetMaxBloomLen(const uint64_t entry_cnt)
+        {
+            return sizeof(uint32_t) + (entry_cnt * kBloomBitsPerKey + 64) / 8 + 2;
+        }
+        static uint64_t DivCeil(const uint64_t len)
+        {
+            return (len + BlockBufferInterface::kSize - 1) / BlockBufferInterface::kSize;
+        }
+
+        BlockStorageInterface<BlockBuffer> &storage_;
+        const uint32_t start_;
+        const uint32_t block_cnt_;
+        const uint64_t data_len_;
+        const Stats stats_;
+        const std::vector<char> meta_;
+        std::vector<IndexEntry> index_;
+        const char *last_key_;
+        int last_key_len_;
+        const uint8_t *bloom_;
+        size_t bloom_len_;
+    };
+
+    // Log-structured merge tree over a block storage.
+    // Writes go to a memtable, which is any in-memory Kvs given by an allocator.
+    // When the memtable is full, it is written out as a sorted run of level 0, and a new memtable is allocated.
+    // Runs of level 0 may overlap; every other level is a set of non-overlapping runs of about the memtable size.
+    // A background thread merges level 0 into level 1 when it has kL0CompactionTrigger runs,
+    // and a run of level i into level i + 1 when level i grows larger than the memtable times kLevelSizeRatio^i.
+    // The manifest, the list of runs, is written after a run is built and before the blocks of inputs are reused.
+    // The memtable is not logged; entries written after the last flush are lost on a crash.
+    // Accesses to the storage from the background thread and from the callers are serialized,
+    // so the storage need not be thread-safe, but must not be used by others while the tree is open.
+    template <class BlockBuffer>
+    class LsmKvs final : public Kvs
+    {
+    public:
+        LsmKvs() = delete;
+        LsmKvs(BlockStorageInterface<BlockBuffer> &storage, KvsAllocatorInterface &memtable_allocator, const size_t memtable_size = kDefaultMemtableSize)
+            : locked_storage_(storage),
+              multiplier_(CreateMultiplier(locked_storage_)),
+              manifest_storage_(multiplier_.GetMultipliedBlockStorage(kManifestStorageIndex)),
+              data_storage_(multiplier_.GetMultipliedBlockStorage(kDataStorageIndex)),
+              memtable_allocator_(memtable_allocator),
+              memtable_size_(memtable_size),
+              memtable_(memtable_allocator.Allocate()),
+              memtable_stats_(Run::CreateEmptyStats()),
+              levels_(kLevelCnt),
+              compact_pointers_(kLevelCnt),
+              compacting_(false),
+              compaction_failed_(false),
+              stop_(false)
+        {
+            if (Open().IsError())
+            {
+                abort();
+            }
+            compaction_thread_ = std::thread(&LsmKvs::CompactionLoop, this);
+        }
+        virtual ~LsmKvs() override
+        {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                if (FlushMemtable(lock).IsError())
+                {
+                    fprintf(stderr, "LsmKvs: failed to flush the memtable\n");
+                }
+                stop_ = true;
+                cond_.notify_all();
+            }
+            compaction_thread_.join();
+            for (std::vector<Run *> &runs : levels_)
+            {
+                for (Run *run : runs)
+                {
+                    Run::Destroy(run);
+                }
+            }
+            delete memtable_;
+        }
+        LsmKvs(const LsmKvs &obj) = delete;
+        LsmKvs &operator=(const LsmKvs &obj) = delete;
+        virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            bool found, deleted;
+            if (Lookup(key, container, found, deleted).IsError() || !found || deleted)
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Status::CreateOkStatus();
+        }
+        virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
+        {
+            return WriteToMemtable(key, &value);
+        }
+        // writes a tombstone without checking whether the key exists
+        virtual Status Delete(WriteOptions options, const ValidSlice &key) override
+        {
+            return WriteToMemtable(key, nullptr);
+        }
+        virtual Optional<KvsEntryIterator> GetFirstIterator() override
+        {
+            SliceContainer container;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (FindLiveKey(BufferPtrSlice("", 0), true, container).IsError())
+                {
+                    return Optional<KvsEntryIterator>::CreateInvalidObj();
+                }
+            }
+            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(container.CreateConstSlice()));
+        }
+        virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
+        {
+            GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
+            new (base) GenericKvsEntryIteratorBase(*this, key);
+            return KvsEntryIterator(base);
+        }
+        virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return FindLiveKey(key, false, container);
+        }
+        // waits until no compaction is needed
+        Status WaitForCompaction()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            Compaction compaction;
+            while (!compaction_failed_ && (compacting_ || FindCompaction(compaction)))
+            {
+                cond_.wait(lock);
+            }
+            return compaction_failed_ ? Status::CreateErrorStatus() : Status::CreateOkStatus();
+        }
+        // number of runs in the level, for tests
+        int GetRunCnt(const int level)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return levels_[level].size();
+        }
+
+    private:
+        using Run = LsmRun<BlockBuffer>;
+        using MultipliedBlockStorage = typename BlockStorageMultiplier<BlockBuffer>::MultipliedBlockStorage;
+        static const size_t kDefaultMemtableSize = 256 * 1024;
+        static const int kManifestStorageIndex = 0;
+        static const int kDataStorageIndex = 1;
+        static const int kManifestBlockCnt = 64;
+        static const int kLevelCnt = 8;
+        static const int kLevelSizeRatio = 8;
+        static const size_t kL0CompactionTrigger = 4;
+        static const size_t kL0StopTrigger = 8; // writers wait for compaction
+        static constexpr const char *const kSignature = "HAYAGUI_LSM_V1_";
+        static const int kRunCntOffset = 16;
+        static const int kRunsOffset = 20;
+        static const int kRunRecordSize = 12;
+        static const char kValueType = 0;
+        static const char kDeletionType = 1;
+
+        struct Extent
+        {
+            uint32_t start_;
+            uint32_t cnt_;
+        };
+        struct Compaction
+        {
+            int level_;                          // merges runs of level_ into level_ + 1
+            std::vector<Run *> inputs_;          // newer first
+            bool drop_deletions_;                // no older version can exist below level_ + 1
+            std::vector<Run *> outputs_;         // in key order
+            std::vector<Extent> output_extents_; // blocks reserved for each output
+        };
+        // value in the memtable, prefixed by its type
+        class EncodedValue
+        {
+        public:
+            explicit EncodedValue(const ValidSlice *value) : len_(value != nullptr ? value->GetLen() + 1 : 1)
+            {
+                ptr_ = len_ <= kStackBufLen ? stack_buf_ : MemAllocator::alloc(len_);
+                ptr_[0] = value != nullptr ? kValueType : kDeletionType;
+                if (value != nullptr && value->CopyToBuffer(ptr_ + 1).IsError())
+                {
+                    abort();
+                }
+            }
+            ~EncodedValue()
+            {
+                if (ptr_ != stack_buf_)
+                {
+                    MemAllocator::free(ptr_);
+                }
+            }
+            EncodedValue(const EncodedValue &obj) = delete;
+            EncodedValue &operator=(const EncodedValue &obj) = delete;
+            const char *GetPtr() const
+            {
+                return ptr_;
+            }
+            int GetLen() const
+            {
+                return len_;
+            }
+
+        private:
+            static const int kStackBufLen = 64;
+            const int len_;
+            char *ptr_;
+            char stack_buf_[kStackBufLen];
+        };
+
+        static BlockStorageMultiplier<BlockBuffer> CreateMultiplier(BlockStorageInterface<BlockBuffer> &storage)
+        {
+            MultiplyRule rule;
+            int i;
+            Status s1 = rule.AppendRegion(LogicalBlockRegion(LogicalBlockAddress(0), LogicalBlockAddress(kManifestBlockCnt - 1)), i);
+            assert(s1.IsOk());
+            assert(i == kManifestStorageIndex);
+            Status s2 = rule.AppendRegion(LogicalBlockRegion(LogicalBlockAddress(kManifestBlockCnt), storage.GetMaxAddress()), i);
+            assert(s2.IsOk());
+            assert(i == kDataStorageIndex);
+            return BlockStorageMultiplier<BlockBuffer>(storage, rule);
+        }
+        static void DecodeValue(const SliceContainer &encoded, SliceContainer &container, bool &deleted)
+        {
+            ConstSlice slice = encoded.CreateConstSlice();
+            char type;
+            Status s1 = ShrinkedSlice(slice, 0, 1).CopyToBuffer(&type);
+            assert(s1.IsOk());
+            deleted = type == kDeletionType;
+            if (!deleted)
+            {
+                container.Set(ShrinkedSlice(slice, 1, slice.GetLen() - 1));
+            }
+        }
+        Status Open()
+        {
+            if (manifest_storage_.Open().IsError() || data_storage_.Open().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            std::vector<char> manifest;
+            if (ReadManifest(manifest).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            std::vector<Extent> used;
+            if (manifest.empty())
+            {
+                // the storage does not hold a tree yet
+                if (WriteManifest().IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            uint32_t run_cnt = 0;
+            if (!manifest.empty())
+            {
+                memcpy(&run_cnt, manifest.data() + kRunCntOffset, sizeof(uint32_t));
+            }
+            for (uint32_t i = 0; i < run_cnt; i++)
+            {
+                uint32_t record[3]; // level, start, block count
+                memcpy(record, manifest.data() + kRunsOffset + i * kRunRecordSize, kRunRecordSize);
+                Run *run = record[0] < kLevelCnt ? Run::Load(data_storage_, record[1], record[2]) : nullptr;
+                if (run == nullptr)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                levels_[record[0]].push_back(run);
+                used.push_back(Extent{record[1], record[2]});
+            }
+            // the remaining blocks are free
+            std::sort(used.begin(), used.end(), [](const Extent &e1, const Extent &e2) { return e1.start_ < e2.start_; });
+            uint32_t next = 0;
+            for (const Extent &extent : used)
+            {
+                ReleaseExtent(Extent{next, extent.start_ - next});
+                next = extent.start_ + extent.cnt_;
+            }
+            ReleaseExtent(Extent{next, static_cast<uint32_t>(data_storage_.GetMaxAddress().GetRaw() + 1) - next});
+            return Status::CreateOkStatus();
+        }
+        // manifest is empty if the storage does not have one
+        Status ReadManifest(std::vector<char> &manifest)
+        {
+            BlockBuffer block_buf;
+            BlockBufferInterface &buf = block_buf;
+            if (manifest_storage_.Read(LogicalBlockAddress(0), block_buf).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            if (buf.Memcmp(kSignature, 0, strlen(kSignature)) != 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            const size_t len = kRunsOffset + buf.GetValue<uint32_t>(kRunCntOffset) * kRunRecordSize;
+            if (len > kManifestBlockCnt * BlockBufferInterface::kSize)
+            {
+                return Status::CreateErrorStatus();
+            }
+            manifest.resize(len);
+            for (size_t offset = 0; offset < len; offset += BlockBufferInterface::kSize)
+            {
+                if (offset != 0 && manifest_storage_.Read(BlockBufferInterface::GetAddressFromOffset(offset), block_buf).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                buf.CopyTo(reinterpret_cast<uint8_t *>(manifest.data() + offset), 0, len - offset < BlockBufferInterface::kSize ? len - offset : BlockBufferInterface::kSize);
+            }
+            return Status::CreateOkStatus();
+        }
+        // The first block, which holds the number of runs, is written last.
+        // A manifest of more than one block is not written atomically.
+        Status WriteManifest()
+        {
+            std::vector<char> manifest(kRunsOffset, 0);
+            memcpy(manifest.data(), kSignature, strlen(kSignature));
+            uint32_t run_cnt = 0;
+            for (int level = 0; level < kLevelCnt; level++)
+            {
+                for (Run *run : levels_[level])
+                {
+                    const uint32_t record[3] = {static_cast<uint32_t>(level), run->GetStart(), run->GetBlockCnt()};
+                    const char *ptr = reinterpret_cast<const char *>(record);
+                    manifest.insert(manifest.end(), ptr, ptr + kRunRecordSize);
+                    run_cnt++;
+                }
+            }
+            memcpy(manifest.data() + kRunCntOffset, &run_cnt, sizeof(uint32_t));
+            if (manifest.size() > kManifestBlockCnt * BlockBufferInterface::kSize)
+            {
+                return Status::CreateErrorStatus();
+            }
+            BlockBuffer block_buf;
+            BlockBufferInterface &buf = block_buf;
+            const size_t block_cnt = (manifest.size() + BlockBufferInterface::kSize - 1) / BlockBufferInterface::kSize;
+            for (size_t i = block_cnt; i-- > 0;)
+            {
+                const size_t offset = i * BlockBufferInterface::kSize;
+                const size_t len = manifest.size() - offset < BlockBufferInterface::kSize ? manifest.size() - offset : BlockBufferInterface::kSize;
+                memset(buf.GetPtrToTheBuffer(), 0, BlockBufferInterface::kSize);
+                buf.CopyFrom(reinterpret_cast<const uint8_t *>(manifest.data() + offset), 0, len);
+                if (manifest_storage_.Write(LogicalBlockAddress(i), block_buf).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        // first fit; runs are at most about the memtable size, so that the space is not split into useless pieces
+        bool AllocateExtent(const uint32_t cnt, Extent &extent)
+        {
+            for (typename std::vector<Extent>::iterator it = free_extents_.begin(); it != free_extents_.end(); ++it)
+            {
+                if (it->cnt_ >= cnt)
+                {
+                    extent = Extent{it->start_, cnt};
+                    it->start_ += cnt;
+                    it->cnt_ -= cnt;
+                    if (it->cnt_ == 0)
+                    {
+                        free_extents_.erase(it);
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+        void ReleaseExtent(const Extent extent)
+        {
+            if (extent.cnt_ == 0)
+            {
+                return;
+            }
+            typename std::vector<Extent>::iterator it = free_extents_.begin();
+            while (it != free_extents_.end() && it->start_ < extent.start_)
+            {
+                ++it;
+            }
+            it = free_extents_.insert(it, extent);
+            if (it + 1 != free_extents_.end() && it->start_ + it->cnt_ == (it + 1)->start_)
+            {
+                it->cnt_ += (it + 1)->cnt_;
+                free_extents_.erase(it + 1);
+            }
+            if (it != free_extents_.begin() && (it - 1)->start_ + (it - 1)->cnt_ == it->start_)
+            {
+                (it - 1)->cnt_ += it->cnt_;
+                free_extents_.erase(it);
+            }
+        }
+        // index of the first run of a level from 1 whose last key is greater than (or equal to, if inclusive) the key
+        static size_t FindRun(const std::vector<Run *> &runs, const ContiguousKey &key, const bool inclusive)
+        {
+            size_t low = 0;
+            size_t high = runs.size();
+            while (low < high)
+            {
+                const size_t mid = (low + high) / 2;
+                const int result = runs[mid]->CmpLastKey(key.GetPtr(), key.GetLen());
+                if (result > 0 || (result == 0 && inclusive))
+                {
+                    high = mid;
+                }
+                else
+                {
+                    low = mid + 1;
+                }
+            }
+            return low;
+        }
+        // found is false if no version of the key exists, and deleted is true if the newest one is a tombstone
+        Status Lookup(const ValidSlice &key, SliceContainer &container, bool &found, bool &deleted)
+        {
+            SliceContainer encoded;
+            if (memtable_->Get(ReadOptions(), key, encoded).IsOk())
+            {
+                found = true;
+                DecodeValue(encoded, container, deleted);
+                return Status::CreateOkStatus();
+            }
+            ContiguousKey ckey(key);
+            const uint64_t hash = FastHash::Calc(ckey.GetPtr(), ckey.GetLen());
+            for (int level = 0; level < kLevelCnt; level++)
+            {
+                const std::vector<Run *> &runs = levels_[level];
+                for (size_t i = level == 0 ? 0 : FindRun(runs, ckey, true); i < runs.size(); i++)
+                {
+                    if (runs[i]->Get(ckey, hash, container, found, deleted).IsError())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                    if (found)
+                    {
+                        return Status::CreateOkStatus();
+                    }
+                    if (level != 0)
+                    {
+                        break;
+                    }
+                }
+            }
+            found = false;
+            return Status::CreateOkStatus();
+        }
+        // the lowest key greater than the given one (or equal to it, if inclusive) in the memtable or any run
+        Status FindCandidateKey(const ValidSlice &key, const bool inclusive, SliceContainer &container, bool &found)
+        {
+            SliceContainer encoded;
+            if (inclusive && memtable_->Get(ReadOptions(), key, encoded).IsOk())
+            {
+                container.Set(key);
+                found = true;
+                return Status::CreateOkStatus();
+            }
+            found = memtable_->FindNextKey(key, container).IsOk();
+            ContiguousKey ckey(key);
+            for (int level = 0; level < kLevelCnt; level++)
+            {
+                const std::vector<Run *> &runs = levels_[level];
+                const size_t end = level == 0 ? runs.size() : FindRun(runs, ckey, inclusive) + 1;
+                for (size_t i = level == 0 ? 0 : end - 1; i < end && i < runs.size(); i++)
+                {
+                    SliceContainer run_key;
+                    bool run_found;
+                    if (runs[i]->FindNextKey(ckey, inclusive, run_key, run_found).IsError())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                    CmpResult result;
+                    if (run_found && (!found || (run_key.Cmp(container, result).IsOk() && result.IsLower())))
+                    {
+                        container.Set(run_key);
+                        found = true;
+                    }
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+        // skips keys whose newest version is a tombstone
+        Status FindLiveKey(const ValidSlice &key, bool inclusive, SliceContainer &container)
+        {
+            SliceContainer current;
+            current.Set(key);
+            while (true)
+            {
+                bool found;
+                if (FindCandidateKey(current.CreateConstSlice(), inclusive, container, found).IsError() || !found)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                SliceContainer value;
+                bool deleted;
+                if (Lookup(container.CreateConstSlice(), value, found, deleted).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                assert(found);
+                if (!deleted)
+                {
+                    return Status::CreateOkStatus();
+                }
+                current.Set(container);
+                inclusive = false;
+            }
+        }
+        Status WriteToMemtable(const ValidSlice &key, const ValidSlice *value)
+        {
+            const int value_len = value != nullptr ? value->GetLen() : 0;
+            if (key.GetLen() > Run::kMaxKeyLen || value_len > Run::kMaxValueLen)
+            {
+                return Status::CreateErrorStatus();
+            }
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (memtable_stats_.data_len_ >= memtable_size_ && FlushMemtable(lock).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            EncodedValue encoded(value);
+            if (memtable_->Put(WriteOptions(), key, BufferPtrSlice(encoded.GetPtr(), encoded.GetLen())).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            memtable_stats_.Add(key.GetLen(), value_len);
+            return Status::CreateOkStatus();
+        }
+        // writes the memtable as the newest run of level 0
+        Status FlushMemtable(std::unique_lock<std::mutex> &lock)
+        {
+            while (levels_[0].size() >= kL0StopTrigger && !compaction_failed_)
+            {
+                cond_.wait(lock);
+            }
+            if (memtable_stats_.entry_cnt_ == 0)
+            {
+                return Status::CreateOkStatus();
+            }
+            Extent extent;
+            if (levels_[0].size() >= kL0StopTrigger ||
+                !AllocateExtent(Run::Builder::GetMaxBlockCnt(memtable_stats_), extent))
+            {
+                return Status::CreateErrorStatus();
+            }
+            Run *run = BuildRunFromMemtable(extent);
+            if (run == nullptr)
+            {
+                ReleaseExtent(extent);
+                return Status::CreateErrorStatus();
+            }
+            ReleaseExtent(Extent{run->GetStart() + run->GetBlockCnt(), extent.cnt_ - run->GetBlockCnt()});
+            levels_[0].insert(levels_[0].begin(), run);
+            delete memtable_;
+            memtable_ = memtable_allocator_.Allocate();
+            memtable_stats_ = Run::CreateEmptyStats();
+            cond_.notify_all();
+            return WriteManifest();
+        }
+        Run *BuildRunFromMemtable(const Extent extent)
+        {
+            typename Run::Builder builder(data_storage_, extent.start_, extent.cnt_);
+            Optional<KvsEntryIterator> o_iter = memtable_->GetFirstIterator();
+            while (o_iter.isPresent())
+            {
+                KvsEntryIterator iter = o_iter.get();
+                SliceContainer key_container, encoded, value_container;
+                bool deleted;
+                if (iter.GetKey(key_container).IsError() || iter.Get(ReadOptions(), encoded).IsError())
+                {
+                    return nullptr;
+                }
+                DecodeValue(encoded, value_container, deleted);
+                ContiguousKey key(key_container.CreateConstSlice());
+                ContiguousKey value(deleted ? ConstSlice("", 0) : value_container.CreateConstSlice());
+                if (builder.Add(typename Run::Entry{key.GetPtr(), key.GetLen(), value.GetPtr(), value.GetLen(), deleted}).IsError())
+                {
+                    return nullptr;
+                }
+                o_iter = iter.GetNext();
+            }
+            return builder.IsEmpty() ? nullptr : builder.Finish();
+        }
+        uint64_t GetLevelCapacity(const int level) const
+        {
+            uint64_t capacity = memtable_size_;
+            for (int i = 0; i < level; i++)
+            {
+                capacity *= kLevelSizeRatio;
+            }
+            return capacity;
+        }
+        uint64_t GetLevelSize(const int level) const
+        {
+            uint64_t size = 0;
+            for (Run *run : levels_[level])
+            {
+                size += run->GetStats().data_len_;
+            }
+            return size;
+        }
+        bool FindCompaction(Compaction &compaction) const
+        {
+            compaction.inputs_.clear();
+            if (levels_[0].size() >= kL0CompactionTrigger)
+            {
+                compaction.level_ = 0;
+                compaction.inputs_ = levels_[0];
+            }
+            else
+            {
+                int level = 1;
+                while (level < kLevelCnt - 1 && GetLevelSize(level) <= GetLevelCapacity(level))
+                {
+                    level++;
+                }
+                if (level == kLevelCnt - 1)
+                {
+                    return false;
+                }
+                // runs of a level are compacted in turn, starting after the last key of the previous one
+                const std::vector<char> &pointer = compact_pointers_[level];
+                const std::vector<Run *> &runs = levels_[level];
+                size_t i = 0;
+                while (!pointer.empty() && i < runs.size() && runs[i]->CmpLastKey(pointer.data(), pointer.size()) <= 0)
+                {
+                    i++;
+                }
+                compaction.level_ = level;
+                compaction.inputs_.push_back(runs[i < runs.size() ? i : 0]);
+            }
+            const size_t upper_cnt = compaction.inputs_.size();
+            for (Run *run : levels_[compaction.level_ + 1])
+            {
+                for (size_t i = 0; i < upper_cnt; i++)
+                {
+                    if (run->Overlaps(*compaction.inputs_[i]))
+                    {
+                        compaction.inputs_.push_back(run);
+                        break;
+                    }
+                }
+            }
+            compaction.drop_deletions_ = true;
+            for (int level = compaction.level_ + 2; level < kLevelCnt; level++)
+            {
+                compaction.drop_deletions_ = compaction.drop_deletions_ && levels_[level].empty();
+            }
+            return true;
+        }
+        void CompactionLoop()
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            while (!stop_)
+            {
+                Compaction compaction;
+                if (compaction_failed_ || !FindCompaction(compaction))
+                {
+                    cond_.wait(lock);
+                    continue;
+                }
+                if (compaction.level_ != 0 && compaction.inputs_.size() == 1)
+                {
+                    // nothing to merge with; the run just moves down
+                    compaction.outputs_.push_back(compaction.inputs_[0]);
+                    InstallCompaction(compaction);
+                    continue;
+                }
+                compacting_ = true;
+                lock.unlock();
+                Status s1 = Merge(compaction);
+                lock.lock();
+                compacting_ = false;
+                if (s1.IsError())
+                {
+                    for (Run *run : compaction.outputs_)
+                    {
+                        Run::Destroy(run);
+                    }
+                    for (const Extent &extent : compaction.output_extents_)
+                    {
+                        ReleaseExtent(extent);
+                    }
+                    compaction_failed_ = true;
+                    cond_.notify_all();
+                    continue;
+                }
+                InstallCompaction(compaction);
+            }
+        }
+        // k-way merge of the inputs without mtx_; the newest version of each key wins
+        Status Merge(Compaction &compaction)
+        {
+            const size_t cnt = compaction.inputs_.size();
+            std::vector<typename Run::Reader *> readers(cnt);
+            std::vector<typename Run::Entry> entries(cnt);
+            std::vector<bool> valid(cnt);
+            typename Run::Stats max_stats = Run::CreateEmptyStats();
+            bool error = false;
+            for (size_t i = 0; i < cnt; i++)
+            {
+                readers[i] = new typename Run::Reader(*compaction.inputs_[i], 0);
+                valid[i] = !readers[i]->IsEnd();
+                error = error || (valid[i] && readers[i]->ReadEntry(entries[i]).IsError());
+                max_stats.Add(compaction.inputs_[i]->GetStats());
+            }
+            typename Run::Builder *builder = nullptr;
+            while (!error)
+            {
+                int min = -1;
+                for (size_t i = 0; i < cnt; i++)
+                {
+                    if (valid[i] && (min < 0 || Run::CmpKey(entries[i].key_, entries[i].key_len_, entries[min].key_, entries[min].key_len_) < 0))
+                    {
+                        min = i;
+                    }
+                }
+                if (min < 0)
+                {
+                    break;
+                }
+                const typename Run::Entry &entry = entries[min];
+                if (!(entry.deleted_ && compaction.drop_deletions_))
+                {
+                    if (builder != nullptr && !builder->Fits(entry.key_len_, entry.value_len_))
+                    {
+                        error = FinishOutput(compaction, builder).IsError();
+                    }
+                    if (!error && builder == nullptr)
+                    {
+                        builder = StartOutput(compaction, Run::GetEntryLen(entry.key_len_, entry.value_len_), max_stats.max_key_len_);
+                    }
+                    error = error || builder == nullptr || builder->Add(entry).IsError();
+                }
+                // older versions of the key are skipped; the newest one is advanced last, since it owns the key
+                for (size_t i = 0; i < cnt && !error; i++)
+                {
+                    if (i != static_cast<size_t>(min) && valid[i] &&
+                        Run::CmpKey(entries[i].key_, entries[i].key_len_, entry.key_, entry.key_len_) == 0)
+                    {
+                        valid[i] = !readers[i]->IsEnd();
+                        error = valid[i] && readers[i]->ReadEntry(entries[i]).IsError();
+                    }
+                }
+                valid[min] = !readers[min]->IsEnd();
+                error = error || (valid[min] && readers[min]->ReadEntry(entries[min]).IsError());
+            }
+            if (!error && builder != nullptr)
+            {
+                error = FinishOutput(compaction, builder).IsError();
+            }
+            delete builder;
+            for (typename Run::Reader *reader : readers)
+            {
+                delete reader;
+            }
+            return error ? Status::CreateErrorStatus() : Status::CreateOkStatus();
+        }
+        // returns nullptr if there is no space
+        typename Run::Builder *StartOutput(Compaction &compaction, const uint64_t entry_len, const int max_key_len)
+        {
+            const uint64_t data_len = entry_len > memtable_size_ ? entry_len : memtable_size_;
+            const typename Run::Stats stats = {static_cast<uint32_t>(data_len / Run::GetEntryLen(0, 0)), data_len, max_key_len};
+            Extent extent;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (!AllocateExtent(Run::Builder::GetMaxBlockCnt(stats), extent))
+                {
+                    return nullptr;
+                }
+            }
+            compaction.output_extents_.push_back(extent);
+            return new typename Run::Builder(data_storage_, extent.start_, extent.cnt_);
+        }
+        Status FinishOutput(Compaction &compaction, typename Run::Builder *&builder)
+        {
+            Run *run = builder->Finish();
+            delete builder;
+            builder = nullptr;
+            if (run == nullptr)
+            {
+                return Status::CreateErrorStatus();
+            }
+            compaction.outputs_.push_back(run);
+            return Status::CreateOkStatus();
+        }
+        void InstallCompaction(Compaction &compaction)
+        {
+            for (int level = compaction.level_; level <= compaction.level_ + 1; level++)
+            {
+                std::vector<Run *> &runs = levels_[level];
+                runs.erase(std::remove_if(runs.begin(), runs.end(), [&compaction](Run *run) {
+                               return std::find(compaction.inputs_.begin(), compaction.inputs_.end(), run) != compaction.inputs_.end();
+                           }),
+                           runs.end());
+            }
+            std::vector<Run *> &output_level = levels_[compaction.level_ + 1];
+            size_t pos = 0;
+            for (size_t i = 0; i < compaction.outputs_.size(); i++)
+            {
+                Run *run = compaction.outputs_[i];
+                int last_key_len;
+                const char *last_key = run->GetLastKey(last_key_len);
+                while (pos < output_level.size() && output_level[pos]->CmpFirstKey(last_key, last_key_len) < 0)
+                {
+                    pos++;
+                }
+                output_level.insert(output_level.begin() + pos, run);
+                if (i < compaction.output_extents_.size())
+                {
+                    const Extent &extent = compaction.output_extents_[i];
+                    ReleaseExtent(Extent{extent.start_ + run->GetBlockCnt(), extent.cnt_ - run->GetBlockCnt()});
+                }
+            }
+            if (compaction.level_ != 0)
+            {
+                int last_key_len;
+                const char *last_key = compaction.inputs_[0]->GetLastKey(last_key_len);
+                compact_pointers_[compaction.level_].assign(last_key, last_key + last_key_len);
+            }
+            if (WriteManifest().IsError())
+            {
+                compaction_failed_ = true;
+            }
+            else if (compaction.outputs_.size() != 1 || compaction.outputs_[0] != compaction.inputs_[0])
+            {
+                for (Run *run : compaction.inputs_)
+                {
+                    ReleaseExtent(Extent{run->GetStart(), run->GetBlockCnt()});
+                    Run::Destroy(run);
+                }
+            }
+            cond_.notify_all();
+        }
+
+        BlockStorageWithLock<BlockBuffer> locked_storage_;
+        BlockStorageMultiplier<BlockBuffer> multiplier_;
+        MultipliedBlockStorage manifest_storage_;
+        MultipliedBlockStorage data_storage_;
+        KvsAllocatorInterface &memtable_allocator_;
+        const size_t memtable_size_;
+        Kvs *memtable_;
+        typename Run::Stats memtable_stats_;
+        std::vector<std::vector<Run *>> levels_;       // level 0 is newer first, and the others are in key order
+        std::vector<std::vector<char>> compact_pointers_; // last key compacted in each level
+        std::vector<Extent> free_extents_;             // sorted and coalesced
+        std::mutex mtx_;
+        std::condition_variable cond_;
+        std::thread compaction_thread_;
+        bool compacting_;
+        bool compaction_failed_;
+        bool stop_;
+    };
+}
@@ -0,0 +1,988 @@
+#pragma once
+#include "kvs_interface.h"
+#include "block_storage/block_storage_interface.h"
+#include "block_storage/block_storage_with_cache.h"
+#include "utils/contiguous_key.h"
+#include "utils/crc32c.h"
+#include <new>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+
+namespace HayaguiKvs
+{
+    // B+tree whose nodes are blocks of a block storage.
+    // A query reads only the blocks on the path from the root through a bounded LRU cache,
+    // so the data set does not have to fit in memory, and opening an existing tree reads only the superblocks.
+    // Nodes are copied on write: an update writes the nodes it changes and their ancestors to free pages,
+    // and then switches to the new root by writing one of the two superblocks alternately.
+    // The superblocks have sequence numbers and crcs, so that a crash at any point leaves the last complete update,
+    // and pages of the old nodes are not reused until the superblock which no longer refers to them is written.
+    // A node less than a quarter full is merged with its sibling, or takes entries from it if both do not fit in one block.
+    // A key and its value take at most kMaxEntryLen bytes in total (157 bytes with 512 byte blocks), since there are no overflow pages.
+    // Put rejects larger entries.
+    template <class BlockBuffer>
+    class PagedBTreeKvs final : public Kvs
+    {
+    public:
+        PagedBTreeKvs() = delete;
+        PagedBTreeKvs(BlockStorageInterface<BlockBuffer> &storage, const int cache_cnt = kDefaultCacheCnt)
+            : storage_(storage, cache_cnt)
+        {
+            if (Open().IsError())
+            {
+                abort();
+            }
+        }
+        virtual ~PagedBTreeKvs() override
+        {
+        }
+        PagedBTreeKvs(const PagedBTreeKvs &obj) = delete;
+        PagedBTreeKvs &operator=(const PagedBTreeKvs &obj) = delete;
+        virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
+        {
+            ContiguousKey ckey(key);
+            Path path;
+            if (FindLeaf(ckey, path).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            Page leaf(buf_);
+            bool found;
+            const int index = leaf.Search(ckey, found);
+            if (!found)
+            {
+                return Status::CreateErrorStatus();
+            }
+            const Entry entry = leaf.GetEntry(index);
+            container.Set(entry.value_, entry.value_len_);
+            return Status::CreateOkStatus();
+        }
+        virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
+        {
+            if (key.GetLen() + value.GetLen() > kMaxEntryLen || !HasBlocksForUpdate())
+            {
+                return Status::CreateErrorStatus();
+            }
+            ContiguousKey ckey(key);
+            ContiguousKey cvalue(value);
+            Path path;
+            if (FindLeaf(ckey, path).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            Page leaf(buf_);
+            bool found;
+            const int index = leaf.Search(ckey, found);
+            if (found)
+            {
+                leaf.Remove(index);
+            }
+            const Entry entry = Entry::CreateLeafEntry(ckey.GetPtr(), ckey.GetLen(), cvalue.GetPtr(), cvalue.GetLen());
+            if (leaf.Insert(index, entry, scratch_buf_))
+            {
+                if (WritePath(path, 0).IsError())
+                {
+                    Abort();
+                    return Status::CreateErrorStatus();
+                }
+                return Commit();
+            }
+            SeparatorKey separator;
+            uint32_t left_page_no;
+            uint32_t right_page_no;
+            if (Split(path.pages_[0], index, entry, separator, left_page_no, right_page_no).IsError() ||
+                InsertIntoParent(path, 1, separator, left_page_no, right_page_no).IsError())
+            {
+                Abort();
+                return Status::CreateErrorStatus();
+            }
+            return Commit();
+        }
+        virtual Status Delete(WriteOptions options, const ValidSlice &key) override
+        {
+            if (!HasBlocksForUpdate())
+            {
+                return Status::CreateErrorStatus();
+            }
+            ContiguousKey ckey(key);
+            Path path;
+            if (FindLeaf(ckey, path).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            Page leaf(buf_);
+            bool found;
+            const int index = leaf.Search(ckey, found);
+            if (!found)
+            {
+                return Status::CreateErrorStatus();
+            }
+            leaf.Remove(index);
+            if (Rebalance(path).IsError())
+            {
+                Abort();
+                return Status::CreateErrorStatus();
+            }
+            return Commit();
+        }
+        virtual Optional<KvsEntryIterator> GetFirstIterator() override
+        {
+            SliceContainer container;
+            if (FindEntry(BufferPtrSlice("", 0), true, container).IsError())
+            {
+                return Optional<KvsEntryIterator>::CreateInvalidObj();
+            }
+            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(container.CreateConstSlice()));
+        }
+        virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
+        {
+            GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
+            new (base) GenericKvsEntryIteratorBase(*this, key);
+            return KvsEntryIterator(base);
+        }
+        virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
+        {
+            return FindEntry(key, false, container);
+        }
+        // number of inner levels; a Get reads GetHeight() + 1 blocks
+        int GetHeight() const
+        {
+            return super_.height_;
+        }
+
+    private:
+        static const int kDefaultCacheCnt = 256;
+        static const int kMaxHeight = 32;
+        static const int kPageSize = BlockBufferInterface::kSize;
+        // page header
+        static const int kTypeOffset = 0;
+        static const int kCntOffset = 2;
+        static const int kHeapOffset = 4;    // records are stored in [heap, kPageSize)
+        static const int kGarbageOffset = 6; // bytes of removed records left in the heap
+        static const int kLinkOffset = 8;    // the leftmost child of an inner, or the next block of the free list
+        static const int kHeaderSize = 16;
+        static const int kSlotSize = 2;      // slots hold offsets of records in key order, and follow the header
+        static const int kPayloadSize = kPageSize - kHeaderSize;
+        static const int kLeafRecordHeaderSize = 4;  // key length, value length, then key and value
+        static const int kInnerRecordHeaderSize = 6; // key length, right child, then key
+        // any record takes at most a third of a page, so that a split always yields two pages
+        static const int kMaxEntryLen = kPayloadSize / 3 - kInnerRecordHeaderSize - kSlotSize;
+        static const int kMaxEntryCnt = kPayloadSize / (kLeafRecordHeaderSize + kSlotSize) + 1;
+        static const int kMergeThreshold = kPayloadSize / 4;
+        static const uint8_t kLeafType = 1;
+        static const uint8_t kInnerType = 2;
+        static const uint8_t kFreeListType = 3;
+        // superblocks are at the first two blocks
+        static const int kSuperBlockCnt = 2;
+        static const int kSeqOffset = 24;
+        static const int kRootOffset = 32;
+        static const int kHeightOffset = 36;
+        static const int kNextPageOffset = 40;
+        static const int kFreeListOffset = 44;
+        static const int kFreeListCntOffset = 48;
+        static const int kFreeCntOffset = 52;
+        static const int kFreePagesOffset = 56;
+        static const int kSuperCrcOffset = kPageSize - sizeof(uint32_t); // of the bytes before it
+        static const int kSuperFreeCapacity = (kSuperCrcOffset - kFreePagesOffset) / sizeof(uint32_t);
+        // free pages which do not fit in the superblock are listed after the header of blocks in a chain,
+        // each of which moves to the superblock at once
+        static const int kFreeListCapacity = kSuperFreeCapacity;
+        // an update releases at most two pages at each level, the root and blocks of the free list
+        static const int kMaxReleasedCnt = kMaxHeight * 2 + 8;
+        static_assert(kMaxReleasedCnt < kSuperFreeCapacity, "An overflowing free list should have a page to be written to.");
+        static constexpr const char *const kSignature = "HAYAGUI_PAGED_BTREE_V2_";
+
+        struct Entry
+        {
+            static Entry CreateLeafEntry(const char *key, const int key_len, const char *value, const int value_len)
+            {
+                return Entry{key, key_len, value, value_len, 0};
+            }
+            static Entry CreateInnerEntry(const char *key, const int key_len, const uint32_t child)
+            {
+                return Entry{key, key_len, nullptr, 0, child};
+            }
+            int GetSize(const bool is_leaf) const
+            {
+                return (is_leaf ? kLeafRecordHeaderSize + value_len_ : kInnerRecordHeaderSize) + key_len_ + kSlotSize;
+            }
+            const char *key_;
+            int key_len_;
+            const char *value_; // leaf only
+            int value_len_;
+            uint32_t child_; // inner only
+        };
+        struct SeparatorKey
+        {
+            void Set(const char *key, const int len)
+            {
+                memcpy(buf_, key, len);
+                len_ = len;
+            }
+            char buf_[kMaxEntryLen];
+            int len_;
+        };
+        // pages_[0] is a leaf and pages_[height] is the root.
+        // indexes_[level] is the index of the child of pages_[level] on the path, and cnts_[level] is the number of keys in it.
+        struct Path
+        {
+            uint32_t pages_[kMaxHeight + 1];
+            int indexes_[kMaxHeight + 1];
+            int cnts_[kMaxHeight + 1];
+        };
+        // Slotted page on a block buffer.
+        class Page
+        {
+        public:
+            explicit Page(BlockBufferInterface &buf) : ptr_(buf.GetPtrToTheBuffer())
+            {
+            }
+            void Init(const uint8_t type)
+            {
+                memset(ptr_, 0, kHeaderSize);
+                ptr_[kTypeOffset] = type;
+                SetU16(kHeapOffset, kPageSize);
+            }
+            bool IsLeaf() const
+            {
+                return ptr_[kTypeOffset] == kLeafType;
+            }
+            int GetCnt() const
+            {
+                return GetU16(kCntOffset);
+            }
+            // bytes taken by live records and slots
+            int GetUsedSize() const
+            {
+                return kPageSize - GetU16(kHeapOffset) - GetU16(kGarbageOffset) + GetCnt() * kSlotSize;
+            }
+            uint32_t GetLink() const
+            {
+                return GetU32(kLinkOffset);
+            }
+            void SetLink(const uint32_t link)
+            {
+                SetU32(kLinkOffset, link);
+            }
+            Entry GetEntry(const int index) const
+            {
+                assert(index < GetCnt());
+                const int offset = GetU16(kHeaderSize + index * kSlotSize);
+                const int key_len = GetU16(offset);
+                if (IsLeaf())
+                {
+                    const char *key = reinterpret_cast<const char *>(ptr_ + offset + kLeafRecordHeaderSize);
+                    return Entry::CreateLeafEntry(key, key_len, key + key_len, GetU16(offset + 2));
+                }
+                return Entry::CreateInnerEntry(reinterpret_cast<const char *>(ptr_ + offset + kInnerRecordHeaderSize), key_len, GetU32(offset + 2));
+            }
+            // children of an inner are indexed from 0 to GetCnt()
+            uint32_t GetChild(const int index) const
+            {
+                return index == 0 ? GetLink() : GetEntry(index - 1).child_;
+            }
+            void SetChild(const int index, const uint32_t child)
+            {
+                if (index == 0)
+                {
+                    SetLink(child);
+                    return;
+                }
+                assert(!IsLeaf() && index <= GetCnt());
+                SetU32(GetU16(kHeaderSize + (index - 1) * kSlotSize) + 2, child);
+            }
+            // index of the first key not lower than the given key
+            int Search(const ContiguousKey &key, bool &found) const
+            {
+                int low = 0;
+                int high = GetCnt();
+                found = false;
+                while (low < high)
+                {
+                    const int mid = (low + high) / 2;
+                    const int cmp = Cmp(GetEntry(mid), key);
+                    if (cmp == 0)
+                    {
+                        found = true;
+                        return mid;
+                    }
+                    if (cmp < 0)
+                    {
+                        low = mid + 1;
+                    }
+                    else
+                    {
+                        high = mid;
+                    }
+                }
+                return low;
+            }
+            // keys in the child i + 1 are greater than or equal to the key i
+            int FindChildIndex(const ContiguousKey &key) const
+            {
+                bool found;
+                const int index = Search(key, found);
+                return found ? index + 1 : index;
+            }
+            // returns false without modifying the page if the entry does not fit
+            bool Insert(const int index, const Entry &entry, BlockBufferInterface &scratch)
+            {
+                const int size = entry.GetSize(IsLeaf());
+                if (GetFreeSize() < size)
+                {
+                    if (GetFreeSize() + GetU16(kGarbageOffset) < size)
+                    {
+                        return false;
+                    }
+                    Compact(scratch);
+                }
+                const int cnt = GetCnt();
+                uint8_t *slots = ptr_ + kHeaderSize;
+                memmove(slots + (index + 1) * kSlotSize, slots + index * kSlotSize, (cnt - index) * kSlotSize);
+                SetU16(kCntOffset, cnt + 1);
+                WriteRecord(index, entry);
+                return true;
+            }
+            void Remove(const int index)
+            {
+                const int cnt = GetCnt();
+                SetU16(kGarbageOffset, GetU16(kGarbageOffset) + GetEntry(index).GetSize(IsLeaf()) - kSlotSize);
+                uint8_t *slots = ptr_ + kHeaderSize;
+                memmove(slots + index * kSlotSize, slots + (index + 1) * kSlotSize, (cnt - index - 1) * kSlotSize);
+                SetU16(kCntOffset, cnt - 1);
+            }
+            // the page should have been initialized, and entries should not point to the page
+            void Append(const Entry *entries, const int cnt)
+            {
+                for (int i = 0; i < cnt; i++)
+                {
+                    const int index = GetCnt();
+                    SetU16(kCntOffset, index + 1);
+                    WriteRecord(index, entries[i]);
+                }
+            }
+
+        private:
+            int GetFreeSize() const
+            {
+                return GetU16(kHeapOffset) - kHeaderSize - GetCnt() * kSlotSize;
+            }
+            void WriteRecord(const int index, const Entry &entry)
+            {
+                const bool is_leaf = IsLeaf();
+                const int offset = GetU16(kHeapOffset) - (entry.GetSize(is_leaf) - kSlotSize);
+                assert(offset >= kHeaderSize + GetCnt() * kSlotSize);
+                SetU16(kHeapOffset, offset);
+                SetU16(kHeaderSize + index * kSlotSize, offset);
+                SetU16(offset, entry.key_len_);
+                if (is_leaf)
+                {
+                    SetU16(offset + 2, entry.value_len_);
+                    memcpy(ptr_ + offset + kLeafRecordHeaderSize, entry.key_, entry.key_len_);
+                    memcpy(ptr_ + offset + kLeafRecordHeaderSize + entry.key_len_, entry.value_, entry.value_len_);
+                }
+                else
+                {
+                    SetU32(offset + 2, entry.child_);
+                    memcpy(ptr_ + offset + kInnerRecordHeaderSize, entry.key_, entry.key_len_);
+                }
+            }
+            // rewrites the records without garbage
+            void Compact(BlockBufferInterface &scratch)
+            {
+                memcpy(scratch.GetPtrToTheBuffer(), ptr_, kPageSize);
+                Page old_page(scratch);
+                const int cnt = GetCnt();
+                SetU16(kCntOffset, 0);
+                SetU16(kHeapOffset, kPageSize);
+                SetU16(kGarbageOffset, 0);
+                for (int i = 0; i < cnt; i++)
+                {
+                    const Entry entry = old_page.GetEntry(i);
+                    Append(&entry, 1);
+                }
+            }
+            static int Cmp(const Entry &entry, const ContiguousKey &key)
+            {
+                const int len = entry.key_len_ < key.GetLen() ? entry.key_len_ : key.GetLen();
+                const int cmp = memcmp(entry.key_, key.GetPtr(), len);
+                return cmp != 0 ? cmp : entry.key_len_ - key.GetLen();
+            }
+            int GetU16(const int offset) const
+            {
+                uint16_t value;
+                memcpy(&value, ptr_ + offset, sizeof(value));
+                return value;
+            }
+            void SetU16(const int offset, const int value)
+            {
+                const uint16_t v = value;
+                memcpy(ptr_ + offset, &v, sizeof(v));
+            }
+            uint32_t GetU32(const int offset) const
+            {
+                uint32_t value;
+                memcpy(&value, ptr_ + offset, sizeof(value));
+                return value;
+            }
+            void SetU32(const int offset, const uint32_t value)
+            {
+                memcpy(ptr_ + offset, &value, sizeof(value));
+            }
+            uint8_t *const ptr_;
+        };
+        struct SuperBlock
+        {
+            uint64_t seq_;
+            uint32_t root_;
+            uint32_t height_;
+            uint32_t next_page_;  // pages from next_page_ have never been used
+            uint32_t free_list_;  // the first block of the free list, 0 if there is none
+            uint32_t free_list_cnt_; // number of pages listed in the free list
+            uint32_t free_cnt_;
+            uint32_t free_pages_[kSuperFreeCapacity];
+        };
+
+        Status Open()
+        {
+            if (storage_.Open().IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            bool found = false;
+            for (int i = 0; i < kSuperBlockCnt; i++)
+            {
+                SuperBlock super;
+                if (storage_.Read(LogicalBlockAddress(i), buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                if (DecodeSuperBlock(buf_, super) && (!found || super.seq_ > super_.seq_))
+                {
+                    super_ = super;
+                    found = true;
+                }
+            }
+            if (found)
+            {
+                committed_ = super_;
+                return Status::CreateOkStatus();
+            }
+            // the storage does not hold a tree yet
+            super_.seq_ = 0;
+            super_.root_ = kSuperBlockCnt;
+            super_.height_ = 0;
+            super_.next_page_ = kSuperBlockCnt + 1;
+            super_.free_list_ = 0;
+            super_.free_list_cnt_ = 0;
+            super_.free_cnt_ = 0;
+            committed_ = super_;
+            Page(buf_).Init(kLeafType);
+            if (WritePage(super_.root_, buf_).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return Commit();
+        }
+        // returns false if the block does not hold a complete superblock
+        static bool DecodeSuperBlock(const BlockBufferInterface &buf, SuperBlock &super)
+        {
+            if (buf.Memcmp(kSignature, 0, strlen(kSignature)) != 0 ||
+                buf.GetValue<uint32_t>(kSuperCrcOffset) != Crc32c::Calc(reinterpret_cast<const char *>(buf.GetConstPtrToTheBuffer()), kSuperCrcOffset))
+            {
+                return false;
+            }
+            super.seq_ = buf.GetValue<uint64_t>(kSeqOffset);
+            super.root_ = buf.GetValue<uint32_t>(kRootOffset);
+            super.height_ = buf.GetValue<uint32_t>(kHeightOffset);
+            super.next_page_ = buf.GetValue<uint32_t>(kNextPageOffset);
+            super.free_list_ = buf.GetValue<uint32_t>(kFreeListOffset);
+            super.free_list_cnt_ = buf.GetValue<uint32_t>(kFreeListCntOffset);
+            super.free_cnt_ = buf.GetValue<uint32_t>(kFreeCntOffset);
+            if (super.free_cnt_ > kSuperFreeCapacity)
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < super.free_cnt_; i++)
+            {
+                super.free_pages_[i] = buf.GetValue<uint32_t>(kFreePagesOffset + i * sizeof(uint32_t));
+            }
+            return true;
+        }
+        // Makes the update durable by writing the superblock which is not the last one.
+        // Pages released by the update are free from then on.
+        Status Commit()
+        {
+            // the pages released by the update are still referred to by the last superblock,
+            // so the free list overflowing the superblock is written to a page which was free before the update
+            while (super_.free_cnt_ + released_cnt_ > kSuperFreeCapacity)
+            {
+                assert(super_.free_cnt_ > 0);
+                const uint32_t page_no = super_.free_pages_[--super_.free_cnt_];
+                Page list(scratch_buf_);
+                list.Init(kFreeListType);
+                list.SetLink(super_.free_list_);
+                BlockBufferInterface &buf = scratch_buf_;
+                int cnt = 0;
+                for (; cnt < kFreeListCapacity && (released_cnt_ > 0 || super_.free_cnt_ > 0); cnt++)
+                {
+                    const uint32_t free_page_no = released_cnt_ > 0 ? released_[--released_cnt_] : super_.free_pages_[--super_.free_cnt_];
+                    buf.SetValue<uint32_t>(kHeaderSize + cnt * sizeof(uint32_t), free_page_no);
+                }
+                buf.SetValue<uint16_t>(kCntOffset, cnt);
+                if (WritePage(page_no, scratch_buf_).IsError())
+                {
+                    Abort();
+                    return Status::CreateErrorStatus();
+                }
+                super_.free_list_ = page_no;
+                super_.free_list_cnt_ += cnt;
+            }
+            for (int i = 0; i < released_cnt_; i++)
+            {
+                super_.free_pages_[super_.free_cnt_++] = released_[i];
+            }
+            released_cnt_ = 0;
+            super_.seq_++;
+            BlockBufferInterface &buf = scratch_buf_;
+            memset(buf.GetPtrToTheBuffer(), 0, kPageSize);
+            buf.CopyFrom(reinterpret_cast<const uint8_t *>(kSignature), 0, strlen(kSignature));
+            buf.SetValue<uint64_t>(kSeqOffset, super_.seq_);
+            buf.SetValue<uint32_t>(kRootOffset, super_.root_);
+            buf.SetValue<uint32_t>(kHeightOffset, super_.height_);
+            buf.SetValue<uint32_t>(kNextPageOffset, super_.next_page_);
+            buf.SetValue<uint32_t>(kFreeListOffset, super_.free_list_);
+            buf.SetValue<uint32_t>(kFreeListCntOffset, super_.free_list_cnt_);
+            buf.SetValue<uint32_t>(kFreeCntOffset, super_.free_cnt_);
+            for (uint32_t i = 0; i < super_.free_cnt_; i++)
+            {
+                buf.SetValue<uint32_t>(kFreePagesOffset + i * sizeof(uint32_t), super_.free_pages_[i]);
+            }
+            buf.SetValue<uint32_t>(kSuperCrcOffset, Crc32c::Calc(reinterpret_cast<const char *>(buf.GetConstPtrToTheBuffer()), kSuperCrcOffset));
+            if (storage_.Write(LogicalBlockAddress(super_.seq_ % kSuperBlockCnt), scratch_buf_).IsError())
+            {
+                Abort();
+                return Status::CreateErrorStatus();
+            }
+            committed_ = super_;
+            return Status::CreateOkStatus();
+        }
+        // forgets the update; the pages it has written are not referred to by the last superblock
+        void Abort()
+        {
+            super_ = committed_;
+            released_cnt_ = 0;
+        }
+        Status ReadPage(const uint32_t page, BlockBuffer &buf)
+        {
+            return storage_.Read(LogicalBlockAddress(page), buf);
+        }
+        Status WritePage(const uint32_t page, const BlockBuffer &buf)
+        {
+            return storage_.Write(LogicalBlockAddress(page), buf);
+        }
+        // an update copies each node on the path, and a split or a merge takes two pages at a level and a new root
+        bool HasBlocksForUpdate() const
+        {
+            const int64_t unused = (int64_t)storage_.GetMaxAddress().GetRaw() + 1 - super_.next_page_;
+            return unused + super_.free_cnt_ + super_.free_list_cnt_ >= super_.height_ * 2 + 4;
+        }
+        // takes a page which is free in the last superblock too
+        Status AllocatePage(uint32_t &page)
+        {
+            if (super_.free_cnt_ == 0 && super_.free_list_ != 0)
+            {
+                // the pages listed in the block move to the superblock, and the block is released
+                if (ReadPage(super_.free_list_, free_list_buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                const Page list(free_list_buf_);
+                const BlockBufferInterface &buf = free_list_buf_;
+                assert(list.GetCnt() <= kSuperFreeCapacity);
+                for (int i = 0; i < list.GetCnt(); i++)
+                {
+                    super_.free_pages_[super_.free_cnt_++] = buf.GetValue<uint32_t>(kHeaderSize + i * sizeof(uint32_t));
+                }
+                super_.free_list_cnt_ -= list.GetCnt();
+                ReleasePage(super_.free_list_);
+                super_.free_list_ = list.GetLink();
+            }
+            if (super_.free_cnt_ > 0)
+            {
+                page = super_.free_pages_[--super_.free_cnt_];
+                return Status::CreateOkStatus();
+            }
+            if ((int64_t)super_.next_page_ > storage_.GetMaxAddress().GetRaw())
+            {
+                return Status::CreateErrorStatus();
+            }
+            page = super_.next_page_++;
+            return Status::CreateOkStatus();
+        }
+        // the page becomes free when the update is committed
+        void ReleasePage(const uint32_t page)
+        {
+            assert(released_cnt_ < kMaxReleasedCnt);
+            released_[released_cnt_++] = page;
+        }
+        // writes the node in buf to a new page instead of the page
+        Status WriteCopy(const uint32_t page, const BlockBuffer &buf, uint32_t &new_page)
+        {
+            if (AllocatePage(new_page).IsError() || WritePage(new_page, buf).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            ReleasePage(page);
+            return Status::CreateOkStatus();
+        }
+        // writes copies of the node in buf_ at the level and its ancestors, up to a new root
+        Status WritePath(Path &path, int level)
+        {
+            uint32_t page_no;
+            while (true)
+            {
+                if (WriteCopy(path.pages_[level], buf_, page_no).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                if (level == (int)super_.height_)
+                {
+                    break;
+                }
+                level++;
+                if (ReadPage(path.pages_[level], buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                Page(buf_).SetChild(path.indexes_[level], page_no);
+            }
+            super_.root_ = page_no;
+            return Status::CreateOkStatus();
+        }
+        // reads the leaf which should contain the key into buf_
+        Status FindLeaf(const ContiguousKey &key, Path &path)
+        {
+            uint32_t page_no = super_.root_;
+            for (int level = super_.height_; level > 0; level--)
+            {
+                if (ReadPage(page_no, buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                Page page(buf_);
+                assert(!page.IsLeaf());
+                const int index = page.FindChildIndex(key);
+                path.pages_[level] = page_no;
+                path.indexes_[level] = index;
+                path.cnts_[level] = page.GetCnt();
+                page_no = page.GetChild(index);
+            }
+            path.pages_[0] = page_no;
+            return ReadPage(page_no, buf_);
+        }
+        // reads the leaf next to pages_[0] into buf_, and moves the path to it
+        Status ReadNextLeaf(Path &path)
+        {
+            int level = 1;
+            while (level <= (int)super_.height_ && path.indexes_[level] == path.cnts_[level])
+            {
+                level++;
+            }
+            if (level > (int)super_.height_)
+            {
+                return Status::CreateErrorStatus();
+            }
+            path.indexes_[level]++;
+            for (; level > 0; level--)
+            {
+                if (ReadPage(path.pages_[level], buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                Page page(buf_);
+                path.cnts_[level] = page.GetCnt();
+                path.pages_[level - 1] = page.GetChild(path.indexes_[level]);
+                path.indexes_[level - 1] = 0;
+            }
+            return ReadPage(path.pages_[0], buf_);
+        }
+        // finds the first key greater than (or equal to, if inclusive) the given key
+        Status FindEntry(const ValidSlice &key, const bool inclusive, SliceContainer &container)
+        {
+            ContiguousKey ckey(key);
+            Path path;
+            if (FindLeaf(ckey, path).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            bool found;
+            int index = Page(buf_).Search(ckey, found);
+            if (found && !inclusive)
+            {
+                index++;
+            }
+            // leaves which could not be merged with their siblings can be empty
+            while (index == Page(buf_).GetCnt())
+            {
+                if (ReadNextLeaf(path).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                index = 0;
+            }
+            const Entry entry = Page(buf_).GetEntry(index);
+            container.Set(entry.key_, entry.key_len_);
+            return Status::CreateOkStatus();
+        }
+        // moves the entries of the node in buf_ and the given entry at index to two new pages, releasing the page
+        Status Split(const uint32_t page_no, const int index, const Entry &entry, SeparatorKey &separator, uint32_t &left_page_no, uint32_t &right_page_no)
+        {
+            scratch_buf_.CopyFrom(buf_);
+            const Page old_page(scratch_buf_);
+            Entry entries[kMaxEntryCnt];
+            const int cnt = old_page.GetCnt() + 1;
+            for (int i = 0; i < cnt; i++)
+            {
+                entries[i] = i < index ? old_page.GetEntry(i) : (i == index ? entry : old_page.GetEntry(i - 1));
+            }
+            Distribute(entries, cnt, old_page.IsLeaf(), old_page.GetLink(), buf_, sibling_buf_, separator);
+            if (WriteCopy(page_no, buf_, left_page_no).IsError() ||
+                AllocatePage(right_page_no).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            return WritePage(right_page_no, sibling_buf_);
+        }
+        // Builds two pages from the entries, divided at the middle by size.
+        // For leaves, the separator is the shortest key between the two pages;
+        // for inners, the middle entry is moved up as the separator, and its child becomes the leftmost child of the right page.
+        // The entries should not point to the pages.
+        void Distribute(const Entry *entries, const int cnt, const bool is_leaf, const uint32_t leftmost_child,
+                        BlockBuffer &left_buf, BlockBuffer &right_buf, SeparatorKey &separator)
+        {
+            int total = 0;
+            for (int i = 0; i < cnt; i++)
+            {
+                total += entries[i].GetSize(is_leaf);
+            }
+            // the first entry of the right page is the one which straddles the middle
+            int left_cnt = 0;
+            for (int size = 0; size + entries[left_cnt].GetSize(is_leaf) / 2 < total / 2; left_cnt++)
+            {
+                size += entries[left_cnt].GetSize(is_leaf);
+            }
+            Page left(left_buf);
+            Page right(right_buf);
+            if (is_leaf)
+            {
+                left_cnt = left_cnt < 1 ? 1 : left_cnt;
+                left.Init(kLeafType);
+                left.Append(entries, left_cnt);
+                right.Init(kLeafType);
+                right.Append(entries + left_cnt, cnt - left_cnt);
+                const Entry &last = entries[left_cnt - 1];
+                const Entry &first = entries[left_cnt];
+                int len = 0;
+                while (len < last.key_len_ && last.key_[len] == first.key_[len])
+                {
+                    len++;
+                }
+                separator.Set(first.key_, len + 1);
+            }
+            else
+            {
+                left_cnt = left_cnt < 1 ? 1 : (left_cnt > cnt - 2 ? cnt - 2 : left_cnt);
+                const Entry &middle = entries[left_cnt];
+                left.Init(kInnerType);
+                left.SetLink(leftmost_child);
+                left.Append(entries, left_cnt);
+                right.Init(kInnerType);
+                right.SetLink(middle.child_);
+                right.Append(entries + left_cnt + 1, cnt - left_cnt - 1);
+                separator.Set(middle.key_, middle.key_len_);
+            }
+        }
+        // replaces the child on the path at the level with the two pages divided by the separator, up to a new root
+        Status InsertIntoParent(Path &path, int level, SeparatorKey &separator, uint32_t left_page_no, uint32_t right_page_no)
+        {
+            while (level <= (int)super_.height_)
+            {
+                if (ReadPage(path.pages_[level], buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                Page page(buf_);
+                page.SetChild(path.indexes_[level], left_page_no);
+                const Entry entry = Entry::CreateInnerEntry(separator.buf_, separator.len_, right_page_no);
+                if (page.Insert(path.indexes_[level], entry, scratch_buf_))
+                {
+                    return WritePath(path, level);
+                }
+                SeparatorKey upper_separator;
+                if (Split(path.pages_[level], path.indexes_[level], entry, upper_separator, left_page_no, right_page_no).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                separator = upper_separator;
+                level++;
+            }
+            // the root has been split
+            assert(super_.height_ < kMaxHeight);
+            uint32_t root;
+            if (AllocatePage(root).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            Page page(buf_);
+            page.Init(kInnerType);
+            page.SetLink(left_page_no);
+            const Entry entry = Entry::CreateInnerEntry(separator.buf_, separator.len_, right_page_no);
+            page.Append(&entry, 1);
+            if (WritePage(root, buf_).IsError())
+            {
+                return Status::CreateErrorStatus();
+            }
+            super_.root_ = root;
+            super_.height_++;
+            return Status::CreateOkStatus();
+        }
+        // Writes the node in buf_ on the path, which has lost an entry, and its ancestors.
+        // An underfull node is merged with its sibling, up to the root.
+        // If the two do not fit in one page, their entries are redistributed instead.
+        Status Rebalance(Path &path)
+        {
+            for (int level = 0; level < (int)super_.height_; level++)
+            {
+                if (Page(buf_).GetUsedSize() >= kMergeThreshold)
+                {
+                    return WritePath(path, level);
+                }
+                if (ReadPage(path.pages_[level + 1], parent_buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                Page parent(parent_buf_);
+                const int child_index = path.indexes_[level + 1];
+                uint32_t page_no;
+                if (parent.GetCnt() == 0)
+                {
+                    // without siblings, the parent is as underfull as the node
+                    if (WriteCopy(path.pages_[level], buf_, page_no).IsError())
+                    {
+                        return Status::CreateErrorStatus();
+                    }
+                    parent.SetChild(child_index, page_no);
+                    buf_.CopyFrom(parent_buf_);
+                    continue;
+                }
+                // the right one of the two is merged into the left one
+                const bool is_left = child_index < parent.GetCnt();
+                const int separator_index = is_left ? child_index : child_index - 1;
+                const uint32_t sibling_page_no = parent.GetChild(is_left ? child_index + 1 : child_index - 1);
+                if (ReadPage(sibling_page_no, sibling_buf_).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                BlockBuffer &left_buf = is_left ? buf_ : sibling_buf_;
+                BlockBuffer &right_buf = is_left ? sibling_buf_ : buf_;
+                const uint32_t left_page_no = is_left ? path.pages_[level] : sibling_page_no;
+                const uint32_t right_page_no = is_left ? sibling_page_no : path.pages_[level];
+                scratch_buf_.CopyFrom(left_buf);
+                sibling_scratch_buf_.CopyFrom(right_buf);
+                const Page left(scratch_buf_);
+                const Page right(sibling_scratch_buf_);
+                const bool is_leaf = left.IsLeaf();
+                SeparatorKey separator;
+                const Entry separator_entry = parent.GetEntry(separator_index);
+                separator.Set(separator_entry.key_, separator_entry.key_len_);
+                Entry entries[kMaxEntryCnt * 2 + 1];
+                int cnt = 0;
+                int total = left.GetUsedSize() + right.GetUsedSize();
+                for (int i = 0; i < left.GetCnt(); i++)
+                {
+                    entries[cnt++] = left.GetEntry(i);
+                }
+                if (!is_leaf)
+                {
+                    // the separator comes down with the leftmost child of the right node
+                    entries[cnt++] = Entry::CreateInnerEntry(separator.buf_, separator.len_, right.GetLink());
+                    total += entries[cnt - 1].GetSize(false);
+                }
+                for (int i = 0; i < right.GetCnt(); i++)
+                {
+                    entries[cnt++] = right.GetEntry(i);
+                }
+                if (total > kPayloadSize)
+                {
+                    SeparatorKey new_separator;
+                    Distribute(entries, cnt, is_leaf, left.GetLink(), left_buf, right_buf, new_separator);
+                    parent.Remove(separator_index);
+                    // a failed insertion does not modify the page, nor the copies of the nodes
+                    if (!parent.Insert(separator_index, Entry::CreateInnerEntry(new_separator.buf_, new_separator.len_, right_page_no), scratch_buf_))
+                    {
+                        // the parent cannot hold the new separator; leave the nodes as they are
+                        buf_.CopyFrom(is_left ? scratch_buf_ : sibling_scratch_buf_);
+                        if (ReadPage(path.pages_[level + 1], parent_buf_).IsError() ||
+                            WriteCopy(path.pages_[level], buf_, page_no).IsError())
+                        {
+                            return Status::CreateErrorStatus();
+                        }
+                        parent.SetChild(child_index, page_no);
+                    }
+                    else
+                    {
+                        uint32_t new_left_page_no;
+                        uint32_t new_right_page_no;
+                        if (WriteCopy(left_page_no, left_buf, new_left_page_no).IsError() ||
+                            WriteCopy(right_page_no, right_buf, new_right_page_no).IsError())
+                        {
+                            return Status::CreateErrorStatus();
+                        }
+                        parent.SetChild(separator_index, new_left_page_no);
+                        parent.SetChild(separator_index + 1, new_right_page_no);
+                    }
+                    buf_.CopyFrom(parent_buf_);
+                    return WritePath(path, level + 1);
+                }
+                Page merged(left_buf);
+                merged.Init(is_leaf ? kLeafType : kInnerType);
+                merged.SetLink(left.GetLink());
+                merged.Append(entries, cnt);
+                if (WriteCopy(left_page_no, left_buf, page_no).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                ReleasePage(right_page_no);
+                parent.Remove(separator_index);
+                parent.SetChild(separator_index, page_no);
+                buf_.CopyFrom(parent_buf_);
+            }
+            // buf_ holds the root
+            const Page root(buf_);
+            if (super_.height_ == 0 || root.GetCnt() != 0)
+            {
+                return WritePath(path, super_.height_);
+            }
+            // the root has only one child
+            ReleasePage(super_.root_);
+            super_.root_ = root.GetLink();
+            super_.height_--;
+            return Status::CreateOkStatus();
+        }
+
+        BlockStorageWithLruCache<BlockBuffer> storage_;
+        SuperBlock super_;
+        SuperBlock committed_; // the state in the last superblock
+        uint32_t released_[kMaxReleasedCnt];
+        int released_cnt_ = 0;
+        BlockBuffer buf_;
+        BlockBuffer sibling_buf_;
+        BlockBuffer parent_buf_;
+        BlockBuffer scratch_buf_;
+        BlockBuffer sibling_scratch_buf_;
+        BlockBuffer free_list_buf_;
+    };
+}
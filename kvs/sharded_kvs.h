@@ -0,0 +1,177 @@
+#pragma once
+#include "kvs_interface.h"
+#include "kvs/hash.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+namespace HayaguiKvs
+{
+    // Partitions keys by hash into independent Kvs instances, each guarded by its own reader-writer lock,
+    // so that single-threaded engines can be used from multiple threads.
+    // Get and FindNextKey take the read lock, so the underlying engines must not modify themselves in those operations.
+    // Iteration is a stateless merge: each step takes the lowest next key among the shards.
+    class ShardedKvs final : public Kvs
+    {
+    public:
+        ShardedKvs() = delete;
+        ShardedKvs(int shard_cnt, KvsAllocatorInterface &underlying_kvs_allocator, HashCalculatorInterface &hash_calcurator)
+            : shard_cnt_(shard_cnt), shards_(new Shard[shard_cnt]), hash_calcurator_(hash_calcurator)
+        {
+            // GlobalBufferAllocator is initialized lazily, which is not thread-safe
+            GlobalBufferAllocator::Get();
+            for (int i = 0; i < shard_cnt_; i++)
+            {
+                shards_[i].kvs_ = underlying_kvs_allocator.Allocate();
+            }
+        }
+        virtual ~ShardedKvs() override
+        {
+            for (int i = 0; i < shard_cnt_; i++)
+            {
+                delete shards_[i].kvs_;
+            }
+            delete[] shards_;
+        }
+        ShardedKvs(const ShardedKvs &obj) = delete;
+        ShardedKvs &operator=(const ShardedKvs &obj) = delete;
+        virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
+        {
+            Shard &shard = GetShard(key);
+            ReadLockGuard lock(shard);
+            return shard.kvs_->Get(options, key, container);
+        }
+        virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
+        {
+            Shard &shard = GetShard(key);
+            WriteLockGuard lock(shard);
+            return shard.kvs_->Put(options, key, value);
+        }
+        virtual Status Delete(WriteOptions options, const ValidSlice &key) override
+        {
+            Shard &shard = GetShard(key);
+            WriteLockGuard lock(shard);
+            return shard.kvs_->Delete(options, key);
+        }
+        virtual Optional<KvsEntryIterator> GetFirstIterator() override
+        {
+            SliceContainer first_key;
+            for (int i = 0; i < shard_cnt_; i++)
+            {
+                // iterators of some engines pin their elements, so the write lock is taken.
+                WriteLockGuard lock(shards_[i]);
+                Optional<KvsEntryIterator> optional_iter = shards_[i].kvs_->GetFirstIterator();
+                if (!optional_iter.isPresent())
+                {
+                    continue;
+                }
+                SliceContainer key;
+                Status s1 = optional_iter.get().GetKey(key);
+                assert(s1.IsOk());
+                SetIfLower(first_key, key);
+            }
+            if (!first_key.IsSliceAvailable())
+            {
+                return Optional<KvsEntryIterator>::CreateInvalidObj();
+            }
+            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(first_key.CreateConstSlice()));
+        }
+        virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
+        {
+            GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
+            new (base) GenericKvsEntryIteratorBase(*this, key);
+            return KvsEntryIterator(base);
+        }
+        virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
+        {
+            SliceContainer next_key;
+            for (int i = 0; i < shard_cnt_; i++)
+            {
+                SliceContainer shard_key;
+                ReadLockGuard lock(shards_[i]);
+                if (shards_[i].kvs_->FindNextKey(key, shard_key).IsOk())
+                {
+                    SetIfLower(next_key, shard_key);
+                }
+            }
+            if (!next_key.IsSliceAvailable())
+            {
+                return Status::CreateErrorStatus();
+            }
+            container.Set(next_key);
+            return Status::CreateOkStatus();
+        }
+
+    private:
+        // padded to a cache line, so that locks of different shards do not share one
+        struct Shard
+        {
+            Shard()
+            {
+                if (pthread_rwlock_init(&lock_, nullptr) != 0)
+                {
+                    abort();
+                }
+            }
+            ~Shard()
+            {
+                pthread_rwlock_destroy(&lock_);
+            }
+            pthread_rwlock_t lock_;
+            Kvs *kvs_ = nullptr;
+            char padding_[64];
+        };
+        class ReadLockGuard
+        {
+        public:
+            explicit ReadLockGuard(Shard &shard) : shard_(shard)
+            {
+                pthread_rwlock_rdlock(&shard_.lock_);
+            }
+            ~ReadLockGuard()
+            {
+                pthread_rwlock_unlock(&shard_.lock_);
+            }
+
+        private:
+            Shard &shard_;
+        };
+        class WriteLockGuard
+        {
+        public:
+            explicit WriteLockGuard(Shard &shard) : shard_(shard)
+            {
+                pthread_rwlock_wrlock(&shard_.lock_);
+            }
+            ~WriteLockGuard()
+            {
+                pthread_rwlock_unlock(&shard_.lock_);
+            }
+
+        private:
+            Shard &shard_;
+        };
+        Shard &GetShard(const ValidSlice &key)
+        {
+            return shards_[hash_calcurator_.CalcHash(shard_cnt_, key)];
+        }
+        static void SetIfLower(SliceContainer &lowest, const SliceContainer &candidate)
+        {
+            if (lowest.IsSliceAvailable())
+            {
+                CmpResult result;
+                if (lowest.Cmp(candidate, result).IsError())
+                {
+                    abort();
+                }
+                if (!result.IsGreater())
+                {
+                    return;
+                }
+            }
+            lowest.Set(candidate);
+        }
+        const int shard_cnt_;
+        Shard *const shards_;
+        HashCalculatorInterface &hash_calcurator_;
+    };
+}
@@ -1,9 +1,12 @@
 #pragma once
 #include "kvs_interface.h"
 #include "utils/allocator.h"
+#include "utils/arena.h"
+#include "utils/contiguous_key.h"
 #include "utils/rnd.h"
 #include "common/rtc.h"
 #include <new>
+#include <string.h>
 #include <assert.h>
 
 namespace HayaguiKvs
@@ -17,69 +20,226 @@ namespace HayaguiKvs
         }
         virtual ~SkipListKvs() override
         {
+            first_element_.ReleaseElements(arena_);
         }
         SkipListKvs(const SkipListKvs &obj) = delete;
         SkipListKvs &operator=(const SkipListKvs &obj) = delete;
         virtual Status Get(ReadOptions options, const ValidSlice &key, SliceContainer &container) override
         {
-            return first_element_.GetValueRecursivelyFromNext(key, container);
+            return first_element_.GetValue(key, container);
         }
         virtual Status Put(WriteOptions options, const ValidSlice &key, const ValidSlice &value) override
         {
-            return first_element_.PutValueRecursivelyFromNext(key, value);
+            return first_element_.PutValue(key, value, arena_);
         }
         virtual Status Delete(WriteOptions options, const ValidSlice &key) override
         {
-            return first_element_.DeleteValueRecursivelyFromNext(key);
+            return first_element_.DeleteValue(key, arena_);
         }
         virtual Optional<KvsEntryIterator> GetFirstIterator() override
         {
-            SliceContainer key_container;
-            Status s1 = first_element_.GetNextAtTheLowestLevel().GetKey(key_container);
-            if (s1.IsError())
+            Element *ele = first_element_.GetFirstElement();
+            if (ele == nullptr)
             {
                 return Optional<KvsEntryIterator>::CreateInvalidObj();
             }
-            return Optional<KvsEntryIterator>::CreateValidObj(GetIterator(key_container.CreateConstSlice()));
+            return Optional<KvsEntryIterator>::CreateValidObj(KvsEntryIterator(IteratorBase::Create(*this, ele)));
         }
         virtual KvsEntryIterator GetIterator(const ValidSlice &key) override
         {
-            GenericKvsEntryIteratorBase *base = MemAllocator::alloc<GenericKvsEntryIteratorBase>();
-            new (base) GenericKvsEntryIteratorBase(*this, key);
+            Element *ele;
+            if (first_element_.FindElement(key, ele).IsOk())
+            {
+                return KvsEntryIterator(IteratorBase::Create(*this, ele));
+            }
+            SeekIteratorBase *base = MemAllocator::alloc<SeekIteratorBase>();
+            new (base) SeekIteratorBase(*this, key);
             return KvsEntryIterator(base);
         }
         virtual Status FindNextKey(const ValidSlice &key, SliceContainer &container) override
         {
-            return first_element_.FindSubsequentKeyRecursivelyFromNext(key, container);
+            return first_element_.FindSubsequentKey(key, container);
+        }
+        // bytes used by elements and keys, including released elements waiting for reuse
+        size_t GetMemoryUsage() const
+        {
+            return arena_.GetMemoryUsage();
         }
 
     private:
+        class Element;
+        // Iterator which pins the element of the key, and advances along the lowest level.
+        // Once the element is unlinked by Delete(), it falls back to operations by the key, as GenericKvsEntryIteratorBase does.
+        class IteratorBase final : public KvsEntryIteratorBaseInterface
+        {
+        public:
+            IteratorBase() = delete;
+            IteratorBase(SkipListKvs &kvs, Element *ele) : kvs_(kvs), ele_(ele)
+            {
+                ele_->Pin();
+            }
+            virtual ~IteratorBase() override
+            {
+                Container::UnpinElement(ele_, kvs_.arena_);
+            }
+            static IteratorBase *Create(SkipListKvs &kvs, Element *ele)
+            {
+                IteratorBase *base = MemAllocator::alloc<IteratorBase>();
+                new (base) IteratorBase(kvs, ele);
+                return base;
+            }
+            virtual bool hasNext() override
+            {
+                Element *next;
+                return GetNextElement(next).IsOk();
+            }
+            virtual KvsEntryIteratorBaseInterface *GetNext() override
+            {
+                Element *next;
+                if (GetNextElement(next).IsError())
+                {
+                    return nullptr;
+                }
+                return Create(kvs_, next);
+            }
+            virtual Status Get(ReadOptions options, SliceContainer &container) override
+            {
+                if (ele_->IsUnlinked())
+                {
+                    SliceContainer key_container;
+                    ele_->PutKeyTo(key_container);
+                    return kvs_.Get(options, key_container.CreateConstSlice(), container);
+                }
+                ele_->PutValueTo(container);
+                return Status::CreateOkStatus();
+            }
+            virtual Status Put(WriteOptions options, ValidSlice &value) override
+            {
+                if (ele_->IsUnlinked())
+                {
+                    SliceContainer key_container;
+                    ele_->PutKeyTo(key_container);
+                    return kvs_.Put(options, key_container.CreateConstSlice(), value);
+                }
+                ele_->ReplaceValueWith(value);
+                return Status::CreateOkStatus();
+            }
+            virtual Status Delete(WriteOptions options) override
+            {
+                // the previous elements are needed to unlink, so the list is walked by the key.
+                SliceContainer key_container;
+                ele_->PutKeyTo(key_container);
+                return kvs_.Delete(options, key_container.CreateConstSlice());
+            }
+            virtual Status GetKey(SliceContainer &container) override
+            {
+                ele_->PutKeyTo(container);
+                return Status::CreateOkStatus();
+            }
+            virtual void Destroy() override
+            {
+                this->~IteratorBase();
+                MemAllocator::free(this);
+            }
+
+        private:
+            Status GetNextElement(Element *&next)
+            {
+                if (ele_->IsUnlinked())
+                {
+                    SliceContainer key_container;
+                    ele_->PutKeyTo(key_container);
+                    return kvs_.first_element_.FindSubsequentElement(key_container.CreateConstSlice(), next);
+                }
+                next = ele_->GetNextAt(0);
+                if (next == nullptr)
+                {
+                    return Status::CreateErrorStatus();
+                }
+                return Status::CreateOkStatus();
+            }
+            SkipListKvs &kvs_;
+            Element *const ele_;
+        };
+        // Iterator for a key which is not stored in the list.
+        // Only the first step searches the list; it hands over to IteratorBase after that.
+        class SeekIteratorBase final : public GenericKvsEntryIteratorBase
+        {
+        public:
+            SeekIteratorBase() = delete;
+            SeekIteratorBase(SkipListKvs &kvs, const ValidSlice &key) : GenericKvsEntryIteratorBase(kvs, key), skiplist_(kvs)
+            {
+            }
+            virtual ~SeekIteratorBase() override
+            {
+            }
+            virtual bool hasNext() override
+            {
+                Element *next;
+                return skiplist_.first_element_.FindSubsequentElement(key_, next).IsOk();
+            }
+            virtual KvsEntryIteratorBaseInterface *GetNext() override
+            {
+                Element *next;
+                if (skiplist_.first_element_.FindSubsequentElement(key_, next).IsError())
+                {
+                    return nullptr;
+                }
+                return IteratorBase::Create(skiplist_, next);
+            }
+            virtual void Destroy() override
+            {
+                this->~SeekIteratorBase();
+                MemAllocator::free(this);
+            }
+
+        private:
+            SkipListKvs &skiplist_;
+        };
+
+        // An element is allocated from the arena in one piece: the tower is sized to the height of the element,
+        // and the key bytes follow the tower.
+        // Deleted elements are unlinked at every level and returned to the arena, unless iterators pin them.
         class Element
         {
         public:
             Element() = delete;
-            Element(const ValidSlice &key, const ValidSlice &value)
-                : key_(ConstSlice::CreateFromValidSlice(key)), value_(DuplicateSlice(value))
-            {
-                InitNextsWithNull();
+            Element(const Element &obj) = delete;
+            Element &operator=(const Element &obj) = delete;
+            static Element *Create(RecyclingArena &arena, const int height, const ContiguousKey &key, const ValidSlice &value)
+            {
+                assert(height > 0 && height <= kHeight);
+                const int key_len = key.GetLen();
+                char *buf = arena.Allocate(CalcSize(height, key_len));
+                Element *ele = new (buf) Element(height, key_len, value);
+                memcpy(ele->GetKeyPtr(), key.GetPtr(), key_len);
+                return ele;
             }
-            ~Element()
+            void Release(RecyclingArena &arena)
             {
+                const size_t size = CalcSize(height_, key_len_);
                 ReleaseValue();
-                for (int i = 0; i < kHeight; i++)
+                this->~Element();
+                arena.Release(reinterpret_cast<char *>(this), size);
+            }
+            // in the same order as ValidSlice::Cmp
+            int CmpKey(const ContiguousKey &key) const
+            {
+                const int cmp_len = key_len_ < key.GetLen() ? key_len_ : key.GetLen();
+                const int result = memcmp(GetKeyPtr(), key.GetPtr(), cmp_len);
+                if (result != 0)
                 {
-                    // to ensure the linked element is referred by others
-                    assert(next_[i] == nullptr);
+                    return result;
                 }
+                return key_len_ - key.GetLen();
             }
-            void cmpKey(const ValidSlice &key, CmpResult &result) const
+            void PrefetchNextAt(const int level) const
             {
-                Status s = key_.Cmp(key, result);
-                assert(s.IsOk());
+                __builtin_prefetch(next_[level]);
             }
             void PutKeyTo(SliceContainer &container)
             {
-                container.Set(key_);
+                container.Set(GetKeyPtr(), key_len_);
             }
             void PutValueTo(SliceContainer &container)
             {
@@ -87,6 +247,7 @@ namespace HayaguiKvs
             }
             Element *GetNextAt(const int level)
             {
+                assert(level < height_);
                 return next_[level];
             }
             void ReplaceValueWith(const ValidSlice &new_value)
@@ -100,18 +261,46 @@ namespace HayaguiKvs
             }
             void InsertNewElementAt(const int level, Element *new_ele)
             {
+                assert(level < height_ && level < new_ele->height_);
                 new_ele->next_[level] = next_[level];
                 next_[level] = new_ele;
             }
-            bool IsValueAvailable() const
+            void UnlinkNextAt(const int level)
             {
-                return value_ != nullptr;
+                Element *next = next_[level];
+                assert(level < height_ && next != nullptr);
+                next_[level] = next->next_[level];
+            }
+            int GetHeight() const
+            {
+                return height_;
+            }
+            void Pin()
+            {
+                pin_cnt_++;
+            }
+            void Unpin()
+            {
+                assert(pin_cnt_ > 0);
+                pin_cnt_--;
+            }
+            bool IsPinned() const
+            {
+                return pin_cnt_ != 0;
+            }
+            void MarkUnlinked()
+            {
+                unlinked_ = true;
+            }
+            bool IsUnlinked() const
+            {
+                return unlinked_;
             }
 
             void Print()
             {
                 printf("element: ");
-                key_.Print();
+                BufferPtrSlice(GetKeyPtr(), key_len_).Print();
                 printf(",");
                 if (value_ == nullptr)
                 {
@@ -124,7 +313,7 @@ namespace HayaguiKvs
             }
             void PrintNext()
             {
-                for (int i = kHeight - 1; i >= 0; i--)
+                for (int i = height_ - 1; i >= 0; i--)
                 {
                     printf("%d: ", i);
                     if (next_[i] == nullptr)
@@ -140,13 +329,26 @@ namespace HayaguiKvs
             }
 
         private:
-            void InitNextsWithNull()
+            Element(const int height, const int key_len, const ValidSlice &value)
+                : value_(DuplicateSlice(value)), height_(height), key_len_(key_len)
             {
-                for (int i = 0; i < kHeight; i++)
+                for (int i = 0; i < height_; i++)
                 {
                     next_[i] = nullptr;
                 }
             }
+            static size_t CalcSize(const int height, const int key_len)
+            {
+                return sizeof(Element) + sizeof(Element *) * (height - 1) + key_len;
+            }
+            char *GetKeyPtr()
+            {
+                return reinterpret_cast<char *>(next_ + height_);
+            }
+            const char *GetKeyPtr() const
+            {
+                return reinterpret_cast<const char *>(next_ + height_);
+            }
             ConstSlice *DuplicateSlice(const ValidSlice &slice)
             {
                 return new (buf_) ConstSlice(ConstSlice::CreateFromValidSlice(slice));
@@ -159,10 +361,14 @@ namespace HayaguiKvs
                     value_ = nullptr;
                 }
             }
-            ConstSlice key_;
             ConstSlice *value_;
             char buf_[sizeof(ConstSlice)] __attribute__((aligned(8)));
-            Element *next_[kHeight];
+            const int height_;
+            const int key_len_;
+            int pin_cnt_ = 0;
+            bool unlinked_ = false;
+            // actually has height_ entries
+            Element *next_[1];
         };
 
         class Container
@@ -176,30 +382,57 @@ namespace HayaguiKvs
             {
                 return ele_ != nullptr;
             }
-            Status GetValueRecursivelyFromNext(const ValidSlice &key, SliceContainer &container)
+            Status GetValue(const ValidSlice &key, SliceContainer &container)
+            {
+                ContiguousKey ckey(key);
+                GetProcessor processor(ckey, container);
+                Element *prev[kHeight];
+                return Walk(prev, processor);
+            }
+            Status PutValue(const ValidSlice &key, const ValidSlice &value, RecyclingArena &arena)
             {
-                GetProcessor processor(key, container);
+                ContiguousKey ckey(key);
+                PutProcessor processor(ckey, value, rnd_, arena);
                 Element *prev[kHeight];
                 return Walk(prev, processor);
             }
-            Status PutValueRecursivelyFromNext(const ValidSlice &key, const ValidSlice &value)
+            Status DeleteValue(const ValidSlice &key, RecyclingArena &arena)
             {
-                PutProcessor processor(key, value, rnd_);
+                ContiguousKey ckey(key);
+                DeleteProcessor processor(ckey, arena);
                 Element *prev[kHeight];
                 return Walk(prev, processor);
             }
-            Status DeleteValueRecursivelyFromNext(const ValidSlice &key)
+            Status FindSubsequentKey(const ValidSlice &key, SliceContainer &container)
+            {
+                Element *ele;
+                if (FindSubsequentElement(key, ele).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                ele->PutKeyTo(container);
+                return Status::CreateOkStatus();
+            }
+            // finds the first element whose key is greater than the given key
+            Status FindSubsequentElement(const ValidSlice &key, Element *&ele)
             {
-                DeleteProcessor processor(key);
+                ContiguousKey ckey(key);
+                FindNextElementProcessor processor(ckey, ele, rnd_);
                 Element *prev[kHeight];
                 return Walk(prev, processor);
             }
-            Status FindSubsequentKeyRecursivelyFromNext(const ValidSlice &key, SliceContainer &container)
+            // finds the element of the key
+            Status FindElement(const ValidSlice &key, Element *&ele)
             {
-                FindNextKeyProcessor processor(key, container, rnd_);
+                ContiguousKey ckey(key);
+                FindElementProcessor processor(ckey, ele);
                 Element *prev[kHeight];
                 return Walk(prev, processor);
             }
+            Element *GetFirstElement()
+            {
+                return ele_->GetNextAt(0);
+            }
             Status GetKey(SliceContainer &container)
             {
                 if (!hasElement())
@@ -209,10 +442,30 @@ namespace HayaguiKvs
                 ele_->PutKeyTo(container);
                 return Status::CreateOkStatus();
             }
-            static Container CreateDummy(Random &rnd)
+            static Container CreateDummy(Random &rnd, RecyclingArena &arena)
             {
                 // for the first element
-                return Container(CreateElement(ConstSlice("dummy", 5), ConstSlice("dummy", 5)), kHeight - 1, rnd);
+                ConstSlice dummy("dummy", 5);
+                return Container(Element::Create(arena, kHeight, ContiguousKey(dummy), dummy), kHeight - 1, rnd);
+            }
+            // releases all the elements including the dummy one
+            void ReleaseElements(RecyclingArena &arena)
+            {
+                Element *ele = ele_;
+                while (ele != nullptr)
+                {
+                    Element *next = ele->GetNextAt(0);
+                    ele->Release(arena);
+                    ele = next;
+                }
+            }
+            static void UnpinElement(Element *ele, RecyclingArena &arena)
+            {
+                ele->Unpin();
+                if (ele->IsUnlinked() && !ele->IsPinned())
+                {
+                    ele->Release(arena);
+                }
             }
             Container GetNextAtTheLowestLevel()
             {
@@ -220,212 +473,259 @@ namespace HayaguiKvs
             }
 
         private:
-            struct ProcessorInterface
-            {
-                virtual const ValidSlice &GetKey() = 0;
-                virtual Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight]) = 0;
-                virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) = 0;
-                virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight]) = 0;
-            };
-            class DeleteProcessor : public ProcessorInterface
+            // Processors are passed to Walk() as a template parameter, so that each operation is inlined into its own loop.
+            // Each of them provides:
+            //   const ContiguousKey &GetKey();
+            //   Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight]);
+            //   Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev);
+            //   Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight]);
+            class DeleteProcessor
             {
             public:
                 DeleteProcessor() = delete;
-                DeleteProcessor(const ValidSlice &key)
-                    : key_(key)
+                DeleteProcessor(const ContiguousKey &key, RecyclingArena &arena)
+                    : key_(key), arena_(arena)
                 {
                 }
-                virtual const ValidSlice &GetKey() override
+                const ContiguousKey &GetKey()
                 {
                     return key_;
                 }
-                virtual Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight])
                 {
                     return Status::CreateErrorStatus();
                 }
-                virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) override
+                Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev)
                 {
                     Container next = prev.GetNextAtTheCurrentLevel();
-                    if (!next.ele_->IsValueAvailable())
+                    Element *ele = next.ele_;
+                    prev.UnlinkNextDownward(ele);
+                    if (ele->IsPinned())
                     {
-                        return Status::CreateErrorStatus();
+                        // released when the last iterator unpins it
+                        ele->Delete();
+                        ele->MarkUnlinked();
+                    }
+                    else
+                    {
+                        ele->Release(arena_);
                     }
-                    next.ele_->Delete();
                     return Status::CreateOkStatus();
                 }
-                virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight])
                 {
                     return Status::CreateErrorStatus();
                 }
 
             private:
-                const ValidSlice &key_;
+                const ContiguousKey &key_;
+                RecyclingArena &arena_;
             };
-            class PutProcessor : public ProcessorInterface
+            class PutProcessor
             {
             public:
                 PutProcessor() = delete;
-                PutProcessor(const ValidSlice &key, const ValidSlice &value, Random &rnd)
-                    : key_(key), value_(value), rnd_(rnd)
+                PutProcessor(const ContiguousKey &key, const ValidSlice &value, Random &rnd, RecyclingArena &arena)
+                    : key_(key), value_(value), rnd_(rnd), arena_(arena)
                 {
                 }
-                virtual const ValidSlice &GetKey() override
+                const ContiguousKey &GetKey()
                 {
                     return key_;
                 }
-                virtual Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight])
                 {
-                    Container::InsertNext(prev, key_, value_, rnd_);
+                    Container::InsertNext(prev, key_, value_, rnd_, arena_);
                     return Status::CreateOkStatus();
                 }
-                virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) override
+                Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev)
                 {
                     Container next = prev.GetNextAtTheCurrentLevel();
                     next.ele_->ReplaceValueWith(value_);
                     return Status::CreateOkStatus();
                 }
-                virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight])
                 {
-                    Container::InsertNext(prev, key_, value_, rnd_);
+                    Container::InsertNext(prev, key_, value_, rnd_, arena_);
                     return Status::CreateOkStatus();
                 }
 
             private:
-                const ValidSlice &key_;
+                const ContiguousKey &key_;
                 const ValidSlice &value_;
                 Random &rnd_;
+                RecyclingArena &arena_;
             };
-            class GetProcessor : public ProcessorInterface
+            class GetProcessor
             {
             public:
                 GetProcessor() = delete;
-                GetProcessor(const ValidSlice &key, SliceContainer &container)
+                GetProcessor(const ContiguousKey &key, SliceContainer &container)
                     : key_(key), container_(container)
                 {
                 }
-                virtual const ValidSlice &GetKey() override
+                const ContiguousKey &GetKey()
                 {
                     return key_;
                 }
-                virtual Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight])
                 {
                     return Status::CreateErrorStatus();
                 }
-                virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) override
+                Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev)
                 {
                     Container next = prev.GetNextAtTheCurrentLevel();
-                    if (!next.ele_->IsValueAvailable())
-                    {
-                        return Status::CreateErrorStatus();
-                    }
                     next.ele_->PutValueTo(container_);
                     return Status::CreateOkStatus();
                 }
-                virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight])
                 {
                     return Status::CreateErrorStatus();
                 }
 
             private:
-                const ValidSlice &key_;
+                const ContiguousKey &key_;
                 SliceContainer &container_;
             };
-            class FindNextKeyProcessor : public ProcessorInterface
+            class FindNextElementProcessor
             {
             public:
-                FindNextKeyProcessor() = delete;
-                FindNextKeyProcessor(const ValidSlice &key, SliceContainer &container, Random &rnd)
-                    : key_(key), container_(container), rnd_(rnd)
+                FindNextElementProcessor() = delete;
+                FindNextElementProcessor(const ContiguousKey &key, Element *&ele, Random &rnd)
+                    : key_(key), ele_(ele), rnd_(rnd)
                 {
                 }
-                virtual const ValidSlice &GetKey() override
+                const ContiguousKey &GetKey()
                 {
                     return key_;
                 }
-                virtual Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight])
                 {
                     return Status::CreateErrorStatus();
                 }
-                virtual Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev) override
+                Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev)
                 {
                     Container next = prev.GetNextAtTheCurrentLevel();
                     assert(next.hasElement());
-                    Container next_next = next.GetNextAtTheLowestLevel();
-                    return WalkUntilReachingAvailablePair(next_next);
+                    return SetIfPresent(next.ele_->GetNextAt(0));
                 }
-                virtual Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight]) override
+                Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight])
                 {
-                    Container next(prev[0], 0, rnd_);
-                    return WalkUntilReachingAvailablePair(next);
+                    return SetIfPresent(prev[0]->GetNextAt(0));
                 }
 
             private:
-                Status WalkUntilReachingAvailablePair(Container &next)
+                Status SetIfPresent(Element *ele)
                 {
-                    if (!next.hasElement())
+                    if (ele == nullptr)
                     {
                         return Status::CreateErrorStatus();
                     }
-                    if (!next.ele_->IsValueAvailable())
-                    {
-                        Container next_next = next.GetNextAtTheCurrentLevel();
-                        return WalkUntilReachingAvailablePair(next_next);
-                    }
-                    return next.GetKey(container_);
+                    ele_ = ele;
+                    return Status::CreateOkStatus();
                 }
-                const ValidSlice &key_;
-                SliceContainer &container_;
+                const ContiguousKey &key_;
+                Element *&ele_;
                 Random &rnd_;
             };
-            Status Walk(Element *prev[kHeight], ProcessorInterface &processor)
+            class FindElementProcessor
             {
-                Container next = GetNextAtTheCurrentLevel();
-                if (!next.hasElement())
+            public:
+                FindElementProcessor() = delete;
+                FindElementProcessor(const ContiguousKey &key, Element *&ele)
+                    : key_(key), ele_(ele)
                 {
-                    prev[focused_level_] = ele_;
-                    if (focused_level_ == 0)
-                    {
-                        return processor.ProcessTheCaseOfNoMoreEntries(prev);
-                    }
-                    Container container_at_the_lower_level(ele_, focused_level_ - 1, rnd_);
-                    return container_at_the_lower_level.Walk(prev, processor);
                 }
-                CmpResult result;
-                next.ele_->cmpKey(processor.GetKey(), result);
-                if (result.IsEqual())
+                const ContiguousKey &GetKey()
                 {
-                    return processor.ProcessTheCaseOfNextEqualsToTheKey(*this);
+                    return key_;
                 }
-                if (result.IsGreater())
+                Status ProcessTheCaseOfNoMoreEntries(Element *prev[kHeight])
                 {
-                    prev[focused_level_] = ele_;
-                    if (focused_level_ == 0)
+                    return Status::CreateErrorStatus();
+                }
+                Status ProcessTheCaseOfNextEqualsToTheKey(Container &prev)
+                {
+                    Container next = prev.GetNextAtTheCurrentLevel();
+                    assert(next.hasElement());
+                    ele_ = next.ele_;
+                    return Status::CreateOkStatus();
+                }
+                Status ProcessTheCaseOfNextGreaterThanTheKey(Element *prev[kHeight])
+                {
+                    return Status::CreateErrorStatus();
+                }
+
+            private:
+                const ContiguousKey &key_;
+                Element *&ele_;
+            };
+            // descends from the current level, moving forward while the next key is lower than the key of the processor.
+            template <class Processor>
+            Status Walk(Element *prev[kHeight], Processor &processor)
+            {
+                const ContiguousKey &key = processor.GetKey();
+                Element *ele = ele_;
+                int level = focused_level_;
+                while (true)
+                {
+                    Element *next = ele->GetNextAt(level);
+                    int result = 1;
+                    if (next != nullptr)
+                    {
+                        // the tower of the next element is read if the key of it is lower
+                        next->PrefetchNextAt(level);
+                        result = next->CmpKey(key);
+                    }
+                    if (result < 0)
+                    {
+                        ele = next;
+                        continue;
+                    }
+                    if (result == 0)
+                    {
+                        Container prev_container(ele, level, rnd_);
+                        return processor.ProcessTheCaseOfNextEqualsToTheKey(prev_container);
+                    }
+                    prev[level] = ele;
+                    if (level == 0)
                     {
+                        if (next == nullptr)
+                        {
+                            return processor.ProcessTheCaseOfNoMoreEntries(prev);
+                        }
                         return processor.ProcessTheCaseOfNextGreaterThanTheKey(prev);
                     }
-                    Container container_at_the_lower_level(ele_, focused_level_ - 1, rnd_);
-                    return container_at_the_lower_level.Walk(prev, processor);
+                    level--;
                 }
-                return next.Walk(prev, processor);
-            }
-            static Element *CreateElement(const ValidSlice &key, const ValidSlice &value)
-            {
-                Element *ele = MemAllocator::alloc<Element>();
-                new (ele) Element(key, value);
-                return ele;
             }
             Container GetNextAtTheCurrentLevel()
             {
                 return Container(ele_->GetNextAt(focused_level_), focused_level_, rnd_);
             }
+            // unlinks the next element at the current level and all the lower ones.
+            // the walk reaches an element first at its highest level, so the current level is the top of its tower.
+            void UnlinkNextDownward(Element *target)
+            {
+                assert(focused_level_ == target->GetHeight() - 1);
+                Element *ele = ele_;
+                for (int level = focused_level_; level >= 0; level--)
+                {
+                    while (ele->GetNextAt(level) != target)
+                    {
+                        ele = ele->GetNextAt(level);
+                    }
+                    ele->UnlinkNextAt(level);
+                }
+            }
             static const int CalcurateElementHeightForNewElement(Random &rnd)
             {
                 return RandomHeight(kHeight, rnd);
             }
-            static void InsertNext(Element *prev[kHeight], const ValidSlice &key, const ValidSlice &value, Random &rnd)
+            static void InsertNext(Element *prev[kHeight], const ContiguousKey &key, const ValidSlice &value, Random &rnd, RecyclingArena &arena)
             {
                 const int ele_height = CalcurateElementHeightForNewElement(rnd);
-                Element *new_ele = CreateElement(key, value);
+                Element *new_ele = Element::Create(arena, ele_height, key, value);
                 for (int i = 0; i < ele_height; i++)
                 {
                     prev[i]->InsertNewElementAt(i, new_ele);
@@ -436,6 +736,7 @@ namespace HayaguiKvs
             Random &rnd_;
         };
         Random rnd_;
-        Container first_element_ = Container::CreateDummy(rnd_);
+        RecyclingArena arena_;
+        Container first_element_ = Container::CreateDummy(rnd_, arena_);
     };
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+#include "utils/status.h"
+#include "utils/slice.h"
+#include "utils/allocator.h"
+#include <new>
+#include <assert.h>
+
+namespace HayaguiKvs
+{
+    struct WriteBatchHandlerInterface
+    {
+        virtual Status Put(const ValidSlice &key, const ValidSlice &value) = 0;
+        virtual Status Delete(const ValidSlice &key) = 0;
+    };
+
+    // A sequence of Put/Delete operations which is applied by Kvs::Write() at once.
+    // A Delete of a key which is absent at that point of the batch does nothing.
+    // Keys and values are copied, so the given slices can be released after they are added.
+    class WriteBatch
+    {
+    public:
+        WriteBatch()
+        {
+        }
+        ~WriteBatch()
+        {
+            Clear();
+        }
+        WriteBatch(const WriteBatch &obj) = delete;
+        WriteBatch &operator=(const WriteBatch &obj) = delete;
+        void Put(const ValidSlice &key, const ValidSlice &value)
+        {
+            Entry *entry = MemAllocator::alloc<Entry>();
+            new (entry) Entry(key, value);
+            AppendEntry(entry);
+            put_cnt_++;
+        }
+        void Delete(const ValidSlice &key)
+        {
+            Entry *entry = MemAllocator::alloc<Entry>();
+            new (entry) Entry(key);
+            AppendEntry(entry);
+        }
+        void Clear()
+        {
+            Entry *entry = first_;
+            while (entry != nullptr)
+            {
+                Entry *next = entry->GetNext();
+                entry->~Entry();
+                MemAllocator::free(entry);
+                entry = next;
+            }
+            first_ = nullptr;
+            last_ = nullptr;
+            cnt_ = 0;
+            put_cnt_ = 0;
+        }
+        int GetCount() const
+        {
+            return cnt_;
+        }
+        int GetPutCount() const
+        {
+            return put_cnt_;
+        }
+        int GetDeleteCount() const
+        {
+            return cnt_ - put_cnt_;
+        }
+        // operations are passed to the handler in the order they were added.
+        Status Iterate(WriteBatchHandlerInterface &handler) const
+        {
+            for (Entry *entry = first_; entry != nullptr; entry = entry->GetNext())
+            {
+                if (entry->ApplyTo(handler).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+            }
+            return Status::CreateOkStatus();
+        }
+
+    private:
+        class Entry
+        {
+        public:
+            Entry() = delete;
+            Entry(const ValidSlice &key, const ValidSlice &value)
+                : key_(ConstSlice::CreateFromValidSlice(key)),
+                  value_(new (buf_) ConstSlice(ConstSlice::CreateFromValidSlice(value)))
+            {
+            }
+            explicit Entry(const ValidSlice &key)
+                : key_(ConstSlice::CreateFromValidSlice(key)),
+                  value_(nullptr)
+            {
+            }
+            ~Entry()
+            {
+                if (value_)
+                {
+                    value_->~ConstSlice();
+                }
+            }
+            Status ApplyTo(WriteBatchHandlerInterface &handler) const
+            {
+                if (value_ == nullptr)
+                {
+                    return handler.Delete(key_);
+                }
+                return handler.Put(key_, *value_);
+            }
+            Entry *GetNext() const
+            {
+                return next_;
+            }
+            void SetNext(Entry *entry)
+            {
+                assert(next_ == nullptr);
+                next_ = entry;
+            }
+
+        private:
+            ConstSlice key_;
+            ConstSlice *value_;
+            char buf_[sizeof(ConstSlice)] __attribute__((aligned(8)));
+            Entry *next_ = nullptr;
+        };
+        void AppendEntry(Entry *entry)
+        {
+            if (last_ == nullptr)
+            {
+                first_ = entry;
+            }
+            else
+            {
+                last_->SetNext(entry);
+            }
+            last_ = entry;
+            cnt_++;
+        }
+        Entry *first_ = nullptr;
+        Entry *last_ = nullptr;
+        int cnt_ = 0;
+        int put_cnt_ = 0;
+    };
+}
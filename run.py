@@ -39,11 +39,12 @@ class SimpleKvsDependencyChecker(DependencyChecker):
                 Test(env, "test/slice.cc").build_and_run()
                 Test(env, "test/allocator.cc").build_and_run()
                 Test(env, "test/block_storage.cc").build_and_run()
-                Test(env, "test/char_storage.cc").build_and_run()
-                Test(env, "test/simple_io.cc").build_and_run()
-                Test(env, "test/iterator.cc").build_and_run()
-                Test(env, "test/persistence.cc").build_and_run()
-                Test(env, "test/performance_evaluation.cc").build_and_run('-DNDEBUG')
+                Test(env, "test/char_storage.cc").build_and_run('-pthread')
+                Test(env, "test/simple_io.cc").build_and_run('-pthread')
+                Test(env, "test/iterator.cc").build_and_run('-pthread')
+                Test(env, "test/persistence.cc").build_and_run('-pthread')
+                Test(env, "test/concurrency.cc").build_and_run('-pthread')
+                Test(env, "test/performance_evaluation.cc").build_and_run('-DNDEBUG -pthread')
         else:
             env.write_now()
             env.write(">>>name : simple_kvs\n")
@@ -278,7 +278,7 @@ class Checker
 {
 public:
     Checker() = delete;
-    Checker(BlockStorageWithOneCache<GenericBlockBuffer> &storage_with_cache, TestStorage &underlying_storage)
+    Checker(BlockStorageInterface<GenericBlockBuffer> &storage_with_cache, TestStorage &underlying_storage)
         : storage_with_cache_(storage_with_cache),
           underlying_storage_(underlying_storage)
     {
@@ -328,7 +328,7 @@ public:
     }
 
 private:
-    BlockStorageWithOneCache<GenericBlockBuffer> &storage_with_cache_;
+    BlockStorageInterface<GenericBlockBuffer> &storage_with_cache_;
     TestStorage &underlying_storage_;
 };
 
@@ -377,6 +377,95 @@ static void cache()
     assert(checker.ReadFromCache(LogicalBlockAddress(2), kSignature3).IsOk());
 }
 
+static void lru_cache()
+{
+    START_TEST;
+    TestStorage underlying_storage;
+    BlockStorageWithLruCache<GenericBlockBuffer> storage_with_cache(underlying_storage, 2);
+    Checker checker(storage_with_cache, underlying_storage);
+    assert(storage_with_cache.Open().IsOk());
+
+    underlying_storage.ResetCnt();
+
+    // written blocks are cached
+    checker.Write(LogicalBlockAddress(0), 123);
+    checker.Write(LogicalBlockAddress(1), 456);
+    assert(checker.ReadFromCache(LogicalBlockAddress(0), 123).IsOk());
+
+    // the least recently used block is evicted
+    checker.Write(LogicalBlockAddress(2), 789);
+    assert(checker.ReadFromCache(LogicalBlockAddress(0), 123).IsOk());
+    assert(checker.ReadFromCache(LogicalBlockAddress(2), 789).IsOk());
+    assert(checker.ReadFromStorage(LogicalBlockAddress(1), 456).IsOk());
+    assert(checker.ReadFromStorage(LogicalBlockAddress(0), 123).IsOk());
+    assert(checker.ReadFromCache(LogicalBlockAddress(1), 456).IsOk());
+
+    // a write to a cached block updates the cache
+    checker.Write(LogicalBlockAddress(1), 321);
+    assert(checker.ReadFromCache(LogicalBlockAddress(1), 321).IsOk());
+}
+
+// regions larger than a vectored I/O can transfer at once, and placed at an offset in the buffers
+template <class BlockStorageContainer>
+static void region_block_storage()
+{
+    START_TEST_WITH_POSTFIX(typeid(BlockStorageContainer).name());
+    BlockStorageContainer container;
+    assert(container->Open().IsOk());
+    const int kCnt = 2100;
+    const LogicalBlockRegion region(LogicalBlockAddress(3), LogicalBlockAddress(3 + kCnt - 1));
+    {
+        BlockBuffers<GenericBlockBuffer> buffers(kCnt + 1);
+        for (int i = 0; i < kCnt + 1; i++)
+        {
+            InitializeBuffer(*buffers.GetBlockBufferFromIndex(i), i);
+        }
+        assert(container->WriteBlocks(region, buffers, 1).IsOk());
+        assert(container->WriteBlocks(region, buffers, 2).IsError());
+        assert(container->WriteBlocks(LogicalBlockRegion(LogicalBlockAddress(0), container->GetMaxAddress() + LogicalBlockAddress(1)), buffers).IsError());
+    }
+    {
+        BlockBuffers<GenericBlockBuffer> buffers(kCnt);
+        assert(container->ReadBlocks(region, buffers).IsOk());
+        for (int i = 0; i < kCnt; i++)
+        {
+            assert(CheckBuffer(*buffers.GetBlockBufferFromIndex(i), i + 1).IsOk());
+        }
+        GenericBlockBuffer buf;
+        assert(container->Read(LogicalBlockAddress(3 + 1000), buf).IsOk());
+        assert(CheckBuffer(buf, 1001).IsOk());
+    }
+}
+
+// the cached block in a region is not read from the underlying storage
+static void cache_region()
+{
+    START_TEST;
+    TestStorage underlying_storage;
+    BlockStorageWithOneCache<GenericBlockBuffer> storage_with_cache(underlying_storage);
+    assert(storage_with_cache.Open().IsOk());
+    assert(storage_with_cache.SetCacheAddress(LogicalBlockAddress(4)).IsOk());
+    const LogicalBlockRegion region(LogicalBlockAddress(2), LogicalBlockAddress(7));
+    BlockBuffers<GenericBlockBuffer> buffers(region.GetRegionSize());
+    for (size_t i = 0; i < region.GetRegionSize(); i++)
+    {
+        InitializeBuffer(*buffers.GetBlockBufferFromIndex(i), i);
+    }
+    underlying_storage.ResetCnt();
+    assert(storage_with_cache.WriteBlocks(region, buffers).IsOk());
+    assert(underlying_storage.IsWriteCntAdded(region.GetRegionSize()));
+    for (size_t i = 0; i < region.GetRegionSize(); i++)
+    {
+        InitializeBuffer(*buffers.GetBlockBufferFromIndex(i), 0);
+    }
+    assert(storage_with_cache.ReadBlocks(region, buffers).IsOk());
+    assert(underlying_storage.IsReadCntAdded(region.GetRegionSize() - 1));
+    for (size_t i = 0; i < region.GetRegionSize(); i++)
+    {
+        assert(CheckBuffer(*buffers.GetBlockBufferFromIndex(i), i).IsOk());
+    }
+}
+
 template <class BlockBuffer, class BlockStorageContainer>
 static void persistent_block_storage()
 {
@@ -401,6 +490,10 @@ int main()
     check_region_overlapped();
     multiplier();
     cache();
+    lru_cache();
+    cache_region();
+    region_block_storage<MemBlockStorageContainer>();
+    region_block_storage<FileBlockStorageContainer>();
     persistent_block_storage<GenericBlockBuffer, FileBlockStorageContainer>();
     persistent_block_storage<GenericBlockBuffer, UnvmeBlockStorageContainer>();
     persistent_block_storage<GenericBlockBuffer, VefsBlockStorageContainer>();
@@ -1,11 +1,16 @@
 #include "block_storage/memblock_storage.h"
 #include "char_storage/char_storage_over_blockstorage.h"
+#include "char_storage/self_describing_char_storage_over_blockstorage.h"
 #include "char_storage/vefs.h"
 #include "char_storage/log.h"
+#include "char_storage/read_ahead.h"
 #include "./test.h"
 #include "test_storage.h"
 #include "misc.h"
+#include <chrono>
+#include <limits.h>
 #include <memory>
+#include <thread>
 #include <vector>
 std::vector<int> dummy;
 
@@ -77,6 +82,317 @@ static void check_cache_of_append_only_storage()
     assert(append_only_storage.Append(slice3).IsOk());
     assert(block_storage.IsWriteCntAdded(3)); // 2 for data write(the data lies upon two blocks), 1 for meta data update
     assert(block_storage.IsReadCntAdded(0));
+
+    ConstSlice slice4 = CreateSliceFromChar('d', 10);
+    ConstSlice slice5 = CreateSliceFromChar('e', 20);
+    const ValidSlice *slices[2];
+    MultipleValidSliceContainer multiple_slice_container(slices, 2);
+    multiple_slice_container.Set(&slice4);
+    multiple_slice_container.Set(&slice5);
+    assert(append_only_storage.Append(multiple_slice_container).IsOk());
+    assert(block_storage.IsWriteCntAdded(2)); // slices are written at once
+    assert(block_storage.IsReadCntAdded(0));
+}
+
+// the data region is reused as a ring once the head of the data is trimmed
+template <class CharStorage>
+static void trim_append_only_storage()
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    const int kLen = 1000;
+    const size_t capacity = (size_t)block_storage.GetMaxAddress().GetRaw() * BlockBufferInterface::kSize;
+    const int cnt = capacity / kLen * 3;
+    {
+        CharStorage char_storage(block_storage);
+        assert(char_storage.Open().IsOk());
+        assert(char_storage.GetStartOffset() == 0);
+        for (int i = 0; i < cnt; i++)
+        {
+            if (i >= 10)
+            {
+                assert(char_storage.Trim((size_t)(i - 10) * kLen).IsOk());
+            }
+            assert(char_storage.Append(CreateSliceFromChar('a' + (i % 26), kLen)).IsOk());
+        }
+        assert(char_storage.GetLen() == (size_t)cnt * kLen);
+        assert(char_storage.Trim(0).IsError());
+        assert(char_storage.Trim(char_storage.GetLen() + 1).IsError());
+    }
+    {
+        CharStorage char_storage(block_storage);
+        assert(char_storage.Open().IsOk());
+        assert(char_storage.GetLen() == (size_t)cnt * kLen);
+        assert(char_storage.GetStartOffset() == (size_t)(cnt - 11) * kLen);
+        SliceContainer container;
+        assert(char_storage.Read((size_t)(cnt - 12) * kLen, kLen, container).IsError());
+        for (int i = cnt - 11; i < cnt; i++)
+        {
+            assert(char_storage.Read((size_t)i * kLen, kLen, container).IsOk());
+            assert(container.DoesMatch(CreateSliceFromChar('a' + (i % 26), kLen)));
+        }
+        // the data can not overwrite the head which is not trimmed
+        while (char_storage.Append(CreateSliceFromChar('z', kLen)).IsOk())
+        {
+        }
+        assert(char_storage.GetLen() - char_storage.GetStartOffset() <= capacity);
+        assert(char_storage.Read((size_t)(cnt - 11) * kLen, kLen, container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('a' + ((cnt - 11) % 26), kLen)));
+    }
+}
+
+static size_t get_durable_len(BlockStorageInterface<GenericBlockBuffer> &block_storage)
+{
+    AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+    assert(char_storage.Open().IsOk());
+    return char_storage.GetLen();
+}
+
+static void buffered_append_only_storage()
+{
+    START_TEST;
+    TestStorage block_storage;
+    {
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage, 2048);
+        assert(char_storage.Open().IsOk());
+        block_storage.ResetCnt();
+        // small appends are kept in memory
+        for (int i = 0; i < 100; i++)
+        {
+            assert(char_storage.Append(CreateSliceFromChar('a' + i % 26, 10)).IsOk());
+        }
+        assert(block_storage.IsWriteCntAdded(0));
+        assert(char_storage.GetLen() == 1000);
+        SliceContainer container;
+        for (int i = 0; i < 100; i++)
+        {
+            assert(char_storage.Read(i * 10, 10, container).IsOk());
+            assert(container.DoesMatch(CreateSliceFromChar('a' + i % 26, 10)));
+        }
+        assert(get_durable_len(block_storage) == 0);
+
+        block_storage.ResetCnt();
+        assert(char_storage.Sync().IsOk());
+        assert(block_storage.IsWriteCntAdded(3)); // 2 for data write, 1 for meta data update
+        assert(block_storage.IsReadCntAdded(0));
+        assert(get_durable_len(block_storage) == 1000);
+
+        // the buffer is written back when it exceeds the limit
+        block_storage.ResetCnt();
+        assert(char_storage.Append(CreateSliceFromChar('z', 2000)).IsOk());
+        assert(block_storage.IsWriteCntAdded(6));
+        assert(block_storage.IsReadCntAdded(0));
+        assert(get_durable_len(block_storage) == 3000);
+
+        // reads over the written back blocks and the buffer
+        assert(char_storage.Append(CreateSliceFromChar('y', 10)).IsOk());
+        assert(char_storage.Read(2400, 600, container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('z', 600)));
+        assert(char_storage.Read(2990, 100, container).IsOk());
+        assert(container.DoesMatch(ConstSlice("zzzzzzzzzzyyyyyyyyyy", 20)));
+        assert(char_storage.Read(995, 10, container).IsOk());
+        assert(container.DoesMatch(ConstSlice("vvvvvzzzzz", 10)));
+    }
+    // the buffered data is written back at the destruction
+    assert(get_durable_len(block_storage) == 3010);
+    {
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage, 2048, 1);
+        assert(char_storage.Open().IsOk());
+        SliceContainer container;
+        assert(char_storage.Read(3000, 10, container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('y', 10)));
+        // the buffer is written back at an append after the interval
+        assert(char_storage.Append(CreateSliceFromChar('x', 10)).IsOk());
+        assert(get_durable_len(block_storage) == 3010);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        assert(char_storage.Append(CreateSliceFromChar('x', 10)).IsOk());
+        assert(get_durable_len(block_storage) == 3030);
+    }
+    {
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage, 2048);
+        assert(char_storage.Open().IsOk());
+        assert(char_storage.Append(CreateSliceFromChar('w', 10)).IsOk());
+        // the buffered data is written back before the metadata is updated
+        assert(char_storage.Trim(100).IsOk());
+        assert(get_durable_len(block_storage) == 3040);
+        assert(char_storage.Append(CreateSliceFromChar('w', 10)).IsOk());
+        assert(char_storage.Truncate(3045).IsOk());
+        assert(get_durable_len(block_storage) == 3045);
+        assert(char_storage.Append(CreateSliceFromChar('v', 10)).IsOk());
+        SliceContainer container;
+        assert(char_storage.Read(3040, 15, container).IsOk());
+        assert(container.DoesMatch(ConstSlice("wwwwwvvvvvvvvvv", 15)));
+    }
+}
+
+static void self_describing_append_only_storage()
+{
+    START_TEST;
+    TestStorage block_storage;
+    using CharStorage = SelfDescribingAppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer>;
+    const int kCnt = 2000;
+    {
+        CharStorage char_storage(block_storage);
+        assert(char_storage.Open().IsOk());
+        block_storage.ResetCnt();
+        // the metadata block is not updated
+        assert(char_storage.Append(CreateSliceFromChar('a', 10)).IsOk());
+        assert(block_storage.IsWriteCntAdded(1));
+        assert(block_storage.IsReadCntAdded(0));
+        assert(char_storage.Append(CreateSliceFromChar('b', 10)).IsOk());
+        assert(block_storage.IsWriteCntAdded(1));
+        assert(block_storage.IsReadCntAdded(0));
+        // the data spans over hint checkpoints
+        for (int i = 2; i < kCnt; i++)
+        {
+            assert(char_storage.Append(CreateSliceFromChar('a' + (i % 26), 100 - (i % 91))).IsOk());
+        }
+    }
+    size_t len = 0;
+    {
+        CharStorage char_storage(block_storage);
+        block_storage.ResetCnt();
+        assert(char_storage.Open().IsOk());
+        // only the blocks after the hint are scanned
+        assert(block_storage.GetReadCnt() < 300);
+        SliceContainer container;
+        for (int i = 0; i < kCnt; i++)
+        {
+            const int value_len = i < 2 ? 10 : 100 - (i % 91);
+            assert(char_storage.Read(len, value_len, container).IsOk());
+            assert(container.DoesMatch(CreateSliceFromChar(i < 2 ? 'a' + i : 'a' + (i % 26), value_len)));
+            len += value_len;
+        }
+        assert(char_storage.GetLen() == len);
+        // truncates the data into the middle of a block
+        assert(char_storage.Truncate(len - 1000).IsOk());
+    }
+    {
+        CharStorage char_storage(block_storage);
+        assert(char_storage.Open().IsOk());
+        assert(char_storage.GetLen() == len - 1000);
+        // the following blocks are not taken as the tail even if the tail block gets full
+        const int fill_len = CharStorage::kPayloadLen - (len - 1000) % CharStorage::kPayloadLen;
+        assert(char_storage.Append(CreateSliceFromChar('x', fill_len)).IsOk());
+        len = len - 1000 + fill_len;
+    }
+    {
+        CharStorage char_storage(block_storage);
+        assert(char_storage.Open().IsOk());
+        assert(char_storage.GetLen() == len);
+        SliceContainer container;
+        assert(char_storage.Read(len - 10, 10, container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('x', 10)));
+    }
+    // truncation at the end of a full ring keeps the oldest block
+    TestStorage full_block_storage;
+    const size_t full_len = (size_t)full_block_storage.GetMaxAddress().GetRaw() * CharStorage::kPayloadLen;
+    {
+        CharStorage char_storage(full_block_storage);
+        assert(char_storage.Open().IsOk());
+        for (size_t offset = 0; offset < full_len; offset += CharStorage::kPayloadLen)
+        {
+            assert(char_storage.Append(CreateSliceFromChar('a' + (offset / CharStorage::kPayloadLen) % 26, CharStorage::kPayloadLen)).IsOk());
+        }
+        assert(char_storage.Append(CreateSliceFromChar('z', 1)).IsError());
+        assert(char_storage.Truncate(full_len).IsOk());
+        assert(char_storage.GetLen() == full_len);
+        SliceContainer container;
+        assert(char_storage.Read(0, 10, container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('a', 10)));
+    }
+    {
+        CharStorage char_storage(full_block_storage);
+        assert(char_storage.Open().IsOk());
+        assert(char_storage.GetLen() == full_len);
+        SliceContainer container;
+        assert(char_storage.Read(0, 10, container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('a', 10)));
+        // truncation into the middle of the ring still works
+        assert(char_storage.Truncate(full_len - CharStorage::kPayloadLen).IsOk());
+        assert(char_storage.Append(CreateSliceFromChar('y', 10)).IsOk());
+        assert(char_storage.Read(full_len - CharStorage::kPayloadLen, 10, container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('y', 10)));
+    }
+}
+
+static void read_ahead_storage()
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> append_only_char_storage(block_storage);
+    assert(append_only_char_storage.Open().IsOk());
+    const int kLen = ReadAheadSequentialReadCharStorage::kMinWindowLen * 5 + 1000;
+    char data[kLen];
+    for (int i = 0; i < kLen; i++)
+    {
+        data[i] = i % 251;
+    }
+    assert(append_only_char_storage.Append(BufferPtrSlice(data, kLen)).IsOk());
+    // records the shortest read of the background thread
+    class RecordingStorage : public RandomReadCharStorageInterface
+    {
+    public:
+        RecordingStorage(RandomReadCharStorageInterface &underlying_storage) : underlying_storage_(underlying_storage), thread_id_(std::this_thread::get_id())
+        {
+        }
+        virtual Status Open() override
+        {
+            return underlying_storage_.Open();
+        }
+        virtual Status Read(const size_t offset, const int len, SliceContainer &container) override
+        {
+            if (std::this_thread::get_id() != thread_id_)
+            {
+                background_read_cnt_++;
+                min_background_read_len_ = len < min_background_read_len_ ? len : min_background_read_len_;
+            }
+            return underlying_storage_.Read(offset, len, container);
+        }
+        virtual size_t GetLen() const override
+        {
+            return underlying_storage_.GetLen();
+        }
+        int background_read_cnt_ = 0;
+        int min_background_read_len_ = INT_MAX;
+
+    private:
+        RandomReadCharStorageInterface &underlying_storage_;
+        const std::thread::id thread_id_;
+    } recording_storage(append_only_char_storage);
+    {
+        // windows are smaller than the data, and a smaller window length is raised to kMinWindowLen
+        ReadAheadSequentialReadCharStorage read_ahead_storage(recording_storage, 1000);
+        assert(read_ahead_storage.Open().IsOk());
+        SliceContainer container;
+        int offset = 0;
+        for (int len = 1; offset + len <= kLen; len = len * 3 % 1777 + 1)
+        {
+            assert(read_ahead_storage.Read(container, len).IsOk());
+            assert(container.DoesMatch(BufferPtrSlice(data + offset, len)));
+            offset += len;
+        }
+        // reads over windows
+        read_ahead_storage.SeekTo(10);
+        assert(read_ahead_storage.Read(container, 10000).IsOk());
+        assert(container.DoesMatch(BufferPtrSlice(data + 10, 10000)));
+        read_ahead_storage.SeekTo(16000);
+        assert(read_ahead_storage.Read(container, 10).IsOk());
+        assert(container.DoesMatch(BufferPtrSlice(data + 16000, 10)));
+        // a short read at the end
+        read_ahead_storage.SeekTo(kLen - 100);
+        assert(read_ahead_storage.Read(container, 1000).IsOk());
+        assert(container.DoesMatch(BufferPtrSlice(data + kLen - 100, 100)));
+        assert(read_ahead_storage.Read(container, 1000).IsOk());
+        int len;
+        assert(container.GetLen(len).IsOk());
+        assert(len == 0);
+        read_ahead_storage.SeekTo(kLen + 1);
+        assert(read_ahead_storage.Read(container, 1).IsError());
+    }
+    // the short window at the end is read in the foreground
+    assert(recording_storage.background_read_cnt_ > 0);
+    assert(recording_storage.min_background_read_len_ >= (int)ReadAheadSequentialReadCharStorage::kMinWindowLen);
 }
 
 static void log()
@@ -131,7 +447,22 @@ int main()
         VefsCharStorage char_storage(file.fname_);
         append_only_storage(char_storage);
     }
+    {
+        MemBlockStorage block_storage;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage, 1024);
+        append_only_storage(char_storage);
+    }
     check_cache_of_append_only_storage();
+    buffered_append_only_storage();
+    {
+        MemBlockStorage block_storage;
+        SelfDescribingAppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        append_only_storage(char_storage);
+    }
+    trim_append_only_storage<AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer>>();
+    trim_append_only_storage<SelfDescribingAppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer>>();
+    self_describing_append_only_storage();
+    read_ahead_storage();
     log();
     return 0;
 }
\ No newline at end of file
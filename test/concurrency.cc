@@ -0,0 +1,223 @@
+#include "kvs/concurrent_skiplist.h"
+#include "kvs/sharded_kvs.h"
+#include "kvs/skiplist.h"
+#include "block_storage/block_storage_with_lock.h"
+#include "./test_storage.h"
+#include "./test.h"
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace HayaguiKvs;
+
+static const int kThreadNum = 8;
+static const int kKeyNumPerThread = 2000;
+
+static void MakeKey(char *buf, const int thread_id, const int i)
+{
+    sprintf(buf, "%02d%06d", thread_id, i);
+}
+
+// each writer puts its own keys, overwrites them, and deletes every 3rd one while readers keep reading.
+static void concurrent_write_and_read(Kvs &kvs)
+{
+    START_TEST;
+    std::atomic<bool> writers_done(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreadNum; t++)
+    {
+        threads.push_back(std::thread([&kvs, t]() {
+            for (int round = 0; round < 2; round++)
+            {
+                for (int i = 0; i < kKeyNumPerThread; i++)
+                {
+                    char key[16], value[16];
+                    MakeKey(key, t, i);
+                    sprintf(value, "%08d", i + round);
+                    assert(kvs.Put(WriteOptions(), BufferPtrSlice(key, 8), BufferPtrSlice(value, 8)).IsOk());
+                }
+            }
+            for (int i = 0; i < kKeyNumPerThread; i += 3)
+            {
+                char key[16];
+                MakeKey(key, t, i);
+                assert(kvs.Delete(WriteOptions(), BufferPtrSlice(key, 8)).IsOk());
+            }
+        }));
+    }
+    std::vector<std::thread> readers;
+    for (int t = 0; t < kThreadNum / 2; t++)
+    {
+        readers.push_back(std::thread([&kvs, &writers_done, t]() {
+            while (!writers_done.load())
+            {
+                for (int i = 0; i < kKeyNumPerThread; i += 7)
+                {
+                    char key[16];
+                    MakeKey(key, t, i);
+                    SliceContainer container;
+                    if (kvs.Get(ReadOptions(), BufferPtrSlice(key, 8), container).IsOk())
+                    {
+                        // a value is one of the values the writer has put
+                        char value1[16], value2[16];
+                        sprintf(value1, "%08d", i);
+                        sprintf(value2, "%08d", i + 1);
+                        assert(container.DoesMatch(ConstSlice(value1, 8)) || container.DoesMatch(ConstSlice(value2, 8)));
+                    }
+                }
+            }
+        }));
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    writers_done.store(true);
+    for (std::thread &thread : readers)
+    {
+        thread.join();
+    }
+    for (int t = 0; t < kThreadNum; t++)
+    {
+        for (int i = 0; i < kKeyNumPerThread; i++)
+        {
+            char key[16];
+            MakeKey(key, t, i);
+            SliceContainer container;
+            if (i % 3 == 0)
+            {
+                assert(kvs.Get(ReadOptions(), BufferPtrSlice(key, 8), container).IsError());
+            }
+            else
+            {
+                char value[16];
+                sprintf(value, "%08d", i + 1);
+                assert(kvs.Get(ReadOptions(), BufferPtrSlice(key, 8), container).IsOk());
+                assert(container.DoesMatch(ConstSlice(value, 8)));
+            }
+        }
+    }
+    // keys are linked in order at the lowest level
+    int cnt = 0;
+    SliceContainer prev_key;
+    Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+    while (optional_iter.isPresent())
+    {
+        KvsEntryIterator iter = optional_iter.get();
+        SliceContainer key;
+        assert(iter.GetKey(key).IsOk());
+        if (cnt != 0)
+        {
+            CmpResult result;
+            assert(key.Cmp(prev_key, result).IsOk());
+            assert(result.IsGreater());
+        }
+        prev_key.Set(key);
+        cnt++;
+        optional_iter = iter.GetNext();
+    }
+    assert(cnt == kThreadNum * (kKeyNumPerThread - (kKeyNumPerThread + 2) / 3));
+}
+
+// all threads race to insert the same keys
+static void concurrent_insert_of_same_keys(Kvs &kvs)
+{
+    START_TEST;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreadNum; t++)
+    {
+        threads.push_back(std::thread([&kvs, t]() {
+            for (int i = 0; i < kKeyNumPerThread; i++)
+            {
+                char key[16];
+                MakeKey(key, 0, i);
+                assert(kvs.Put(WriteOptions(), BufferPtrSlice(key, 8), BufferPtrSlice(key, 8)).IsOk());
+            }
+        }));
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    int cnt = 0;
+    Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+    while (optional_iter.isPresent())
+    {
+        KvsEntryIterator iter = optional_iter.get();
+        char key[16];
+        MakeKey(key, 0, cnt);
+        SliceContainer container;
+        assert(iter.GetKey(container).IsOk());
+        assert(container.DoesMatch(ConstSlice(key, 8)));
+        cnt++;
+        optional_iter = iter.GetNext();
+    }
+    assert(cnt == kKeyNumPerThread);
+}
+
+// each thread writes its own blocks and reads them back through the lock, and no access is lost
+static void concurrent_block_access()
+{
+    START_TEST;
+    TestStorage underlying_storage;
+    BlockStorageWithLock<GenericBlockBuffer> storage(underlying_storage);
+    assert(storage.Open().IsOk());
+    const int kBlockNumPerThread = 100;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreadNum; t++)
+    {
+        threads.push_back(std::thread([&storage, t]() {
+            GenericBlockBuffer buffer;
+            BlockBufferInterface &buf = buffer;
+            for (int i = 0; i < kBlockNumPerThread; i++)
+            {
+                const LogicalBlockAddress address(t * kBlockNumPerThread + i);
+                buf.SetValue<int>(0, t * kBlockNumPerThread + i);
+                assert(storage.Write(address, buffer).IsOk());
+                buf.SetValue<int>(0, -1);
+                assert(storage.Read(address, buffer).IsOk());
+                assert(buf.GetValue<int>(0) == t * kBlockNumPerThread + i);
+            }
+        }));
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    assert(underlying_storage.IsReadCntAdded(kThreadNum * kBlockNumPerThread));
+    assert(underlying_storage.IsWriteCntAdded(kThreadNum * kBlockNumPerThread));
+}
+
+class SkipListAllocator : public KvsAllocatorInterface
+{
+    virtual Kvs *Allocate() override
+    {
+        return new SkipListKvs<12>();
+    }
+};
+
+int main()
+{
+    {
+        ConcurrentSkipListKvs kvs;
+        concurrent_write_and_read(kvs);
+    }
+    {
+        ConcurrentSkipListKvs kvs;
+        concurrent_insert_of_same_keys(kvs);
+    }
+    SkipListAllocator kvs_allocator;
+    FastHashCalculator hash_calculator;
+    {
+        ShardedKvs kvs(16, kvs_allocator, hash_calculator);
+        concurrent_write_and_read(kvs);
+    }
+    {
+        ShardedKvs kvs(16, kvs_allocator, hash_calculator);
+        concurrent_insert_of_same_keys(kvs);
+    }
+    concurrent_block_access();
+    return 0;
+}
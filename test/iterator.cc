@@ -290,6 +290,140 @@ private:
     KvsContainerInterface &kvs_container_;
 };
 
+class DeleteCurrentTester
+{
+public:
+    DeleteCurrentTester(KvsContainerInterface &kvs_container) : kvs_container_(kvs_container)
+    {
+    }
+    void Do()
+    {
+        START_TEST;
+        ConstSlice key1("11", 2);
+        ConstSlice key2("123", 3);
+        ConstSlice key3("3", 1);
+        ConstSlice value("abc", 3);
+        assert(kvs_container_->Put(WriteOptions(), key1, value).IsOk());
+        assert(kvs_container_->Put(WriteOptions(), key2, value).IsOk());
+        assert(kvs_container_->Put(WriteOptions(), key3, value).IsOk());
+        KvsEntryIterator iter = kvs_container_->GetIterator(key2);
+        assert(kvs_container_->Delete(WriteOptions(), key2).IsOk());
+        SliceContainer container;
+        assert(iter.Get(ReadOptions(), container).IsError());
+        assert(iter.GetKey(container).IsOk());
+        assert(container.DoesMatch(key2));
+        Optional<KvsEntryIterator> next_iter = iter.GetNext();
+        assert(next_iter.isPresent());
+        assert(next_iter.get().GetKey(container).IsOk());
+        assert(container.DoesMatch(key3));
+    }
+
+private:
+    KvsContainerInterface &kvs_container_;
+};
+
+class InsertDuringScanTester
+{
+public:
+    InsertDuringScanTester(KvsContainerInterface &kvs_container) : kvs_container_(kvs_container)
+    {
+    }
+    void Do()
+    {
+        START_TEST;
+        ConstSlice key1("1", 1);
+        ConstSlice key2("2", 1);
+        ConstSlice key3("3", 1);
+        ConstSlice value("abc", 3);
+        assert(kvs_container_->Put(WriteOptions(), key1, value).IsOk());
+        assert(kvs_container_->Put(WriteOptions(), key3, value).IsOk());
+        Optional<KvsEntryIterator> optional_iter = kvs_container_->GetFirstIterator();
+        assert(optional_iter.isPresent());
+        KvsEntryIterator iter = optional_iter.get();
+        assert(iter.hasNext());
+        assert(kvs_container_->Put(WriteOptions(), key2, value).IsOk());
+        Optional<KvsEntryIterator> next_iter = iter.GetNext();
+        assert(next_iter.isPresent());
+        iter = next_iter.get();
+        SliceContainer container;
+        assert(iter.GetKey(container).IsOk());
+        assert(container.DoesMatch(key2));
+        next_iter = iter.GetNext();
+        assert(next_iter.isPresent());
+        assert(next_iter.get().GetKey(container).IsOk());
+        assert(container.DoesMatch(key3));
+    }
+
+private:
+    KvsContainerInterface &kvs_container_;
+};
+
+class ScanTester
+{
+public:
+    ScanTester(KvsContainerInterface &kvs_container) : kvs_container_(kvs_container)
+    {
+    }
+    void Do()
+    {
+        START_TEST;
+        const int kNum = 64;
+        for (int i = 0; i < kNum; i++)
+        {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "k%03d", (i * 37) % kNum);
+            ConstSlice key(buf, 4);
+            assert(kvs_container_->Put(WriteOptions(), key, key).IsOk());
+        }
+        for (int i = 0; i < kNum; i += 5)
+        {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "k%03d", i);
+            ConstSlice key(buf, 4);
+            assert(kvs_container_->Delete(WriteOptions(), key).IsOk());
+        }
+        {
+            Optional<KvsEntryIterator> optional_iter = kvs_container_->GetFirstIterator();
+            int expected = 0;
+            while (optional_iter.isPresent())
+            {
+                if (expected % 5 == 0)
+                {
+                    expected++;
+                }
+                char buf[16];
+                snprintf(buf, sizeof(buf), "k%03d", expected);
+                ConstSlice expected_key(buf, 4);
+                KvsEntryIterator iter = optional_iter.get();
+                SliceContainer key_container;
+                assert(iter.GetKey(key_container).IsOk());
+                assert(key_container.DoesMatch(expected_key));
+                SliceContainer value_container;
+                assert(iter.Get(ReadOptions(), value_container).IsOk());
+                assert(value_container.DoesMatch(expected_key));
+                expected++;
+                optional_iter = iter.GetNext();
+            }
+            assert(expected == kNum);
+        }
+        {
+            // seek from a key which is not stored
+            ConstSlice missing_key("k0105", 5);
+            KvsEntryIterator iter = kvs_container_->GetIterator(missing_key);
+            SliceContainer container;
+            assert(iter.Get(ReadOptions(), container).IsError());
+            Optional<KvsEntryIterator> next_iter = iter.GetNext();
+            assert(next_iter.isPresent());
+            assert(next_iter.get().GetKey(container).IsOk());
+            ConstSlice expected_key("k011", 4);
+            assert(container.DoesMatch(expected_key));
+        }
+    }
+
+private:
+    KvsContainerInterface &kvs_container_;
+};
+
 template <class KvsContainer>
 static void test()
 {
@@ -339,6 +473,21 @@ static void test()
         JumpDeletedValueTester tester(kvs_container);
         tester.Do();
     }
+    {
+        KvsContainer kvs_container;
+        ScanTester tester(kvs_container);
+        tester.Do();
+    }
+    {
+        KvsContainer kvs_container;
+        DeleteCurrentTester tester(kvs_container);
+        tester.Do();
+    }
+    {
+        KvsContainer kvs_container;
+        InsertDuringScanTester tester(kvs_container);
+        tester.Do();
+    }
 }
 
 int main()
@@ -346,6 +495,14 @@ int main()
     test<GenericKvsContainer<SimpleKvs>>();
     test<GenericKvsContainer<LinkedListKvs>>();
     test<GenericKvsContainer<SkipListKvs<4>>>();
+    test<GenericKvsContainer<BTreeKvs>>();
+    test<GenericKvsContainer<ArtKvs>>();
+    test<PagedBTreeKvsContainer>();
+    test<LsmKvsContainer>();
+    test<SeparatedCharStorageKvsContainer>();
     test<HashKvsContainer>();
+    test<GenericKvsContainer<FlatHashKvs>>();
+    test<GenericKvsContainer<ConcurrentSkipListKvs>>();
+    test<ShardedKvsContainer>();
     return 0;
 }
\ No newline at end of file
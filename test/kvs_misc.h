@@ -3,11 +3,19 @@
 #include "kvs/linkedlist.h"
 #include "kvs/skiplist.h"
 #include "kvs/hash.h"
+#include "kvs/flat_hash.h"
+#include "kvs/concurrent_skiplist.h"
+#include "kvs/sharded_kvs.h"
+#include "kvs/btree.h"
+#include "kvs/art.h"
+#include "kvs/paged_btree.h"
+#include "kvs/lsm.h"
 #include "kvs/char_storage_kvs.h"
 #include "char_storage/char_storage_over_blockstorage.h"
 #include "char_storage/vefs.h"
 #include "block_storage/unvme.h"
 #include "block_storage/vefs.h"
+#include "block_storage/memblock_storage.h"
 #include "misc.h"
 
 using namespace HayaguiKvs;
@@ -28,10 +36,83 @@ private:
             return new LinkedListKvs();
         }
     } kvs_allocator_;
-    SimpleHashCalculator hash_calculator_;
+    FastHashCalculator hash_calculator_;
     HashKvs kvs_;
 };
 
+class ShardedKvsContainer final : public KvsContainerInterface
+{
+public:
+    ShardedKvsContainer() : kvs_(8, kvs_allocator_, hash_calculator_) {}
+    virtual Kvs *operator->() override
+    {
+        return &kvs_;
+    }
+
+private:
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } kvs_allocator_;
+    FastHashCalculator hash_calculator_;
+    ShardedKvs kvs_;
+};
+
+class PagedBTreeKvsContainer final : public KvsContainerInterface
+{
+public:
+    PagedBTreeKvsContainer() : kvs_(block_storage_, 16) {}
+    virtual Kvs *operator->() override
+    {
+        return &kvs_;
+    }
+
+private:
+    MemBlockStorage block_storage_;
+    PagedBTreeKvs<GenericBlockBuffer> kvs_;
+};
+
+class LsmKvsContainer final : public KvsContainerInterface
+{
+public:
+    LsmKvsContainer() : kvs_(block_storage_, kvs_allocator_, 4096) {}
+    virtual Kvs *operator->() override
+    {
+        return &kvs_;
+    }
+
+private:
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } kvs_allocator_;
+    MemBlockStorage block_storage_;
+    LsmKvs<GenericBlockBuffer> kvs_;
+};
+
+class SeparatedCharStorageKvsContainer final : public KvsContainerInterface
+{
+public:
+    SeparatedCharStorageKvsContainer()
+        : char_storage_(block_storage_), kvs_(char_storage_, cache_kvs_, CharStorageKvs::ValueMode::kSeparated) {}
+    virtual Kvs *operator->() override
+    {
+        return &kvs_;
+    }
+
+private:
+    MemBlockStorage block_storage_;
+    SkipListKvs<12> cache_kvs_;
+    AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage_;
+    CharStorageKvs kvs_;
+};
+
 class BlockStoragKvsContainer final : public KvsContainerInterface
 {
 public:
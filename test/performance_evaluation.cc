@@ -2,9 +2,12 @@
 #include "./test.h"
 #include "./kvs_misc.h"
 #include "misc.h"
+#include "test_storage.h"
 #include "common/rtc.h"
 #include <assert.h>
 #include <utility>
+#include <thread>
+#include <vector>
 
 using namespace HayaguiKvs;
 
@@ -29,6 +32,332 @@ static inline void memallocator_performance()
     }
 }
 
+// compares the throughput and the bucket distribution of hash calculators
+// with zero-padded counter keys, as benchmark.cc generates.
+class HashCalculatorMeasurer
+{
+public:
+    HashCalculatorMeasurer(HashCalculatorInterface &calculator, const char *const name) : calculator_(calculator), name_(name)
+    {
+    }
+    void Do()
+    {
+        START_TEST;
+        printf("%s\n", name_);
+        MeasureDistribution(8);
+        MeasureDistribution(1024);
+        MeasureThroughput(16);
+        MeasureThroughput(40);
+        MeasureThroughput(256);
+    }
+
+private:
+    void MeasureDistribution(const int bucket_size)
+    {
+        int *const counts = new int[bucket_size];
+        for (int i = 0; i < bucket_size; i++)
+        {
+            counts[i] = 0;
+        }
+        for (int i = 0; i < kKeyNum; i++)
+        {
+            char buf[41];
+            sprintf(buf, "%040d", i);
+            BufferPtrSlice key(buf, 40);
+            counts[calculator_.CalcHash(bucket_size, key)]++;
+        }
+        int max = 0;
+        int used = 0;
+        double chi_square = 0;
+        const double expected = static_cast<double>(kKeyNum) / bucket_size;
+        for (int i = 0; i < bucket_size; i++)
+        {
+            max = getMax(max, counts[i]);
+            if (counts[i] != 0)
+            {
+                used++;
+            }
+            chi_square += (counts[i] - expected) * (counts[i] - expected) / expected;
+        }
+        printf("buckets: %d, used: %d, max: %d (expected %.1f), chi-square: %.1f\n", bucket_size, used, max, expected, chi_square);
+        delete[] counts;
+    }
+    void MeasureThroughput(const int key_len)
+    {
+        char buf[257];
+        for (int i = 0; i < key_len; i++)
+        {
+            buf[i] = (i % 26) + 'A';
+        }
+        BufferPtrSlice key(buf, key_len);
+        int sum = 0;
+        char name[32];
+        sprintf(name, "hash_%dB_x%d", key_len, kKeyNum);
+        {
+            TimeTaker time_taker(name);
+            for (int i = 0; i < kKeyNum; i++)
+            {
+                buf[0] = i;
+                sum += calculator_.CalcHash(1024, key);
+            }
+        }
+        // to keep the loop from being optimized out
+        if (sum == -1)
+        {
+            printf("\n");
+        }
+    }
+    static const int kKeyNum = 100000;
+    HashCalculatorInterface &calculator_;
+    const char *const name_;
+};
+
+// measures the throughput of a kvs shared among threads with 90% Get and 10% Put on preloaded keys.
+// the elapsed time of each run covers kOpNumPerThread operations per thread.
+class ScalabilityMeasurer
+{
+public:
+    ScalabilityMeasurer(Kvs &kvs, const char *const name) : kvs_(kvs), name_(name)
+    {
+    }
+    void Do()
+    {
+        START_TEST;
+        printf("%s\n", name_);
+        for (int i = 0; i < kKeyNum; i++)
+        {
+            char buf[17];
+            MakeKey(buf, i);
+            if (kvs_.Put(WriteOptions(), BufferPtrSlice(buf, 16), BufferPtrSlice(buf, 16)).IsError())
+            {
+                abort();
+            }
+        }
+        for (int thread_num = 1; thread_num <= 64; thread_num *= 2)
+        {
+            Measure(thread_num);
+        }
+    }
+
+private:
+    void Measure(const int thread_num)
+    {
+        char name[32];
+        sprintf(name, "threads_%d_x%d", thread_num, kOpNumPerThread);
+        TimeTaker time_taker(name);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_num; t++)
+        {
+            threads.push_back(std::thread([this, t]() {
+                uint32_t x = t * 2654435761U + 1;
+                for (int i = 0; i < kOpNumPerThread; i++)
+                {
+                    // xorshift
+                    x ^= x << 13;
+                    x ^= x >> 17;
+                    x ^= x << 5;
+                    char buf[17];
+                    MakeKey(buf, x % kKeyNum);
+                    BufferPtrSlice key(buf, 16);
+                    if (x % 10 == 0)
+                    {
+                        if (kvs_.Put(WriteOptions(), key, key).IsError())
+                        {
+                            abort();
+                        }
+                    }
+                    else
+                    {
+                        SliceContainer container;
+                        if (kvs_.Get(ReadOptions(), key, container).IsError())
+                        {
+                            abort();
+                        }
+                    }
+                }
+            }));
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+    static void MakeKey(char *buf, const int i)
+    {
+        sprintf(buf, "%016d", i);
+    }
+    static const int kKeyNum = 10000;
+    static const int kOpNumPerThread = 20000;
+    Kvs &kvs_;
+    const char *const name_;
+};
+
+// inserts kKeyNum keys of 16 bytes, and reports the bytes used per entry.
+// values of SkipListKvs are not included, while those of ArtKvs are.
+template <class T>
+static inline void memory_footprint(const char *const name)
+{
+    START_TEST;
+    printf("%s\n", name);
+    static const int kKeyNum = 100000;
+    T kvs;
+    char time_name[32];
+    sprintf(time_name, "put_x%d", kKeyNum);
+    {
+        TimeTaker time_taker(time_name);
+        for (int i = 0; i < kKeyNum; i++)
+        {
+            char buf[17];
+            sprintf(buf, "%016d", i * 7919 % kKeyNum);
+            if (kvs.Put(WriteOptions(), BufferPtrSlice(buf, 16), BufferPtrSlice(buf, 8)).IsError())
+            {
+                abort();
+            }
+        }
+    }
+    printf("bytes per entry: %.1f\n", static_cast<double>(kvs.GetMemoryUsage()) / kKeyNum);
+}
+
+// keys of 40 bytes which are zero-padded numbers, so that the first bytes of keys in a node are all the same
+static inline void btree_padded_keys()
+{
+    START_TEST;
+    static const int kKeyNum = 20000;
+    BTreeKvs kvs;
+    for (int i = 0; i < kKeyNum; i++)
+    {
+        char buf[41];
+        sprintf(buf, "%040d", i * 7919 % kKeyNum);
+        if (kvs.Put(WriteOptions(), BufferPtrSlice(buf, 40), BufferPtrSlice(buf, 8)).IsError())
+        {
+            abort();
+        }
+    }
+    TimeTaker time_taker("BTreeKvs_get_padded_keys");
+    for (int i = 0; i < kKeyNum; i++)
+    {
+        char buf[41];
+        sprintf(buf, "%040d", i * 104729 % kKeyNum);
+        SliceContainer container;
+        if (kvs.Get(ReadOptions(), BufferPtrSlice(buf, 40), container).IsError())
+        {
+            abort();
+        }
+    }
+}
+
+// reopens a store of kKeyNum keys, which CharStorageKvs replays from its log and PagedBTreeKvs does not,
+// and reports the blocks read per Get with a cache much smaller than the tree.
+static inline void paged_btree_startup_and_reads()
+{
+    START_TEST;
+    static const int kKeyNum = 20000;
+    static const int kGetNum = 2000;
+    MemBlockStorage log_storage;
+    TestStorage tree_storage;
+    {
+        SkipListKvs<12> cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(log_storage);
+        CharStorageKvs log_kvs(char_storage, cache_kvs);
+        PagedBTreeKvs<GenericBlockBuffer> tree_kvs(tree_storage, 64);
+        for (int i = 0; i < kKeyNum; i++)
+        {
+            char buf[17];
+            sprintf(buf, "%016d", i * 7919 % kKeyNum);
+            if (log_kvs.Put(WriteOptions(), BufferPtrSlice(buf, 16), BufferPtrSlice(buf, 8)).IsError() ||
+                tree_kvs.Put(WriteOptions(), BufferPtrSlice(buf, 16), BufferPtrSlice(buf, 8)).IsError())
+            {
+                abort();
+            }
+        }
+    }
+    {
+        TimeTaker time_taker("CharStorageKvs_open");
+        SkipListKvs<12> cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(log_storage);
+        CharStorageKvs log_kvs(char_storage, cache_kvs);
+    }
+    PagedBTreeKvs<GenericBlockBuffer> *tree_kvs;
+    {
+        TimeTaker time_taker("PagedBTreeKvs_open");
+        tree_kvs = new PagedBTreeKvs<GenericBlockBuffer>(tree_storage, 64);
+    }
+    tree_storage.ResetCnt();
+    {
+        TimeTaker time_taker("PagedBTreeKvs_get");
+        for (int i = 0; i < kGetNum; i++)
+        {
+            char buf[17];
+            sprintf(buf, "%016d", i * 104729 % kKeyNum);
+            SliceContainer container;
+            if (tree_kvs->Get(ReadOptions(), BufferPtrSlice(buf, 16), container).IsError())
+            {
+                abort();
+            }
+        }
+    }
+    printf("height: %d, blocks read per get: %.2f\n", tree_kvs->GetHeight(), static_cast<double>(tree_storage.GetReadCnt()) / kGetNum);
+    delete tree_kvs;
+}
+
+class SkipListAllocator : public KvsAllocatorInterface
+{
+    virtual Kvs *Allocate() override
+    {
+        return new SkipListKvs<12>();
+    }
+};
+
+// random writes land in the memtable instead of updating blocks in place
+static inline void lsm_random_writes()
+{
+    START_TEST;
+    static const int kKeyNum = 20000;
+    SkipListAllocator kvs_allocator;
+    MemBlockStorage tree_storage;
+    MemBlockStorage lsm_storage;
+    PagedBTreeKvs<GenericBlockBuffer> tree_kvs(tree_storage, 64);
+    LsmKvs<GenericBlockBuffer> lsm_kvs(lsm_storage, kvs_allocator, 64 * 1024);
+    Kvs *kvs_array[2] = {&tree_kvs, &lsm_kvs};
+    const char *names[2] = {"PagedBTreeKvs", "LsmKvs"};
+    for (int j = 0; j < 2; j++)
+    {
+        char name[32];
+        sprintf(name, "%s_put", names[j]);
+        {
+            TimeTaker time_taker(name);
+            for (int i = 0; i < kKeyNum; i++)
+            {
+                char buf[17];
+                sprintf(buf, "%016d", i * 7919 % kKeyNum);
+                if (kvs_array[j]->Put(WriteOptions(), BufferPtrSlice(buf, 16), BufferPtrSlice(buf, 8)).IsError())
+                {
+                    abort();
+                }
+            }
+        }
+        if (j == 1 && lsm_kvs.WaitForCompaction().IsError())
+        {
+            abort();
+        }
+        sprintf(name, "%s_get", names[j]);
+        {
+            TimeTaker time_taker(name);
+            for (int i = 0; i < kKeyNum; i++)
+            {
+                char buf[17];
+                sprintf(buf, "%016d", i * 104729 % kKeyNum);
+                SliceContainer container;
+                if (kvs_array[j]->Get(ReadOptions(), BufferPtrSlice(buf, 16), container).IsError())
+                {
+                    abort();
+                }
+            }
+        }
+    }
+    printf("runs of LsmKvs per level: %d %d %d %d\n", lsm_kvs.GetRunCnt(0), lsm_kvs.GetRunCnt(1), lsm_kvs.GetRunCnt(2), lsm_kvs.GetRunCnt(3));
+}
+
 class SingleShotPerformanceMeasurer
 {
 public:
@@ -173,10 +502,48 @@ static void test()
 int main()
 {
     memallocator_performance();
+    {
+        SimpleHashCalculator calculator;
+        HashCalculatorMeasurer measurer(calculator, "SimpleHashCalculator");
+        measurer.Do();
+    }
+    {
+        FastHashCalculator calculator;
+        HashCalculatorMeasurer measurer(calculator, "FastHashCalculator");
+        measurer.Do();
+    }
     test<GenericKvsContainer<SimpleKvs>>();
     test<GenericKvsContainer<LinkedListKvs>>();
     test<HashKvsContainer>();
+    test<GenericKvsContainer<FlatHashKvs>>();
     test<GenericKvsContainer<SkipListKvs<12>>>();
+    test<GenericKvsContainer<BTreeKvs>>();
+    test<GenericKvsContainer<ArtKvs>>();
     test<CharStorageKvsContainer>();
+    memory_footprint<SkipListKvs<12>>("SkipListKvs<12>");
+    memory_footprint<ArtKvs>("ArtKvs");
+    btree_padded_keys();
+    paged_btree_startup_and_reads();
+    lsm_random_writes();
+    {
+        SkipListAllocator kvs_allocator;
+        FastHashCalculator hash_calculator;
+        {
+            // a global lock
+            ShardedKvs kvs(1, kvs_allocator, hash_calculator);
+            ScalabilityMeasurer measurer(kvs, "ShardedKvs(1 shard)");
+            measurer.Do();
+        }
+        {
+            ShardedKvs kvs(64, kvs_allocator, hash_calculator);
+            ScalabilityMeasurer measurer(kvs, "ShardedKvs(64 shards)");
+            measurer.Do();
+        }
+        {
+            ConcurrentSkipListKvs kvs;
+            ScalabilityMeasurer measurer(kvs, "ConcurrentSkipListKvs");
+            measurer.Do();
+        }
+    }
     return 0;
 }
\ No newline at end of file
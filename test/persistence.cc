@@ -2,12 +2,20 @@
 #include "kvs/simple_kvs.h"
 #include "kvs/linkedlist.h"
 #include "kvs/char_storage_kvs.h"
+#include "kvs/paged_btree.h"
+#include "kvs/lsm.h"
+#include "kvs/skiplist.h"
+#include "kvs/sharded_kvs.h"
 #include "char_storage/char_storage_over_blockstorage.h"
+#include "char_storage/self_describing_char_storage_over_blockstorage.h"
+#include "char_storage/log.h"
 #include "block_storage/memblock_storage.h"
 #include "block_storage/file_block_storage.h"
 #include "./test.h"
 #include "misc.h"
+#include "test_storage.h"
 #include <assert.h>
+#include <map>
 #include <memory>
 #include <utility>
 
@@ -101,6 +109,412 @@ static inline void recover_from_file()
     }
 }
 
+static inline void recover_batch_from_block_storage()
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        WriteBatch batch;
+        for (int i = 0; i < 100; i++)
+        {
+            char key[20];
+            snprintf(key, sizeof(key), "%016d", i);
+            batch.Put(ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + (i % 26), i + 1));
+        }
+        for (int i = 0; i < 100; i += 3)
+        {
+            char key[20];
+            snprintf(key, sizeof(key), "%016d", i);
+            batch.Delete(ConstSlice(key, strlen(key)));
+        }
+        // an absent key, whose delete does not stop the rest of the batch in the log nor in the cache
+        batch.Delete(ConstSlice("absent", 6));
+        batch.Put(ConstSlice("last", 4), ConstSlice("value", 5));
+        assert(char_storage_kvs.Write(WriteOptions(), batch).IsOk());
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), ConstSlice("last", 4), container).IsOk());
+    }
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        for (int i = 0; i < 100; i++)
+        {
+            char key[20];
+            snprintf(key, sizeof(key), "%016d", i);
+            SliceContainer container;
+            if (i % 3 == 0)
+            {
+                assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsError());
+            }
+            else
+            {
+                assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+                assert(container.DoesMatch(CreateSliceFromChar('a' + (i % 26), i + 1)));
+            }
+        }
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), ConstSlice("last", 4), container).IsOk());
+        assert(container.DoesMatch(ConstSlice("value", 5)));
+    }
+}
+
+// only synced writes are recovered while the storage buffers the log
+static inline void recover_synced_writes(const CharStorageKvs::ValueMode value_mode)
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    ConstSlice key1("key1", 4);
+    ConstSlice key2("key2", 4);
+    ConstSlice value = CreateSliceFromChar('s', 100);
+    WriteOptions sync_options;
+    sync_options.sync = true;
+    {
+        SkipListKvs<12> cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage, 64 * 1024);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, value_mode);
+        assert(char_storage_kvs.Put(WriteOptions(), key1, value).IsOk());
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), key1, container).IsOk());
+        assert(container.DoesMatch(value));
+        {
+            SkipListKvs<12> recovered_cache_kvs;
+            AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> recovered_char_storage(block_storage);
+            CharStorageKvs recovered_kvs(recovered_char_storage, recovered_cache_kvs, value_mode);
+            assert(recovered_kvs.Get(ReadOptions(), key1, container).IsError());
+        }
+        assert(char_storage_kvs.Delete(WriteOptions(), key1).IsOk());
+        assert(char_storage_kvs.Put(sync_options, key2, value).IsOk());
+        {
+            SkipListKvs<12> recovered_cache_kvs;
+            AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> recovered_char_storage(block_storage);
+            CharStorageKvs recovered_kvs(recovered_char_storage, recovered_cache_kvs, value_mode);
+            assert(recovered_kvs.Get(ReadOptions(), key1, container).IsError());
+            assert(recovered_kvs.Get(ReadOptions(), key2, container).IsOk());
+            assert(container.DoesMatch(value));
+        }
+    }
+}
+
+// the cache kvs holds only the locations of the values
+static inline void recover_separated_values()
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    Tester tester;
+    char key[20];
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, CharStorageKvs::ValueMode::kSeparated);
+        tester.Write(char_storage_kvs);
+        WriteBatch batch;
+        for (int i = 0; i < 100; i++)
+        {
+            snprintf(key, sizeof(key), "%016d", i);
+            batch.Put(ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + (i % 26), i + 1));
+            if (i % 3 == 0)
+            {
+                batch.Delete(ConstSlice(key, strlen(key)));
+            }
+        }
+        assert(char_storage_kvs.Write(WriteOptions(), batch).IsOk());
+        tester.Read(char_storage_kvs);
+    }
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, CharStorageKvs::ValueMode::kSeparated);
+        tester.Read(char_storage_kvs);
+        for (int i = 0; i < 100; i++)
+        {
+            snprintf(key, sizeof(key), "%016d", i);
+            SliceContainer container;
+            if (i % 3 == 0)
+            {
+                assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsError());
+                continue;
+            }
+            assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+            assert(container.DoesMatch(CreateSliceFromChar('a' + (i % 26), i + 1)));
+            int len;
+            assert(cache_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+            assert(container.GetLen(len).IsOk());
+            assert(len == sizeof(uint64_t) + sizeof(uint32_t));
+        }
+    }
+}
+
+// the result of the parallel recovery matches the sequential one
+static inline void recover_in_parallel(const CharStorageKvs::ValueMode value_mode)
+{
+    START_TEST;
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } kvs_allocator;
+    FastHashCalculator hash_calculator;
+    MemBlockStorage block_storage;
+    const int kNum = 1000;
+    char key[20];
+    {
+        SkipListKvs<12> cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, value_mode);
+        // a record which is larger than a chunk
+        assert(char_storage_kvs.Put(WriteOptions(), ConstSlice("big", 3), CreateSliceFromChar('x', 1200 * 1024)).IsOk());
+        for (int round = 0; round < 2; round++)
+        {
+            WriteBatch batch;
+            for (int i = 0; i < kNum; i++)
+            {
+                snprintf(key, sizeof(key), "%016d", i);
+                batch.Put(ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + ((i + round) % 26), (i * 7 + round) % 500 + 1));
+                if (i % 5 == round)
+                {
+                    batch.Delete(ConstSlice(key, strlen(key)));
+                }
+            }
+            assert(char_storage_kvs.Write(WriteOptions(), batch).IsOk());
+        }
+    }
+    SkipListKvs<12> expected_kvs;
+    AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> expected_char_storage(block_storage);
+    CharStorageKvs expected(expected_char_storage, expected_kvs, value_mode);
+    ShardedKvs cache_kvs(8, kvs_allocator, hash_calculator);
+    AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+    CharStorageKvs char_storage_kvs(char_storage, cache_kvs, value_mode, 4);
+    SliceContainer container, expected_container;
+    assert(char_storage_kvs.Get(ReadOptions(), ConstSlice("big", 3), container).IsOk());
+    assert(container.DoesMatch(CreateSliceFromChar('x', 1200 * 1024)));
+    for (int i = 0; i < kNum; i++)
+    {
+        snprintf(key, sizeof(key), "%016d", i);
+        if (i % 5 == 1)
+        {
+            assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsError());
+            continue;
+        }
+        assert(expected.Get(ReadOptions(), ConstSlice(key, strlen(key)), expected_container).IsOk());
+        assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+        CmpResult result;
+        assert(container.Cmp(expected_container, result).IsOk());
+        assert(result.IsEqual());
+        assert(container.DoesMatch(CreateSliceFromChar('a' + ((i + 1) % 26), (i * 7 + 1) % 500 + 1)));
+    }
+}
+
+// a broken record at the tail is dropped on recovery, and later records are appended in its place
+static inline void recover_from_torn_tail(const int recovery_thread_cnt)
+{
+    START_TEST;
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } kvs_allocator;
+    FastHashCalculator hash_calculator;
+    MemBlockStorage block_storage;
+    Tester tester;
+    ConstSlice key("torn", 4);
+    ConstSlice value = CreateSliceFromChar('t', 100);
+    const size_t record_len = LogRecord::GetPutRecordLen(key.GetLen(), value.GetLen());
+    char buf[256];
+    assert(LogRecord::EncodePut(buf, key, value).IsOk());
+    size_t len;
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        tester.Write(char_storage_kvs);
+        len = char_storage.GetLen();
+        // a part of a record
+        assert(char_storage.Append(BufferPtrSlice(buf, record_len / 2)).IsOk());
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        ShardedKvs cache_kvs(4, kvs_allocator, hash_calculator);
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, CharStorageKvs::ValueMode::kCached, recovery_thread_cnt);
+        tester.Read(char_storage_kvs);
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), key, container).IsError());
+        assert(char_storage.GetLen() == len);
+        if (i == 0)
+        {
+            // a record whose crc does not match
+            buf[record_len - 1] ^= 1;
+            assert(char_storage.Append(BufferPtrSlice(buf, record_len)).IsOk());
+            buf[record_len - 1] ^= 1;
+        }
+    }
+    {
+        ShardedKvs cache_kvs(4, kvs_allocator, hash_calculator);
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, CharStorageKvs::ValueMode::kCached, recovery_thread_cnt);
+        assert(char_storage.GetLen() == len);
+        assert(char_storage_kvs.Put(WriteOptions(), key, value).IsOk());
+    }
+    {
+        ShardedKvs cache_kvs(4, kvs_allocator, hash_calculator);
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, CharStorageKvs::ValueMode::kCached, recovery_thread_cnt);
+        tester.Read(char_storage_kvs);
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), key, container).IsOk());
+        assert(container.DoesMatch(value));
+        assert(char_storage.GetLen() == len + record_len);
+    }
+}
+
+// a broken record followed by valid ones is not a torn tail, so the log is kept and updates are rejected
+static inline void keep_log_with_broken_record(const int recovery_thread_cnt)
+{
+    START_TEST;
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } kvs_allocator;
+    FastHashCalculator hash_calculator;
+    MemBlockStorage block_storage;
+    Tester tester;
+    ConstSlice broken_key("broken", 6);
+    ConstSlice last_key("last", 4);
+    ConstSlice value = CreateSliceFromChar('b', 100);
+    const size_t record_len = LogRecord::GetPutRecordLen(broken_key.GetLen(), value.GetLen());
+    char buf[256];
+    assert(LogRecord::EncodePut(buf, broken_key, value).IsOk());
+    size_t len;
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        tester.Write(char_storage_kvs);
+        // a record whose crc does not match, and a valid one after it
+        buf[record_len - 1] ^= 1;
+        assert(char_storage.Append(BufferPtrSlice(buf, record_len)).IsOk());
+        assert(char_storage_kvs.Put(WriteOptions(), last_key, value).IsOk());
+        len = char_storage.GetLen();
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        ShardedKvs cache_kvs(4, kvs_allocator, hash_calculator);
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, CharStorageKvs::ValueMode::kCached, recovery_thread_cnt);
+        assert(char_storage_kvs.IsBroken());
+        assert(char_storage.GetLen() == len);
+        // the records before the broken one are replayed
+        tester.Read(char_storage_kvs);
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), broken_key, container).IsError());
+        assert(char_storage_kvs.Put(WriteOptions(), last_key, value).IsError());
+        assert(char_storage_kvs.CompactLog().IsError());
+        assert(char_storage.GetLen() == len);
+    }
+}
+
+static inline void recover_from_self_describing_blocks()
+{
+    START_TEST;
+    using CharStorage = SelfDescribingAppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer>;
+    MemBlockStorage block_storage;
+    Tester tester;
+    ConstSlice key("torn", 4);
+    ConstSlice value = CreateSliceFromChar('t', 1000);
+    const size_t record_len = LogRecord::GetPutRecordLen(key.GetLen(), value.GetLen());
+    char buf[1100];
+    assert(LogRecord::EncodePut(buf, key, value).IsOk());
+    size_t len;
+    {
+        SimpleKvs cache_kvs;
+        CharStorage char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        tester.Write(char_storage_kvs);
+        len = char_storage.GetLen();
+        // a part of a record which spans over blocks
+        assert(char_storage.Append(BufferPtrSlice(buf, record_len / 2)).IsOk());
+    }
+    {
+        SimpleKvs cache_kvs;
+        CharStorage char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        tester.Read(char_storage_kvs);
+        assert(char_storage.GetLen() == len);
+        assert(char_storage_kvs.Put(WriteOptions(), key, value).IsOk());
+    }
+    {
+        SimpleKvs cache_kvs;
+        CharStorage char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        tester.Read(char_storage_kvs);
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), key, container).IsOk());
+        assert(container.DoesMatch(value));
+        assert(char_storage.GetLen() == len + record_len);
+    }
+}
+
+// logs written in the v1 format are recovered, and v2 records follow them
+static inline void recover_v1_log()
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    Tester tester;
+    const char put_signature = 0;
+    const char delete_signature = 1;
+    ConstSlice key1("v1key1", 6);
+    ConstSlice key2("v1key2", 6);
+    ConstSlice value("v1value", 7);
+    {
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        LogAppender log_appender(char_storage);
+        assert(log_appender.Open().IsOk());
+        const ValidSlice *slices[3];
+        BufferPtrSlice put(&put_signature, 1);
+        BufferPtrSlice del(&delete_signature, 1);
+        MultipleValidSliceContainer put_container(slices, 3);
+        put_container.Set(&put);
+        put_container.Set(&key1);
+        put_container.Set(&value);
+        assert(log_appender.AppendEntries(put_container).IsOk());
+        MultipleValidSliceContainer put_container2(slices, 3);
+        put_container2.Set(&put);
+        put_container2.Set(&key2);
+        put_container2.Set(&value);
+        assert(log_appender.AppendEntries(put_container2).IsOk());
+        MultipleValidSliceContainer delete_container(slices, 2);
+        delete_container.Set(&del);
+        delete_container.Set(&key2);
+        assert(log_appender.AppendEntries(delete_container).IsOk());
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        SliceContainer container;
+        assert(char_storage_kvs.Get(ReadOptions(), key1, container).IsOk());
+        assert(container.DoesMatch(value));
+        assert(char_storage_kvs.Get(ReadOptions(), key2, container).IsError());
+        if (i == 0)
+        {
+            tester.Write(char_storage_kvs);
+        }
+        tester.Read(char_storage_kvs);
+    }
+}
+
 static inline void store_many_kvpairs()
 {
     START_TEST;
@@ -133,11 +547,411 @@ static inline void store_many_kvpairs()
     }
 }
 
+// the write history exceeds the storage, and writes are interleaved with the steps of log compactions
+static inline void compact_log(const CharStorageKvs::ValueMode value_mode)
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    const int kNum = 200;
+    const int kRound = 60;
+    char key[20];
+    size_t live_len = 0;
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, value_mode);
+        for (int round = 0; round < kRound; round++)
+        {
+            for (int i = 0; i < kNum; i++)
+            {
+                snprintf(key, sizeof(key), "%016d", i);
+                assert(char_storage_kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + ((i + round) % 26), 300)).IsOk());
+            }
+            if (round % 10 != 9)
+            {
+                continue;
+            }
+            assert(char_storage_kvs.StartLogCompaction().IsOk());
+            assert(char_storage_kvs.IsCompactingLog());
+            bool done = false;
+            for (int i = 0; !done; i++)
+            {
+                assert(char_storage_kvs.ContinueLogCompaction(16, done).IsOk());
+                snprintf(key, sizeof(key), "%016d", (i * 7) % kNum);
+                if (i % 2 == 0)
+                {
+                    assert(char_storage_kvs.Delete(WriteOptions(), ConstSlice(key, strlen(key))).IsOk());
+                }
+                else
+                {
+                    assert(char_storage_kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('A' + (round % 26), 300)).IsOk());
+                }
+            }
+            assert(!char_storage_kvs.IsCompactingLog());
+        }
+        assert(char_storage_kvs.CompactLog().IsOk());
+        live_len = char_storage_kvs.GetLogLen();
+        assert(char_storage.GetLen() > (size_t)block_storage.GetMaxAddress().GetRaw() * BlockBufferInterface::kSize);
+    }
+    {
+        SimpleKvs cache_kvs;
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs, value_mode);
+        // the log holds one record per live entry
+        int live_cnt = 0;
+        size_t record_len = 0;
+        for (int i = 0; i < kNum; i++)
+        {
+            snprintf(key, sizeof(key), "%016d", i);
+            SliceContainer container;
+            Status s = char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container);
+            if (s.IsOk())
+            {
+                live_cnt++;
+                record_len += LogRecord::GetPutRecordLen(strlen(key), 300);
+                assert(container.DoesMatch(CreateSliceFromChar('A' + ((kRound - 1) % 26), 300)) ||
+                       container.DoesMatch(CreateSliceFromChar('a' + ((i + kRound - 1) % 26), 300)));
+            }
+        }
+        assert(live_cnt > 0 && live_cnt < kNum);
+        assert(char_storage_kvs.GetLogLen() == live_len);
+        assert(live_len == record_len);
+    }
+}
+
+// the log is recovered after a log compaction with writes between its steps, without a following compaction
+static inline void recover_after_log_compaction(const int recovery_thread_cnt)
+{
+    START_TEST;
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } kvs_allocator;
+    FastHashCalculator hash_calculator;
+    MemBlockStorage block_storage;
+    const int kNum = 100;
+    char key[20];
+    SimpleKvs expected;
+    {
+        ShardedKvs cache_kvs(8, kvs_allocator, hash_calculator);
+        AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+        CharStorageKvs char_storage_kvs(char_storage, cache_kvs);
+        for (int i = 0; i < kNum; i++)
+        {
+            snprintf(key, sizeof(key), "%016d", i);
+            assert(char_storage_kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('a', 100)).IsOk());
+            assert(expected.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('a', 100)).IsOk());
+        }
+        assert(char_storage_kvs.StartLogCompaction().IsOk());
+        bool done = false;
+        for (int i = 0; !done; i++)
+        {
+            // deletes keys both before and after the cursor of the compaction
+            snprintf(key, sizeof(key), "%016d", kNum - 1 - i * 3);
+            assert(char_storage_kvs.Delete(WriteOptions(), ConstSlice(key, strlen(key))).IsOk());
+            assert(expected.Delete(WriteOptions(), ConstSlice(key, strlen(key))).IsOk());
+            snprintf(key, sizeof(key), "%016d", kNum + i);
+            assert(char_storage_kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('b', 100)).IsOk());
+            assert(expected.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('b', 100)).IsOk());
+            snprintf(key, sizeof(key), "%016d", i * 3);
+            assert(char_storage_kvs.Delete(WriteOptions(), ConstSlice(key, strlen(key))).IsOk());
+            assert(expected.Delete(WriteOptions(), ConstSlice(key, strlen(key))).IsOk());
+            assert(char_storage_kvs.ContinueLogCompaction(8, done).IsOk());
+        }
+        assert(!char_storage_kvs.IsCompactingLog());
+    }
+    ShardedKvs cache_kvs(8, kvs_allocator, hash_calculator);
+    AppendOnlyCharStorageOverBlockStorage<GenericBlockBuffer> char_storage(block_storage);
+    CharStorageKvs char_storage_kvs(char_storage, cache_kvs, CharStorageKvs::ValueMode::kCached, recovery_thread_cnt);
+    for (int i = 0; i < kNum * 2; i++)
+    {
+        snprintf(key, sizeof(key), "%016d", i);
+        SliceContainer container, expected_container;
+        if (expected.Get(ReadOptions(), ConstSlice(key, strlen(key)), expected_container).IsError())
+        {
+            assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsError());
+            continue;
+        }
+        assert(char_storage_kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+        assert(container.DoesMatch(expected_container.CreateConstSlice()));
+    }
+}
+
+// opening an existing tree reads only the superblocks, and a Get reads one block per level
+static inline void reopen_paged_btree()
+{
+    START_TEST;
+    TestStorage block_storage;
+    Tester tester;
+    const int kNum = 3000;
+    char key[20];
+    {
+        PagedBTreeKvs<GenericBlockBuffer> kvs(block_storage, 16);
+        tester.Write(kvs);
+        for (int i = 0; i < kNum; i++)
+        {
+            snprintf(key, sizeof(key), "%016d", i);
+            assert(kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + (i % 26), i % 64)).IsOk());
+        }
+    }
+    block_storage.ResetCnt();
+    PagedBTreeKvs<GenericBlockBuffer> kvs(block_storage, 16);
+    assert(block_storage.IsReadCntAdded(2));
+    assert(kvs.GetHeight() >= 2);
+    snprintf(key, sizeof(key), "%016d", kNum / 2);
+    SliceContainer container;
+    assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+    assert(block_storage.IsReadCntAdded(kvs.GetHeight() + 1));
+    assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+    assert(block_storage.IsReadCntAdded(0));
+    tester.Read(kvs);
+    for (int i = 0; i < kNum; i++)
+    {
+        snprintf(key, sizeof(key), "%016d", i);
+        assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('a' + (i % 26), i % 64)));
+    }
+}
+
+// The j-th update of reopen_paged_btree_after_crash: new keys split nodes, deleting most keys merges them,
+// which makes the free pages overflow the superblock, and the last puts take them again.
+// Returns the index of the key, and sets the length of the value, or -1 for a delete.
+static inline int GetPagedBTreeUpdate(const int j, const int base_cnt, int &value_len)
+{
+    const int kPutCnt = 100;
+    if (j < kPutCnt || j >= base_cnt)
+    {
+        value_len = 60 + j % 61;
+        return j < kPutCnt ? base_cnt + j : j - base_cnt;
+    }
+    value_len = -1;
+    return j - kPutCnt;
+}
+
+static inline Status UpdatePagedBTree(Kvs &kvs, const int j, const int base_cnt, int *value_lens)
+{
+    int value_len;
+    const int i = GetPagedBTreeUpdate(j, base_cnt, value_len);
+    char key[20];
+    snprintf(key, sizeof(key), "%016d", i);
+    Status s = value_len < 0 ? kvs.Delete(WriteOptions(), ConstSlice(key, strlen(key)))
+                             : kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + value_len % 26, value_len));
+    if (s.IsOk())
+    {
+        value_lens[i] = value_len;
+    }
+    return s;
+}
+
+static inline void CheckPagedBTree(Kvs &kvs, const int *value_lens, const int cnt)
+{
+    char key[20];
+    SliceContainer container;
+    for (int i = 0; i < cnt; i++)
+    {
+        snprintf(key, sizeof(key), "%016d", i);
+        if (value_lens[i] < 0)
+        {
+            assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsError());
+            continue;
+        }
+        assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('a' + value_lens[i] % 26, value_lens[i])));
+    }
+}
+
+// A crash at any write of an update leaves the tree of the last complete update.
+// The write at the crash is torn, and a torn superblock is ignored in favor of the other one.
+static inline void reopen_paged_btree_after_crash()
+{
+    START_TEST;
+    // writes go to an overlay over the base storage, and are lost after the given number of writes
+    class CrashingStorage : public BlockStorageInterface<GenericBlockBuffer>
+    {
+    public:
+        CrashingStorage(BlockStorageInterface<GenericBlockBuffer> &base, const int write_cnt) : base_(base), write_cnt_(write_cnt)
+        {
+        }
+        virtual Status Open() override
+        {
+            return Status::CreateOkStatus();
+        }
+        virtual LogicalBlockAddress GetMaxAddress() const override
+        {
+            return base_.GetMaxAddress();
+        }
+        bool HasCrashed() const
+        {
+            return crashed_;
+        }
+        void Restart()
+        {
+            crashed_ = false;
+            write_cnt_ = -1;
+        }
+
+    private:
+        virtual Status ReadInternal(const LogicalBlockAddress address, GenericBlockBuffer &buffer) override
+        {
+            auto it = overlay_.find(address.GetRaw());
+            if (it == overlay_.end())
+            {
+                return base_.Read(address, buffer);
+            }
+            buffer.CopyFrom(*it->second);
+            return Status::CreateOkStatus();
+        }
+        virtual Status WriteInternal(const LogicalBlockAddress address, const GenericBlockBuffer &buffer) override
+        {
+            if (crashed_)
+            {
+                return Status::CreateErrorStatus();
+            }
+            std::unique_ptr<GenericBlockBuffer> block(new GenericBlockBuffer);
+            if (write_cnt_ == 0)
+            {
+                // only the first half reaches the storage
+                if (ReadInternal(address, *block).IsError())
+                {
+                    return Status::CreateErrorStatus();
+                }
+                block->CopyFrom(buffer.GetConstPtrToTheBuffer(), 0, BlockBufferInterface::kSize / 2);
+                crashed_ = true;
+            }
+            else
+            {
+                block->CopyFrom(buffer);
+                write_cnt_--;
+            }
+            overlay_[address.GetRaw()] = std::move(block);
+            return crashed_ ? Status::CreateErrorStatus() : Status::CreateOkStatus();
+        }
+        BlockStorageInterface<GenericBlockBuffer> &base_;
+        int write_cnt_;
+        bool crashed_ = false;
+        std::map<int64_t, std::unique_ptr<GenericBlockBuffer>> overlay_;
+    };
+    const int kBaseCnt = 800;
+    const int kKeyCnt = kBaseCnt + 100;
+    const int kUpdateCnt = kBaseCnt + 300;
+    int base_value_lens[kKeyCnt];
+    MemBlockStorage base_storage;
+    {
+        PagedBTreeKvs<GenericBlockBuffer> kvs(base_storage, 16);
+        for (int i = 0; i < kKeyCnt; i++)
+        {
+            base_value_lens[i] = -1;
+        }
+        char key[20];
+        for (int i = 0; i < kBaseCnt; i++)
+        {
+            snprintf(key, sizeof(key), "%016d", i);
+            base_value_lens[i] = 120;
+            assert(kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + 120 % 26, 120)).IsOk());
+        }
+    }
+    for (int write_cnt = 0;; write_cnt += 7)
+    {
+        int value_lens[kKeyCnt];
+        memcpy(value_lens, base_value_lens, sizeof(value_lens));
+        CrashingStorage storage(base_storage, write_cnt);
+        int done = 0;
+        {
+            PagedBTreeKvs<GenericBlockBuffer> kvs(storage, 16);
+            while (done < kUpdateCnt && UpdatePagedBTree(kvs, done, kBaseCnt, value_lens).IsOk())
+            {
+                done++;
+            }
+        }
+        if (!storage.HasCrashed())
+        {
+            assert(done == kUpdateCnt);
+            break;
+        }
+        storage.Restart();
+        PagedBTreeKvs<GenericBlockBuffer> kvs(storage, 16);
+        CheckPagedBTree(kvs, value_lens, kKeyCnt);
+        // the free pages are intact, so that the rest of the updates can be done
+        for (int j = done; j < kUpdateCnt; j++)
+        {
+            assert(UpdatePagedBTree(kvs, j, kBaseCnt, value_lens).IsOk());
+        }
+        CheckPagedBTree(kvs, value_lens, kKeyCnt);
+    }
+}
+
+// runs are found again through the manifest, and a lookup reads only a few blocks of each level
+static inline void reopen_lsm()
+{
+    START_TEST;
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } allocator;
+    TestStorage block_storage;
+    Tester tester;
+    const int kNum = 3000;
+    char key[20];
+    {
+        LsmKvs<GenericBlockBuffer> kvs(block_storage, allocator, 4096);
+        tester.Write(kvs);
+        for (int i = 0; i < kNum; i++)
+        {
+            snprintf(key, sizeof(key), "%016d", i);
+            assert(kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), CreateSliceFromChar('a' + (i % 26), i % 64)).IsOk());
+        }
+    }
+    LsmKvs<GenericBlockBuffer> kvs(block_storage, allocator, 4096);
+    assert(kvs.WaitForCompaction().IsOk());
+    int run_level_cnt = kvs.GetRunCnt(0);
+    for (int level = 1; level < 8; level++)
+    {
+        run_level_cnt += kvs.GetRunCnt(level) != 0 ? 1 : 0;
+    }
+    block_storage.ResetCnt();
+    snprintf(key, sizeof(key), "%016d", kNum / 2);
+    SliceContainer container;
+    assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+    assert(block_storage.GetReadCnt() <= 2 * run_level_cnt);
+    tester.Read(kvs);
+    for (int i = 0; i < kNum; i++)
+    {
+        snprintf(key, sizeof(key), "%016d", i);
+        assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk());
+        assert(container.DoesMatch(CreateSliceFromChar('a' + (i % 26), i % 64)));
+    }
+}
+
 int main()
 {
     persist_with_underlying_kvs();
     recover_from_block_storage();
     recover_from_file();
+    recover_batch_from_block_storage();
     store_many_kvpairs();
+    recover_separated_values();
+    recover_synced_writes(CharStorageKvs::ValueMode::kCached);
+    recover_synced_writes(CharStorageKvs::ValueMode::kSeparated);
+    recover_in_parallel(CharStorageKvs::ValueMode::kCached);
+    recover_in_parallel(CharStorageKvs::ValueMode::kSeparated);
+    recover_from_torn_tail(1);
+    recover_from_torn_tail(4);
+    keep_log_with_broken_record(1);
+    keep_log_with_broken_record(4);
+    recover_v1_log();
+    recover_from_self_describing_blocks();
+    compact_log(CharStorageKvs::ValueMode::kCached);
+    compact_log(CharStorageKvs::ValueMode::kSeparated);
+    recover_after_log_compaction(1);
+    recover_after_log_compaction(4);
+    reopen_paged_btree();
+    reopen_paged_btree_after_crash();
+    reopen_lsm();
     return 0;
 }
\ No newline at end of file
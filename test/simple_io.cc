@@ -215,6 +215,93 @@ private:
     KvsContainerInterface &kvs_container_;
 };
 
+class WriteBatchTester
+{
+public:
+    WriteBatchTester(KvsContainerInterface &kvs_container) : kvs_container_(kvs_container)
+    {
+    }
+    void Do()
+    {
+        START_TEST;
+        ConstSlice key1("111", 3);
+        ConstSlice key2("123", 3);
+        ConstSlice key3("3", 1);
+        ConstSlice value1("abcde", 5);
+        ConstSlice value2("fghi", 4);
+        ConstSlice value3("xy", 2);
+        assert(kvs_container_->Put(WriteOptions(), key3, value3).IsOk());
+        WriteBatch batch;
+        batch.Put(key1, value1);
+        batch.Put(key2, value2);
+        batch.Put(key1, value2);
+        batch.Delete(key3);
+        assert(batch.GetCount() == 4);
+        assert(kvs_container_->Write(WriteOptions(), batch).IsOk());
+        SliceContainer container;
+        assert(kvs_container_->Get(ReadOptions(), key1, container).IsOk());
+        assert(container.DoesMatch(value2));
+        assert(kvs_container_->Get(ReadOptions(), key2, container).IsOk());
+        assert(container.DoesMatch(value2));
+        assert(kvs_container_->Get(ReadOptions(), key3, container).IsError());
+        // deleting an absent key does not stop the rest of the batch
+        WriteBatch batch2;
+        batch2.Delete(ConstSlice("absent", 6));
+        batch2.Put(key3, value1);
+        assert(kvs_container_->Write(WriteOptions(), batch2).IsOk());
+        assert(kvs_container_->Get(ReadOptions(), key3, container).IsOk());
+        assert(container.DoesMatch(value1));
+    }
+
+private:
+    KvsContainerInterface &kvs_container_;
+};
+
+class MultiGetTester
+{
+public:
+    MultiGetTester(KvsContainerInterface &kvs_container) : kvs_container_(kvs_container)
+    {
+    }
+    void Do()
+    {
+        START_TEST;
+        static const int kKeyNum = 64;
+        char bufs[kKeyNum][5];
+        BufferPtrSlice *keys[kKeyNum];
+        const ValidSlice *key_ptrs[kKeyNum];
+        for (int i = 0; i < kKeyNum; i++)
+        {
+            sprintf(bufs[i], "%04d", i * 7);
+            keys[i] = new BufferPtrSlice(bufs[i], 4);
+            key_ptrs[i] = keys[i];
+            if (i % 4 != 0)
+            {
+                assert(kvs_container_->Put(WriteOptions(), *keys[i], *keys[i]).IsOk());
+            }
+        }
+        SliceContainer containers[kKeyNum];
+        containers[0].Set(ConstSlice("stale", 5));
+        assert(kvs_container_->MultiGet(ReadOptions(), key_ptrs, kKeyNum, containers).IsOk());
+        for (int i = 0; i < kKeyNum; i++)
+        {
+            if (i % 4 == 0)
+            {
+                assert(!containers[i].IsSliceAvailable());
+            }
+            else
+            {
+                assert(containers[i].IsSliceAvailable());
+                assert(containers[i].DoesMatch(*keys[i]));
+            }
+            delete keys[i];
+        }
+    }
+
+private:
+    KvsContainerInterface &kvs_container_;
+};
+
 template <class KvsContainer>
 static void test()
 {
@@ -254,6 +341,454 @@ static void test()
         MixedQueriesTester tester(kvs_container);
         tester.Do();
     }
+    {
+        KvsContainer kvs_container;
+        WriteBatchTester tester(kvs_container);
+        tester.Do();
+    }
+    {
+        KvsContainer kvs_container;
+        MultiGetTester tester(kvs_container);
+        tester.Do();
+    }
+}
+
+static void hash_resize()
+{
+    START_TEST;
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new LinkedListKvs();
+        }
+    } kvs_allocator;
+    FastHashCalculator hash_calculator;
+    HashKvs kvs(4, kvs_allocator, hash_calculator);
+    const int kNum = 5000;
+    bool resized_while_iterating = false;
+    for (int i = 0; i < kNum; i++)
+    {
+        char buf[12];
+        sprintf(buf, "%08d", i);
+        ConstSlice key(buf, 8);
+        assert(kvs.Put(WriteOptions(), key, key).IsOk());
+        if (kvs.IsResizing())
+        {
+            // keys must be found in either table during the migration
+            for (int j = 0; j <= i; j += 97)
+            {
+                char buf2[12];
+                sprintf(buf2, "%08d", j);
+                SliceContainer container;
+                assert(kvs.Get(ReadOptions(), ConstSlice(buf2, 8), container).IsOk());
+            }
+            if (resized_while_iterating)
+            {
+                continue;
+            }
+            // the migration goes on while an iterator is outstanding, and the iterator still walks all keys in order
+            KvsEntryIterator first_iter = kvs.GetIterator(ConstSlice("00000000", 8));
+            SliceContainer container;
+            assert(first_iter.Get(ReadOptions(), container).IsOk());
+            assert(container.DoesMatch(ConstSlice("00000000", 8)));
+            int cnt = 1;
+            Optional<KvsEntryIterator> optional_iter = first_iter.GetNext();
+            while (optional_iter.isPresent())
+            {
+                KvsEntryIterator iter = optional_iter.get();
+                char buf2[12];
+                sprintf(buf2, "%08d", cnt);
+                assert(iter.GetKey(container).IsOk());
+                assert(container.DoesMatch(ConstSlice(buf2, 8)));
+                assert(iter.Get(ReadOptions(), container).IsOk());
+                assert(container.DoesMatch(ConstSlice(buf2, 8)));
+                // overwriting steps the migration
+                assert(kvs.Put(WriteOptions(), key, key).IsOk());
+                cnt++;
+                optional_iter = iter.GetNext();
+            }
+            assert(cnt == i + 1);
+            assert(!kvs.IsResizing());
+            resized_while_iterating = true;
+        }
+    }
+    assert(resized_while_iterating);
+    // overwriting does not increase the number of entries
+    const int bucket_size = kvs.GetBucketSize();
+    for (int i = 0; i < kNum * 4; i++)
+    {
+        ConstSlice key("00000000", 8);
+        assert(kvs.Put(WriteOptions(), key, key).IsOk());
+    }
+    assert(!kvs.IsResizing() && kvs.GetBucketSize() == bucket_size);
+    assert(bucket_size * 4 >= kNum);
+    int cnt = 0;
+    Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+    while (optional_iter.isPresent())
+    {
+        KvsEntryIterator iter = optional_iter.get();
+        char buf[12];
+        sprintf(buf, "%08d", cnt);
+        SliceContainer container;
+        assert(iter.GetKey(container).IsOk());
+        assert(container.DoesMatch(ConstSlice(buf, 8)));
+        cnt++;
+        optional_iter = iter.GetNext();
+    }
+    assert(cnt == kNum);
+}
+
+// deleted elements are unlinked, and their memory is reused by later puts
+static void skiplist_churn()
+{
+    START_TEST;
+    SkipListKvs<12> kvs;
+    const int kNum = 1000;
+    size_t memory_usage = 0;
+    for (int round = 0; round < 10; round++)
+    {
+        for (int i = 0; i < kNum; i++)
+        {
+            char buf[17];
+            sprintf(buf, "%08d%08d", round, i);
+            ConstSlice key(buf, 16);
+            assert(kvs.Put(WriteOptions(), key, key).IsOk());
+        }
+        if (round == 0)
+        {
+            memory_usage = kvs.GetMemoryUsage();
+        }
+        // an iterator pins the element, which is deleted under it
+        char buf[17];
+        sprintf(buf, "%08d%08d", round, kNum / 2);
+        KvsEntryIterator iter = kvs.GetIterator(ConstSlice(buf, 16));
+        for (int i = 0; i < kNum; i++)
+        {
+            sprintf(buf, "%08d%08d", round, i);
+            assert(kvs.Delete(WriteOptions(), ConstSlice(buf, 16)).IsOk());
+        }
+        SliceContainer container;
+        assert(iter.Get(ReadOptions(), container).IsError());
+        assert(!iter.hasNext());
+    }
+    assert(!kvs.GetFirstIterator().isPresent());
+    // heights are random, so the size of each element varies
+    assert(kvs.GetMemoryUsage() <= memory_usage * 2);
+}
+
+// enough keys to split leaves and inner nodes, then to remove them again
+static void btree_split_and_remove()
+{
+    START_TEST;
+    BTreeKvs kvs;
+    const int kNum = 5000;
+    char buf[20];
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < kNum; i++)
+        {
+            // keys share the first 8 bytes, so that full keys are compared
+            sprintf(buf, "prefix__%08d", i * 7919 % kNum);
+            ConstSlice key(buf, 16);
+            assert(kvs.Put(WriteOptions(), key, key).IsOk());
+        }
+        int cnt = 0;
+        Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+        while (optional_iter.isPresent())
+        {
+            KvsEntryIterator iter = optional_iter.get();
+            sprintf(buf, "prefix__%08d", cnt);
+            SliceContainer container;
+            assert(iter.GetKey(container).IsOk());
+            assert(container.DoesMatch(ConstSlice(buf, 16)));
+            assert(iter.Get(ReadOptions(), container).IsOk());
+            assert(container.DoesMatch(ConstSlice(buf, 16)));
+            cnt++;
+            optional_iter = iter.GetNext();
+        }
+        assert(cnt == kNum);
+        for (int i = 0; i < kNum; i++)
+        {
+            if (i % 10 == 0)
+            {
+                continue;
+            }
+            sprintf(buf, "prefix__%08d", i * 7919 % kNum);
+            assert(kvs.Delete(WriteOptions(), ConstSlice(buf, 16)).IsOk());
+        }
+        for (int i = 0; i < kNum; i++)
+        {
+            sprintf(buf, "prefix__%08d", i);
+            SliceContainer container;
+            // 7919 * i % kNum is a multiple of 10 only if i is
+            assert(kvs.Get(ReadOptions(), ConstSlice(buf, 16), container).IsOk() == (i % 10 == 0));
+        }
+        SliceContainer container;
+        assert(kvs.FindNextKey(ConstSlice("prefix__", 8), container).IsOk());
+        assert(container.DoesMatch(ConstSlice("prefix__00000000", 16)));
+    }
+    for (int i = 0; i < kNum; i += 10)
+    {
+        sprintf(buf, "prefix__%08d", i * 7919 % kNum);
+        assert(kvs.Delete(WriteOptions(), ConstSlice(buf, 16)).IsOk());
+    }
+    assert(!kvs.GetFirstIterator().isPresent());
+}
+
+// keys of nodes share long prefixes, and some keys are prefixes of others.
+// puts and deletes in random order are checked against SimpleKvs, including lookups of absent keys.
+static void btree_prefixes()
+{
+    START_TEST;
+    BTreeKvs kvs;
+    SimpleKvs expected;
+    const int kNum = 20000;
+    char buf[41];
+    unsigned int seed = 1;
+    for (int i = 0; i < kNum; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        sprintf(buf, "%040d", (seed >> 8) % 3000);
+        // a key of 40 bytes, or a prefix of one
+        const int len = 32 + (seed >> 4) % 9;
+        ConstSlice key(buf, len);
+        if ((seed >> 20) % 3 == 0)
+        {
+            assert(kvs.Delete(WriteOptions(), key).IsOk() == expected.Delete(WriteOptions(), key).IsOk());
+        }
+        else
+        {
+            assert(kvs.Put(WriteOptions(), key, key).IsOk());
+            assert(expected.Put(WriteOptions(), key, key).IsOk());
+        }
+        seed = seed * 1103515245 + 12345;
+        sprintf(buf, "%040d", (seed >> 8) % 3000);
+        ConstSlice lookup_key(buf, 30 + (seed >> 4) % 11);
+        SliceContainer container, expected_container;
+        const bool exists = expected.Get(ReadOptions(), lookup_key, expected_container).IsOk();
+        assert(kvs.Get(ReadOptions(), lookup_key, container).IsOk() == exists);
+        const bool next_exists = expected.FindNextKey(lookup_key, expected_container).IsOk();
+        assert(kvs.FindNextKey(lookup_key, container).IsOk() == next_exists);
+        if (next_exists)
+        {
+            assert(container.DoesMatch(expected_container.CreateConstSlice()));
+        }
+    }
+    Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+    Optional<KvsEntryIterator> optional_expected_iter = expected.GetFirstIterator();
+    while (optional_iter.isPresent())
+    {
+        assert(optional_expected_iter.isPresent());
+        KvsEntryIterator iter = optional_iter.get();
+        KvsEntryIterator expected_iter = optional_expected_iter.get();
+        SliceContainer container, expected_container;
+        assert(iter.GetKey(container).IsOk());
+        assert(expected_iter.GetKey(expected_container).IsOk());
+        assert(container.DoesMatch(expected_container.CreateConstSlice()));
+        optional_iter = iter.GetNext();
+        optional_expected_iter = expected_iter.GetNext();
+    }
+    assert(!optional_expected_iter.isPresent());
+}
+
+// keys share prefixes longer than the stored part, some keys are prefixes of others,
+// and a node gets all the 256 bytes as children.
+static void art_prefixes()
+{
+    START_TEST;
+    ArtKvs kvs;
+    const int kNum = 2000;
+    char buf[41];
+    for (int i = 0; i < kNum; i++)
+    {
+        sprintf(buf, "%040d", i * 7919 % kNum);
+        assert(kvs.Put(WriteOptions(), ConstSlice(buf, 40), ConstSlice(buf, 40)).IsOk());
+        // "00..0012" is a prefix of "00..00123"
+        assert(kvs.Put(WriteOptions(), ConstSlice(buf, 39), ConstSlice(buf, 39)).IsOk());
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        buf[0] = 'x';
+        buf[1] = i;
+        assert(kvs.Put(WriteOptions(), ConstSlice(buf, 2), ConstSlice(buf, 2)).IsOk());
+    }
+    int cnt = 0;
+    SliceContainer prev_key;
+    Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+    while (optional_iter.isPresent())
+    {
+        KvsEntryIterator iter = optional_iter.get();
+        SliceContainer key, value;
+        assert(iter.GetKey(key).IsOk());
+        assert(iter.Get(ReadOptions(), value).IsOk());
+        assert(key.DoesMatch(value.CreateConstSlice()));
+        if (cnt != 0)
+        {
+            CmpResult result;
+            assert(key.Cmp(prev_key, result).IsOk());
+            assert(result.IsGreater());
+        }
+        prev_key.Set(key);
+        cnt++;
+        optional_iter = iter.GetNext();
+    }
+    // prefixes of 40 bytes keys are shared by every 10 keys
+    assert(cnt == kNum + kNum / 10 + 256);
+    for (int i = 0; i < kNum; i++)
+    {
+        sprintf(buf, "%040d", i);
+        assert(kvs.Delete(WriteOptions(), ConstSlice(buf, 40)).IsOk());
+        SliceContainer container;
+        assert(kvs.Get(ReadOptions(), ConstSlice(buf, 39), container).IsOk());
+    }
+    for (int i = 0; i < kNum; i += 10)
+    {
+        sprintf(buf, "%040d", i);
+        assert(kvs.Delete(WriteOptions(), ConstSlice(buf, 39)).IsOk());
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        buf[0] = 'x';
+        buf[1] = i;
+        SliceContainer container;
+        assert(kvs.Get(ReadOptions(), ConstSlice(buf, 2), container).IsOk());
+        assert(kvs.Delete(WriteOptions(), ConstSlice(buf, 2)).IsOk());
+    }
+    assert(!kvs.GetFirstIterator().isPresent());
+}
+
+// the storage holds only one set of the keys at a time,
+// so that the rounds succeed only if pages emptied by merges are reused.
+static void paged_btree_split_and_merge()
+{
+    START_TEST;
+    MemBlockStorage block_storage;
+    PagedBTreeKvs<GenericBlockBuffer> kvs(block_storage, 16);
+    const int kNum = 20000;
+    char key[32], value[64];
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < kNum; i++)
+        {
+            const int n = i * 7919 % kNum;
+            sprintf(key, "%d", n);
+            memset(value, 'a' + round, n % 50);
+            assert(kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), ConstSlice(value, n % 50)).IsOk());
+        }
+        assert(kvs.GetHeight() >= 2);
+        int cnt = 0;
+        SliceContainer prev_key;
+        Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+        while (optional_iter.isPresent())
+        {
+            KvsEntryIterator iter = optional_iter.get();
+            SliceContainer key_container;
+            assert(iter.GetKey(key_container).IsOk());
+            if (cnt != 0)
+            {
+                CmpResult result;
+                assert(key_container.Cmp(prev_key, result).IsOk());
+                assert(result.IsGreater());
+            }
+            prev_key.Set(key_container);
+            cnt++;
+            optional_iter = iter.GetNext();
+        }
+        assert(cnt == kNum);
+        for (int i = 0; i < kNum; i++)
+        {
+            sprintf(key, "%d", i);
+            assert(kvs.Delete(WriteOptions(), ConstSlice(key, strlen(key))).IsOk());
+            sprintf(key, "%d", kNum - 1 - i / 2);
+            SliceContainer container;
+            assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk() == (kNum - 1 - i / 2 > i));
+        }
+        assert(!kvs.GetFirstIterator().isPresent());
+        assert(kvs.GetHeight() == 0);
+    }
+    // a key and a value take at most 157 bytes in total with 512 byte blocks, and larger entries are rejected
+    char long_value[160];
+    memset(long_value, 'z', sizeof(long_value));
+    for (int i = 0; i < 100; i++)
+    {
+        sprintf(key, "%04d", i);
+        assert(kvs.Put(WriteOptions(), ConstSlice(key, 4), ConstSlice(long_value, 153)).IsOk());
+    }
+    assert(kvs.GetHeight() >= 2);
+    assert(kvs.Put(WriteOptions(), ConstSlice(key, 4), ConstSlice(long_value, 154)).IsError());
+    assert(kvs.Put(WriteOptions(), ConstSlice(long_value, 158), ConstSlice(long_value, 0)).IsError());
+    SliceContainer container;
+    assert(kvs.Get(ReadOptions(), ConstSlice(key, 4), container).IsOk());
+    assert(container.DoesMatch(ConstSlice(long_value, 153)));
+    assert(kvs.Get(ReadOptions(), ConstSlice(long_value, 158), container).IsError());
+}
+
+// the memtable is small, so that entries go through flushes and compactions of several levels,
+// and the newest version of each key has to win in every merge.
+static void lsm_flush_and_compaction()
+{
+    START_TEST;
+    class Allocator : public KvsAllocatorInterface
+    {
+        virtual Kvs *Allocate() override
+        {
+            return new SkipListKvs<12>();
+        }
+    } allocator;
+    MemBlockStorage block_storage;
+    LsmKvs<GenericBlockBuffer> kvs(block_storage, allocator, 4096);
+    const int kNum = 10000;
+    char key[32], value[64];
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < kNum; i++)
+        {
+            const int n = i * 7919 % kNum;
+            sprintf(key, "%d", n);
+            memset(value, 'a' + round, n % 30);
+            assert(kvs.Put(WriteOptions(), ConstSlice(key, strlen(key)), ConstSlice(value, n % 30)).IsOk());
+        }
+        for (int i = round; i < kNum; i += 3)
+        {
+            sprintf(key, "%d", i);
+            assert(kvs.Delete(WriteOptions(), ConstSlice(key, strlen(key))).IsOk());
+        }
+    }
+    assert(kvs.WaitForCompaction().IsOk());
+    assert(kvs.GetRunCnt(0) < 4);
+    assert(kvs.GetRunCnt(2) > 1);
+    for (int i = 0; i < kNum; i++)
+    {
+        sprintf(key, "%d", i);
+        SliceContainer container;
+        const bool deleted = i % 3 == 2;
+        assert(kvs.Get(ReadOptions(), ConstSlice(key, strlen(key)), container).IsOk() == !deleted);
+        if (!deleted)
+        {
+            memset(value, 'c', i % 30);
+            assert(container.DoesMatch(ConstSlice(value, i % 30)));
+        }
+    }
+    int cnt = 0;
+    SliceContainer prev_key;
+    Optional<KvsEntryIterator> optional_iter = kvs.GetFirstIterator();
+    while (optional_iter.isPresent())
+    {
+        KvsEntryIterator iter = optional_iter.get();
+        SliceContainer key_container;
+        assert(iter.GetKey(key_container).IsOk());
+        if (cnt != 0)
+        {
+            CmpResult result;
+            assert(key_container.Cmp(prev_key, result).IsOk());
+            assert(result.IsGreater());
+        }
+        prev_key.Set(key_container);
+        cnt++;
+        optional_iter = iter.GetNext();
+    }
+    assert(cnt == kNum - (kNum + 1) / 3);
 }
 
 int main()
@@ -262,5 +797,20 @@ int main()
     test<GenericKvsContainer<LinkedListKvs>>();
     test<HashKvsContainer>();
     test<GenericKvsContainer<SkipListKvs<4>>>();
+    test<GenericKvsContainer<BTreeKvs>>();
+    test<GenericKvsContainer<ArtKvs>>();
+    test<PagedBTreeKvsContainer>();
+    test<LsmKvsContainer>();
+    test<SeparatedCharStorageKvsContainer>();
+    test<GenericKvsContainer<FlatHashKvs>>();
+    test<GenericKvsContainer<ConcurrentSkipListKvs>>();
+    test<ShardedKvsContainer>();
+    hash_resize();
+    skiplist_churn();
+    btree_split_and_remove();
+    btree_prefixes();
+    art_prefixes();
+    paged_btree_split_and_merge();
+    lsm_flush_and_compaction();
     return 0;
 }
@@ -36,6 +36,10 @@ public:
         last_write_cnt_ = write_cnt_;
         return flag;
     }
+    int GetReadCnt() const
+    {
+        return read_cnt_;
+    }
     bool IsReadCntIncremented()
     {
         return IsReadCntAdded(1);
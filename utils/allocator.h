@@ -236,9 +236,12 @@ namespace HayaguiKvs
             allocator_.reset(new LocalBufferAllocator(*(new MallocBasedMemAllocator())));
             return allocator_.get();
         }
+        // buffers of kMinUnpooledLen bytes or more are allocated from the base allocator,
+        // and the others from the current pool, which is not thread-safe
+        static const size_t kMinUnpooledLen = 4096;
         Container Alloc(size_t len)
         {
-            if (len >= 4096)
+            if (len >= kMinUnpooledLen)
             {
                 return Container(nullptr, base_allocator_, base_allocator_.alloc(len + 8), len);
             }
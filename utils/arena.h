@@ -0,0 +1,176 @@
+#pragma once
+#include "utils/allocator.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+namespace HayaguiKvs
+{
+    // Bump-pointer allocator which carves small objects out of large chunks.
+    // Memory is released only when the arena is destroyed.
+    class Arena
+    {
+    public:
+        Arena() : Arena(kDefaultChunkSize)
+        {
+        }
+        explicit Arena(size_t chunk_size) : chunk_size_(chunk_size)
+        {
+        }
+        ~Arena()
+        {
+            Chunk *chunk = chunks_;
+            while (chunk != nullptr)
+            {
+                Chunk *next = chunk->next_;
+                MemAllocator::free(reinterpret_cast<char *>(chunk));
+                chunk = next;
+            }
+        }
+        Arena(const Arena &obj) = delete;
+        Arena &operator=(const Arena &obj) = delete;
+        // returned buffer is aligned to 8 bytes
+        char *Allocate(size_t len)
+        {
+            len = (len + kAlign - 1) & ~(kAlign - 1);
+            if (len > remaining_)
+            {
+                if (len > chunk_size_ / 4)
+                {
+                    // large objects get their own chunk, so that the rest of the current chunk is not wasted
+                    return AllocateChunk(len);
+                }
+                ptr_ = AllocateChunk(chunk_size_);
+                remaining_ = chunk_size_;
+            }
+            char *buf = ptr_;
+            ptr_ += len;
+            remaining_ -= len;
+            return buf;
+        }
+        // bytes obtained from the underlying allocator, including unused space of chunks
+        size_t GetMemoryUsage() const
+        {
+            return memory_usage_;
+        }
+        void Swap(Arena &obj)
+        {
+            Swap(chunk_size_, obj.chunk_size_);
+            Swap(chunks_, obj.chunks_);
+            Swap(ptr_, obj.ptr_);
+            Swap(remaining_, obj.remaining_);
+            Swap(memory_usage_, obj.memory_usage_);
+        }
+
+    private:
+        struct Chunk
+        {
+            Chunk *next_;
+            uint64_t padding_;
+        };
+        char *AllocateChunk(size_t len)
+        {
+            Chunk *chunk = reinterpret_cast<Chunk *>(MemAllocator::alloc(sizeof(Chunk) + len));
+            if (chunk == nullptr)
+            {
+                abort();
+            }
+            chunk->next_ = chunks_;
+            chunks_ = chunk;
+            memory_usage_ += sizeof(Chunk) + len;
+            return reinterpret_cast<char *>(chunk + 1);
+        }
+        template <class T>
+        static void Swap(T &a, T &b)
+        {
+            T tmp = a;
+            a = b;
+            b = tmp;
+        }
+        static const size_t kAlign = 8;
+        static const size_t kDefaultChunkSize = 64 * 1024;
+        size_t chunk_size_;
+        Chunk *chunks_ = nullptr;
+        char *ptr_ = nullptr;
+        size_t remaining_ = 0;
+        size_t memory_usage_ = 0;
+    };
+
+    // Arena which recycles released buffers through free lists per size class.
+    // Buffers larger than kMaxRecycledSize are obtained from MemAllocator directly.
+    class RecyclingArena
+    {
+    public:
+        RecyclingArena()
+        {
+            for (size_t i = 0; i <= kMaxRecycledSize / kAlign; i++)
+            {
+                free_lists_[i] = nullptr;
+            }
+        }
+        RecyclingArena(const RecyclingArena &obj) = delete;
+        RecyclingArena &operator=(const RecyclingArena &obj) = delete;
+        // returned buffer is aligned to 8 bytes
+        char *Allocate(size_t len)
+        {
+            len = Align(len);
+            if (len > kMaxRecycledSize)
+            {
+                char *buf = MemAllocator::alloc(len);
+                if (buf == nullptr)
+                {
+                    abort();
+                }
+                large_memory_usage_ += len;
+                return buf;
+            }
+            FreeBuffer *&head = free_lists_[len / kAlign];
+            if (head != nullptr)
+            {
+                FreeBuffer *buf = head;
+                head = buf->next_;
+                return reinterpret_cast<char *>(buf);
+            }
+            return arena_.Allocate(len);
+        }
+        // len must be the same as the one passed to Allocate()
+        void Release(char *buf, size_t len)
+        {
+            len = Align(len);
+            if (len > kMaxRecycledSize)
+            {
+                MemAllocator::free(buf);
+                large_memory_usage_ -= len;
+                return;
+            }
+            FreeBuffer *free_buf = reinterpret_cast<FreeBuffer *>(buf);
+            FreeBuffer *&head = free_lists_[len / kAlign];
+            free_buf->next_ = head;
+            head = free_buf;
+        }
+        // bytes obtained from the underlying allocators, including buffers in the free lists
+        size_t GetMemoryUsage() const
+        {
+            return arena_.GetMemoryUsage() + large_memory_usage_;
+        }
+
+    private:
+        struct FreeBuffer
+        {
+            FreeBuffer *next_;
+        };
+        static size_t Align(size_t len)
+        {
+            if (len < sizeof(FreeBuffer))
+            {
+                len = sizeof(FreeBuffer);
+            }
+            return (len + kAlign - 1) & ~(kAlign - 1);
+        }
+        static const size_t kAlign = 8;
+        static const size_t kMaxRecycledSize = 512;
+        Arena arena_;
+        FreeBuffer *free_lists_[kMaxRecycledSize / kAlign + 1];
+        size_t large_memory_usage_ = 0;
+    };
+}
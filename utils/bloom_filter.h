@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace HayaguiKvs
+{
+    // Bloom filter over 64bit hashes of keys.
+    // Probes are derived from one hash by double hashing, and the last byte of a filter holds the number of probes.
+    class BloomFilter
+    {
+    public:
+        static void Build(const uint64_t *hashes, const int cnt, const int bits_per_key, std::vector<uint8_t> &filter)
+        {
+            // ln(2) * bits_per_key minimizes the false positive rate
+            int probe_cnt = bits_per_key * 69 / 100;
+            probe_cnt = probe_cnt < 1 ? 1 : (probe_cnt > 30 ? 30 : probe_cnt);
+            size_t bit_cnt = static_cast<size_t>(cnt) * bits_per_key;
+            bit_cnt = bit_cnt < 64 ? 64 : bit_cnt;
+            const size_t byte_cnt = (bit_cnt + 7) / 8;
+            bit_cnt = byte_cnt * 8;
+            filter.assign(byte_cnt + 1, 0);
+            for (int i = 0; i < cnt; i++)
+            {
+                uint64_t h = hashes[i];
+                const uint64_t delta = (h >> 33) | (h << 31);
+                for (int j = 0; j < probe_cnt; j++)
+                {
+                    const size_t bit = h % bit_cnt;
+                    filter[bit / 8] |= 1 << (bit % 8);
+                    h += delta;
+                }
+            }
+            filter[byte_cnt] = probe_cnt;
+        }
+        static bool MayContain(const uint8_t *filter, const size_t len, uint64_t hash)
+        {
+            if (len < 2)
+            {
+                return true;
+            }
+            const size_t bit_cnt = (len - 1) * 8;
+            const int probe_cnt = filter[len - 1];
+            const uint64_t delta = (hash >> 33) | (hash << 31);
+            for (int j = 0; j < probe_cnt; j++)
+            {
+                const size_t bit = hash % bit_cnt;
+                if ((filter[bit / 8] & (1 << (bit % 8))) == 0)
+                {
+                    return false;
+                }
+                hash += delta;
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "utils/slice.h"
+#include "utils/allocator.h"
+
+namespace HayaguiKvs
+{
+    // Copies a key into a contiguous buffer, so that it can be compared with memcmp directly.
+    // Short keys are kept on the stack, and long ones in MemAllocator, so that it can be used from multiple threads.
+    class ContiguousKey
+    {
+    public:
+        ContiguousKey() = delete;
+        explicit ContiguousKey(const ValidSlice &key) : len_(key.GetLen())
+        {
+            ptr_ = len_ <= kStackBufLen ? stack_buf_ : MemAllocator::alloc(len_);
+            if (key.CopyToBuffer(ptr_).IsError())
+            {
+                abort();
+            }
+        }
+        ~ContiguousKey()
+        {
+            if (ptr_ != stack_buf_)
+            {
+                MemAllocator::free(ptr_);
+            }
+        }
+        ContiguousKey(const ContiguousKey &obj) = delete;
+        ContiguousKey &operator=(const ContiguousKey &obj) = delete;
+        const char *GetPtr() const
+        {
+            return ptr_;
+        }
+        int GetLen() const
+        {
+            return len_;
+        }
+
+    private:
+        static const int kStackBufLen = 64;
+        const int len_;
+        char *ptr_;
+        char stack_buf_[kStackBufLen];
+    };
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+namespace HayaguiKvs
+{
+    // CRC-32C (Castagnoli).
+    // The crc32 instruction is used when SSE4.2 is available (e.g. -msse4.2), and the fallback is slicing-by-8.
+    class Crc32c
+    {
+    public:
+        static uint32_t Calc(const char *const buf, const size_t len)
+        {
+            return Extend(0, buf, len);
+        }
+        // crc of the concatenation of the data of crc and buf
+        static uint32_t Extend(const uint32_t crc, const char *const buf, const size_t len)
+        {
+            const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
+            const uint8_t *const end = p + len;
+            uint64_t l = crc ^ 0xffffffffu;
+#ifdef __SSE4_2__
+            for (; end - p >= 8; p += 8)
+            {
+                l = _mm_crc32_u64(l, Read64(p));
+            }
+            for (; p != end; p++)
+            {
+                l = _mm_crc32_u8(static_cast<uint32_t>(l), *p);
+            }
+#else
+            const uint32_t(*const table)[256] = GetTable();
+            for (; end - p >= 8; p += 8)
+            {
+                const uint64_t v = Read64(p) ^ l;
+                l = table[7][v & 0xff] ^ table[6][(v >> 8) & 0xff] ^ table[5][(v >> 16) & 0xff] ^ table[4][(v >> 24) & 0xff] ^
+                    table[3][(v >> 32) & 0xff] ^ table[2][(v >> 40) & 0xff] ^ table[1][(v >> 48) & 0xff] ^ table[0][v >> 56];
+            }
+            for (; p != end; p++)
+            {
+                l = table[0][(l ^ *p) & 0xff] ^ (l >> 8);
+            }
+#endif
+            return static_cast<uint32_t>(l) ^ 0xffffffffu;
+        }
+
+    private:
+        static uint64_t Read64(const uint8_t *p)
+        {
+            uint64_t v;
+            memcpy(&v, p, sizeof(uint64_t));
+            return v;
+        }
+#ifndef __SSE4_2__
+        static const uint32_t (*GetTable())[256]
+        {
+            static const Table table;
+            return table.entries_;
+        }
+        struct Table
+        {
+            Table()
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t crc = i;
+                    for (int j = 0; j < 8; j++)
+                    {
+                        crc = (crc >> 1) ^ (kPoly & (0 - (crc & 1)));
+                    }
+                    entries_[0][i] = crc;
+                }
+                for (int k = 1; k < 8; k++)
+                {
+                    for (int i = 0; i < 256; i++)
+                    {
+                        entries_[k][i] = (entries_[k - 1][i] >> 8) ^ entries_[0][entries_[k - 1][i] & 0xff];
+                    }
+                }
+            }
+            uint32_t entries_[8][256];
+        };
+        static const uint32_t kPoly = 0x82f63b78;
+#endif
+    };
+}
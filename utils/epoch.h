@@ -0,0 +1,183 @@
+#pragma once
+#include "utils/allocator.h"
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+namespace HayaguiKvs
+{
+    // Epoch-based reclamation.
+    // Readers enter a critical section with Guard, and writers retire unlinked objects instead of freeing them.
+    // An object retired at epoch e is freed once the global epoch reaches e + 2, which happens only after
+    // every thread which might have seen the object has left its critical section.
+    class EpochManager
+    {
+    public:
+        // objects to be retired embed this header at the beginning, and are allocated with MemAllocator
+        struct Retirable
+        {
+            Retirable *next_retired_;
+            uint64_t retired_epoch_;
+        };
+        class Guard
+        {
+        public:
+            Guard() = delete;
+            explicit Guard(EpochManager &manager) : manager_(manager)
+            {
+                manager_.Enter();
+            }
+            ~Guard()
+            {
+                manager_.Exit();
+            }
+            Guard(const Guard &obj) = delete;
+            Guard &operator=(const Guard &obj) = delete;
+
+        private:
+            EpochManager &manager_;
+        };
+        EpochManager()
+        {
+            for (int i = 0; i < kMaxThreads; i++)
+            {
+                slots_[i].epoch_.store(0, std::memory_order_relaxed);
+            }
+        }
+        ~EpochManager()
+        {
+            // no thread can be in a critical section anymore
+            for (int i = 0; i < kMaxThreads; i++)
+            {
+                FreeList(slots_[i].retired_);
+            }
+        }
+        EpochManager(const EpochManager &obj) = delete;
+        EpochManager &operator=(const EpochManager &obj) = delete;
+        void Retire(Retirable *obj)
+        {
+            Slot &slot = GetSlot();
+            obj->retired_epoch_ = global_epoch_.load(std::memory_order_seq_cst);
+            obj->next_retired_ = slot.retired_;
+            slot.retired_ = obj;
+            slot.retired_cnt_++;
+            if (slot.retired_cnt_ >= kReclaimThreshold)
+            {
+                TryAdvance();
+                Reclaim(slot);
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            std::atomic<uint64_t> epoch_; // 0 while the thread is out of critical sections
+            int nest_ = 0;
+            Retirable *retired_ = nullptr;
+            size_t retired_cnt_ = 0;
+            char padding_[64 - sizeof(std::atomic<uint64_t>) - sizeof(int) - sizeof(Retirable *) - sizeof(size_t)];
+        };
+        // thread indexes are shared among all managers, and are recycled when threads exit.
+        class ThreadIndex
+        {
+        public:
+            static int Get()
+            {
+                static thread_local ThreadIndex index;
+                return index.index_;
+            }
+
+        private:
+            ThreadIndex()
+            {
+                for (int i = 0; i < kMaxThreads; i++)
+                {
+                    bool expected = false;
+                    if (GetUsedFlags()[i].compare_exchange_strong(expected, true))
+                    {
+                        index_ = i;
+                        return;
+                    }
+                }
+                abort();
+            }
+            ~ThreadIndex()
+            {
+                GetUsedFlags()[index_].store(false);
+            }
+            static std::atomic<bool> *GetUsedFlags()
+            {
+                static std::atomic<bool> used[kMaxThreads];
+                return used;
+            }
+            int index_;
+        };
+        Slot &GetSlot()
+        {
+            return slots_[ThreadIndex::Get()];
+        }
+        void Enter()
+        {
+            Slot &slot = GetSlot();
+            if (slot.nest_++ == 0)
+            {
+                slot.epoch_.store(global_epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            }
+        }
+        void Exit()
+        {
+            Slot &slot = GetSlot();
+            assert(slot.nest_ > 0);
+            if (--slot.nest_ == 0)
+            {
+                slot.epoch_.store(0, std::memory_order_release);
+            }
+        }
+        void TryAdvance()
+        {
+            uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+            for (int i = 0; i < kMaxThreads; i++)
+            {
+                const uint64_t slot_epoch = slots_[i].epoch_.load(std::memory_order_seq_cst);
+                if (slot_epoch != 0 && slot_epoch != epoch)
+                {
+                    return;
+                }
+            }
+            global_epoch_.compare_exchange_strong(epoch, epoch + 1);
+        }
+        void Reclaim(Slot &slot)
+        {
+            const uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+            Retirable **link = &slot.retired_;
+            while (*link != nullptr)
+            {
+                Retirable *obj = *link;
+                if (obj->retired_epoch_ + 2 <= epoch)
+                {
+                    *link = obj->next_retired_;
+                    MemAllocator::free(obj);
+                    slot.retired_cnt_--;
+                }
+                else
+                {
+                    link = &obj->next_retired_;
+                }
+            }
+        }
+        static void FreeList(Retirable *obj)
+        {
+            while (obj != nullptr)
+            {
+                Retirable *next = obj->next_retired_;
+                MemAllocator::free(obj);
+                obj = next;
+            }
+        }
+        static const int kMaxThreads = 256;
+        static const size_t kReclaimThreshold = 64;
+        std::atomic<uint64_t> global_epoch_{1};
+        Slot slots_[kMaxThreads];
+    };
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace HayaguiKvs
+{
+    // 64bit hash function for contiguous bytes.
+    // Short keys are mixed with wyhash-style 64x64->128 multiplications, and long keys are accumulated
+    // in 64byte stripes as xxh3 does. The stripe loop uses SSE2 when it is available, and the scalar
+    // fallback computes exactly the same value.
+    class FastHash
+    {
+    public:
+        static uint64_t Calc(const char *const buf, const size_t len, const uint64_t seed = 0)
+        {
+            const uint8_t *const p = reinterpret_cast<const uint8_t *>(buf);
+            if (len <= 16)
+            {
+                return CalcShort(p, len, seed);
+            }
+            if (len < kLongThreshold)
+            {
+                return CalcMedium(p, len, seed);
+            }
+            return CalcLong(p, len, seed);
+        }
+
+    private:
+        static const size_t kLongThreshold = 128;
+        static const size_t kStripeLen = 64;
+        static const size_t kStripesPerBlock = 16;
+        static const uint64_t kPrime0 = 0xa0761d6478bd642fULL;
+        static const uint64_t kPrime1 = 0xe7037ed1a0b428dbULL;
+        static const uint64_t kPrime2 = 0x8ebc6af09c88c6e3ULL;
+        static const uint64_t kPrime3 = 0x589965cc75374cc3ULL;
+        static const uint32_t kPrime32 = 0x9e3779b1U;
+        static const uint64_t *GetSecret()
+        {
+            static const uint64_t secret[8] = {
+                0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+                0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL};
+            return secret;
+        }
+        static uint64_t Read64(const uint8_t *p)
+        {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            return v;
+        }
+        static uint64_t Read32(const uint8_t *p)
+        {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+        static uint64_t Mum(const uint64_t a, const uint64_t b)
+        {
+#ifdef __SIZEOF_INT128__
+            const __uint128_t r = static_cast<__uint128_t>(a) * b;
+            return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+            const uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+            const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+            const uint64_t t = rl + (rm0 << 32);
+            uint64_t c = t < rl;
+            const uint64_t lo = t + (rm1 << 32);
+            c += lo < t;
+            const uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+            return lo ^ hi;
+#endif
+        }
+        static uint64_t Finalize(const uint64_t a, const uint64_t b, const uint64_t seed, const size_t len)
+        {
+            return Mum(kPrime1 ^ len, Mum(a ^ kPrime1, b ^ seed));
+        }
+        static uint64_t CalcShort(const uint8_t *p, const size_t len, uint64_t seed)
+        {
+            seed ^= kPrime0;
+            uint64_t a, b;
+            if (len >= 4)
+            {
+                const size_t shift = (len >> 3) << 2;
+                a = (Read32(p) << 32) | Read32(p + shift);
+                b = (Read32(p + len - 4) << 32) | Read32(p + len - 4 - shift);
+            }
+            else if (len > 0)
+            {
+                a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+                b = 0;
+            }
+            else
+            {
+                a = b = 0;
+            }
+            return Finalize(a, b, seed, len);
+        }
+        // consumes 16 bytes at a time, and the last 16 bytes (which may overlap) are mixed at the end.
+        static uint64_t MixTail(const uint8_t *p, const size_t len, uint64_t seed)
+        {
+            size_t i = len;
+            while (i > 16)
+            {
+                seed = Mum(Read64(p) ^ kPrime1, Read64(p + 8) ^ seed);
+                p += 16;
+                i -= 16;
+            }
+            return Mum(Read64(p + i - 16) ^ kPrime2, Read64(p + i - 8) ^ seed);
+        }
+        static uint64_t CalcMedium(const uint8_t *p, const size_t len, uint64_t seed)
+        {
+            seed ^= kPrime0;
+            return Mum(kPrime1 ^ len, MixTail(p, len, seed) ^ kPrime3);
+        }
+        static uint64_t CalcLong(const uint8_t *p, const size_t len, const uint64_t seed)
+        {
+            uint64_t acc[8] __attribute__((aligned(16))) = {
+                kPrime32, kPrime0, kPrime1, kPrime2, kPrime3, kPrime32 ^ seed, kPrime0 ^ seed, kPrime1 ^ seed};
+            const size_t stripes = len / kStripeLen;
+            for (size_t i = 0; i < stripes; i++)
+            {
+                Accumulate(acc, p + i * kStripeLen);
+                if (i % kStripesPerBlock == kStripesPerBlock - 1)
+                {
+                    Scramble(acc);
+                }
+            }
+            const uint64_t *const secret = GetSecret();
+            uint64_t h = len * kPrime0;
+            for (int i = 0; i < 8; i += 2)
+            {
+                h ^= Mum(acc[i] ^ secret[i], acc[i + 1] ^ secret[i + 1]);
+                h = (h << 27 | h >> 37) * kPrime1;
+            }
+            const size_t rest = len - stripes * kStripeLen;
+            // len >= kLongThreshold, so the last 16 bytes can always be read even if rest is 0.
+            const uint8_t *const tail = p + stripes * kStripeLen;
+            const uint64_t tail_hash = rest > 16 ? MixTail(tail, rest, seed ^ kPrime2) : Mum(Read64(p + len - 16) ^ kPrime2, Read64(p + len - 8) ^ seed);
+            return Finalize(h, tail_hash, seed ^ kPrime0, len);
+        }
+        // acc[i ^ 1] += data[i]; acc[i] += lo32(data[i] ^ secret[i]) * hi32(data[i] ^ secret[i])
+        static void Accumulate(uint64_t acc[8], const uint8_t *stripe)
+        {
+            const uint64_t *const secret = GetSecret();
+#ifdef __SSE2__
+            __m128i *const vacc = reinterpret_cast<__m128i *>(acc);
+            for (int i = 0; i < 4; i++)
+            {
+                const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(stripe) + i);
+                const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i *>(secret) + i);
+                const __m128i data_key = _mm_xor_si128(data, key);
+                const __m128i product = _mm_mul_epu32(data_key, _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1)));
+                const __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                vacc[i] = _mm_add_epi64(vacc[i], _mm_add_epi64(product, swapped));
+            }
+#else
+            for (int i = 0; i < 8; i++)
+            {
+                const uint64_t data = Read64(stripe + i * 8);
+                const uint64_t data_key = data ^ secret[i];
+                acc[i ^ 1] += data;
+                acc[i] += (data_key & 0xffffffffULL) * (data_key >> 32);
+            }
+#endif
+        }
+        // acc[i] = (acc[i] ^ (acc[i] >> 47) ^ secret[i]) * kPrime32
+        static void Scramble(uint64_t acc[8])
+        {
+            const uint64_t *const secret = GetSecret();
+#ifdef __SSE2__
+            __m128i *const vacc = reinterpret_cast<__m128i *>(acc);
+            const __m128i prime = _mm_set1_epi32(static_cast<int>(kPrime32));
+            for (int i = 0; i < 4; i++)
+            {
+                const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i *>(secret) + i);
+                const __m128i a = _mm_xor_si128(_mm_xor_si128(vacc[i], _mm_srli_epi64(vacc[i], 47)), key);
+                const __m128i lo = _mm_mul_epu32(a, prime);
+                const __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+                vacc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+            }
+#else
+            for (int i = 0; i < 8; i++)
+            {
+                acc[i] = (acc[i] ^ (acc[i] >> 47) ^ secret[i]) * kPrime32;
+            }
+#endif
+        }
+    };
+}